@@ -0,0 +1,194 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+
+#include "attitude.h"
+#include <math.h>
+
+#if defined (__AVX__)
+	#include <immintrin.h>
+#elif defined (__SSE2__)
+	#include <emmintrin.h>
+#elif defined (__ARM_NEON) && defined (__aarch64__)
+	#include <arm_neon.h>
+#endif
+
+// the formulas the dump tools have always used, q is w, x, y, z
+void attitudeEulerQuat(const float *q, float *rpy) {
+	float q0, q1, q2, q3;
+
+	q0 = q[1];
+	q1 = q[2];
+	q2 = q[3];
+	q3 = q[0];
+
+	rpy[2] = atan2f((2.0f * (q0 * q1 + q3 * q2)), (q3*q3 - q2*q2 - q1*q1 + q0*q0));
+	rpy[1] = asinf(-2.0f * (q0 * q2 - q1 * q3));
+	rpy[0] = atanf((2.0f * (q1 * q2 + q0 * q3)) / (q3*q3 + q2*q2 - q1*q1 -q0*q0));
+}
+
+#if ATTITUDE_LANES > 1
+
+// the few vector operations the kernel needs, for each instruction set
+#if defined (__AVX__)
+typedef __m256 attVec_t;
+typedef __m256 attMask_t;
+
+static inline attVec_t attLoad(const float *p) { return _mm256_loadu_ps(p); }
+static inline void attStore(float *p, attVec_t a) { _mm256_storeu_ps(p, a); }
+static inline attVec_t attSet(float f) { return _mm256_set1_ps(f); }
+static inline attVec_t attAdd(attVec_t a, attVec_t b) { return _mm256_add_ps(a, b); }
+static inline attVec_t attSub(attVec_t a, attVec_t b) { return _mm256_sub_ps(a, b); }
+static inline attVec_t attMul(attVec_t a, attVec_t b) { return _mm256_mul_ps(a, b); }
+static inline attVec_t attDiv(attVec_t a, attVec_t b) { return _mm256_div_ps(a, b); }
+static inline attVec_t attSqrt(attVec_t a) { return _mm256_sqrt_ps(a); }
+static inline attMask_t attGt(attVec_t a, attVec_t b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline attMask_t attLt(attVec_t a, attVec_t b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline attMask_t attEq(attVec_t a, attVec_t b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+static inline attMask_t attAnd(attMask_t a, attMask_t b) { return _mm256_and_ps(a, b); }
+static inline attVec_t attSelect(attMask_t m, attVec_t a, attVec_t b) { return _mm256_blendv_ps(b, a, m); }
+static inline attVec_t attAbs(attVec_t a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+static inline attVec_t attCopySign(attVec_t a, attVec_t s) { return _mm256_or_ps(attAbs(a), _mm256_and_ps(_mm256_set1_ps(-0.0f), s)); }
+#elif defined (__SSE2__)
+typedef __m128 attVec_t;
+typedef __m128 attMask_t;
+
+static inline attVec_t attLoad(const float *p) { return _mm_loadu_ps(p); }
+static inline void attStore(float *p, attVec_t a) { _mm_storeu_ps(p, a); }
+static inline attVec_t attSet(float f) { return _mm_set1_ps(f); }
+static inline attVec_t attAdd(attVec_t a, attVec_t b) { return _mm_add_ps(a, b); }
+static inline attVec_t attSub(attVec_t a, attVec_t b) { return _mm_sub_ps(a, b); }
+static inline attVec_t attMul(attVec_t a, attVec_t b) { return _mm_mul_ps(a, b); }
+static inline attVec_t attDiv(attVec_t a, attVec_t b) { return _mm_div_ps(a, b); }
+static inline attVec_t attSqrt(attVec_t a) { return _mm_sqrt_ps(a); }
+static inline attMask_t attGt(attVec_t a, attVec_t b) { return _mm_cmpgt_ps(a, b); }
+static inline attMask_t attLt(attVec_t a, attVec_t b) { return _mm_cmplt_ps(a, b); }
+static inline attMask_t attEq(attVec_t a, attVec_t b) { return _mm_cmpeq_ps(a, b); }
+static inline attMask_t attAnd(attMask_t a, attMask_t b) { return _mm_and_ps(a, b); }
+static inline attVec_t attSelect(attMask_t m, attVec_t a, attVec_t b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+static inline attVec_t attAbs(attVec_t a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline attVec_t attCopySign(attVec_t a, attVec_t s) { return _mm_or_ps(attAbs(a), _mm_and_ps(_mm_set1_ps(-0.0f), s)); }
+#else
+typedef float32x4_t attVec_t;
+typedef uint32x4_t attMask_t;
+
+static inline attVec_t attLoad(const float *p) { return vld1q_f32(p); }
+static inline void attStore(float *p, attVec_t a) { vst1q_f32(p, a); }
+static inline attVec_t attSet(float f) { return vdupq_n_f32(f); }
+static inline attVec_t attAdd(attVec_t a, attVec_t b) { return vaddq_f32(a, b); }
+static inline attVec_t attSub(attVec_t a, attVec_t b) { return vsubq_f32(a, b); }
+static inline attVec_t attMul(attVec_t a, attVec_t b) { return vmulq_f32(a, b); }
+static inline attVec_t attDiv(attVec_t a, attVec_t b) { return vdivq_f32(a, b); }
+static inline attVec_t attSqrt(attVec_t a) { return vsqrtq_f32(a); }
+static inline attMask_t attGt(attVec_t a, attVec_t b) { return vcgtq_f32(a, b); }
+static inline attMask_t attLt(attVec_t a, attVec_t b) { return vcltq_f32(a, b); }
+static inline attMask_t attEq(attVec_t a, attVec_t b) { return vceqq_f32(a, b); }
+static inline attMask_t attAnd(attMask_t a, attMask_t b) { return vandq_u32(a, b); }
+static inline attVec_t attSelect(attMask_t m, attVec_t a, attVec_t b) { return vbslq_f32(m, a, b); }
+static inline attVec_t attAbs(attVec_t a) { return vabsq_f32(a); }
+static inline attVec_t attCopySign(attVec_t a, attVec_t s) { return vbslq_f32(vdupq_n_u32(0x80000000), s, a); }
+#endif
+
+// atan, after Cephes atanf: reduced to |x| <= tan(pi/8), then a cubic in x^2
+static inline attVec_t attAtan(attVec_t x) {
+	attVec_t a, r, y, z, p;
+	attMask_t big, mid;
+
+	a = attAbs(x);
+	big = attGt(a, attSet(2.414213562373095f));
+	mid = attGt(a, attSet(0.4142135623730950f));
+
+	r = attSelect(big, attDiv(attSet(-1.0f), a), attSelect(mid, attDiv(attSub(a, attSet(1.0f)), attAdd(a, attSet(1.0f))), a));
+	y = attSelect(big, attSet((float)M_PI_2), attSelect(mid, attSet((float)M_PI_4), attSet(0.0f)));
+
+	z = attMul(r, r);
+	p = attSub(attMul(attSet(8.05374449538e-2f), z), attSet(1.38776856032e-1f));
+	p = attAdd(attMul(p, z), attSet(1.99777106478e-1f));
+	p = attSub(attMul(p, z), attSet(3.33329491539e-1f));
+	p = attAdd(attMul(attMul(p, z), r), r);
+
+	return attCopySign(attAdd(y, p), x);
+}
+
+static inline attVec_t attAtan2(attVec_t y, attVec_t x) {
+	attVec_t r;
+
+	r = attAtan(attDiv(y, x));
+	r = attSelect(attLt(x, attSet(0.0f)), attAdd(r, attCopySign(attSet((float)M_PI), y)), r);
+
+	// atan2(0, 0) is 0 rather than the NaN the division gives
+	return attSelect(attAnd(attEq(x, attSet(0.0f)), attEq(y, attSet(0.0f))), attSet(0.0f), r);
+}
+
+// asin, after Cephes asinf: above 0.5 through asin(x) = pi/2 - 2 asin(sqrt((1 - x) / 2))
+static inline attVec_t attAsin(attVec_t x) {
+	attVec_t a, r, z, p;
+	attMask_t high;
+
+	a = attAbs(x);
+	high = attGt(a, attSet(0.5f));
+
+	z = attSelect(high, attMul(attSet(0.5f), attSub(attSet(1.0f), a)), attMul(a, a));
+	r = attSelect(high, attSqrt(z), a);
+
+	p = attAdd(attMul(attSet(4.2163199048e-2f), z), attSet(2.4181311049e-2f));
+	p = attAdd(attMul(p, z), attSet(4.5470025998e-2f));
+	p = attAdd(attMul(p, z), attSet(7.4953002686e-2f));
+	p = attAdd(attMul(p, z), attSet(1.6666752422e-1f));
+	p = attAdd(attMul(attMul(p, z), r), r);
+	p = attSelect(high, attSub(attSet((float)M_PI_2), attAdd(p, p)), p);
+
+	// NaN outside [-1, 1], as asinf() gives
+	return attSelect(attGt(a, attSet(1.0f)), attSet(NAN), attCopySign(p, x));
+}
+
+#endif
+
+void attitudeEulerQuatBatch(const float *w, const float *x, const float *y, const float *z, int n, float *roll, float *pitch, float *yaw) {
+	float q[4], rpy[3];
+	int i = 0;
+
+#if ATTITUDE_LANES > 1
+	attVec_t q0, q1, q2, q3, two;
+
+	two = attSet(2.0f);
+	for (; i + ATTITUDE_LANES <= n; i += ATTITUDE_LANES) {
+		q0 = attLoad(x + i);
+		q1 = attLoad(y + i);
+		q2 = attLoad(z + i);
+		q3 = attLoad(w + i);
+
+		attStore(yaw + i, attAtan2(attMul(two, attAdd(attMul(q0, q1), attMul(q3, q2))),
+			attAdd(attSub(attSub(attMul(q3, q3), attMul(q2, q2)), attMul(q1, q1)), attMul(q0, q0))));
+		attStore(pitch + i, attAsin(attMul(attSet(-2.0f), attSub(attMul(q0, q2), attMul(q1, q3)))));
+		attStore(roll + i, attAtan(attDiv(attMul(two, attAdd(attMul(q1, q2), attMul(q0, q3))),
+			attSub(attSub(attAdd(attMul(q3, q3), attMul(q2, q2)), attMul(q1, q1)), attMul(q0, q0)))));
+	}
+#endif
+
+	for (; i < n; i++) {
+		q[0] = w[i];
+		q[1] = x[i];
+		q[2] = y[i];
+		q[3] = z[i];
+		attitudeEulerQuat(q, rpy);
+		roll[i] = rpy[0];
+		pitch[i] = rpy[1];
+		yaw[i] = rpy[2];
+	}
+}
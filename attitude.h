@@ -0,0 +1,49 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+
+#ifndef _attitude_h
+#define _attitude_h
+
+// Roll, pitch and yaw (rad) of attitude quaternions, w first as logged.  The batch form works through
+// ATTITUDE_LANES quaternions at a time with SIMD where the build has it (AVX, SSE2 or NEON on aarch64),
+// using polynomial atan/asin which agree with the C library to within ATTITUDE_TOLERANCE.  Anything left
+// over, and builds without SIMD, go through attitudeEulerQuat().
+
+#if defined (__AVX__)
+	#define ATTITUDE_LANES		8
+#elif defined (__SSE2__) || (defined (__ARM_NEON) && defined (__aarch64__))
+	#define ATTITUDE_LANES		4
+#else
+	#define ATTITUDE_LANES		1
+#endif
+
+#define ATTITUDE_TOLERANCE		2e-6			// rad, largest difference between the two forms
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void attitudeEulerQuat(const float *q, float *rpy);
+extern void attitudeEulerQuatBatch(const float *w, const float *x, const float *y, const float *z, int n, float *roll, float *pitch, float *yaw);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
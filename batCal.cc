@@ -17,26 +17,58 @@
 */
 
 #include "logger.h"
+#include "profiler.h"
 #ifdef HAS_PLPLOT
 	#include "plplot/plplot.h"
 #endif
 #include <getopt.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <Eigen/Core>
-#include <Eigen/LU>
+#include <Eigen/QR>
 
 using namespace Eigen;
 
+// The fit is y = a + bx + cx^2 + dx^3 + ex^4 + fx^5 of voltage against state of charge.  Rows of [X y]
+// are collected BATCAL_BLOCK at a time under the triangular factor of all the rows before them and
+// the lot is QR factored again, so a log of any length needs the same memory and X is never stored.
+
+#define BATCAL_ORDER		6					// 5th order poly
+#define BATCAL_BLOCK		256					// rows folded into the factor at a time
+#define BATCAL_PLOT_POINTS	1000				// records of each log kept for the plot
+
 typedef struct {
 	float vIn;
 	float soc;
 } logData_t;
 
-logData_t *logData;
+typedef struct {
+	const char *logFile;
+	MatrixXd *B;								// factor of the rows so far on top, new rows below it
+	int numRows;								// rows used in B
+	int numRecs;
+	double ab[BATCAL_ORDER];
+	logData_t *plot;							// every plotStep'th record
+	int numPlot;
+	float vMin, vMax;							// of all of them
+	int ok;
+	profiler_t prof;							// --stats of this log
+} batCalFit_t;
+
+typedef struct {
+	batCalFit_t *fits;
+	int numFits;
+	int next;
+	pthread_mutex_t lock;
+} batCalBatch_t;
+
 double zeroSOC;
-int numRecs;
+int batCalThreads;								// logs fitted at a time, 0 for one per CPU
+int batCalStats;								// --stats/--profile report format, 0 for none
+int batCalProfile;
 
-void batCalPlot(MatrixXd &ab) {
+void batCalPlot(batCalFit_t *f) {
 #ifdef HAS_PLPLOT
 	char s[256];
 	float yMin, yMax;
@@ -45,18 +77,15 @@ void batCalPlot(MatrixXd &ab) {
 	PLFLT *xVals;
 	PLFLT *yVals;
 
+	logData_t *logData = f->plot;
+	double *ab = f->ab;
+	int numRecs = f->numPlot;
+
 	xVals = (PLFLT *)calloc(numRecs, sizeof(PLFLT));
 	yVals = (PLFLT *)calloc(numRecs, sizeof(PLFLT));
 
-	yMin = +999999999.99;
-	yMax = -999999999.99;
-
-	for (i = 0; i < numRecs; i++) {
-		if (logData[i].vIn < yMin)
-			yMin = logData[i].vIn;
-		if (logData[i].vIn > yMax)
-			yMax = logData[i].vIn;
-	}
+	yMin = f->vMin;
+	yMax = f->vMax;
 
 	plinit();
 	plschr(0.0, 0.75);
@@ -65,7 +94,7 @@ void batCalPlot(MatrixXd &ab) {
 	pllab("SOC (%)", "Volts", "Battery Voltage vs State of Charge");
 
 	sprintf(s, "y = %5.1f + %5.1f*x + %5.1f*x^2 + %5.1f*x^3 + %5.1f*x^4 + %5.1f*x^5",
-		ab(0, 0), ab(1, 0), ab(2, 0), ab(3, 0), ab(4, 0), ab(5, 0));
+		ab[0], ab[1], ab[2], ab[3], ab[4], ab[5]);
     plptex(95.0, yMax-(yMax-yMin)/10.0, -10, 0, 0, s);
 	printf("%s\n", s);
 
@@ -82,7 +111,7 @@ void batCalPlot(MatrixXd &ab) {
 		double s = logData[i].soc;
 
 		xVals[i] = s * 100;
-		yVals[i] = ab(0, 0) + ab(1, 0)*s + ab(2, 0)*s*s + ab(3, 0)*s*s*s + ab(4, 0)*s*s*s*s + ab(5, 0)*s*s*s*s*s;
+		yVals[i] = ab[0] + ab[1]*s + ab[2]*s*s + ab[3]*s*s*s + ab[4]*s*s*s*s + ab[5]*s*s*s*s*s;
 	}
 	plcol0(1);
 	plline(numRecs, xVals, yVals);
@@ -94,114 +123,211 @@ void batCalPlot(MatrixXd &ab) {
 #endif
 }
 
-void batCalInterpolate(void) {
-	MatrixXd X;
-	MatrixXd A;
-	MatrixXd c;
-	MatrixXd ab;
-	int m,n;
-	int i, j, k;
-
-	n = numRecs;
-	m = 6;		// 5th order poly
-
-	X.setZero(n, m);
-	A.setZero(m, m);
-	c.setZero(m, 1);
-
-	// y = a + bx + cx^2 + dx^3 + ex^4 fx^5
-	for (k = 0; k < n; k++) {
-		X(k, 0) = 1.0;
-		X(k, 1) = logData[k].soc;
-		X(k, 2) = logData[k].soc * logData[k].soc;
-		X(k, 3) = logData[k].soc * logData[k].soc * logData[k].soc;
-		X(k, 4) = logData[k].soc * logData[k].soc * logData[k].soc * logData[k].soc;
-		X(k, 5) = logData[k].soc * logData[k].soc * logData[k].soc * logData[k].soc * logData[k].soc;
-	}
+// QR factor the rows collected in B, leaving just the triangular factor of them all on top
+static void batCalFold(batCalFit_t *f) {
+	HouseholderQR<MatrixXd> qr(f->B->topRows(f->numRows));
+
+	f->B->topRows(BATCAL_ORDER + 1) = qr.matrixQR().topRows(BATCAL_ORDER + 1).triangularView<Upper>();
+	f->numRows = BATCAL_ORDER + 1;
+}
+
+// add one record to the fit
+static void batCalAddRow(batCalFit_t *f, double soc, double vIn) {
+	MatrixXd &B = *f->B;
+	double x = 1.0;
+	int i;
 
-	for (i = 0; i < m; i++) {
-		for (j = 0; j < m; j++)
-			for (k = 0; k < n; k++)
-				A(i, j) += X(k, i) * X(k, j);
+	if (f->numRows == B.rows()) {
+		profilerBegin(&f->prof, PROFILER_FIT);
+		batCalFold(f);
+		profilerEnd(&f->prof);
+	}
 
-		for (k = 0; k < n; k++)
-			c(i, 0) += X(k, i) * logData[k].vIn;
+	for (i = 0; i < BATCAL_ORDER; i++) {
+		B(f->numRows, i) = x;
+		x *= soc;
 	}
+	B(f->numRows, BATCAL_ORDER) = vIn;
+	f->numRows++;
+}
 
-	ab = A.inverse() * c;
+// solve R ab = Q'y from the factor of [X y]
+void batCalSolve(batCalFit_t *f) {
+	MatrixXd R;
+	VectorXd ab;
+	int i;
 
-	batCalPlot(ab);
+	batCalFold(f);
+	R = f->B->topLeftCorner(BATCAL_ORDER, BATCAL_ORDER);
+	ab = R.triangularView<Upper>().solve(f->B->topRightCorner(BATCAL_ORDER, 1));
 
-	printf("#define DEFAULT_SPVR_BAT_CRV1	%+e\n", ab(0, 0));
-	printf("#define DEFAULT_SPVR_BAT_CRV2	%+e\n", ab(1, 0));
-	printf("#define DEFAULT_SPVR_BAT_CRV3	%+e\n", ab(2, 0));
-	printf("#define DEFAULT_SPVR_BAT_CRV4	%+e\n", ab(3, 0));
-	printf("#define DEFAULT_SPVR_BAT_CRV5	%+e\n", ab(4, 0));
-	printf("#define DEFAULT_SPVR_BAT_CRV6	%+e\n", ab(5, 0));
+	for (i = 0; i < BATCAL_ORDER; i++)
+		f->ab[i] = ab(i);
 }
 
-int batCalLoadLog(char *logFile) {
-        FILE *lf;
-	loggerRecord_t l;
+// checksum errors were already reported on the first pass
+static void batCalQuiet(loggerMap_t *m, const char *s) {
+}
 
-	lf = fopen(logFile, "rb");
+static void batCalError(loggerMap_t *m, const char *s) {
+	profilerChecksumError((profiler_t *)m->user, s);
+	loggerChecksumError(s);
+}
 
-	if (lf == NULL) {
-		fprintf(stderr, "batCal: cannot open logfile '%s'\n", logFile);
-		return 0;
-	}
-	else {
-		numRecs = 0;
-		while (loggerReadEntry(lf, &l) != EOF) {
-			if (l.data[LOG_ADC_VIN] < zeroSOC)
-				break;
-
-			if (l.data[LOG_MOT_THROTTLE] > 0) {
-				logData = (logData_t *)realloc(logData, sizeof(logData_t) * (numRecs+1));
-				logData[numRecs].vIn = l.data[LOG_ADC_VIN];
-				numRecs++;
+// Records count from the first one with the motors running until the voltage drops below zeroSOC.
+// Returns the number the log has, -1 if it can't be read.
+static int batCalPass(batCalFit_t *f, int numRecs, int plotStep) {
+	loggerContext_t *c;
+	loggerRecord_t r;
+	uint32_t numRead = 0;
+	int n = 0;
+
+	if ((c = loggerContextOpen(f->logFile)) == NULL)
+		return -1;
+	c->map->error = numRecs ? batCalQuiet : batCalError;
+	c->map->user = &f->prof;
+	c->map->prof = &f->prof;
+
+	while (loggerContextRead(c, &r) != EOF) {
+		numRead++;
+		if (r.data[LOG_ADC_VIN] < zeroSOC)
+			break;
+
+		if (r.data[LOG_MOT_THROTTLE] > 0) {
+			if (numRecs) {
+				double soc = 1.0 - ((double)n / (double)numRecs);
+
+				batCalAddRow(f, soc, r.data[LOG_ADC_VIN]);
+				if (!n || r.data[LOG_ADC_VIN] < f->vMin)
+					f->vMin = r.data[LOG_ADC_VIN];
+				if (!n || r.data[LOG_ADC_VIN] > f->vMax)
+					f->vMax = r.data[LOG_ADC_VIN];
+				if (!(n % plotStep) && f->numPlot < BATCAL_PLOT_POINTS) {
+					f->plot[f->numPlot].vIn = r.data[LOG_ADC_VIN];
+					f->plot[f->numPlot].soc = soc;
+					f->numPlot++;
+				}
 			}
+			n++;
 		}
 	}
 
-	fclose(lf);
+	// what the log has is counted on the first pass
+	if (!numRecs) {
+		profilerCount(&f->prof, PROFILER_RECORDS, numRead);
+		profilerCount(&f->prof, PROFILER_BYTES_IN, c->map->pos);
+		profilerCount(&f->prof, PROFILER_SKIPPED, c->map->skipped);
+		profilerCount(&f->prof, PROFILER_RESYNCS, c->map->resyncs);
+	}
+
+	loggerContextClose(c);
 
-	if (numRecs < 1) {
-		fprintf(stderr, "batCal: aborting\n");
+	return n;
+}
+
+// Fit one log in two passes over it, the first to count the records which set the state of charge
+// of each one in the second.  Returns 0 if it has too few records.
+int batCalFitLog(batCalFit_t *f) {
+	int n;
+
+	if ((n = batCalPass(f, 0, 1)) < 0) {
+		fprintf(stderr, "batCal: cannot open logfile '%s'\n", f->logFile);
+		return 0;
+	}
+	if (n < BATCAL_ORDER) {
+		fprintf(stderr, "batCal: only %d records in '%s', aborting\n", n, f->logFile);
+		return 0;
 	}
-	else {
-		int i;
 
-		for (i = 0; i < numRecs; i++) {
-			logData[i].soc = 1.0 - ((double)i / (double)numRecs);
-		}
+	f->B = new MatrixXd(MatrixXd::Zero(BATCAL_ORDER + 1 + BATCAL_BLOCK, BATCAL_ORDER + 1));
+	f->numRows = BATCAL_ORDER + 1;
+	f->plot = (logData_t *)calloc(BATCAL_PLOT_POINTS, sizeof(logData_t));
+
+	f->numRecs = batCalPass(f, n, (n + BATCAL_PLOT_POINTS - 1) / BATCAL_PLOT_POINTS);
+	profilerBegin(&f->prof, PROFILER_FIT);
+	batCalSolve(f);
+	profilerEnd(&f->prof);
+	profilerCount(&f->prof, PROFILER_EXPORTED, f->numRecs);
+
+	delete f->B;
+	f->B = NULL;
+
+	fprintf(stderr, "batCal: loaded %d records from '%s'\n", f->numRecs, f->logFile);
+
+	return f->numRecs == n;
+}
 
-		fprintf(stderr, "batCal: loaded %d records from '%s'\n", numRecs, logFile);
+// worker of a run over several logs, fits them until there are none left
+void *batCalThread(void *arg) {
+	batCalBatch_t *b = (batCalBatch_t *)arg;
+	int n;
+
+	while (1) {
+		pthread_mutex_lock(&b->lock);
+		n = b->next++;
+		pthread_mutex_unlock(&b->lock);
+		if (n >= b->numFits)
+			break;
+
+		b->fits[n].ok = batCalFitLog(&b->fits[n]);
 	}
 
-	return numRecs;
+	return NULL;
+}
+
+// fit every log, batCalThreads of them at a time
+void batCalFitAll(batCalFit_t *fits, int numFits) {
+	batCalBatch_t b;
+	pthread_t *threads;
+	int *running;
+	int numThreads;
+	int i;
+
+	numThreads = batCalThreads > 0 ? batCalThreads : sysconf(_SC_NPROCESSORS_ONLN);
+	if (numThreads > numFits)
+		numThreads = numFits;
+	if (numThreads < 1)
+		numThreads = 1;
+
+	b.fits = fits;
+	b.numFits = numFits;
+	b.next = 0;
+	pthread_mutex_init(&b.lock, NULL);
+
+	threads = (pthread_t *)calloc(numThreads, sizeof(pthread_t));
+	running = (int *)calloc(numThreads, sizeof(int));
+
+	for (i = 1; i < numThreads; i++)
+		running[i] = !pthread_create(&threads[i], NULL, batCalThread, &b);
+	batCalThread(&b);
+	for (i = 1; i < numThreads; i++)
+		if (running[i])
+			pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&b.lock);
+	free(threads);
+	free(running);
 }
 
 void batCalUsage(void) {
-	fprintf(stderr, "usage: batcal [--help] [--zero=value] <log_file>\n");
+	fprintf(stderr, "usage: batcal [--help] [--zero=value] [--threads=num] [--stats[=json]] [--profile[=json]] <log_file> ...\n");
 }
 
 void batCalOpts(int argc, char **argv) {
         int bflag, ch;
-	static int longOpt;
-	int pCount;
-	float variance;
-	int i;
 
         /* options descriptor */
         static struct option longopts[] = {
                 {"help",		no_argument,		NULL,		'h'},
                 {"zero",		required_argument,	NULL,		'z'},
+                {"threads",		required_argument,	NULL,		'j'},
+                {"stats",		optional_argument,	NULL,		'S'},
+                {"profile",		optional_argument,	NULL,		'P'},
                 {NULL,          	0,                      NULL,		0}
         };
 
         bflag = 0;
-        while ((ch = getopt_long(argc, argv, "hz:", longopts, NULL)) != -1)
+        while ((ch = getopt_long(argc, argv, "hz:j:S::P::", longopts, NULL)) != -1)
                 switch (ch) {
 		case 'h':
 			batCalUsage();
@@ -209,6 +335,18 @@ void batCalOpts(int argc, char **argv) {
 		case 'z':
 			zeroSOC = atof(optarg);
 			break;
+		case 'j':
+			batCalThreads = atoi(optarg);
+			break;
+		case 'P':
+			batCalProfile = 1;
+			// no break
+		case 'S':
+			if ((batCalStats = profilerFormat(optarg)) == 0) {
+				fprintf(stderr, "batCal: --stats and --profile take text or json, not '%s'\n", optarg);
+				exit(1);
+			}
+			break;
                 default:
 			batCalUsage();
                         fprintf(stderr, "sim2: calOpts: error\n");
@@ -217,22 +355,62 @@ void batCalOpts(int argc, char **argv) {
 }
 
 int main(int argc, char **argv) {
+	batCalFit_t *fits, *f;
+	profiler_t prof;
+	int numOk = 0;
+	int i;
+
         batCalOpts(argc, argv);
         argc -= optind;
         argv += optind;
 
-	if (argc != 1) {
-		fprintf(stderr, "batCal: need one log file argument, aborting\n");
+	if (argc < 1) {
+		fprintf(stderr, "batCal: need a log file argument, aborting\n");
 		return 1;
 	}
-	
 
-	if (!batCalLoadLog(*argv)) {
+	// each log is a battery of its own
+	profilerInit(&prof, batCalProfile);
+	fits = (batCalFit_t *)calloc(argc, sizeof(batCalFit_t));
+	for (i = 0; i < argc; i++) {
+		fits[i].logFile = argv[i];
+		profilerInit(&fits[i].prof, batCalProfile);
+	}
+
+	batCalFitAll(fits, argc);
+
+	if (batCalStats) {
+		for (i = 0; i < argc; i++)
+			profilerMerge(&prof, &fits[i].prof);
+		profilerReport(stderr, &prof, "batCal", batCalStats);
+	}
+
+	for (i = 0; i < argc; i++) {
+		f = &fits[i];
+		if (!f->ok)
+			continue;
+
+		batCalPlot(f);
+
+		if (argc > 1)
+			printf("// %s\n", f->logFile);
+		printf("#define DEFAULT_SPVR_BAT_CRV1	%+e\n", f->ab[0]);
+		printf("#define DEFAULT_SPVR_BAT_CRV2	%+e\n", f->ab[1]);
+		printf("#define DEFAULT_SPVR_BAT_CRV3	%+e\n", f->ab[2]);
+		printf("#define DEFAULT_SPVR_BAT_CRV4	%+e\n", f->ab[3]);
+		printf("#define DEFAULT_SPVR_BAT_CRV5	%+e\n", f->ab[4]);
+		printf("#define DEFAULT_SPVR_BAT_CRV6	%+e\n", f->ab[5]);
+		numOk++;
+	}
+
+	for (i = 0; i < argc; i++)
+		free(fits[i].plot);
+	free(fits);
+
+	if (!numOk) {
 		fprintf(stderr, "batCal: no logs loaded, aborting...\n");
 		return 1;
 	}
-	
-	batCalInterpolate();
 
-	return 0;
+	return numOk < argc;
 }
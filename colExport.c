@@ -0,0 +1,268 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#include "colExport.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Values are written in host byte order, which is little endian everywhere these tools run.
+// Offsets are counted rather than asked for with ftell(), so the output can be a pipe.
+
+#define COL_EXPORT_MAX_EXACT	9007199254740992.0		// 2^53, whole numbers up to this are exact in a double
+
+static const int colExportSizes[] = {8, 4, 4, 4, 2, 2, 1, 1};	// indexed by COL_EXPORT_TYPE_*
+
+static void colExportWrite(colExport_t *c, const void *p, size_t len) {
+	if (len && fwrite(p, 1, len, c->fp) != len)
+		c->error = 1;
+	c->offset += len;
+}
+
+colExport_t *colExportInit(FILE *fp, int numCols, const char **names, int flags) {
+	colExport_t *c;
+	colExportHeader_t h;
+	uint16_t len;
+	int i;
+
+	c = (colExport_t *)calloc(1, sizeof(colExport_t));
+	c->fp = fp;
+	c->flags = flags;
+	c->numCols = numCols;
+	c->vals = (double *)malloc((numCols + 1) * COL_EXPORT_CHUNK_ROWS * sizeof(double));
+	c->buf = (char *)malloc((COL_EXPORT_CHUNK_ROWS + 1) * sizeof(double));
+
+	memcpy(h.magic, COL_EXPORT_MAGIC, sizeof(h.magic));
+	h.version = COL_EXPORT_VERSION;
+	h.numCols = numCols;
+	h.chunkRows = COL_EXPORT_CHUNK_ROWS;
+	colExportWrite(c, &h, sizeof(h));
+
+	for (i = 0; i < numCols; i++) {
+		len = strlen(names[i]);
+		colExportWrite(c, &len, sizeof(len));
+		colExportWrite(c, names[i], len);
+	}
+
+	return c;
+}
+
+// narrowest whole number type for values from min to max, -1 if there is none
+static int colExportIntType(double min, double max) {
+	if (min >= 0) {
+		if (max <= UINT8_MAX)
+			return COL_EXPORT_TYPE_U8;
+		if (max <= UINT16_MAX)
+			return COL_EXPORT_TYPE_U16;
+		if (max <= UINT32_MAX)
+			return COL_EXPORT_TYPE_U32;
+	}
+	else {
+		if (min >= INT8_MIN && max <= INT8_MAX)
+			return COL_EXPORT_TYPE_S8;
+		if (min >= INT16_MIN && max <= INT16_MAX)
+			return COL_EXPORT_TYPE_S16;
+		if (min >= INT32_MIN && max <= INT32_MAX)
+			return COL_EXPORT_TYPE_S32;
+	}
+	return -1;
+}
+
+static int colExportPut(char *p, int type, double v) {
+	float f;
+	uint32_t u32;
+	int32_t s32;
+	uint16_t u16;
+	int16_t s16;
+
+	switch (type) {
+		case COL_EXPORT_TYPE_DOUBLE:
+			memcpy(p, &v, 8);
+			return 8;
+		case COL_EXPORT_TYPE_FLOAT:
+			f = v;
+			memcpy(p, &f, 4);
+			return 4;
+		case COL_EXPORT_TYPE_U32:
+			u32 = v;
+			memcpy(p, &u32, 4);
+			return 4;
+		case COL_EXPORT_TYPE_S32:
+			s32 = v;
+			memcpy(p, &s32, 4);
+			return 4;
+		case COL_EXPORT_TYPE_U16:
+			u16 = v;
+			memcpy(p, &u16, 2);
+			return 2;
+		case COL_EXPORT_TYPE_S16:
+			s16 = v;
+			memcpy(p, &s16, 2);
+			return 2;
+		case COL_EXPORT_TYPE_U8:
+			*(uint8_t *)p = v;
+			return 1;
+		case COL_EXPORT_TYPE_S8:
+			*(int8_t *)p = v;
+			return 1;
+	}
+	return 0;
+}
+
+// encode n values of one column into c->buf and fill in its directory entry, less the offset
+static void colExportBlock(colExport_t *c, const double *v, int n, colExportBlock_t *b) {
+	double min = INFINITY, max = -INFINITY;
+	double dmin = INFINITY, dmax = -INFINITY, d;
+	int whole = 1, single = 1, same = 1;
+	int type, dtype;
+	int len;
+	int i;
+
+	memset(b, 0, sizeof(colExportBlock_t));
+
+	for (i = 0; i < n; i++) {
+		if (same && memcmp(&v[i], &v[0], sizeof(double)))
+			same = 0;
+
+		if (isnan(v[i])) {
+			b->nanCount++;
+			whole = 0;
+			continue;
+		}
+
+		if (v[i] < min)
+			min = v[i];
+		if (v[i] > max)
+			max = v[i];
+
+		if (whole && (v[i] != floor(v[i]) || fabs(v[i]) > COL_EXPORT_MAX_EXACT || (v[i] == 0.0 && signbit(v[i]))))
+			whole = 0;
+		if (single && (double)(float)v[i] != v[i])
+			single = 0;
+
+		if (i > 0 && whole) {
+			d = v[i] - v[i-1];
+			if (d < dmin)
+				dmin = d;
+			if (d > dmax)
+				dmax = d;
+		}
+	}
+
+	if (b->nanCount == (uint32_t)n) {
+		b->min = b->max = nan("");
+	}
+	else {
+		b->min = min;
+		b->max = max;
+	}
+
+	type = whole ? colExportIntType(min, max) : -1;
+	if (type < 0)
+		type = single ? COL_EXPORT_TYPE_FLOAT : COL_EXPORT_TYPE_DOUBLE;
+
+	if (same) {
+		b->encoding = COL_EXPORT_CONST;
+		len = colExportPut(c->buf, type, v[0]);
+	}
+	else if ((c->flags & COL_EXPORT_DELTA) && whole && (dtype = colExportIntType(dmin, dmax)) >= 0 &&
+			colExportSizes[dtype] < colExportSizes[type]) {
+		b->encoding = COL_EXPORT_DELTAS;
+		type = dtype;
+		len = colExportPut(c->buf, COL_EXPORT_TYPE_DOUBLE, v[0]);
+		for (i = 1; i < n; i++)
+			len += colExportPut(c->buf + len, type, v[i] - v[i-1]);
+	}
+	else {
+		b->encoding = COL_EXPORT_PLAIN;
+		for (i = 0, len = 0; i < n; i++)
+			len += colExportPut(c->buf + len, type, v[i]);
+	}
+
+	b->type = type;
+	b->length = len;
+}
+
+// write out the chunk filled so far
+static void colExportChunk(colExport_t *c) {
+	colExportBlock_t *b;
+	int i;
+
+	if (!c->numRows)
+		return;
+
+	if (c->numChunks == c->allocChunks) {
+		c->allocChunks = c->allocChunks ? c->allocChunks * 2 : 64;
+		c->blocks = (colExportBlock_t *)realloc(c->blocks, c->allocChunks * c->numCols * sizeof(colExportBlock_t));
+		c->chunkRows = (uint32_t *)realloc(c->chunkRows, c->allocChunks * sizeof(uint32_t));
+	}
+
+	for (i = 0; i < c->numCols; i++) {
+		b = &c->blocks[c->numChunks * c->numCols + i];
+		colExportBlock(c, c->vals + i * COL_EXPORT_CHUNK_ROWS, c->numRows, b);
+		b->offset = c->offset;
+		colExportWrite(c, c->buf, b->length);
+	}
+
+	c->chunkRows[c->numChunks++] = c->numRows;
+	c->totalRows += c->numRows;
+	c->numRows = 0;
+}
+
+// add a row of numCols values
+void colExportRow(colExport_t *c, const double *vals) {
+	int i;
+
+	for (i = 0; i < c->numCols; i++)
+		c->vals[i * COL_EXPORT_CHUNK_ROWS + c->numRows] = vals[i];
+
+	if (++c->numRows == COL_EXPORT_CHUNK_ROWS)
+		colExportChunk(c);
+}
+
+// write the last chunk and the directory, then free the export; returns 0 if anything failed to write
+int colExportFinish(colExport_t *c) {
+	colExportTrailer_t t;
+	int ok;
+	int i;
+
+	colExportChunk(c);
+
+	t.directory = c->offset;
+	t.numRows = c->totalRows;
+	t.numChunks = c->numChunks;
+	memcpy(t.magic, COL_EXPORT_MAGIC, sizeof(t.magic));
+
+	for (i = 0; i < c->numChunks; i++) {
+		colExportWrite(c, &c->chunkRows[i], sizeof(uint32_t));
+		colExportWrite(c, &c->blocks[i * c->numCols], c->numCols * sizeof(colExportBlock_t));
+	}
+	colExportWrite(c, &t, sizeof(t));
+
+	if (fflush(c->fp))
+		c->error = 1;
+	ok = !c->error;
+
+	free(c->vals);
+	free(c->buf);
+	free(c->blocks);
+	free(c->chunkRows);
+	free(c);
+
+	return ok;
+}
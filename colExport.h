@@ -0,0 +1,112 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#ifndef _colExport_h
+#define _colExport_h
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Binary column export ("AQLC"), all values little endian:
+//
+//	colExportHeader_t
+//	numCols names, each a uint16_t length followed by that many bytes
+//	column blocks, each holding one column of one chunk of up to chunkRows rows
+//	a directory: for each chunk a uint32_t row count, then numCols colExportBlock_t
+//	colExportTrailer_t
+//
+// A reader starts from the trailer at the end of the file and only needs to read the blocks of the
+// columns it wants.  Each block is stored as the narrowest COL_EXPORT_TYPE_* which holds every value
+// of it exactly, so nothing is lost against the doubles it was given.
+
+#define COL_EXPORT_MAGIC		"AQLC"
+#define COL_EXPORT_VERSION		1
+#define COL_EXPORT_CHUNK_ROWS	16384
+
+#define COL_EXPORT_DELTA		0x01			// flag: delta code whole number blocks
+
+enum colExportTypes {
+	COL_EXPORT_TYPE_DOUBLE = 0,
+	COL_EXPORT_TYPE_FLOAT,
+	COL_EXPORT_TYPE_U32,
+	COL_EXPORT_TYPE_S32,
+	COL_EXPORT_TYPE_U16,
+	COL_EXPORT_TYPE_S16,
+	COL_EXPORT_TYPE_U8,
+	COL_EXPORT_TYPE_S8
+};
+
+enum colExportEncodings {
+	COL_EXPORT_PLAIN = 0,						// one value per row
+	COL_EXPORT_CONST,							// one value for every row
+	COL_EXPORT_DELTAS							// a double for the first row, then the difference to the previous row for each one after
+};
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t numCols;
+	uint32_t chunkRows;
+} colExportHeader_t;
+
+typedef struct {
+	uint64_t offset;							// file offset of the block
+	uint32_t length;							// bytes in the block
+	uint8_t type;								// COL_EXPORT_TYPE_*
+	uint8_t encoding;							// COL_EXPORT_PLAIN etc.
+	uint16_t reserved;
+	uint32_t nanCount;							// rows without a value (NaN)
+	uint32_t reserved2;
+	double min, max;							// of the values which aren't NaN, NaN if there are none
+} colExportBlock_t;
+
+typedef struct {
+	uint64_t directory;							// file offset of the directory
+	uint64_t numRows;
+	uint32_t numChunks;
+	char magic[4];
+} colExportTrailer_t;
+
+typedef struct {
+	FILE *fp;
+	int flags;									// COL_EXPORT_*
+	int numCols;
+	int numRows;								// rows in the chunk being filled
+	double *vals;								// numCols columns of COL_EXPORT_CHUNK_ROWS values
+	char *buf;									// block being encoded
+	uint64_t offset;							// bytes written so far
+	uint64_t totalRows;
+	colExportBlock_t *blocks;					// directory, numCols per chunk
+	uint32_t *chunkRows;
+	int numChunks, allocChunks;
+	int error;
+} colExport_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern colExport_t *colExportInit(FILE *fp, int numCols, const char **names, int flags);
+extern void colExportRow(colExport_t *c, const double *vals);
+extern int colExportFinish(colExport_t *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
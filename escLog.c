@@ -0,0 +1,126 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+#include "escLog.h"
+#include <stdlib.h>
+#include <string.h>
+
+escLogReader_t *escLogOpen(FILE *fp) {
+	escLogReader_t *r;
+
+	r = (escLogReader_t *)calloc(1, sizeof(escLogReader_t));
+	r->fp = fp;
+	r->buf = (unsigned char *)malloc(ESC_LOG_BUF_SIZE);
+	r->synced = 1;
+
+	return r;
+}
+
+void escLogClose(escLogReader_t *r) {
+	free(r->buf);
+	free(r);
+}
+
+// move what is left to the front of the buffer and read as much again as fits
+static void escLogFill(escLogReader_t *r) {
+	size_t want, n;
+
+	if (r->pos) {
+		memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+		r->len -= r->pos;
+		r->pos = 0;
+	}
+
+	want = ESC_LOG_BUF_SIZE - r->len;
+	n = fread(r->buf + r->len, 1, want, r->fp);
+	if (n < want)
+		r->eof = 1;
+	r->len += n;
+}
+
+static int escLogIsSync(const unsigned char *p) {
+	return p[0] == ESC_LOG_SYNC && (p[1] & 0xc0) == 0xc0;
+}
+
+// Read up to ESC_LOG_BATCH records into b and decode them.  Returns the number read, 0 at the end of the log.
+int escLogRead(escLogReader_t *r, escLogBatch_t *b) {
+	const unsigned char *p, *end;
+	uint64_t v;
+	int i;
+
+	b->n = 0;
+	while (b->n < ESC_LOG_BATCH) {
+		// keep enough for a record and the sync of the one after it
+		if (r->len - r->pos < ESC_LOG_REC_SIZE + 2 && !r->eof)
+			escLogFill(r);
+
+		p = r->buf + r->pos;
+		end = r->buf + r->len;
+
+		if (end - p < ESC_LOG_REC_SIZE) {
+			if (end > p) {
+				if (r->synced && escLogIsSync(p))
+					fprintf(stderr, "escLog: incomplete record at end of log after record # %u\n", r->records);
+				r->skipped += end - p;
+				r->pos = r->len;
+			}
+			if (!r->synced) {
+				fprintf(stderr, "escLog: sync lost after record # %u, %llu bytes skipped to end of log\n", r->records, (unsigned long long)(r->skipped - r->skippedBefore));
+				r->synced = 1;
+			}
+			break;
+		}
+
+		if (escLogIsSync(p) && (r->synced || end - p < ESC_LOG_REC_SIZE + 2 || escLogIsSync(p + ESC_LOG_REC_SIZE))) {
+			if (!r->synced) {
+				fprintf(stderr, "escLog: sync lost after record # %u, %llu bytes skipped\n", r->records, (unsigned long long)(r->skipped - r->skippedBefore));
+				r->synced = 1;
+			}
+
+			// decoded as it is copied, g++ 12 at -O1 and -O2 dropped the call to a separate pass over the batch
+			i = b->n++;
+			b->id[i] = p[1] & 0x3f;
+			memcpy(&b->micros[i], p + 2, sizeof(uint32_t));
+			memcpy(&v, p + 6, sizeof(uint64_t));
+			b->raw[i] = v;
+			b->state[i] = ESC_STATE(v);
+			b->vin[i] = ESC_VIN(v);
+			b->amps[i] = ESC_AMPS(v);
+			b->rpm[i] = ESC_RPM(v);
+			b->duty[i] = ESC_DUTY(v);
+			b->temp[i] = ESC_TEMP(v);
+			b->errCode[i] = ESC_ERRCODE(v);
+			r->pos += ESC_LOG_REC_SIZE;
+			r->records++;
+			continue;
+		}
+
+		if (r->synced) {
+			r->synced = 0;
+			r->resyncs++;
+			r->skippedBefore = r->skipped;
+		}
+
+		// on to the next sync byte, the last one might start a record still to be read
+		if ((p = (const unsigned char *)memchr(p + 1, ESC_LOG_SYNC, end - p - 1)) == NULL)
+			p = end - 1;
+		r->skipped += p - (r->buf + r->pos);
+		r->pos = p - r->buf;
+	}
+
+	return b->n;
+}
@@ -0,0 +1,81 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+#ifndef _escLog_h
+#define _escLog_h
+
+#include <stdio.h>
+#include <stdint.h>
+
+// ESC32 logs are records of a 0xff sync, an ESC id byte with its top two bits set, then (little endian) a
+// uint32_t of micros and 64 bits of CAN status, packed from the low bit up:
+//
+//	state 3, vin 12 (x 100), amps 14 (x 100), rpm 15, duty 8 (x 255/100), temp 9 ((deg C + 32) * 4), errCode 3
+//
+// ESC32v2 logs have an error count where v3 has temp.  The reader takes the file in large blocks and
+// decodes a batch of records at a time into columns.  When a record doesn't start where the one before it
+// ended, it looks for one at every byte, and only takes it if another one follows (or the log ends there).
+
+#define ESC_LOG_SYNC			0xff
+#define ESC_LOG_REC_SIZE		14
+#define ESC_LOG_NUM_IDS			64
+#define ESC_LOG_BUF_SIZE		(64*1024)
+#define ESC_LOG_BATCH			(ESC_LOG_BUF_SIZE / ESC_LOG_REC_SIZE)
+
+#define ESC_STATE(v)			((unsigned int)((v) & 0x7))
+#define ESC_VIN(v)				((unsigned int)(((v) >> 3) & 0xfff))
+#define ESC_AMPS(v)				((unsigned int)(((v) >> 15) & 0x3fff))
+#define ESC_RPM(v)				((unsigned int)(((v) >> 29) & 0x7fff))
+#define ESC_DUTY(v)				((unsigned int)(((v) >> 44) & 0xff))
+#define ESC_TEMP(v)				((unsigned int)(((v) >> 52) & 0x1ff))
+#define ESC_ERRCODE(v)			((unsigned int)(((v) >> 61) & 0x7))
+
+// a batch of records, decoded into columns
+typedef struct {
+	int n;
+	uint8_t id[ESC_LOG_BATCH];
+	uint32_t micros[ESC_LOG_BATCH];
+	uint64_t raw[ESC_LOG_BATCH];
+	uint16_t state[ESC_LOG_BATCH], vin[ESC_LOG_BATCH], amps[ESC_LOG_BATCH], rpm[ESC_LOG_BATCH];
+	uint16_t duty[ESC_LOG_BATCH], temp[ESC_LOG_BATCH], errCode[ESC_LOG_BATCH];
+} escLogBatch_t;
+
+typedef struct {
+	FILE *fp;
+	unsigned char *buf;
+	int len, pos;									// bytes in buf, where the next record starts
+	int eof;
+	int synced;										// 0 after the last record was followed by something else
+	uint32_t records;								// read so far
+	uint32_t resyncs;								// times sync was lost
+	uint64_t skipped;								// bytes dropped getting it back
+	uint64_t skippedBefore;							// skipped when sync was last lost
+} escLogReader_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern escLogReader_t *escLogOpen(FILE *fp);
+extern int escLogRead(escLogReader_t *r, escLogBatch_t *b);
+extern void escLogClose(escLogReader_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,38 +2,196 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <getopt.h>
+#include "escLog.h"
+#include "writer.h"
 
+// per ESC rolling means over the last escRollLen records, and totals for the summary
 typedef struct {
-    uint8_t escId;
-    uint32_t micros;
-    uint32_t data[2];
-} __attribute__((gcc_struct, packed)) motorsLog_t;  // gcc_struct attribute required for win/gcc/mingw, ignore on others
+	uint32_t records;
+	float *ring;							// rpm, amps, temp of each of the last escRollLen records
+	int ringPos;
+	double rollSum[3];
+	double min[3], max[3], sum[3];
+	writerStruct_t *w;						// its own output with -s
+	FILE *fp;
+} escLogEsc_t;
 
-typedef struct {
-    unsigned int state :    3;
-    unsigned int vin :	    12;	// x 100
-    unsigned int amps :	    14;	// x 100
-    unsigned int rpm :	    15;
-    unsigned int duty :	    8;	// x (255/100)
-    unsigned int temp :     9;  // (Deg C + 32) * 4
-    unsigned int errCode :  3;
-} __attribute__((gcc_struct, packed)) esc32CanStatus_t;
+int logdataVersion = 3;
+int escRollLen;								// 0 for no rolling means
+int escSummary;
+const char *escSplit;						// file name prefix for one output per ESC
+escLogEsc_t escs[ESC_LOG_NUM_IDS];
+escLogBatch_t escBatch;
+
+void escLogDumpUsage(void) {
+	fprintf(stderr, "Usage: escLogDump [-v2] [-s prefix] [-r n] [-S] <log file> [ >output.txt ]\n\n");
+	fprintf(stderr, "   Default is ESC32v3 log, use -v2 for ESC32v2.\n");
+	fprintf(stderr, "   -s prefix  write each ESC to its own file, prefix<id>.txt, instead of all to stdout\n");
+	fprintf(stderr, "   -r n       add the mean rpm, amps and temp of the last n records of the same ESC to each row\n");
+	fprintf(stderr, "   -S         print the records and min/mean/max rpm, amps and temp of each ESC to stderr\n");
+}
+
+void escLogDumpRoll(escLogEsc_t *e, const float *v) {
+	float *old;
+	int i;
+
+	if (!e->ring)
+		e->ring = (float *)calloc(escRollLen * 3, sizeof(float));
+
+	old = e->ring + e->ringPos * 3;
+	for (i = 0; i < 3; i++) {
+		if (e->records > (uint32_t)escRollLen)
+			e->rollSum[i] -= old[i];
+		e->rollSum[i] += v[i];
+		old[i] = v[i];
+	}
+	e->ringPos = (e->ringPos + 1) % escRollLen;
+}
+
+void escLogDumpHeaders(writerStruct_t *w) {
+	writerString(w, "micros id state vin amps rpm duty ");
+	if (logdataVersion == 2)
+		writerString(w, "errors ");
+	else
+		writerString(w, "temp ");
+	writerString(w, "dsrm-code ");
+	if (escRollLen) {
+		if (logdataVersion == 2)
+			writerString(w, "rpm-mean amps-mean errors-mean ");
+		else
+			writerString(w, "rpm-mean amps-mean temp-mean ");
+	}
+	writerChar(w, '\n');
+}
+
+// the output of ESC id, opening its file with -s
+writerStruct_t *escLogDumpWriter(int id, writerStruct_t *w) {
+	char fname[512];
+	escLogEsc_t *e = &escs[id];
+
+	if (!escSplit)
+		return w;
+
+	if (!e->w) {
+		snprintf(fname, sizeof(fname), "%s%d.txt", escSplit, id);
+		if ((e->fp = fopen(fname, "w")) == NULL) {
+			fprintf(stderr, "escLogDump: cannot open '%s', aborting...\n", fname);
+			exit(1);
+		}
+		e->w = writerInit(e->fp, 0);
+		escLogDumpHeaders(e->w);
+	}
+
+	return e->w;
+}
+
+void escLogDumpBatch(escLogBatch_t *b, writerStruct_t *stdw) {
+	escLogEsc_t *e;
+	writerStruct_t *w;
+	float v[3];
+	int i, k;
+
+	for (i = 0; i < b->n; i++) {
+		e = &escs[b->id[i]];
+		w = escLogDumpWriter(b->id[i], stdw);
+
+		v[0] = b->rpm[i];
+		v[1] = b->amps[i] / 100.0f;
+		v[2] = logdataVersion == 2 ? b->temp[i] : (float)b->temp[i] / 4.0f - 32.0f;
+
+		for (k = 0; k < 3; k++) {
+			if (!e->records || v[k] < e->min[k])
+				e->min[k] = v[k];
+			if (!e->records || v[k] > e->max[k])
+				e->max[k] = v[k];
+			e->sum[k] += v[k];
+		}
+		e->records++;
+
+		writerInt(w, (int)b->micros[i]);
+		writerChar(w, ' ');
+		writerInt(w, b->id[i]);
+		writerChar(w, ' ');
+		writerInt(w, b->state[i]);
+		writerChar(w, ' ');
+		writerFixed(w, b->vin[i] / 100.0f);
+		writerChar(w, ' ');
+		writerFixed(w, b->amps[i] / 100.0f);
+		writerChar(w, ' ');
+		writerInt(w, b->rpm[i]);
+		writerChar(w, ' ');
+		writerFixed(w, (float)b->duty[i] / 255 * 100);
+		writerChar(w, ' ');
+		if (logdataVersion == 2)
+			writerInt(w, b->temp[i]);  // actually the error count
+		else
+			writerFixed(w, (float)b->temp[i] / 4.0f - 32.0f);
+		writerChar(w, ' ');
+		writerInt(w, b->errCode[i]);
+		writerChar(w, ' ');
+		if (escRollLen) {
+			escLogDumpRoll(e, v);
+			k = e->records < (uint32_t)escRollLen ? e->records : escRollLen;
+			writerFixed(w, e->rollSum[0] / k);
+			writerChar(w, ' ');
+			writerFixed(w, e->rollSum[1] / k);
+			writerChar(w, ' ');
+			writerFixed(w, e->rollSum[2] / k);
+			writerChar(w, ' ');
+		}
+		writerChar(w, '\n');
+	}
+}
+
+void escLogDumpSummary(void) {
+	escLogEsc_t *e;
+	int i;
+
+	fprintf(stderr, "%4s %9s %27s %27s %27s\n", "esc", "records", "rpm min/mean/max", "amps min/mean/max", logdataVersion == 2 ? "errors min/mean/max" : "temp min/mean/max");
+	for (i = 0; i < ESC_LOG_NUM_IDS; i++) {
+		e = &escs[i];
+		if (e->records)
+			fprintf(stderr, "%4d %9u %8.0f %9.1f %8.0f %8.2f %9.2f %8.2f %8.2f %9.2f %8.2f\n", i, e->records,
+				e->min[0], e->sum[0] / e->records, e->max[0],
+				e->min[1], e->sum[1] / e->records, e->max[1],
+				e->min[2], e->sum[2] / e->records, e->max[2]);
+	}
+}
 
 int main(int argc, char *argv[]) {
 	FILE *fp;
-	uint8_t sync = 0;
-	motorsLog_t logBuf;
-	int rec = 0;
-	int logdataVersion = 3;
-
-	if (argc < 2 || !strcmp(argv[1], "-h")) {
-		fprintf(stderr, "Usage: escLogDump [-v2] <log file> [ >output.txt ]\n\n");
-		fprintf(stderr, "   Default is ESC32v3 log, use -v2 for ESC32v2.\n");
-		exit(1);
+	escLogReader_t *r;
+	writerStruct_t *w;
+	int ch, i;
+
+	while ((ch = getopt(argc, argv, "hv:s:r:S")) != -1) {
+		switch (ch) {
+			case 'v':
+				logdataVersion = atoi(optarg) == 2 ? 2 : 3;
+				break;
+			case 's':
+				escSplit = optarg;
+				break;
+			case 'r':
+				escRollLen = atoi(optarg);
+				if (escRollLen < 0)
+					escRollLen = 0;
+				break;
+			case 'S':
+				escSummary = 1;
+				break;
+			case 'h':
+			default:
+				escLogDumpUsage();
+				exit(1);
+		}
 	}
 
-	if (!strcmp(argv[1], "-v2"))
-		logdataVersion = 2;
+	if (optind >= argc) {
+		escLogDumpUsage();
+		exit(1);
+	}
 
 	fp = fopen(argv[argc-1], "rb");
 	if (fp == NULL) {
@@ -42,42 +200,33 @@ int main(int argc, char *argv[]) {
 	}
 
 	fprintf(stderr, "Opening log file with ESC data version %d\n", logdataVersion);
+	w = writerInit(stdout, 0);
+
 	// column headers
-	printf("micros id state vin amps rpm duty ");
-	if (logdataVersion == 2)
-		printf("errors ");
-	else
-		printf("temp ");
-	printf("dsrm-code \n");
-
-	while (fread(&sync, sizeof(sync), 1, fp) == 1) {
-		if (sync == 0xff) {
-			if (fread(&logBuf, 13, 1, fp) == 1) {
-				// check bits 9 & 10 of the sync flag
-				if ((logBuf.escId & 0xc0) == 0xc0) {
-					esc32CanStatus_t *status = (esc32CanStatus_t *)&logBuf.data;
-
-					printf("%d ", logBuf.micros);
-					printf("%d ", logBuf.escId & 0x3f);
-					printf("%d ", status->state);
-					printf("%f ", status->vin / 100.0f);
-					printf("%f ", status->amps / 100.0f);
-					printf("%d ", status->rpm);
-					printf("%f ", (float)status->duty / 255 * 100);
-					if (logdataVersion == 2)
-						printf("%d ", status->temp);  // actually the error count
-					else
-						printf("%f ", (float)status->temp / 4.0f - 32.0f);
-					printf("%d ", status->errCode);
-					printf("\n");
-					rec++;
-				} else
-					fprintf(stderr, "invalid sync at record # %d (s: 0x%x)\n", rec, (logBuf.escId & 0xc0));
-			} else
-				fprintf(stderr, "invalid num fields at record # %d\n", rec);
-		} else
-			fprintf(stderr, "sync error record # %d (s: 0x%x)\n", rec, sync);
+	if (!escSplit)
+		escLogDumpHeaders(w);
+
+	r = escLogOpen(fp);
+	while (escLogRead(r, &escBatch) > 0)
+		escLogDumpBatch(&escBatch, w);
+
+	if (r->resyncs)
+		fprintf(stderr, "escLogDump: lost sync %u times, %llu bytes skipped\n", r->resyncs, (unsigned long long)r->skipped);
+
+	for (i = 0; i < ESC_LOG_NUM_IDS; i++) {
+		if (escs[i].w) {
+			writerFree(escs[i].w);
+			fclose(escs[i].fp);
+		}
+		free(escs[i].ring);
 	}
 
+	writerFree(w);
+	escLogClose(r);
+	fclose(fp);
+
+	if (escSummary)
+		escLogDumpSummary();
+
 	exit(0);
 }
@@ -21,34 +21,72 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
 #include <termios.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #define DEFAULT_PORT		"/dev/ttyUSB0"
 #define DEFAULT_BAUD		115200
 #define FIRMWARE_FILENAME	"STM32.hex"
+#define FIRMWARE_BASE		0x08000000
+#define LOADER_MAX_PORTS	16
+#define LOADER_PROGRESS		1000000		// us between progress lines with several boards
 
-serialStruct_t *s;
+typedef struct {
+	stmPort_t p;
+	pthread_t thread;
+	int running;
+	volatile int finished;
+} loaderBoard_t;
 
-char port[256];
+char ports[LOADER_MAX_PORTS][256];
+int numPorts;
 unsigned int baud;
 unsigned char overrideParity;
 unsigned char cont;
+unsigned char verify;
+unsigned int firmBase;
 char firmFile[256];
+stmImage_t img;
 
 void loaderUsage(void) {
-	fprintf(stderr, "usage: loader <-h> <-p device_file> <-b baud_rate> <-f firmware_file> <-o>\n");
+	fprintf(stderr, "usage: loader <-h> <-p device_file[,device_file...]> <-b baud_rate> <-f firmware_file> <-a bin_address> <-c> <-o> <-v>\n");
+	fprintf(stderr, "       with several ports (-p given more than once, or a list) all boards are flashed at once\n");
+	fprintf(stderr, "       firmware files ending in .bin are raw images, written at -a (default 0x%08x)\n", FIRMWARE_BASE);
+	fprintf(stderr, "       -v  read the flash back and compare CRCs before starting it\n");
+}
+
+// add each port of a comma separated list
+void loaderAddPorts(const char *list) {
+	const char *p = list;
+	int len;
+
+	while (*p) {
+		len = strcspn(p, ",");
+		if (len && len < (int)sizeof(ports[0])) {
+			if (numPorts == LOADER_MAX_PORTS)
+				fprintf(stderr, "loader: too many ports, ignoring '%.*s'\n", len, p);
+			else {
+				memcpy(ports[numPorts], p, len);
+				ports[numPorts++][len] = 0;
+			}
+		}
+		p += len;
+		if (*p)
+			p++;
+	}
 }
 
 unsigned int loaderOptions(int argc, char **argv) {
 	int ch;
 
-	strncpy(port, DEFAULT_PORT, sizeof(port));
 	baud = DEFAULT_BAUD;
 	overrideParity = 0;
 	strncpy(firmFile, FIRMWARE_FILENAME, sizeof(firmFile));
+	firmBase = FIRMWARE_BASE;
 
 	/* options descriptor */
 	static struct option longopts[] = {
@@ -58,17 +96,19 @@ unsigned int loaderOptions(int argc, char **argv) {
 		{ "firm_file",	required_argument,	NULL,           'f' },
 		{ "cont",	no_argument,		NULL,		'c' },
 		{ "overide_party",no_argument,		NULL,           'o' },
+		{ "address",	required_argument,	NULL,		'a' },
+		{ "verify",	no_argument,		NULL,		'v' },
 		{ NULL,         0,                      NULL,           0 }
 	};
 
-	while ((ch = getopt_long(argc, argv, "hp:b:f:co", longopts, NULL)) != -1)
+	while ((ch = getopt_long(argc, argv, "hp:b:f:coa:v", longopts, NULL)) != -1)
 		switch (ch) {
 		case 'h':
 			loaderUsage();
 			exit(0);
 			break;
 		case 'p':
-			strncpy(port, optarg, sizeof(port));
+			loaderAddPorts(optarg);
 			break;
 		case 'b':
 			baud = atoi(optarg);
@@ -82,6 +122,12 @@ unsigned int loaderOptions(int argc, char **argv) {
 		case 'o':
 			overrideParity = 1;
 			break;
+		case 'a':
+			firmBase = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			verify = 1;
+			break;
 		default:
 			loaderUsage();
 			return 0;
@@ -89,32 +135,138 @@ unsigned int loaderOptions(int argc, char **argv) {
 	argc -= optind;
 	argv += optind;
 
+	if (!numPorts)
+		loaderAddPorts(DEFAULT_PORT);
+
 	return 1;
 }
 
+void *loaderThread(void *arg) {
+	loaderBoard_t *b = (loaderBoard_t *)arg;
+
+	stmLoader(&b->p, &img, overrideParity, cont, verify);
+	b->finished = 1;
+
+	return NULL;
+}
+
+// flash every board at once, one thread each, and report how each went
+int loaderParallel(void) {
+	loaderBoard_t *boards;
+	loaderBoard_t *b;
+	char line[1024], last[1024];
+	double t;
+	int running, passed;
+	int len;
+	int i;
+
+	boards = (loaderBoard_t *)calloc(numPorts, sizeof(loaderBoard_t));
+
+	for (i = 0; i < numPorts; i++) {
+		boards[i].p.name = ports[i];
+		if ((boards[i].p.s = initSerial(ports[i], baud, 0)) == 0)
+			printf("%s: cannot open port\n", ports[i]);
+	}
+
+	printf("Upgrading STM on %d ports from %s...\n", numPorts, firmFile);
+	if (!cont) {
+		printf("Place all STMs in bootloader mode and press any key >");
+		getchar();
+		printf("\n");
+	}
+
+	*last = 0;
+	t = stmSeconds();
+	for (i = 0; i < numPorts; i++) {
+		b = &boards[i];
+		if (b->p.s && (b->running = !pthread_create(&b->thread, NULL, loaderThread, b)) == 0)
+			printf("%s: cannot start thread\n", ports[i]);
+	}
+
+	do {
+		usleep(LOADER_PROGRESS);
+
+		running = 0;
+		len = snprintf(line, sizeof(line), "Progress:");
+		for (i = 0; i < numPorts; i++) {
+			b = &boards[i];
+			if (b->running && !b->finished)
+				running++;
+			if (b->running && b->p.total && len < (int)sizeof(line))
+				len += snprintf(line + len, sizeof(line) - len, " %s %d%%", ports[i], b->p.done * 100 / b->p.total);
+		}
+		if (running && len > 9 && strcmp(line, last)) {
+			printf("%s\n", line);
+			strcpy(last, line);
+		}
+	} while (running);
+
+	passed = 0;
+	printf("\n");
+	for (i = 0; i < numPorts; i++) {
+		b = &boards[i];
+		if (b->running)
+			pthread_join(b->thread, NULL);
+
+		if (b->p.result) {
+			passed++;
+			printf("%s: PASS  %.1fs  %.1f KB/s  %d retries\n", ports[i], b->p.secs, b->p.secs > 0 ? b->p.total / b->p.secs / 1024 : 0.0, b->p.errors);
+		}
+		else {
+			printf("%s: FAIL  %d retries\n", ports[i], b->p.errors);
+		}
+
+		if (b->p.s)
+			serialFree(b->p.s);
+	}
+	printf("%d of %d boards passed in %.1fs\n", passed, numPorts, stmSeconds() - t);
+
+	free(boards);
+
+	return passed == numPorts;
+}
+
+// exits 0 only if every board was flashed (and verified)
 int main(int argc, char **argv) {
+	stmPort_t p;
 	FILE *fw;
+	int passed;
+	int len;
 
 	// init
 	if (!loaderOptions(argc, argv)) {
 		fprintf(stderr, "Init failed, aborting\n");
-		return 0;
-	}
-
-	if ((s = initSerial(port, baud, 0)) == 0) {
-		printf("Cannot open port '%s', aborting.\n", port);
-		return 0;
+		return 1;
 	}
 
-	fw = fopen(firmFile, "r");
+	fw = fopen(firmFile, "rb");
 	if (!fw) {
 		printf("Cannot open firmware file '%s', aborting.\n", firmFile);
-		return 0;
+		return 1;
+	}
+
+	len = strlen(firmFile);
+	if (!stmImageLoad(&img, fw, len > 4 && !strcasecmp(firmFile + len - 4, ".bin"), firmBase)) {
+		printf("Cannot read firmware file '%s', aborting.\n", firmFile);
+		return 1;
+	}
+	fclose(fw);
+
+	if (numPorts > 1) {
+		passed = loaderParallel();
 	}
 	else {
-		printf("Upgrading STM on port %s from %s...\n", port, firmFile);
-		stmLoader(s, fw, overrideParity, cont);
+		memset(&p, 0, sizeof(p));
+		if ((p.s = initSerial(ports[0], baud, 0)) == 0) {
+			printf("Cannot open port '%s', aborting.\n", ports[0]);
+			return 1;
+		}
+
+		printf("Upgrading STM on port %s from %s...\n", ports[0], firmFile);
+		passed = stmLoader(&p, &img, overrideParity, cont, verify);
+		serialFree(p.s);
 	}
+	stmImageFree(&img);
 
-	return 1;
+	return !passed;
 }
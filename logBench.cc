@@ -0,0 +1,937 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+// logBench - checks and times the logger decoders and text formatters against synthetic log data,
+// writes synthetic logs (-g) and times the log readers and whole tools on them
+
+#include "logger.h"
+#include "writer.h"
+#include "attitude.h"
+#include "logGen.h"
+#include "quatosLog.h"
+#include "escLog.h"
+#include "logDump_mavlink.h"
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#define LOGBENCH_PACKETS	1024		// distinct packets to cycle through
+#define LOGBENCH_SYNC_RECS	65536		// records of the in memory log the sync scan goes over
+#define LOGBENCH_JOBS		32
+#define LOGBENCH_MAV_PACKET	(8 + 263)	// what the MAVLink export used to write for each packet
+#define LOGBENCH_ESC_RECS	20000		// records of the in memory ESC32 log the decode is checked on
+
+// a log to time the readers on, or a command to time against the log given before it
+typedef struct {
+	int type;						// 'a' AQ log, 'q' QUATOS log, 'E' ESC32 log, 't' command
+	const char *arg;
+} benchJob_t;
+
+int benchRecords = 2000000;
+loggerContext_t benchContext;		// field list being benchmarked
+benchJob_t benchJobs[LOGBENCH_JOBS];
+int benchNumJobs;
+double benchFileBytes, benchFileRecs;	// of the last log timed
+
+static double benchTime(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// the per-field switch decoder which the decode plan replaced, kept as the reference result
+static void benchDecodeRef(const char *buf, loggerRecord_t *r) {
+	float f;
+	uint16_t u16;
+	int16_t s16;
+	double d;
+	uint32_t u32;
+	int32_t s32;
+	uint8_t u8;
+	int8_t s8;
+	unsigned char fieldId;
+	int i;
+
+	for (i = 0; i < benchContext.numFields; i++) {
+		fieldId = benchContext.fields[i].fieldId;
+
+		if (fieldId >= LOG_VOLTAGE0 && fieldId <= LOG_VOLTAGE14) {
+			memcpy(&f, buf, sizeof(f));
+			r->voltages[fieldId-LOG_VOLTAGE0] = f;
+		}
+		else if (fieldId >= LOG_UKF_Q1 && fieldId <= LOG_UKF_Q4) {
+			memcpy(&f, buf, sizeof(f));
+			r->quat[fieldId-LOG_UKF_Q1] = f;
+		}
+		else if (fieldId >= LOG_MOT_MOTOR0 && fieldId <= LOG_MOT_MOTOR13) {
+			memcpy(&u16, buf, sizeof(u16));
+			r->motors[fieldId-LOG_MOT_MOTOR0] = u16;
+		}
+		else if (fieldId >= LOG_RADIO_CHANNEL0 && fieldId <= LOG_RADIO_CHANNEL17) {
+			memcpy(&s16, buf, sizeof(s16));
+			r->radioChannels[fieldId-LOG_RADIO_CHANNEL0] = s16;
+		}
+
+		switch (benchContext.fields[i].fieldType) {
+			case LOG_TYPE_DOUBLE:
+				memcpy(&d, buf, sizeof(d));
+				r->data[fieldId] = d;
+				buf += 8;
+				break;
+			case LOG_TYPE_FLOAT:
+				memcpy(&f, buf, sizeof(f));
+				r->data[fieldId] = f;
+				buf += 4;
+				break;
+			case LOG_TYPE_U32:
+				memcpy(&u32, buf, sizeof(u32));
+				r->data[fieldId] = u32;
+				buf += 4;
+				break;
+			case LOG_TYPE_S32:
+				memcpy(&s32, buf, sizeof(s32));
+				r->data[fieldId] = s32;
+				buf += 4;
+				break;
+			case LOG_TYPE_U16:
+				memcpy(&u16, buf, sizeof(u16));
+				r->data[fieldId] = u16;
+				buf += 2;
+				break;
+			case LOG_TYPE_S16:
+				memcpy(&s16, buf, sizeof(s16));
+				r->data[fieldId] = s16;
+				buf += 2;
+				break;
+			case LOG_TYPE_U8:
+				memcpy(&u8, buf, sizeof(u8));
+				r->data[fieldId] = u8;
+				buf += 1;
+				break;
+			case LOG_TYPE_S8:
+				memcpy(&s8, buf, sizeof(s8));
+				r->data[fieldId] = s8;
+				buf += 1;
+				break;
+		}
+	}
+}
+
+// build and install an 'H' header with every field; shuffled puts them in a scrambled order
+static void benchSchema(int shuffled) {
+	char fields[LOG_NUM_IDS * sizeof(loggerFields_t)];
+	int n;
+
+	n = logGenSchema(shuffled ? LOGGEN_SCHEMA_SHUFFLED : LOGGEN_SCHEMA_FULL, NULL, fields);
+	loggerContextSetFields(&benchContext, fields, n);
+}
+
+static void benchRun(const char *name, int shuffled) {
+	loggerRecord_t *ref, *rec;
+	char *packets;
+	double t, tRef, tPlan;
+	int i;
+
+	benchSchema(shuffled);
+
+	packets = (char *)malloc(LOGBENCH_PACKETS * benchContext.packetSize);
+	ref = (loggerRecord_t *)calloc(1, sizeof(loggerRecord_t));
+	rec = (loggerRecord_t *)calloc(1, sizeof(loggerRecord_t));
+
+	srand(1);
+	for (i = 0; i < LOGBENCH_PACKETS * benchContext.packetSize; i++)
+		packets[i] = rand();
+
+	// both decoders must produce identical records
+	for (i = 0; i < LOGBENCH_PACKETS; i++) {
+		benchDecodeRef(packets + i * benchContext.packetSize, ref);
+		loggerContextDecode(&benchContext, packets + i * benchContext.packetSize, rec);
+		if (memcmp(ref, rec, sizeof(loggerRecord_t))) {
+			fprintf(stderr, "logBench: %s: decoders differ at packet %d\n", name, i);
+			exit(1);
+		}
+	}
+
+	t = benchTime();
+	for (i = 0; i < benchRecords; i++)
+		benchDecodeRef(packets + (i % LOGBENCH_PACKETS) * benchContext.packetSize, ref);
+	tRef = benchTime() - t;
+
+	t = benchTime();
+	for (i = 0; i < benchRecords; i++)
+		loggerContextDecode(&benchContext, packets + (i % LOGBENCH_PACKETS) * benchContext.packetSize, rec);
+	tPlan = benchTime() - t;
+
+	// keep the results live
+	if (memcmp(ref, rec, sizeof(loggerRecord_t)))
+		fprintf(stderr, "logBench: %s: decoders differ\n", name);
+
+	printf("%-10s %3d fields %4d bytes  switch: %8.1f MB/s %6.2f Mrec/s  plan: %8.1f MB/s %6.2f Mrec/s  (x%.2f)\n",
+		name, benchContext.numFields, benchContext.packetSize,
+		benchRecords * (double)benchContext.packetSize / tRef / 1e6, benchRecords / tRef / 1e6,
+		benchRecords * (double)benchContext.packetSize / tPlan / 1e6, benchRecords / tPlan / 1e6,
+		tRef / tPlan);
+
+	free(packets);
+	free(ref);
+	free(rec);
+	loggerContextReset(&benchContext);
+}
+
+// the checksum loop each packet used to go through
+static void benchChecksumRef(const char *buf, int len, unsigned char *ckA, unsigned char *ckB) {
+	int i;
+
+	for (i = 0; i < len; i++) {
+		*ckA += buf[i];
+		*ckB += *ckA;
+	}
+}
+
+// loggerChecksum() against the byte loop, for 'M' packets and the much longer 'L' records
+static void benchChecksumLen(const char *packets, int len) {
+	unsigned char ckA, ckB, refA, refB, sum = 0, refSum = 0;
+	double t, tRef, tSimd;
+	int i;
+
+	t = benchTime();
+	for (i = 0; i < benchRecords; i++) {
+		refA = refB = 0;
+		benchChecksumRef(packets + (i % LOGBENCH_PACKETS) * len, len, &refA, &refB);
+		refSum += refA ^ refB;
+	}
+	tRef = benchTime() - t;
+
+	t = benchTime();
+	for (i = 0; i < benchRecords; i++) {
+		ckA = ckB = 0;
+		loggerChecksum(packets + (i % LOGBENCH_PACKETS) * len, len, &ckA, &ckB);
+		sum += ckA ^ ckB;
+	}
+	tSimd = benchTime() - t;
+
+	if (sum != refSum) {
+		fprintf(stderr, "logBench: checksum: %d byte packets sum to %02x instead of %02x\n", len, sum, refSum);
+		exit(1);
+	}
+
+	printf("%-10s %4d bytes  bytes: %8.1f MB/s %6.2f Mrec/s  blocks: %8.1f MB/s %6.2f Mrec/s  (x%.2f)\n",
+		"checksum", len, benchRecords * (double)len / tRef / 1e6, benchRecords / tRef / 1e6,
+		benchRecords * (double)len / tSimd / 1e6, benchRecords / tSimd / 1e6, tRef / tSimd);
+}
+
+static void benchChecksum(void) {
+	unsigned char ckA, ckB, refA, refB;
+	char *packets;
+	int size;
+	int i, j;
+
+	benchSchema(0);
+
+	size = benchContext.packetSize > (int)sizeof(loggerRecord_t) - 2 ? benchContext.packetSize : (int)sizeof(loggerRecord_t) - 2;
+	packets = (char *)malloc(LOGBENCH_PACKETS * size);
+
+	srand(1);
+	for (i = 0; i < LOGBENCH_PACKETS * size; i++)
+		packets[i] = rand();
+
+	// every length and alignment up to a few blocks, carrying on from any starting sums
+	for (i = 0; i < 100; i++)
+		for (j = 0; j < 16; j++) {
+			refA = ckA = rand();
+			refB = ckB = rand();
+			benchChecksumRef(packets + j, i, &refA, &refB);
+			loggerChecksum(packets + j, i, &ckA, &ckB);
+			if (ckA != refA || ckB != refB) {
+				fprintf(stderr, "logBench: checksum: %d bytes at offset %d sum to %02x %02x instead of %02x %02x\n",
+					i, j, ckA, ckB, refA, refB);
+				exit(1);
+			}
+		}
+
+	benchChecksumLen(packets, benchContext.packetSize);
+	benchChecksumLen(packets, sizeof(loggerRecord_t) - 2);
+
+	free(packets);
+	loggerContextReset(&benchContext);
+}
+
+static void benchCountError(loggerMap_t *m, const char *s) {
+	(*(int *)m->user)++;
+}
+
+// Packets found in a generated log with 'H' headers, 'L' records, garbage and damaged records,
+// read straight from memory the way a mapped log file is.
+static void benchSync(void) {
+	writerStruct_t *w;
+	logGenOpts_t o;
+	logGenStats_t st;
+	loggerMap_t m;
+	loggerRecord_t *rec;
+	const char *pkt;
+	double t, tScan, tRead;
+	int errors = 0, found, n, passes;
+	int i;
+
+	logGenDefaults(&o);
+	o.records = LOGBENCH_SYNC_RECS;
+	o.headerEvery = LOGBENCH_SYNC_RECS / 4;
+	o.lEvery = 1000;
+	o.corruptEvery = 500;
+
+	w = writerInit(NULL, 0);
+	logGenAq(w, &o, &st);
+	rec = (loggerRecord_t *)calloc(1, sizeof(loggerRecord_t));
+
+	memset(&m, 0, sizeof(m));
+	m.base = w->buf;
+	m.size = w->len;
+	m.fd = -1;
+	m.notify = -1;
+	m.ctx = &benchContext;
+	m.error = benchCountError;
+	m.user = &errors;
+
+	// every record but the damaged ones is found, and each damaged one is a checksum error
+	for (found = 0; loggerMapNextPacket(&m, &pkt) != EOF; found++)
+		;
+	if (found != (int)(st.records - st.damaged) || errors != (int)st.damaged) {
+		fprintf(stderr, "logBench: sync: %d packets and %d errors, expected %d and %d\n",
+			found, errors, (int)(st.records - st.damaged), (int)st.damaged);
+		exit(1);
+	}
+
+	passes = (benchRecords + found - 1) / found;
+
+	t = benchTime();
+	for (i = 0, n = 0; i < passes; i++) {
+		loggerMapRewind(&m);
+		while (loggerMapNextPacket(&m, &pkt) != EOF)
+			n++;
+	}
+	tScan = benchTime() - t;
+
+	t = benchTime();
+	for (i = 0; i < passes; i++) {
+		loggerMapRewind(&m);
+		while (loggerMapReadEntry(&m, rec) != EOF)
+			n--;
+	}
+	tRead = benchTime() - t;
+
+	if (n)
+		fprintf(stderr, "logBench: sync: scan and read differ\n");
+
+	printf("%-10s %9d recs %6.1f MB  scan: %8.1f MB/s %6.2f Mrec/s  scan+decode: %8.1f MB/s %6.2f Mrec/s\n",
+		"sync", found * passes, m.size * (double)passes / 1e6,
+		m.size * (double)passes / tScan / 1e6, found * (double)passes / tScan / 1e6,
+		m.size * (double)passes / tRead / 1e6, found * (double)passes / tRead / 1e6);
+
+	free(rec);
+	writerFree(w);
+	loggerContextReset(&benchContext);
+}
+
+// "%.15G" through snprintf() and the writer, over values shaped like decoded log fields
+static void benchFormat(void) {
+	double *vals;
+	char ref[WRITER_NUM_SIZE], out[WRITER_NUM_SIZE];
+	double t, tRef, tWriter;
+	size_t lRef = 0, lWriter = 0;
+	int i;
+
+	vals = (double *)malloc(LOGBENCH_PACKETS * sizeof(double));
+
+	srand(1);
+	for (i = 0; i < LOGBENCH_PACKETS; i++) {
+		switch (i % 4) {
+			case 0:		// counters and u16/s16 fields
+				vals[i] = rand() % 65536 - 32768;
+				break;
+			case 1:		// float sensor values
+				vals[i] = (float)((rand() - RAND_MAX/2) / 1e6);
+				break;
+			case 2:		// lat/lon
+				vals[i] = (rand() / (double)RAND_MAX - 0.5) * 360.0;
+				break;
+			case 3:		// small floats
+				vals[i] = (float)(rand() / (double)RAND_MAX * 1e-3);
+				break;
+		}
+	}
+
+	for (i = 0; i < LOGBENCH_PACKETS; i++) {
+		snprintf(ref, sizeof(ref), "%.15G", vals[i]);
+		writerFormatDouble(out, vals[i]);
+		if (strcmp(ref, out)) {
+			fprintf(stderr, "logBench: format: '%s' != '%s'\n", out, ref);
+			exit(1);
+		}
+	}
+
+	t = benchTime();
+	for (i = 0; i < benchRecords; i++)
+		lRef += snprintf(ref, sizeof(ref), "%.15G", vals[i % LOGBENCH_PACKETS]);
+	tRef = benchTime() - t;
+
+	t = benchTime();
+	for (i = 0; i < benchRecords; i++)
+		lWriter += writerFormatDouble(out, vals[i % LOGBENCH_PACKETS]);
+	tWriter = benchTime() - t;
+
+	if (lRef != lWriter)
+		fprintf(stderr, "logBench: format: lengths differ\n");
+
+	printf("%-10s %9d values  snprintf: %6.2f Mnum/s  writer: %6.2f Mnum/s  (x%.2f)\n",
+		"format", benchRecords, benchRecords / tRef / 1e6, benchRecords / tWriter / 1e6, tRef / tWriter);
+
+	free(vals);
+}
+
+// the batched Euler angle kernel against attitudeEulerQuat(), over random and awkward attitudes
+static void benchAttitude(void) {
+	float *q[4], *rpy[3], *ref[3];
+	float one[4], out[3];
+	double t, tRef, tBatch, err, maxErr[3];
+	int n = LOGBENCH_PACKETS * 64;
+	int i, j, k;
+
+	for (i = 0; i < 4; i++)
+		q[i] = (float *)malloc(n * sizeof(float));
+	for (i = 0; i < 3; i++) {
+		rpy[i] = (float *)malloc(n * sizeof(float));
+		ref[i] = (float *)malloc(n * sizeof(float));
+		maxErr[i] = 0.0;
+	}
+
+	srand(1);
+	for (j = 0; j < n; j++) {
+		for (i = 0, err = 0.0; i < 4; i++) {
+			one[i] = rand() / (double)RAND_MAX * 2.0 - 1.0;
+			err += one[i] * one[i];
+		}
+		switch (j % 16) {
+			case 0:		// level, pitched up and down 90 degrees, upside down
+				one[0] = 1.0f; one[1] = one[2] = one[3] = 0.0f; err = 1.0;
+				if (j % 64 == 16) { one[0] = one[2] = (float)M_SQRT1_2; }
+				if (j % 64 == 32) { one[0] = (float)M_SQRT1_2; one[2] = -(float)M_SQRT1_2; }
+				if (j % 64 == 48) { one[0] = 0.0f; one[1] = 1.0f; }
+				break;
+			case 1:		// not quite normalized, as logged
+				err *= 1.0 + (rand() / (double)RAND_MAX - 0.5) * 1e-3;
+				break;
+		}
+		for (i = 0; i < 4; i++)
+			q[i][j] = one[i] / sqrt(err);
+	}
+
+	attitudeEulerQuatBatch(q[0], q[1], q[2], q[3], n, rpy[0], rpy[1], rpy[2]);
+	for (j = 0; j < n; j++) {
+		for (i = 0; i < 4; i++)
+			one[i] = q[i][j];
+		attitudeEulerQuat(one, out);
+		for (k = 0; k < 3; k++) {
+			ref[k][j] = out[k];
+			if (isnan(out[k]) != isnan(rpy[k][j])) {
+				fprintf(stderr, "logBench: attitude: NaN mismatch at %d\n", j);
+				exit(1);
+			}
+			// yaw may come out as +pi one way and -pi the other
+			err = fabs(out[k] - rpy[k][j]);
+			if (k == 2 && err > M_PI)
+				err = fabs(err - 2.0 * M_PI);
+			if (err > maxErr[k])
+				maxErr[k] = err;
+		}
+	}
+
+	if (maxErr[0] > ATTITUDE_TOLERANCE || maxErr[1] > ATTITUDE_TOLERANCE || maxErr[2] > ATTITUDE_TOLERANCE) {
+		fprintf(stderr, "logBench: attitude: error %g %g %g rad over tolerance\n", maxErr[0], maxErr[1], maxErr[2]);
+		exit(1);
+	}
+
+	t = benchTime();
+	for (k = 0; k < benchRecords; k += n)
+		for (j = 0; j < n; j++) {
+			for (i = 0; i < 4; i++)
+				one[i] = q[i][j];
+			attitudeEulerQuat(one, out);
+			ref[0][j] = out[0];
+		}
+	tRef = benchTime() - t;
+
+	t = benchTime();
+	for (k = 0; k < benchRecords; k += n)
+		attitudeEulerQuatBatch(q[0], q[1], q[2], q[3], n, rpy[0], rpy[1], rpy[2]);
+	tBatch = benchTime() - t;
+
+	k = (benchRecords + n - 1) / n * n;
+	printf("%-10s %9d quats  lanes %d  max err %.1e %.1e %.1e rad  scalar: %6.2f Mq/s  batch: %6.2f Mq/s  (x%.2f)\n",
+		"attitude", k, ATTITUDE_LANES, maxErr[0], maxErr[1], maxErr[2], k / tRef / 1e6, k / tBatch / 1e6, tRef / tBatch);
+
+	for (i = 0; i < 4; i++)
+		free(q[i]);
+	for (i = 0; i < 3; i++) {
+		free(rpy[i]);
+		free(ref[i]);
+	}
+}
+
+// bitwise CRC-16/MCRF4XX, the X.25 variant MAVLink uses
+static uint16_t benchMavCrcRef(const uint8_t *p, int len, uint8_t extra) {
+	uint16_t crc = 0xFFFF;
+	int i, b;
+
+	for (i = 0; i <= len; i++) {
+		crc ^= i < len ? p[i] : extra;
+		for (b = 0; b < 8; b++)
+			crc = crc & 1 ? (crc >> 1) ^ 0x8408 : crc >> 1;
+	}
+
+	return crc;
+}
+
+// Check the framing and checksums of a tlog in memory.  Returns the number of packets, or -1.
+static int benchMavCheck(const uint8_t *p, size_t len) {
+	size_t i;
+	int n, extra;
+
+	for (i = 0, n = 0; i < len; i += MAVLINK_OVERHEAD + p[i+9], n++) {
+		if (i + MAVLINK_OVERHEAD > len || p[i+8] != MAVLINK_STX || i + MAVLINK_OVERHEAD + p[i+9] > len)
+			return -1;
+		switch (p[i+13]) {
+			case MAVLINK_MSG_ID_HEARTBEAT:				extra = MAVLINK_MSG_ID_HEARTBEAT_CRC; break;
+			case MAVLINK_MSG_ID_SYS_STATUS:				extra = MAVLINK_MSG_ID_SYS_STATUS_CRC; break;
+			case MAVLINK_MSG_ID_GPS_RAW_INT:			extra = MAVLINK_MSG_ID_GPS_RAW_INT_CRC; break;
+			case MAVLINK_MSG_ID_SCALED_IMU:				extra = MAVLINK_MSG_ID_SCALED_IMU_CRC; break;
+			case MAVLINK_MSG_ID_SCALED_PRESSURE:		extra = MAVLINK_MSG_ID_SCALED_PRESSURE_CRC; break;
+			case MAVLINK_MSG_ID_ATTITUDE:				extra = MAVLINK_MSG_ID_ATTITUDE_CRC; break;
+			case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:	extra = MAVLINK_MSG_ID_GLOBAL_POSITION_INT_CRC; break;
+			case MAVLINK_MSG_ID_RC_CHANNELS_RAW:		extra = MAVLINK_MSG_ID_RC_CHANNELS_RAW_CRC; break;
+			case MAVLINK_MSG_ID_SERVO_OUTPUT_RAW:		extra = MAVLINK_MSG_ID_SERVO_OUTPUT_RAW_CRC; break;
+			default:
+				return -1;
+		}
+		if (benchMavCrcRef(p + i + 9, MAVLINK_HEADER_LEN - 1 + p[i+9], extra) != (p[i+MAVLINK_PAYLOAD+p[i+9]] | p[i+MAVLINK_PAYLOAD+p[i+9]+1] << 8))
+			return -1;
+	}
+
+	return n;
+}
+
+// the MAVLink export: packing each record straight into the writer against what it replaced,
+// one fwrite() of a padded packet and an fflush() for each packet
+static void benchMav(void) {
+	loggerRecord_t *recs;
+	writerStruct_t *w;
+	const double rpy[3] = {0.1, -0.2, 1.5};
+	FILE *fp;
+	double t, tRef, tWriter;
+	size_t len;
+	int n = benchRecords / 20;
+	int packets, i, j;
+
+	recs = (loggerRecord_t *)calloc(LOGBENCH_PACKETS, sizeof(loggerRecord_t));
+	srand(1);
+	for (i = 0; i < LOGBENCH_PACKETS; i++) {
+		for (j = 0; j < LOG_NUM_IDS; j++)
+			recs[i].data[j] = (rand() % 2000 - 1000) / 10.0;
+		recs[i].data[LOG_LASTUPDATE] = i * 5000.0;
+		recs[i].data[LOG_GPS_ITOW] = i * 5.0;
+		recs[i].data[LOG_GPS_POS_UPDATE] = i / 40;
+	}
+
+	// one pass in memory to check
+	w = writerInit(NULL, 0);
+	mavlinkInit(w, 0);
+	for (i = 0; i < LOGBENCH_PACKETS; i++)
+		mavlinkDo(&recs[i], rpy);
+	packets = benchMavCheck((uint8_t *)w->buf, w->len);
+	if (packets != (int)mavlinkData.packets) {
+		fprintf(stderr, "logBench: mav: bad packet in the export\n");
+		exit(1);
+	}
+	len = w->len;
+	writerFree(w);
+
+	if ((fp = fopen("/dev/null", "wb")) == NULL) {
+		fprintf(stderr, "logBench: mav: cannot open /dev/null\n");
+		return;
+	}
+
+	t = benchTime();
+	for (i = 0; i < n; i++)
+		for (j = 0; j < packets / LOGBENCH_PACKETS; j++) {
+			fwrite(recs, LOGBENCH_MAV_PACKET, 1, fp);
+			fflush(fp);
+		}
+	tRef = benchTime() - t;
+
+	w = writerInit(fp, 0);
+	mavlinkInit(w, 0);
+	t = benchTime();
+	for (i = 0; i < n; i++)
+		mavlinkDo(&recs[i % LOGBENCH_PACKETS], rpy);
+	writerFlush(w);
+	tWriter = benchTime() - t;
+	writerFree(w);
+	fclose(fp);
+
+	printf("%-10s %9d records %4.1f packets %5.1f bytes  per packet: %6.2f Mrec/s  writer: %6.2f Mrec/s  (x%.2f)\n",
+		"mav", n, packets / (double)LOGBENCH_PACKETS, len / (double)packets, n / tRef / 1e6, n / tWriter / 1e6, tRef / tWriter);
+
+	free(recs);
+}
+
+// read a whole AQ log, through the packet scan alone and then decoding each record
+static void benchFileAq(const char *fname) {
+	loggerContext_t *c;
+	loggerRecord_t *rec;
+	const char *pkt;
+	double t, tScan, tRead;
+	int errors = 0, scanErrors, n = 0;
+
+	if (!(c = loggerContextOpen(fname))) {
+		fprintf(stderr, "logBench: cannot open AQ log '%s'\n", fname);
+		exit(1);
+	}
+	c->map->error = benchCountError;
+	c->map->user = &errors;
+	rec = (loggerRecord_t *)calloc(1, sizeof(loggerRecord_t));
+
+	t = benchTime();
+	while (loggerMapNextPacket(c->map, &pkt) != EOF)
+		n++;
+	tScan = benchTime() - t;
+	scanErrors = errors;
+
+	loggerMapRewind(c->map);
+	t = benchTime();
+	while (loggerContextRead(c, rec) != EOF)
+		;
+	tRead = benchTime() - t;
+
+	benchFileBytes = c->map->size;
+	benchFileRecs = n;
+
+	printf("%-10s %9d recs %6.1f MB  %d errors  scan: %8.1f MB/s %6.2f Mrec/s  read: %8.1f MB/s %6.2f Mrec/s\n",
+		"aq log", n, benchFileBytes / 1e6, scanErrors,
+		benchFileBytes / tScan / 1e6, n / tScan / 1e6, benchFileBytes / tRead / 1e6, n / tRead / 1e6);
+
+	free(rec);
+	loggerContextClose(c);
+}
+
+static void benchFileQuatos(const char *fname) {
+	quatosLogReader_t *r;
+	double *rows;
+	double t;
+	FILE *fp;
+	int n = 0, k;
+
+	if (!(fp = fopen(fname, "rb"))) {
+		fprintf(stderr, "logBench: cannot open QUATOS log '%s'\n", fname);
+		exit(1);
+	}
+	r = quatosLogOpen(fp, QUATOS_LOG_FIELDS);
+	rows = (double *)malloc(QUATOS_LOG_BATCH * QUATOS_LOG_FIELDS * sizeof(double));
+
+	t = benchTime();
+	while ((k = quatosLogRead(r, rows, QUATOS_LOG_BATCH)) > 0)
+		n += k;
+	t = benchTime() - t;
+
+	benchFileBytes = ftello(fp);
+	benchFileRecs = n;
+
+	printf("%-10s %9d recs %6.1f MB  %u resyncs  read: %8.1f MB/s %6.2f Mrec/s\n",
+		"quatos log", n, benchFileBytes / 1e6, r->resyncs, benchFileBytes / t / 1e6, n / t / 1e6);
+
+	free(rows);
+	quatosLogClose(r);
+	fclose(fp);
+}
+
+// the CAN status bitfields escLogDump used to read, as a reference for the decoded columns
+typedef struct {
+	unsigned int state :	3;
+	unsigned int vin :		12;
+	unsigned int amps :		14;
+	unsigned int rpm :		15;
+	unsigned int duty :		8;
+	unsigned int temp :		9;
+	unsigned int errCode :	3;
+} __attribute__((gcc_struct, packed)) benchEscStatusRef_t;
+
+// read an ESC32 log from logGen back and check every column against the records it wrote
+static void benchEscCheck(void) {
+	logGenOpts_t o;
+	logGenStats_t st;
+	writerStruct_t *w;
+	escLogReader_t *r;
+	escLogBatch_t *b;
+	benchEscStatusRef_t ref;
+	const unsigned char *p;
+	uint32_t micros;
+	FILE *fp;
+	int n = 0, bad = 0, k, i;
+
+	logGenDefaults(&o);
+	o.records = LOGBENCH_ESC_RECS;
+	w = writerInit(NULL, 0);
+	logGenEsc(w, &o, &st);
+
+	if (!(fp = tmpfile())) {
+		fprintf(stderr, "logBench: esc: cannot open a temporary file\n");
+		exit(1);
+	}
+	fwrite(w->buf, 1, w->len, fp);
+	rewind(fp);
+
+	r = escLogOpen(fp);
+	b = (escLogBatch_t *)malloc(sizeof(escLogBatch_t));
+	while ((k = escLogRead(r, b)) > 0) {
+		for (i = 0; i < k && n < LOGBENCH_ESC_RECS; i++, n++) {
+			p = (const unsigned char *)w->buf + (size_t)n * ESC_LOG_REC_SIZE;
+			memcpy(&micros, p + 2, sizeof(micros));
+			memcpy(&ref, p + 6, sizeof(ref));
+			if (b->id[i] != (p[1] & 0x3f) || b->micros[i] != micros || b->state[i] != ref.state || b->vin[i] != ref.vin ||
+				b->amps[i] != ref.amps || b->rpm[i] != ref.rpm || b->duty[i] != ref.duty || b->temp[i] != ref.temp || b->errCode[i] != ref.errCode)
+				bad++;
+		}
+		n += k - i;
+	}
+
+	if (bad || n != LOGBENCH_ESC_RECS) {
+		fprintf(stderr, "logBench: esc: %d of %d records decoded wrong, %d read\n", bad, LOGBENCH_ESC_RECS, n);
+		exit(1);
+	}
+
+	free(b);
+	escLogClose(r);
+	fclose(fp);
+	writerFree(w);
+}
+
+static void benchFileEsc(const char *fname) {
+	escLogReader_t *r;
+	escLogBatch_t *b;
+	double t;
+	FILE *fp;
+	int n = 0, k;
+
+	if (!(fp = fopen(fname, "rb"))) {
+		fprintf(stderr, "logBench: cannot open ESC32 log '%s'\n", fname);
+		exit(1);
+	}
+	benchEscCheck();
+
+	r = escLogOpen(fp);
+	b = (escLogBatch_t *)malloc(sizeof(escLogBatch_t));
+
+	t = benchTime();
+	while ((k = escLogRead(r, b)) > 0)
+		n += k;
+	t = benchTime() - t;
+
+	benchFileBytes = ftello(fp);
+	benchFileRecs = n;
+
+	printf("%-10s %9d recs %6.1f MB  %u resyncs  read: %8.1f MB/s %6.2f Mrec/s\n",
+		"esc log", n, benchFileBytes / 1e6, r->resyncs, benchFileBytes / t / 1e6, n / t / 1e6);
+
+	free(b);
+	escLogClose(r);
+	fclose(fp);
+}
+
+// a whole tool run, against the size of the log timed before it
+static void benchCommand(const char *cmd) {
+	double t;
+	int ret;
+
+	fflush(stdout);
+	t = benchTime();
+	ret = system(cmd);
+	t = benchTime() - t;
+
+	if (ret)
+		fprintf(stderr, "logBench: '%s' returned %d\n", cmd, ret);
+
+	printf("%-10s %6.2f s  %8.1f MB/s %6.2f Mrec/s  %s\n",
+		"command", t, benchFileBytes / t / 1e6, benchFileRecs / t / 1e6, cmd);
+}
+
+// write a synthetic log of type aq, quatos, esc or esc2 (ESC32v2)
+static void benchGenerate(const char *type, const char *fname, logGenOpts_t *o) {
+	writerStruct_t *w;
+	logGenStats_t st;
+	FILE *fp;
+
+	if (!fname) {
+		fprintf(stderr, "logBench: -g needs an output file (-o)\n");
+		exit(1);
+	}
+	if (!(fp = fopen(fname, "wb"))) {
+		fprintf(stderr, "logBench: cannot open output file '%s'\n", fname);
+		exit(1);
+	}
+	w = writerInit(fp, 0);
+
+	if (!strcmp(type, "aq")) {
+		logGenAq(w, o, &st);
+	}
+	else if (!strcmp(type, "quatos")) {
+		logGenQuatos(w, o, &st);
+	}
+	else if (!strcmp(type, "esc") || !strcmp(type, "esc2")) {
+		o->escV2 = type[3] == '2';
+		logGenEsc(w, o, &st);
+	}
+	else {
+		fprintf(stderr, "logBench: unknown log type '%s'\n", type);
+		exit(1);
+	}
+
+	writerFree(w);
+	fclose(fp);
+
+	fprintf(stderr, "logBench: %s: %llu records, %.1f MB, %d headers, %llu garbled, %llu damaged\n", fname,
+		(unsigned long long)st.records, st.bytes / 1e6, st.headers, (unsigned long long)st.garbled, (unsigned long long)st.damaged);
+}
+
+void benchUsage(void) {
+	fprintf(stderr, "usage: logBench [-n records] [-a aq.log] [-q quatos.log] [-E esc.log] [-t command] ...\n");
+	fprintf(stderr, "       logBench -g (aq|quatos|esc|esc2) -o file [-n records] [-s MB] [-S (full|shuffled|short|random)]\n");
+	fprintf(stderr, "                [-H n] [-L n] [-c n] [-e escs] [-r seed]\n\n");
+	fprintf(stderr, "   -n   records each benchmark runs over, or records to generate\n");
+	fprintf(stderr, "   -a, -q, -E  time the readers over a whole AQ, QUATOS or ESC32 log\n");
+	fprintf(stderr, "   -t   time a command (through the shell) against the size of the log given before it\n");
+	fprintf(stderr, "   -g   write a synthetic log of a made up flight instead:\n");
+	fprintf(stderr, "        -s stop once it is this many MB, -S fields logged, -H repeat the header every n records,\n");
+	fprintf(stderr, "        -L every n'th record as an 'L' record, -c damage every n'th record, -e ESCs in an ESC32 log\n");
+}
+
+int main(int argc, char **argv) {
+	logGenOpts_t o;
+	const char *genType = NULL, *genFile = NULL;
+	int recordsSet = 0;
+	int ch;
+	int i;
+
+	logGenDefaults(&o);
+
+	while ((ch = getopt(argc, argv, "n:g:o:s:S:H:L:c:e:r:a:q:E:t:h")) != -1) {
+		switch (ch) {
+			case 'n':
+				benchRecords = atoi(optarg);
+				recordsSet = 1;
+				break;
+			case 'g':
+				genType = optarg;
+				break;
+			case 'o':
+				genFile = optarg;
+				break;
+			case 's':
+				o.size = (uint64_t)(atof(optarg) * 1024 * 1024);
+				break;
+			case 'S':
+				if ((o.schema = logGenSchemaByName(optarg)) < 0) {
+					fprintf(stderr, "logBench: unknown schema '%s'\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'H':
+				o.headerEvery = atoi(optarg);
+				break;
+			case 'L':
+				o.lEvery = atoi(optarg);
+				break;
+			case 'c':
+				o.corruptEvery = atoi(optarg);
+				break;
+			case 'e':
+				o.numEscs = atoi(optarg);
+				break;
+			case 'r':
+				o.seed = strtoul(optarg, NULL, 0);
+				break;
+			case 'a':
+			case 'q':
+			case 'E':
+			case 't':
+				if (benchNumJobs == LOGBENCH_JOBS) {
+					fprintf(stderr, "logBench: too many logs and commands\n");
+					exit(1);
+				}
+				benchJobs[benchNumJobs].type = ch;
+				benchJobs[benchNumJobs++].arg = optarg;
+				break;
+			case 'h':
+			default:
+				benchUsage();
+				exit(0);
+		}
+	}
+
+	if (benchRecords < 1)
+		benchRecords = 1;
+
+	if (genType) {
+		if (recordsSet)
+			o.records = benchRecords;
+		else if (o.size)
+			o.records = ~(uint64_t)0;
+		benchGenerate(genType, genFile, &o);
+		return 0;
+	}
+
+	benchRun("decode", 0);
+	benchRun("shuffled", 1);
+	benchChecksum();
+	benchSync();
+	benchFormat();
+	benchAttitude();
+	benchMav();
+
+	for (i = 0; i < benchNumJobs; i++) {
+		switch (benchJobs[i].type) {
+			case 'a':
+				benchFileAq(benchJobs[i].arg);
+				break;
+			case 'q':
+				benchFileQuatos(benchJobs[i].arg);
+				break;
+			case 'E':
+				benchFileEsc(benchJobs[i].arg);
+				break;
+			case 't':
+				benchCommand(benchJobs[i].arg);
+				break;
+		}
+	}
+
+	return 0;
+}
@@ -17,10 +17,12 @@
 */
 
 #include "logDump.h"
-#ifdef USE_MAVLINK
-	#include "logDump_mavlink.h"
-#endif
+#include "logDump_mavlink.h"
 #include "plotter.h"
+#include "writer.h"
+#include "colExport.h"
+#include "logStats.h"
+#include "attitude.h"
 #include <stdlib.h>
 #include <errno.h>
 #include <stdio.h>
@@ -29,6 +31,15 @@
 #include <math.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <signal.h>
+#if defined (__WIN32__)
+	#include <fcntl.h>
+	#include <io.h>
+#else
+	#include <unistd.h>
+#endif
 #include <algorithm>
 
 // include export formatting templates (gpx/kml)
@@ -41,31 +52,46 @@ bool exportMAV;
 int dumpNum;
 int dumpOrder[NUM_FIELDS];
 const char *dumpHeaders[NUM_FIELDS];
-int gpxWptCnt;
-int gpxTrkCnt;
-unsigned camTrigActivatedTime;
-unsigned camTrigLastActive;
-unsigned camTrigCnt;
-double lastGpsFixTime;
-double homeLat, homeLon;
+int dumpThreads;		// worker threads for flat text export, 0 for one per CPU
+bool dumpQuiet;			// no progress or per-log messages (batch mode)
+char *dumpOutDir;		// batch mode: directory for the per-log exports
+volatile sig_atomic_t dumpInterrupted;	// --follow was stopped with ^C
+// state carried from record to record, per thread so export slices can run in parallel (see logDumpState_t)
+__thread logDumpTrigger_t camTrig;
+__thread double homeLat, homeLon;
+__thread bool homeSet;
+__thread logDumpAttitude_t dumpAttitude;
+// state of the log being exported, per thread so a batch can export several logs at once (see logDumpReset())
+__thread int gpxWptCnt;
+__thread int gpxTrkCnt;
+__thread double lastGpsFixTime;
+__thread char *trackName;
 double *dumpYMin, *dumpYMax;
 double *dumpXMin, *dumpXMax;
+plotterSeries_t **dumpSeries;	// per-value plot series, filled in the same pass as the extents
 char *trackDateStr;
-char *gpxWaypoints;
+__thread writerStruct_t *gpxWaypoints;	// waypoints held until the track is closed
 
-filespec_t logfilespec;
-loggerRecord_t logEntry;
-time_t towStartTime;
-FILE *outFP;
+__thread filespec_t logfilespec;
+__thread loggerRecord_t logEntry;
+__thread time_t towStartTime;
+__thread FILE *dumpOut;			// export output
+__thread writerStruct_t *dumpWriter;	// flat text export output, buffers dumpOut
+__thread colExport_t *dumpCols;		// binary column export output
+profiler_t dumpProfiler;		// --stats of the whole run
+__thread profiler_t *dumpProf;	// this thread's, NULL without --stats
 
 static const char *blnk = "";
 
 void usage(void) {
 	char outTxt[8000] = "\n\
-Usage: logDump [options] [values] [plot options] logfile [ > outfile.ext ]\n\n\
+Usage: logDump [options] [values] [plot options] logfile [ > outfile.ext ]\n\
+       logDump [options] [values] --out-dir dir (logfile|dir) ...\n\n\
 Options Summary (see below for shorthand option names):\n\n\
-	[--exp-format (csv|tab|gpx|kml)] [--col-headers] [--plot]\n\
-	[--out-freq HZ] [--range-min num] [--range-max num]\n\
+	[--exp-format (csv|tab|gpx|kml|col)] [--exp-delta] [--col-headers] [--plot]\n\
+	[--summary] [--stats[=json]] [--profile[=json]]\n\
+	[--out-freq HZ] [--range-min num] [--range-max num] [--threads num]\n\
+	[--build-index] [--verify] [--out-dir dir] [--follow[=secs]]\n\
 	[ --gps-track\n\
 		[--gps-wpoints (include|only)]\n\
 		[--alt-source (press|ukf)] [--alt-offset num]\n\
@@ -77,15 +103,43 @@ Options Summary (see below for shorthand option names):\n\n\
 Option Details:\n\
 \n\
  --exp-format (-e) type\n\
-	Defines the export format. One of: txt, csv, tab, gpx, or kml.\n\
+	Defines the export format. One of: txt, csv, tab, gpx, kml, col or mav.\n\
 	(KML and GPX only work with the --gps-track option).\n\
+	col writes binary, typed columns in chunks with min/max statistics\n\
+	(see colExport.h); --gps-time values are in ms since 1970.\n\
+	mav writes a MAVLink telemetry log (.tlog) of attitude, sensors,\n\
+	position, radio and motors for ground station replay; it needs\n\
+	no values and stamps packets with the date from --log-date.\n\
+\n\
+ --exp-delta (-z)\n\
+	Store whole number columns of col exports as differences between\n\
+	rows where that is smaller (timestamps, counters).\n\
 \n\
  --col-headers (-c)\n\
 	Include column headings row in the export.\n\
 \n\
  --plot (-p)\n\
 	Plot the data instead of exporting it (ignores -e & -c options).\n\
+	Each value is reduced to the first, last, lowest and highest sample\n\
+	of each pixel column, so peaks stay visible; use -fullres to plot\n\
+	every sample.\n\
 	(See plotting options, below. Use -h to get details.)\n\
+\n\
+ --summary (-S)\n\
+	Write the lowest, highest and mean value and the number of samples\n\
+	of each value instead of exporting them. For whole logs at 200Hz\n\
+	these come from the log's statistics file (logfile.sts), which\n\
+	gains each value the first time it is asked for. Plots of long logs\n\
+	are drawn from this file too, once it has their values.\n\
+\n\
+ --stats[=json]\n\
+	At exit, print the records read and exported, checksum errors by\n\
+	record type, bytes skipped resynchronizing and records dropped by\n\
+	the GPS accuracy filters to stderr, as text or a line of JSON.\n\
+\n\
+ --profile[=json]\n\
+	Same as --stats, plus the time spent in each stage (scan, checksum,\n\
+	decode, filter, derive, format, write) summed over the threads.\n\
 \n\
  --out-freq (-f) number\n\
 	Frequency of log dump output in whole Hz. Valid values are\n\
@@ -93,10 +147,37 @@ Option Details:\n\
 	in which case it is 5.\n\
 \n\
  --range-min (-m) number\n\
-	Start export at this record number (default is 1).\n\
+	Start export at this record number (default is 1). Skips ahead\n\
+	using the log's index file (logfile.idx), which is written\n\
+	the first time it is needed.\n\
 \n\
  --range-max (-M) number\n\
 	End export at this record number (zero means all records until end).\n\
+\n\
+ --threads (-j) number\n\
+	Number of threads used for flat text (txt, csv, tab) exports;\n\
+	default is one per CPU, 1 reads the log strictly in order.\n\
+\n\
+ --build-index (-x)\n\
+	Only write (or rewrite) the index file used by --range-min.\n\
+\n\
+ --verify\n\
+	Only check the checksum of every packet, using --threads threads,\n\
+	and list the byte ranges which are not part of a valid packet;\n\
+	no values are decoded. Exits with 1 if the log has any.\n\
+\n\
+ --follow (-F)[secs]\n\
+	Keep the log open and export new records as it grows, until it\n\
+	stops growing for secs seconds (default: until ^C). GPX, KML and\n\
+	col exports are completed when following stops. A log replaced\n\
+	under its name or cut short and copied again goes on where it\n\
+	was, or from its start if it is a different log now.\n\
+\n\
+ --out-dir (-D) dir\n\
+	Export each of several logs (or every *.log file in a directory)\n\
+	to dir/logname.ext, --threads logs at a time, then list the\n\
+	records read, exported and skipped as corrupt for each. Logs of\n\
+	the same name from different directories are refused.\n\
 \n\
  --gps-track (-g)\n\
 	Dumps a GPS track log with date & time, lat, lon, altitude, and\n\
@@ -251,7 +332,10 @@ void logDumpOpts(int argc, char **argv) {
 		O_RADIO_CHAN_GT8,
 		O_ATTITUDE,
 		O_ACC_BIAS,
-		O_GMBL_TRIG
+		O_GMBL_TRIG,
+		O_STATS,
+		O_PROFILE,
+		O_VERIFY
 	};
 
 	/* options descriptor */
@@ -272,11 +356,20 @@ void logDumpOpts(int argc, char **argv) {
 		{"localtime",		no_argument,		NULL,		'l'},
 		{"col-headers",		no_argument,		NULL,		'c'},
 		{"exp-format",		required_argument,	NULL,		'e'},
+		{"exp-delta",		no_argument,		NULL,		'z'},
 		{"gps-wpoints",		required_argument,	NULL,		'w'},
 		{"alt-source",		required_argument,	NULL,		'A'},
 		{"alt-offset",		required_argument,	NULL,		'O'},
 		{"range-min",		required_argument,	NULL,		'm'},
 		{"range-max",		required_argument,	NULL,		'M'},
+		{"threads",			required_argument,	NULL,		'j'},
+		{"build-index",		no_argument,		NULL,		'x'},
+		{"out-dir",			required_argument,	NULL,		'D'},
+		{"follow",			optional_argument,	NULL,		'F'},
+		{"summary",			no_argument,		NULL,		'S'},
+		{"stats",			optional_argument,	&longOpt,	O_STATS},
+		{"profile",			optional_argument,	&longOpt,	O_PROFILE},
+		{"verify",			no_argument,		&longOpt,	O_VERIFY},
 		{"all",				no_argument,		&longOpt,	O_ALL},
 		{"micros",			no_argument,		&longOpt,	O_MICROS},
 		{"voltages",		no_argument,		&longOpt,	O_VOLTAGES},
@@ -321,7 +414,7 @@ void logDumpOpts(int argc, char **argv) {
 		{NULL,				0,					NULL,		0}
 	};
 
-	while ((ch = getopt_long(argc, argv, "hpglcyf:a:v:d:t::r:i:e:w:A:O:m:M:", longopts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, "hpglcyxzSf:a:v:d:t::r:i:e:w:A:O:m:M:j:D:F::", longopts, NULL)) != -1) {
 		switch (ch) {
 			case 'h':
 				usage();
@@ -393,10 +486,12 @@ void logDumpOpts(int argc, char **argv) {
 					exportGPX = true;
 				else if (strcmp(optarg, "kml") == 0)
 					exportKML = true;
-#ifdef USE_MAVLINK
-				else if (strcmp(optarg, "mav") == 0)
+				else if (strcmp(optarg, "col") == 0)
+					exportCol = true;
+				else if (strcmp(optarg, "mav") == 0) {
 					exportMAV = true;
-#endif
+					outputRealDate = true;
+				}
 				break;
 			case 'w':
 				if (!strcmp(optarg, "o") || !strcmp(optarg, "only"))
@@ -419,6 +514,26 @@ void logDumpOpts(int argc, char **argv) {
 			case 'M':
 				dumpRangeMax = strtoul(optarg, 0, 0);
 				break;
+			case 'j':
+				dumpThreads = atoi(optarg);
+				break;
+			case 'x':
+				dumpBuildIndex = true;
+				break;
+			case 'z':
+				exportColDelta = true;
+				break;
+			case 'D':
+				dumpOutDir = optarg;
+				break;
+			case 'F':
+				dumpFollow = true;
+				if (optarg)
+					dumpFollowIdle = atoi(optarg);
+				break;
+			case 'S':
+				dumpSummary = true;
+				break;
 			case 0:
 				switch (longOpt) {
 					case O_ALL:
@@ -568,6 +683,18 @@ void logDumpOpts(int argc, char **argv) {
 						dumpTrigger = true;
 						dumpOrder[dumpNum++] = LOG_GMBL_TRIGGER;
 						break;
+					case O_VERIFY:
+						dumpVerify = true;
+						break;
+					case O_PROFILE:
+						dumpProfile = true;
+						// no break
+					case O_STATS:
+						if ((dumpStats = profilerFormat(optarg)) == 0) {
+							fprintf(stderr, "logDump: --stats and --profile take text or json, not '%s'\n", optarg);
+							exit(1);
+						}
+						break;
 				} // longopt switch
 				break;
 			default:
@@ -577,17 +704,23 @@ void logDumpOpts(int argc, char **argv) {
 	} // while getopt has value loop
 }
 
-void attitudeExtractEulerQuat(float *q, double *yaw, double *pitch, double *roll) {
-	float q0, q1, q2, q3;
-
-	q0 = q[1];
-	q1 = q[2];
-	q2 = q[3];
-	q3 = q[0];
+// roll, pitch and yaw of a record; the export, filters and stats all ask for these so the
+// conversion is only redone when the quaternion changes
+const double *logDumpAttitude(loggerRecord_t *l) {
+	float rpy[3];
+
+	if (!dumpAttitude.valid || memcmp(dumpAttitude.quat, l->quat, sizeof(dumpAttitude.quat))) {
+		profilerBegin(dumpProf, PROFILER_DERIVE);
+		memcpy(dumpAttitude.quat, l->quat, sizeof(dumpAttitude.quat));
+		attitudeEulerQuat(dumpAttitude.quat, rpy);
+		dumpAttitude.rpy[0] = rpy[0];
+		dumpAttitude.rpy[1] = rpy[1];
+		dumpAttitude.rpy[2] = rpy[2];
+		dumpAttitude.valid = true;
+		profilerEnd(dumpProf);
+	}
 
-	*yaw = atan2((2.0f * (q0 * q1 + q3 * q2)), (q3*q3 - q2*q2 - q1*q1 + q0*q0));
-	*pitch = asin(-2.0f * (q0 * q2 - q1 * q3));
-	*roll = atan((2.0f * (q1 * q2 + q0 * q3)) / (q3*q3 + q2*q2 - q1*q1 -q0*q0));
+	return dumpAttitude.rpy;
 }
 
 //float presToAlt(float pressure) {
@@ -643,12 +776,32 @@ filespec_t extractFileName(char *fp) {
 	return r;
 }
 
+// localtime() and gmtime() which can be used from export threads
+struct tm *logDumpLocaltime(const time_t *t, struct tm *tm) {
+#if defined (__WIN32__)
+	*tm = *localtime(t);	// msvcrt already keeps one buffer per thread
+#else
+	localtime_r(t, tm);
+#endif
+	return tm;
+}
+
+struct tm *logDumpGmtime(const time_t *t, struct tm *tm) {
+#if defined (__WIN32__)
+	*tm = *gmtime(t);
+#else
+	gmtime_r(t, tm);
+#endif
+	return tm;
+}
+
 // return the UTC offset in seconds
 int getUTCOffset(void) {
 	time_t now = time(NULL);
+	struct tm ltime, utime;
 
-	struct tm ltime = *localtime(&now);
-	struct tm utime = *gmtime(&now);
+	logDumpLocaltime(&now, &ltime);
+	logDumpGmtime(&now, &utime);
 	int utcOffset = difftime(mktime(&ltime), mktime(&utime));
 
 	return utcOffset;
@@ -657,6 +810,7 @@ int getUTCOffset(void) {
 // format iTOW to full ISO8601 date-time
 void formatIsoTime(char *s, double v) {
 	char timeStr[31], buff[10];
+	struct tm tm;
 	time_t timeVal;
 	int utcOffset = getUTCOffset();
 	int utcOffsetHrs = utcOffset / 3600;
@@ -665,7 +819,7 @@ void formatIsoTime(char *s, double v) {
 	timeVal = towStartTime + (v/1000);
 	if (utcToLocal)
 		timeVal += utcOffset;
-	strftime(timeStr, 31, "%Y-%m-%dT%H:%M:%S", localtime(&timeVal));
+	strftime(timeStr, 31, "%Y-%m-%dT%H:%M:%S", logDumpLocaltime(&timeVal, &tm));
 	sprintf(buff, ".%.3d", (int)v % 1000);
 	strcat(timeStr, buff);
 	if (utcToLocal) {
@@ -706,41 +860,17 @@ double logDumpGetValue(loggerRecord_t *l, int field) {
 			break;
 		case FLD_CAM_TRIGGER:
 		case LOG_GMBL_TRIGGER:
-			// is trigger active?
-			if ( l->data[LOG_GMBL_TRIGGER] || (
-					camTrigChannel > 0 && camTrigChannel < 19 && (
-						(camTrigValue < 0 && l->radioChannels[camTrigChannel-1] < camTrigValue) ||
-						(camTrigValue > 0 && l->radioChannels[camTrigChannel-1] > camTrigValue) ||
-						(camTrigValue == 0 && l->radioChannels[camTrigChannel-1] > -TRIG_ZERO_BUFFER && l->radioChannels[camTrigChannel-1] < TRIG_ZERO_BUFFER) )
-					)) {
-				// first time this trigger is activated
-				if (!camTrigActivatedTime)
-					camTrigActivatedTime = l->data[LOG_LASTUPDATE];
-
-				// use count in LOG_GMBL_TRIGGER if available
-				val = (l->data[LOG_GMBL_TRIGGER]) ? l->data[LOG_GMBL_TRIGGER] : ++camTrigCnt;
-
-				// if a shutter delay is configured, we only want one positive return value per trigger activation, after the specified delay time
-				if (camTrigDelay && (val == camTrigLastActive || l->data[LOG_LASTUPDATE] < camTrigActivatedTime + camTrigDelay))
-					val = 0;
-			}
-			// trigger is not active
-			else {
-				val = 0;
-				camTrigActivatedTime = 0;
-			}
+			// set by logDumpTriggerUpdate() for the current record
+			val = camTrig.event;
 			break;
 		case FLD_ROLL:
-			attitudeExtractEulerQuat(l->quat, &rpy[2], &rpy[1], &rpy[0]);
-			val = rpy[0] * -1.0 * RAD_TO_DEG;
+			val = logDumpAttitude(l)[0] * -1.0 * RAD_TO_DEG;
 			break;
 		case FLD_PITCH:
-			attitudeExtractEulerQuat(l->quat, &rpy[2], &rpy[1], &rpy[0]);
-			val = rpy[1] * -1.0 * RAD_TO_DEG;
+			val = logDumpAttitude(l)[1] * -1.0 * RAD_TO_DEG;
 			break;
 		case FLD_YAW:
-			attitudeExtractEulerQuat(l->quat, &rpy[2], &rpy[1], &rpy[0]);
-			val = rpy[2] * RAD_TO_DEG;
+			val = logDumpAttitude(l)[2] * RAD_TO_DEG;
 			if (val < 0) val = 360 + val;
 			break;
 	    case FLD_ACC_PITCH :
@@ -773,12 +903,86 @@ double logDumpGetValue(loggerRecord_t *l, int field) {
 	return val;
 }
 
-void logDumpStats(loggerRecord_t *l) {
-	int i, j;
+// Advance the trigger state by one record and set t->event to its trigger value.  This is the only
+// place trigger state changes, so everything after it can read the event as often as it likes.
+void logDumpTriggerUpdate(logDumpTrigger_t *t, loggerRecord_t *l) {
+	double val;
+
+	// is trigger active?
+	if ( l->data[LOG_GMBL_TRIGGER] || (
+			camTrigChannel > 0 && camTrigChannel < 19 && (
+				(camTrigValue < 0 && l->radioChannels[camTrigChannel-1] < camTrigValue) ||
+				(camTrigValue > 0 && l->radioChannels[camTrigChannel-1] > camTrigValue) ||
+				(camTrigValue == 0 && l->radioChannels[camTrigChannel-1] > -TRIG_ZERO_BUFFER && l->radioChannels[camTrigChannel-1] < TRIG_ZERO_BUFFER) )
+			)) {
+		// first time this trigger is activated
+		if (!t->activatedTime)
+			t->activatedTime = l->data[LOG_LASTUPDATE];
+
+		// use count in LOG_GMBL_TRIGGER if available
+		val = (l->data[LOG_GMBL_TRIGGER]) ? l->data[LOG_GMBL_TRIGGER] : ++t->cnt;
+
+		// if a shutter delay is configured, we only want one positive return value per trigger activation, after the specified delay time
+		if (camTrigDelay && (val == t->lastActive || l->data[LOG_LASTUPDATE] < t->activatedTime + camTrigDelay))
+			val = 0;
+	}
+	// trigger is not active
+	else {
+		val = 0;
+		t->activatedTime = 0;
+	}
+
+	if ((bool)val)
+		t->lastActive = val;
+	t->event = val;
+}
+
+// mark the logged fields needed to calculate a value
+void logDumpFieldMask(int field, unsigned char *fieldMask) {
+	switch (field) {
+		case FLD_GPS_H_SPEED:
+			fieldMask[LOG_GPS_VELN] = fieldMask[LOG_GPS_VELE] = 1;
+			break;
+		case FLD_GPS_UTC_TIME:
+			fieldMask[LOG_GPS_ITOW] = 1;
+			break;
+		case FLD_CAM_TRIGGER:
+		case LOG_GMBL_TRIGGER:
+			fieldMask[LOG_GMBL_TRIGGER] = fieldMask[LOG_LASTUPDATE] = 1;
+			if (camTrigChannel > 0 && camTrigChannel < 19)
+				fieldMask[LOG_RADIO_CHANNEL0 + camTrigChannel-1] = 1;
+			break;
+		case FLD_ROLL:
+		case FLD_PITCH:
+		case FLD_YAW:
+			fieldMask[LOG_UKF_Q1] = fieldMask[LOG_UKF_Q2] = fieldMask[LOG_UKF_Q3] = fieldMask[LOG_UKF_Q4] = 1;
+			break;
+		case FLD_ACC_PITCH:
+		case FLD_ACC_ROLL:
+		case FLD_ACC_MAGNITUDE:
+			fieldMask[LOG_IMU_ACCX] = fieldMask[LOG_IMU_ACCY] = fieldMask[LOG_IMU_ACCZ] = 1;
+			break;
+		case FLD_MAG_MAGNITUDE:
+			fieldMask[LOG_IMU_MAGX] = fieldMask[LOG_IMU_MAGY] = fieldMask[LOG_IMU_MAGZ] = 1;
+			break;
+		case FLD_BRG_TO_HOME:
+			fieldMask[LOG_GPS_LAT] = fieldMask[LOG_GPS_LON] = 1;
+			break;
+		default:
+			if (field < LOG_NUM_IDS)
+				fieldMask[field] = 1;
+			break;
+	}
+}
+
+// update min/max extents of each exported value and add it to its plot series at x
+void logDumpStats(loggerRecord_t *l, const double x) {
+	int i;
 	double val;
 
 	for (i = 0; i < dumpNum; i++) {
 		val = logDumpGetValue(l, dumpOrder[i]);
+		plotterSeriesAdd(dumpSeries[i], x, val);
 		if (val > dumpYMax[i])
 			dumpYMax[i] = val;
 		if (val < dumpYMin[i])
@@ -786,30 +990,22 @@ void logDumpStats(loggerRecord_t *l) {
 	}
 }
 
-void logDumpHeaders(void) {
+void logDumpHeaders(writerStruct_t *w) {
 	int i;
 
 	if (dumpNum) {
 		for (i = 0; i < dumpNum; i++) {
-			printf("%s%c", dumpHeaders[dumpOrder[i]], (i < dumpNum-1 ? valueSep : 0));
+			writerString(w, dumpHeaders[dumpOrder[i]]);
+			writerChar(w, (i < dumpNum-1 ? valueSep : 0));
 		}
-		printf("\n"); // end of export row
+		writerChar(w, '\n'); // end of export row
 	}
 }
 
-void logDumpText(loggerRecord_t *l) {
-	int i, mkwpt;
-	double logVal, gpsFixTime;
-	char outStr[31];
-	char gpxTrkptOut[1000];
-	char *trackName;
-	char lclTrigWptName[40];
-	static bool homeSet;
-	unsigned trigCount;
-	expFields_t exp;
-
-	// check for home position being set
+// check for home position being set
+void logDumpHome(loggerRecord_t *l) {
 	if (homeSetChannel && posHoldChannel) {
+		profilerBegin(dumpProf, PROFILER_DERIVE);
 		if (!homeSet && (l->radioChannels[homeSetChannel-1] > 250 ||
 				(homeLat == 0.0f && l->radioChannels[posHoldChannel-1] > 250))) {
 			homeLat = logDumpGetValue(l, LOG_GPS_LAT);
@@ -818,44 +1014,104 @@ void logDumpText(loggerRecord_t *l) {
 		}
 		else if (l->radioChannels[homeSetChannel-1] < 250)
 			homeSet = false;
+		profilerEnd(dumpProf);
 	}
+}
 
-	// flat text format
-	if (!exportGPX && !exportKML && !exportMAV) {
+// write one flat text export row
+void logDumpTextRow(loggerRecord_t *l, writerStruct_t *w) {
+	char *s, *p;
+	double logVal;
+	int i;
 
-		for (i = 0; i < dumpNum; i++) {
-			logVal = logDumpGetValue(l, dumpOrder[i]);
+	s = p = writerReserve(w, LOGDUMP_ROW_SIZE);
 
-			if (dumpOrder[i] == FLD_GPS_UTC_TIME)
-				formatIsoTime(outStr, logVal);
-			else
-				sprintf(outStr, "%.15G", logVal);
+	for (i = 0; i < dumpNum; i++) {
+		logVal = logDumpGetValue(l, dumpOrder[i]);
 
-			if ((dumpOrder[i] == FLD_CAM_TRIGGER || dumpOrder[i] == LOG_GMBL_TRIGGER) && (bool)logVal)
-				camTrigLastActive = logVal;
+		if (dumpOrder[i] == FLD_GPS_UTC_TIME) {
+			formatIsoTime(p, logVal);
+			p += strlen(p);
+		}
+		else {
+			p += writerFormatDouble(p, logVal);
+		}
 
-			printf(outStr);
+		if (i < dumpNum-1)
+			*p++ = valueSep;
+	}
+	*p++ = '\n'; // end of export row
 
-			if (i < dumpNum-1)
-				printf("%c", valueSep);
+	w->len += p - s;
+}
 
-		}
-		printf("\n"); // end of export row
+// add one row to the binary column export
+void logDumpColRow(loggerRecord_t *l) {
+	double vals[NUM_FIELDS];
+	int i;
 
+	for (i = 0; i < dumpNum; i++) {
+		vals[i] = logDumpGetValue(l, dumpOrder[i]);
+
+		// the same instant formatIsoTime() shows
+		if (dumpOrder[i] == FLD_GPS_UTC_TIME)
+			vals[i] += (towStartTime + (utcToLocal ? getUTCOffset() : 0)) * 1000.0;
 	}
-#ifdef USE_MAVLINK
-	// mavlink log format (experimental)
+
+	colExportRow(dumpCols, vals);
+}
+
+void logDumpGetState(logDumpState_t *s) {
+	s->camTrig = camTrig;
+	s->homeLat = homeLat;
+	s->homeLon = homeLon;
+	s->homeSet = homeSet;
+	s->towStartTime = towStartTime;
+}
+
+void logDumpSetState(const logDumpState_t *s) {
+	camTrig = s->camTrig;
+	homeLat = s->homeLat;
+	homeLon = s->homeLon;
+	homeSet = s->homeSet;
+	towStartTime = s->towStartTime;
+}
+
+void logDumpText(loggerRecord_t *l) {
+	int mkwpt;
+	double gpsFixTime;
+	char outStr[31];
+	char gpxTrkptOut[1000];
+	int len;
+	char lclTrigWptName[40];
+	unsigned trigCount;
+	expFields_t exp;
+
+	logDumpHome(l);
+
+	profilerBegin(dumpProf, PROFILER_FORMAT);
+
+	// flat text format
+	if (!exportGPX && !exportKML && !exportMAV && !exportCol) {
+
+		logDumpTextRow(l, dumpWriter);
+
+	}
+	// binary columns
+	else if (exportCol) {
+		logDumpColRow(l);
+	}
+	// MAVLink telemetry log
 	else if (exportMAV) {
-		mavlinkDo(l);
+		mavlinkDo(l, logDumpAttitude(l));
 	}
-#endif
 	// KML/GPX format
 	else {
 
 		strcpy(exp.name, "");
 		strcpy(exp.wptstyle, "waypoint");
-		trackName = (char *) calloc(strlen(logfilespec.name)+10, sizeof(char));
-		strcpy(trackName, logfilespec.name);
+		if (!trackName)
+			trackName = (char *) calloc(strlen(logfilespec.name)+16, sizeof(char));
 		mkwpt = 0;
 
 		exp.lat = logDumpGetValue(l, LOG_GPS_LAT);
@@ -884,7 +1140,6 @@ void logDumpText(loggerRecord_t *l) {
 				sprintf(exp.name, lclTrigWptName);
 				strcpy(exp.wptstyle, "trg_waypoint");
 				mkwpt = 1;
-				camTrigLastActive = trigCount;
 			}
 		}
 
@@ -902,25 +1157,25 @@ void logDumpText(loggerRecord_t *l) {
 				gpxTrkCnt++;
 				sprintf(trackName, "%s-%d", logfilespec.name, gpxTrkCnt);
 				if (exportGPX) {
-					printf(gpxTrkEnd);
-					printf(gpxTrkStart, trackName);
+					fprintf(dumpOut, gpxTrkEnd);
+					fprintf(dumpOut, gpxTrkStart, trackName);
 				} else {
-					printf(kmlModel, trackModelURL);
-					printf(kmlTrkEnd);
-					printf(kmlTrkStart, trackName, trackAltMode);
+					fprintf(dumpOut, kmlModel, trackModelURL);
+					fprintf(dumpOut, kmlTrkEnd);
+					fprintf(dumpOut, kmlTrkStart, trackName, trackAltMode);
 				}
 			}
 			lastGpsFixTime = gpsFixTime;
 
 			if (exportGPX)
 				// template value order: lat, lon, ele, time, heading, speed
-				printf(gpxTrkptTempl, exp.lat, exp.lon, exp.alt, exp.time, exp.hdg, exp.speed);
+				fprintf(dumpOut, gpxTrkptTempl, exp.lat, exp.lon, exp.alt, exp.time, exp.hdg, exp.speed);
 			else {
-				printf(kmlTrkTimestamp, exp.time);
+				fprintf(dumpOut, kmlTrkTimestamp, exp.time);
 				// template value order: lon, lat, ele
-				printf(kmlTrkCoords, exp.lon, exp.lat, exp.alt);
+				fprintf(dumpOut, kmlTrkCoords, exp.lon, exp.lat, exp.alt);
 				// template value order: heading, tilt, roll
-				printf(kmlTrkAngles, exp.hdg, exp.pitch, exp.roll);
+				fprintf(dumpOut, kmlTrkAngles, exp.hdg, exp.pitch, exp.roll);
 			}
 
 		}
@@ -928,189 +1183,719 @@ void logDumpText(loggerRecord_t *l) {
 		if (mkwpt || gpsTrackAsWpts || gpsTrackInclWpts) {
 			if (exportGPX)
 				// template value order: lat, lon, ele, time, heading, speed, name
-				sprintf(gpxTrkptOut, gpxWptTempl, exp.lat, exp.lon, exp.alt, exp.time, exp.hdg, exp.speed, exp.name);
+				len = sprintf(gpxTrkptOut, gpxWptTempl, exp.lat, exp.lon, exp.alt, exp.time, exp.hdg, exp.speed, exp.name);
 			else
 				// str replace order: wpt name, date/time, lat, lon, alt, speed, speed (km/h), heading, climb rate,
 				//		isotime, wpt style, alt. mode, lon, lat, alt
-				sprintf(gpxTrkptOut, kmlWptTempl, exp.name, exp.time, exp.lat, exp.lon, exp.alt, exp.speed, exp.speed*3600/1000,
+				len = sprintf(gpxTrkptOut, kmlWptTempl, exp.name, exp.time, exp.lat, exp.lon, exp.alt, exp.speed, exp.speed*3600/1000,
 						exp.hdg, exp.roll, exp.pitch, -exp.climb, exp.time, exp.wptstyle, waypointAltMode, exp.lon, exp.lat, exp.alt );
 
 			if (gpsTrackAsWpts)
-				printf(gpxTrkptOut);
-			else {
-				gpxWaypoints = (char *) realloc(gpxWaypoints, (strlen(gpxWaypoints) + (strlen(gpxTrkptOut)+1)) * sizeof(char));
-				strcat(gpxWaypoints, gpxTrkptOut);
-			}
+				fprintf(dumpOut, gpxTrkptOut);
+			else
+				writerWrite(gpxWaypoints, gpxTrkptOut, len);
 		}
 
 	} // export format
+
+	profilerEnd(dumpProf);
 }
 
+// Decide whether a record is exported.  Trigger detection runs here, once for each record which passes
+// the other filters, so only records which could be exported advance the trigger state.
 bool logDumpCheckRecordForExport(const uint32_t count, loggerRecord_t *logEntry) {
-	return count >= dumpRangeMin &&
-		!(count % OUTPUT_FREQ_DIVISOR) &&
-		( !dumpTriggeredOnly || logDumpGetValue(logEntry, FLD_CAM_TRIGGER) ) &&
-		( !dumpGpsTrack || ( logDumpGetValue(logEntry, LOG_GPS_HACC) <= gpsTrackMinHAcc && logDumpGetValue(logEntry, LOG_GPS_VACC) <= gpsTrackMinVAcc) );
+	bool ret = false;
+
+	profilerBegin(dumpProf, PROFILER_FILTER);
+
+	if (count >= dumpRangeMin && !(count % OUTPUT_FREQ_DIVISOR)) {
+		if (dumpGpsTrack && !(logDumpGetValue(logEntry, LOG_GPS_HACC) <= gpsTrackMinHAcc)) {
+			profilerCount(dumpProf, PROFILER_DROP_HACC, 1);
+		}
+		else if (dumpGpsTrack && !(logDumpGetValue(logEntry, LOG_GPS_VACC) <= gpsTrackMinVAcc)) {
+			profilerCount(dumpProf, PROFILER_DROP_VACC, 1);
+		}
+		else {
+			logDumpTriggerUpdate(&camTrig, logEntry);
+			ret = !dumpTriggeredOnly || camTrig.event;
+		}
+	}
+
+	profilerEnd(dumpProf);
+
+	return ret;
 }
 
 bool logDumpProgress(const uint32_t count) {
 	// send progress indication
-	if (!(count % 1000)) {
+	if (!(count % 1000) && !dumpQuiet) {
 		fprintf(stderr, ".");
 		fflush(stderr);
 	}
 	return !dumpRangeMax || count <= dumpRangeMax;
 }
 
-int main(int argc, char **argv) {
-	FILE *lf;
-	int i, j;
-	uint32_t count = 0; // total log line counter
-	uint32_t exp_count = 0; // total exported lines counter
-	struct stat sbuf; // file stat() buffer
+void logDumpInterrupt(int sig) {
+	dumpInterrupted = 1;
+	signal(sig, SIG_DFL);
+}
 
-	outFP = stdout;
-	dumpNum = 0;
+// Read the next record into logEntry.  With --follow, waits for the log to grow when it
+// runs out, after handing over what has been exported so far.
+bool logDumpNextRecord(loggerMap_t *lf) {
+	int ret;
 
-	plotterOpts(argc, argv);
-	logDumpOpts(argc, argv);
-	argc -= optind;
-	argv += optind;
+	while (loggerMapReadEntry(lf, &logEntry) == EOF) {
+		if (!dumpFollow || dumpInterrupted)
+			return false;
 
-	fprintf(stderr, "\n");
-	if (argc < 1) {
-		fprintf(stderr, "logDump: need log file argument. Type logDump --help for usage details.\n");
-		exit(1);
+		writerFlush(dumpWriter);
+		fflush(dumpOut);
+
+		if ((ret = loggerMapWait(lf, dumpFollowIdle)) <= 0) {
+			if (ret < 0)
+				fprintf(stderr, "\nlogDump: logfile can't be read, stopped following it\n");
+			return false;
+		}
+		// another log now, its records start over from nothing while the export goes on
+		if (ret == 2) {
+			memset(&camTrig, 0, sizeof(camTrig));
+			homeLat = homeLon = 0.0;
+			homeSet = false;
+			memset(&dumpAttitude, 0, sizeof(dumpAttitude));
+			memset(&logEntry, 0, sizeof(logEntry));
+		}
 	}
-	if (dumpNum < 1) {
-		fprintf(stderr, "logDump: need at least one value to export. Type logDump --help for usage details.\n");
-		exit(1);
+
+	return true;
+}
+
+// number of CPUs available to worker threads
+int logDumpNumCPUs(void) {
+#if defined (__WIN32__)
+	const char *n = getenv("NUMBER_OF_PROCESSORS");
+
+	return n ? atoi(n) : 1;
+#else
+	return sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+// format the exported records of one slice, starting from the record contents and state saved for it
+void *logDumpTextSlice(void *arg) {
+	logDumpSlice_t *s = (logDumpSlice_t *)arg;
+	profiler_t *prof = dumpProf;
+	uint32_t i;
+
+	logDumpSetState(&s->state);
+	s->out = writerInit(NULL, LOGDUMP_ROW_SIZE * 64);
+	dumpProf = &s->prof;
+
+	for (i = s->first; i < s->last; i++) {
+		profilerBegin(dumpProf, PROFILER_DECODE);
+		loggerIndexRecord(s->idx, i - s->base, &s->rec);
+		profilerEnd(dumpProf);
+
+		if (logDumpCheckRecordForExport(i, &s->rec)) {
+			logDumpHome(&s->rec);
+			profilerBegin(dumpProf, PROFILER_FORMAT);
+			logDumpTextRow(&s->rec, s->out);
+			profilerEnd(dumpProf);
+		}
 	}
 
-	// init waypoint storage
-	gpxWaypoints = (char *) calloc(1, sizeof(char));
+	dumpProf = prof;
 
-	// determine output frequency
-	if (dumpGpsTrack && !usrSpecOutFreq) // use lower default setting for gps track log
-		outputFreq = gpsTrackFreq;
+	// the field list loggerIndexRecord() decoded with, per thread
+	loggerContextReset(loggerThreadContext());
 
-	// set up field labels (combine from logger.h and logdump.h)
-	for (i=0; i < LOG_NUM_IDS; i++)
-		dumpHeaders[i] = loggerFieldLabels[i];
-	j = 0;
-	for (i++; i < NUM_FIELDS; i++)
-		dumpHeaders[i] = logDumpFieldLabels[j++];
+	return NULL;
+}
 
-	fprintf(stderr, "logDump: opening logfile: %s\n", argv[0]);
+// Flat text export using dumpThreads threads.  The log is indexed in parallel (see loggerMapIndex()),
+// then read once in order to decide which records are exported and to carry the record contents
+// (fields missing from an 'H' header keep their last value) and the trigger/home state to the start
+// of each slice of LOGDUMP_SLICE records.  The slices are then formatted in parallel from there and
+// written out in order, so the output is the same as exporting one record at a time with logDumpText().
+// Starts at lf->pos, with count holding the number of records before it.
+// Returns the number of exported records, count is set to the number of records read.
+uint32_t logDumpTextParallel(loggerMap_t *lf, uint32_t *count) {
+	loggerIndex_t idx;
+	logDumpSlice_t *slices, *s;
+	pthread_t *threads;
+	int *running;
+	uint32_t exp_count = 0;
+	uint32_t numSlices;
+	char errType[2] = {0, 0};
+	int e;
+	uint32_t base = *count;
+	uint32_t i, j, n;
+
+	profilerBegin(dumpProf, PROFILER_SCAN);
+	loggerMapIndex(lf, &idx, dumpThreads);
+	profilerEnd(dumpProf);
+
+	slices = (logDumpSlice_t *)calloc(idx.numPackets / LOGDUMP_SLICE + 1, sizeof(logDumpSlice_t));
+	threads = (pthread_t *)calloc(dumpThreads, sizeof(pthread_t));
+	running = (int *)calloc(dumpThreads, sizeof(int));
+
+	// in order: record selection, state, progress and checksum errors as in the one-at-a-time export
+	e = 0;
+	while (*count - base < (uint32_t)idx.numPackets) {
+		if (!((*count - base) % LOGDUMP_SLICE)) {
+			s = &slices[(*count - base) / LOGDUMP_SLICE];
+			s->idx = &idx;
+			s->base = base;
+			s->first = *count;
+			s->rec = logEntry;
+			logDumpGetState(&s->state);
+			if (dumpProf && dumpProf->timing)
+				profilerInit(&s->prof, 1);
+		}
 
-	if ( !stat(argv[0], &sbuf) ) {
+		for (; e < idx.numErrors && idx.errors[e].packet == (int)(*count - base); e++) {
+			errType[0] = idx.errors[e].type;
+			lf->error(lf, errType);
+		}
 
-		// if asked to output a real date column, need to get a base date to start from
-		if (outputRealDate) {
-
-			char fileDateStr[30] = "";
-			time_t now = time(NULL);
-			// init gps track log time with current UTC time
-			struct tm* trackTime = gmtime(&now);
-
-			strftime(fileDateStr, 100, "%d-%m-%Y %H:%M:%S", localtime(&sbuf.st_mtime));
-			fprintf(stderr, "logDump: Logfile last modified: %s (UTC)\n", fileDateStr);
-
-			// set track date to log file date unless date was specified via options
-			if ( trackDateStr == NULL || strlen(trackDateStr) != 6 ) {
-				trackTime = localtime(&sbuf.st_mtime); // log date is actually in UTC time even though system thinks it's local
-			} else {
-				char tday[3], tmon[3], tyr[3];
-				strncpy(tday, trackDateStr, 2);
-				strncpy(tmon, trackDateStr+2, 2);
-				strncpy(tyr, trackDateStr+4, 2);
-				trackTime->tm_year = atoi(tyr + 0) + 100;
-				trackTime->tm_mon = atoi(tmon + 0) - 1;
-				trackTime->tm_mday = atoi(tday + 0);
+		profilerBegin(dumpProf, PROFILER_DECODE);
+		loggerIndexRecord(&idx, *count - base, &logEntry);
+		profilerEnd(dumpProf);
+		if (logDumpCheckRecordForExport((*count)++, &logEntry)) {
+			logDumpHome(&logEntry);
+			exp_count++;
+		}
+		if (!logDumpProgress(*count))
+			break;
+	}
+
+	// errors after the last record
+	if (*count - base == (uint32_t)idx.numPackets) {
+		for (; e < idx.numErrors; e++) {
+			errType[0] = idx.errors[e].type;
+			lf->error(lf, errType);
+		}
+		lf->pos = lf->size;
+	}
+
+	numSlices = (*count - base + LOGDUMP_SLICE - 1) / LOGDUMP_SLICE;
+	for (i = 0; i < numSlices; i++)
+		slices[i].last = (i == numSlices-1) ? *count : slices[i].first + LOGDUMP_SLICE;
+
+	// format dumpThreads slices at a time, the first of them in this thread
+	for (i = 0; i < numSlices; i += dumpThreads) {
+		n = std::min((uint32_t)dumpThreads, numSlices - i);
+
+		for (j = 1; j < n; j++)
+			if ((running[j] = !pthread_create(&threads[j], NULL, logDumpTextSlice, &slices[i+j])) == 0)
+				logDumpTextSlice(&slices[i+j]);
+		logDumpTextSlice(&slices[i]);
+
+		for (j = 0; j < n; j++) {
+			if (j && running[j])
+				pthread_join(threads[j], NULL);
+			writerWrite(dumpWriter, slices[i+j].out->buf, slices[i+j].out->len);
+			writerFree(slices[i+j].out);
+
+			// only the stage times, the selection above already counted what the filters dropped
+			if (dumpProf && dumpProf->timing) {
+				memset(slices[i+j].prof.counts, 0, sizeof(slices[i+j].prof.counts));
+				profilerMerge(dumpProf, &slices[i+j].prof);
 			}
+		}
+	}
 
-			// zero time values for start of week calculation (GPS Time Of Week starts on each Sunday at 00:00:00)
-			trackTime->tm_hour = 0;
-			trackTime->tm_min = 0;
-			trackTime->tm_sec = 0;
+	loggerIndexFree(&idx);
+	free(slices);
+	free(threads);
+	free(running);
 
-			// seconds to add to GPS ToW from log
-			towStartTime = mktime(trackTime);
+	return exp_count;
+}
 
-			// find the previous Sunday if we don't have it already
-			while (trackTime->tm_wday != 0) {
-				trackTime->tm_mday -= 1;
-				// TOW always starts on a Sunday
-				towStartTime = mktime(trackTime);
-			}
+// name of the seek index file kept next to a log
+char *logDumpIndexName(const char *logFile) {
+	char *s = (char *)malloc(strlen(logFile) + 5);
+
+	sprintf(s, "%s.idx", logFile);
+
+	return s;
+}
+
+// Position lf at or before record dumpRangeMin using the log's seek index, which is built (and saved
+// for next time) if it is missing or out of date.  Returns the number of records skipped.
+uint32_t logDumpSeek(loggerMap_t *lf, const char *idxFile) {
+	loggerSeek_t s;
+	uint32_t n;
+
+	if (!loggerSeekLoad(lf, &s, idxFile)) {
+		fprintf(stderr, "logDump: writing index file '%s'\n", idxFile);
+		loggerSeekBuild(lf, &s, LOGGER_SEEK_INTERVAL);
+		if (!loggerSeekSave(lf, &s, idxFile))
+			fprintf(stderr, "logDump: cannot write index file '%s'\n", idxFile);
+	}
+
+	n = loggerMapSeek(lf, &s, dumpRangeMin);
+
+	loggerSeekFree(&s);
+
+	return n;
+}
+
+// name of the statistics cache file kept next to a log
+char *logDumpStatsName(const char *logFile) {
+	char *s = (char *)malloc(strlen(logFile) + 5);
+
+	sprintf(s, "%s.sts", logFile);
+
+	return s;
+}
+
+// The statistics cache holds whole logs exported at the logging rate, from the default first record.
+bool logDumpStatsCacheable(void) {
+	return !dumpGpsTrack && !dumpTriggeredOnly && OUTPUT_FREQ_DIVISOR == 1 && dumpRangeMin == 1 && !dumpRangeMax;
+}
+
+// values which depend on settings other than those above aren't cached
+bool logDumpStatsValue(int field) {
+	return field != FLD_CAM_TRIGGER && field != LOG_GMBL_TRIGGER && field != FLD_BRG_TO_HOME;
+}
+
+bool logDumpStatsCached(const logStats_t *cache, int field) {
+	return logDumpStatsCacheable() && logDumpStatsValue(field) && logStatsFind(cache, field);
+}
+
+// set up st to collect each exported value the cache doesn't have; returns how many that is
+int logDumpStatsNeeded(logStats_t *st, const logStats_t *cache) {
+	int i;
+
+	logStatsInit(st, cache->logSize, cache->logTime);
+
+	for (i = 0; i < dumpNum; i++)
+		if (!logDumpStatsCached(cache, dumpOrder[i]) && !logStatsFind(st, dumpOrder[i]))
+			logStatsAdd(st, dumpOrder[i]);
+
+	return st->numValues;
+}
+
+// move the values of st which can be cached into the cache and write it out
+void logDumpStatsSave(logStats_t *cache, logStats_t *st, uint32_t numRecords, const char *statsFile) {
+	logStatsValue_t *v;
+	int i;
+
+	if (!logDumpStatsCacheable())
+		return;
+
+	cache->numRecords = numRecords;
+	for (i = 0; i < st->numValues; i++) {
+		if (logDumpStatsValue(st->values[i].id)) {
+			v = logStatsAdd(cache, st->values[i].id);
+			*v = st->values[i];
+			st->values[i].blocks = NULL;
+		}
+	}
+
+	if (!logStatsSave(cache, statsFile))
+		fprintf(stderr, "logDump: cannot write statistics file '%s'\n", statsFile);
+}
 
-			strftime(fileDateStr, 100, "%d-%b-%Y %H:%M:%S", trackTime);
-			fprintf(stderr, "logDump: using GPS Time of Week reference date: %s\n", fileDateStr);
+// One pass over the records to export.  Each one's values go to the plot series when plotting, and
+// to the statistics of st.  Returns the number of records exported.
+uint32_t logDumpScan(loggerMap_t *lf, uint32_t *count, logStats_t *st) {
+	loggerColumns_t logCols;
+	unsigned char fieldMask[LOG_NUM_IDS] = {0};
+	uint32_t exp_count = 0;
+	int i, j;
 
-			if (utcToLocal) {
-				// use local time in track log
-				// towStartTime += getUTCOffset();
-				fprintf(stderr, "logDump: adjusting date/time output to local time (UTC %.1fh).\n", getUTCOffset() / 3600.0f);
+	// load only the log columns needed by the exported values and the record filters
+	for (i = 0; i < dumpNum; i++)
+		logDumpFieldMask(dumpOrder[i], fieldMask);
+	if (dumpTriggeredOnly)
+		logDumpFieldMask(FLD_CAM_TRIGGER, fieldMask);
+	if (dumpGpsTrack)
+		fieldMask[LOG_GPS_HACC] = fieldMask[LOG_GPS_VACC] = 1;
+
+	profilerBegin(dumpProf, PROFILER_SCAN);
+	loggerColumnsLoad(lf, &logCols, fieldMask);
+	profilerEnd(dumpProf);
+
+	for (j = 0; j < logCols.numRecs; j++) {
+		profilerBegin(dumpProf, PROFILER_DECODE);
+		loggerColumnsRecord(&logCols, j, &logEntry);
+		profilerEnd(dumpProf);
+		if (logDumpCheckRecordForExport(*count, &logEntry)) {
+			if (dumpPlot)
+				logDumpStats(&logEntry, (double)(exp_count * OUTPUT_FREQ_DIVISOR + dumpRangeMin));
+			for (i = 0; i < st->numValues; i++)
+				logStatsUpdate(&st->values[i], *count, logDumpGetValue(&logEntry, st->values[i].id));
+			exp_count++;
+		}
+		if (!logDumpProgress(++*count))
+			break;
+	}
+
+	loggerColumnsFree(&logCols);
+
+	return exp_count;
+}
+
+// Fill in the plot series and extents from the cache, if it has every value in blocks no wider than
+// a pixel column.  Returns the number of records plotted, 0 if the log has to be read instead.
+uint32_t logDumpPlotStats(const logStats_t *cache) {
+	const logStatsValue_t *v;
+	const logStatsSummary_t *b;
+	uint32_t records = 0;			// each value of the cache covers the same records
+	double x[4], y[4];
+	int i, j, k, n;
+
+	for (i = 0; i < dumpNum; i++) {
+		v = logDumpStatsCached(cache, dumpOrder[i]) ? logStatsFind(cache, dumpOrder[i]) : NULL;
+		if (!v || !v->total.records || !plotterWidth() || v->numBlocks < plotterWidth())
+			return 0;
+		records = v->total.records;
+	}
+
+	for (i = 0; i < dumpNum; i++) {
+		v = logStatsFind(cache, dumpOrder[i]);
+
+		if (v->total.count) {
+			dumpYMin[i] = std::min(dumpYMin[i], v->total.min);
+			dumpYMax[i] = std::max(dumpYMax[i], v->total.max);
+		}
+
+		// the first, lowest, highest and last record of each block, in record order
+		for (j = 0; j < v->numBlocks; j++) {
+			b = &v->blocks[j];
+			if (!b->records)
+				continue;
+
+			x[0] = j ? j * LOG_STATS_BLOCK : dumpRangeMin;
+			y[0] = b->first;
+			x[3] = x[0] + b->records - 1;
+			y[3] = b->last;
+			n = 1;
+			if (b->count) {
+				k = b->minAt <= b->maxAt;
+				x[2-k] = b->minAt;
+				y[2-k] = b->min;
+				x[1+k] = b->maxAt;
+				y[1+k] = b->max;
+				n = 3;
+			}
+			else {
+				x[1] = x[3];
+				y[1] = y[3];
 			}
 
-		} // if outputRealDate
+			plotterSeriesAdd(dumpSeries[i], x[0], y[0]);
+			for (k = 1; k <= n; k++)
+				if (x[k] != x[k-1])
+					plotterSeriesAdd(dumpSeries[i], x[k], y[k]);
+		}
+	}
+
+	return records;
+}
+
+// write the summary of each exported value, the cache has them if it can and st the rest
+void logDumpSummary(writerStruct_t *w, const logStats_t *cache, const logStats_t *st) {
+	const logStatsValue_t *v;
+	int i;
+
+	if (includeHeaders) {
+		writerString(w, "value");
+		writerChar(w, valueSep);
+		writerString(w, "min");
+		writerChar(w, valueSep);
+		writerString(w, "max");
+		writerChar(w, valueSep);
+		writerString(w, "mean");
+		writerChar(w, valueSep);
+		writerString(w, "count\n");
+	}
+
+	for (i = 0; i < dumpNum; i++) {
+		v = logDumpStatsCached(cache, dumpOrder[i]) ? logStatsFind(cache, dumpOrder[i]) : logStatsFind(st, dumpOrder[i]);
+
+		writerString(w, dumpHeaders[dumpOrder[i]]);
+		writerChar(w, valueSep);
+		writerDouble(w, v->total.min);
+		writerChar(w, valueSep);
+		writerDouble(w, v->total.max);
+		writerChar(w, valueSep);
+		writerDouble(w, v->total.count ? v->total.sum / v->total.count : nan(""));
+		writerChar(w, valueSep);
+		writerInt(w, v->total.count);
+		writerChar(w, '\n');
+	}
+}
+
+// Work out the date GPS time of week counts from, from the log's modification date or --log-date.
+void logDumpTowStart(const struct stat *sbuf) {
+	char fileDateStr[30] = "";
+	time_t now = time(NULL);
+	struct tm tmBuf;
+	// init gps track log time with current UTC time
+	struct tm* trackTime = logDumpGmtime(&now, &tmBuf);
 
+	strftime(fileDateStr, 100, "%d-%m-%Y %H:%M:%S", logDumpLocaltime(&sbuf->st_mtime, &tmBuf));
+	if (!dumpQuiet)
+		fprintf(stderr, "logDump: Logfile last modified: %s (UTC)\n", fileDateStr);
+
+	// set track date to log file date unless date was specified via options
+	if ( trackDateStr == NULL || strlen(trackDateStr) != 6 ) {
+		trackTime = logDumpLocaltime(&sbuf->st_mtime, &tmBuf); // log date is actually in UTC time even though system thinks it's local
 	} else {
-		fprintf(stderr, "logDump: could not access logfile: %s\n", argv[0]);
-		exit(1);
+		char tday[3] = "", tmon[3] = "", tyr[3] = "";
+		strncpy(tday, trackDateStr, 2);
+		strncpy(tmon, trackDateStr+2, 2);
+		strncpy(tyr, trackDateStr+4, 2);
+		trackTime->tm_year = atoi(tyr + 0) + 100;
+		trackTime->tm_mon = atoi(tmon + 0) - 1;
+		trackTime->tm_mday = atoi(tday + 0);
 	}
 
-#if defined (__WIN32__)
-	lf = fopen(argv[0], "rb");
-#else
-	lf = fopen(argv[0], "r");
-#endif
+	// zero time values for start of week calculation (GPS Time Of Week starts on each Sunday at 00:00:00)
+	trackTime->tm_hour = 0;
+	trackTime->tm_min = 0;
+	trackTime->tm_sec = 0;
 
-	logfilespec = extractFileName(argv[0]);
+	// seconds to add to GPS ToW from log
+	towStartTime = mktime(trackTime);
 
-	if (lf) {
-		fprintf(stderr, "\n");
+	// find the previous Sunday if we don't have it already
+	while (trackTime->tm_wday != 0) {
+		trackTime->tm_mday -= 1;
+		// TOW always starts on a Sunday
+		towStartTime = mktime(trackTime);
+	}
 
-#ifdef USE_MAVLINK
-		if (exportMAV) {
-			mavlinkInit();
-			char outfileName[] = "test.mavlink";
-			outFP = fopen(outfileName, "wb");
-			if (outFP == NULL) {
-				fprintf(stderr, "logDump: cannot open output file '%s'\n", outfileName);
-				exit(0);
-			}
+	strftime(fileDateStr, 100, "%d-%b-%Y %H:%M:%S", trackTime);
+	if (!dumpQuiet)
+		fprintf(stderr, "logDump: using GPS Time of Week reference date: %s\n", fileDateStr);
+
+	if (utcToLocal && !dumpQuiet) {
+		// use local time in track log
+		// towStartTime += getUTCOffset();
+		fprintf(stderr, "logDump: adjusting date/time output to local time (UTC %.1fh).\n", getUTCOffset() / 3600.0f);
+	}
+}
+
+// start the per-thread export state over for the next log
+void logDumpReset(void) {
+	memset(&camTrig, 0, sizeof(camTrig));
+	homeLat = homeLon = 0.0;
+	homeSet = false;
+	memset(&dumpAttitude, 0, sizeof(dumpAttitude));
+	memset(&logEntry, 0, sizeof(logEntry));
+	gpxWptCnt = gpxTrkCnt = 0;
+	lastGpsFixTime = 0;
+	free(trackName);
+	trackName = NULL;
+	towStartTime = 0;
+}
+
+// checksum errors are counted for --stats, those of a batch log instead of printed
+void logDumpCountError(loggerMap_t *m, const char *s) {
+	profilerChecksumError(dumpProf, s);
+
+	if (dumpQuiet)
+		((logDumpFile_t *)m->user)->errors++;
+	else
+		loggerChecksumError(s);
+}
+
+// Check every packet of a log without decoding any, using dumpThreads threads (see loggerMapIndex()),
+// and list the byte ranges which are not part of a valid packet.  Returns 0 if there are any.
+int logDumpVerify(logDumpFile_t *f, loggerMap_t *lf) {
+	loggerIndex_t idx;
+	char errType[2] = {0, 0};
+	int i;
+
+	lf->prof = dumpProf;
+
+	profilerBegin(dumpProf, PROFILER_SCAN);
+	loggerMapIndex(lf, &idx, dumpThreads);
+	profilerEnd(dumpProf);
+
+	// the ranges say where, so the checksum errors are only counted
+	for (i = 0; i < idx.numErrors; i++) {
+		errType[0] = idx.errors[i].type;
+		profilerChecksumError(dumpProf, errType);
+	}
+
+	if (!dumpQuiet) {
+		for (i = 0; i < idx.numRanges; i++)
+			fprintf(stderr, "logDump: bytes %llu to %llu (%llu) corrupt\n", (unsigned long long)idx.ranges[i].start,
+				(unsigned long long)idx.ranges[i].end - 1, (unsigned long long)(idx.ranges[i].end - idx.ranges[i].start));
+		fprintf(stderr, "logDump: %d valid packets, %d checksum errors, %llu bytes corrupt in %d ranges\n",
+			idx.numPackets, idx.numErrors, (unsigned long long)lf->skipped, idx.numRanges);
+	}
+
+	f->count = idx.numPackets;
+	f->errors = idx.numErrors;
+
+	profilerCount(dumpProf, PROFILER_RECORDS, idx.numPackets);
+	profilerCount(dumpProf, PROFILER_BYTES_IN, lf->size);
+	profilerCount(dumpProf, PROFILER_SKIPPED, lf->skipped);
+	profilerCount(dumpProf, PROFILER_RESYNCS, lf->resyncs);
+
+	i = !idx.numRanges;
+	loggerIndexFree(&idx);
+
+	return i;
+}
+
+// Export one log to out.  Returns 0 if the log can't be read (or its index can't be written).
+int logDumpFile(logDumpFile_t *f, FILE *out) {
+	loggerMap_t *lf;
+	FILE *wptFile;
+	int i, j;
+	uint32_t count = 0; // total log line counter
+	uint32_t exp_count = 0; // total exported lines counter
+	uint32_t first; // records before the first one read
+	size_t firstPos; // and where it starts
+	struct stat sbuf; // file stat() buffer
+	char *idxFile; // seek index file of the log
+	char *statsFile; // statistics cache file of the log
+	char *logPath; // copy of the log name for extractFileName() to split up
+	int ret = 1;
+
+	dumpOut = out;
+
+	if (!dumpQuiet)
+		fprintf(stderr, "logDump: opening logfile: %s\n", f->logFile);
+
+	if ( !stat(f->logFile, &sbuf) ) {
+		// if asked to output a real date column, need to get a base date to start from
+		if (outputRealDate)
+			logDumpTowStart(&sbuf);
+	} else {
+		fprintf(stderr, "logDump: could not access logfile: %s\n", f->logFile);
+		return 0;
+	}
+
+	lf = loggerMapOpen(f->logFile);
+
+	idxFile = logDumpIndexName(f->logFile);
+	statsFile = logDumpStatsName(f->logFile);
+	logPath = strdup(f->logFile);
+	logfilespec = extractFileName(logPath);
+
+	if (lf && dumpVerify) {
+		ret = logDumpVerify(f, lf);
+		loggerMapClose(lf);
+	}
+	else if (lf && dumpBuildIndex) {
+		loggerSeek_t s;
+
+		loggerSeekBuild(lf, &s, LOGGER_SEEK_INTERVAL);
+		if (!loggerSeekSave(lf, &s, idxFile)) {
+			fprintf(stderr, "logDump: cannot write index file '%s'\n", idxFile);
+			ret = 0;
 		}
+		else if (!dumpQuiet)
+			fprintf(stderr, "logDump: %u records, %d index entries written to '%s'\n", s.numRecords, s.numEntries, idxFile);
+		f->count = s.numRecords;
+
+		loggerSeekFree(&s);
+		loggerMapClose(lf);
+	}
+	else if (lf) {
+		if (!dumpQuiet)
+			fprintf(stderr, "\n");
+		lf->error = logDumpCountError;
+		lf->user = f;
+		lf->prof = dumpProf;
+
+		if (dumpFollow) {
+			loggerMapFollow(lf);
+			signal(SIGINT, logDumpInterrupt);
+		}
+
+		// init waypoint storage, kept in a temp file if one can be made
+		wptFile = tmpfile();
+		gpxWaypoints = writerInit(wptFile, 0);
+
+		dumpWriter = writerInit(dumpOut, 0);
+		dumpWriter->prof = dumpProf;
+
+		if (exportMAV && !dumpPlot) {
+#if defined (__WIN32__)
+			_setmode(_fileno(dumpOut), _O_BINARY);
 #endif
+			mavlinkInit(dumpWriter, towStartTime);
+		}
+
+		if (exportCol && !dumpPlot) {
+			const char *names[NUM_FIELDS];
 
-		if (includeHeaders && !exportGPX && !exportKML && !exportMAV && !dumpPlot) {
+#if defined (__WIN32__)
+			_setmode(_fileno(dumpOut), _O_BINARY);
+#endif
+			for (i = 0; i < dumpNum; i++)
+				names[i] = dumpHeaders[dumpOrder[i]];
+			dumpCols = colExportInit(dumpOut, dumpNum, names, exportColDelta ? COL_EXPORT_DELTA : 0);
+		} else if (includeHeaders && !exportGPX && !exportKML && !exportMAV && !dumpPlot && !dumpSummary) {
 			// write text header
-			logDumpHeaders();
+			logDumpHeaders(dumpWriter);
 		} else if (exportGPX) {
 			// write GPX header
-			printf(gpxHeader);
+			fprintf(dumpOut, gpxHeader);
 			if (!gpsTrackAsWpts)
-				printf(gpxTrkStart, logfilespec.name);
+				fprintf(dumpOut, gpxTrkStart, logfilespec.name);
 			gpxTrkCnt++;
 		} else if (exportKML) {
 			// write KML header
 			// str replace order: document title, wpt color, wpt icon, wpt color, wpt icon,
 			// 		wpt trg color, wpt icon, wpt trg color, wpt icon, line color, line width (d), line color, line width (d)
-			printf(kmlHeader, logfilespec.name, waypointColor, waypointIconURL, waypointColor, waypointIconURL,
+			fprintf(dumpOut, kmlHeader, logfilespec.name, waypointColor, waypointIconURL, waypointColor, waypointIconURL,
 					waypointTrigColor, waypointIconURL, waypointTrigColor, waypointIconURL, trackColor, trackWidth, trackColor, trackWidth);
 			if (!gpsTrackAsWpts) {
-				printf(kmlFolderHeader, "Track", "Track");
+				fprintf(dumpOut, kmlFolderHeader, "Track", "Track");
 				// str replace order: track name, track ID, alt. mode
-				printf(kmlTrkHeader, logfilespec.name, logfilespec.name);
-				printf(kmlTrkStart, logfilespec.name, trackAltMode);
+				fprintf(dumpOut, kmlTrkHeader, logfilespec.name, logfilespec.name);
+				fprintf(dumpOut, kmlTrkStart, logfilespec.name, trackAltMode);
 			} else
-				printf(kmlFolderHeader, "Points", "Points");
+				fprintf(dumpOut, kmlFolderHeader, "Points", "Points");
 			gpxTrkCnt++;
 		}
 
+		// skip the records before the export range
+		if (dumpRangeMin > 1) {
+			count = logDumpSeek(lf, idxFile);
+			// building the index may have read all of it
+			lf->skipped = lf->resyncs = 0;
+		}
+		first = count;
+		firstPos = lf->pos;
+
+		// value statistics, from the cache where it has them
+		if (dumpSummary) {
+			logStats_t cache, st;
+
+			if (logDumpStatsCacheable())
+				logStatsLoad(&cache, statsFile, sbuf.st_size, sbuf.st_mtime);
+			else
+				logStatsInit(&cache, sbuf.st_size, sbuf.st_mtime);
+
+			if (logDumpStatsNeeded(&st, &cache)) {
+				exp_count = logDumpScan(lf, &count, &st);
+				logDumpStatsSave(&cache, &st, count, statsFile);
+			}
+			else {
+				count = first = cache.numRecords;
+				exp_count = logStatsFind(&cache, dumpOrder[0])->total.records;
+			}
+
+			logDumpSummary(dumpWriter, &cache, &st);
+
+			logStatsFree(&st);
+			logStatsFree(&cache);
+		}
 		// plot output
-		if (dumpPlot) {
-			double *xVals, *yVals;
+		else if (dumpPlot) {
+			logStats_t cache, st;
 
 			// need to get X & Y extents for all plotted values to initialize plotter
 
@@ -1118,65 +1903,62 @@ int main(int argc, char **argv) {
 			dumpYMax = (double *)calloc(dumpNum, sizeof(double));
 			dumpXMin = (double *)calloc(dumpNum, sizeof(double));
 			dumpXMax = (double *)calloc(dumpNum, sizeof(double));
+			dumpSeries = (plotterSeries_t **)calloc(dumpNum, sizeof(plotterSeries_t *));
+			for (i = 0; i < dumpNum; i++)
+				dumpSeries[i] = plotterSeriesInit();
 			// initialize with bogus values
 			std::fill(dumpYMin, dumpYMin + dumpNum, +9999999.99);
 			std::fill(dumpYMax, dumpYMax + dumpNum, -9999999.99);
 
-			// force header read
-			loggerReadEntry(lf, &logEntry);
-			rewind(lf);
-
-			// read through entire log to update dumpYMin/dumpYMax extents for each value being exported
-			while (loggerReadEntry(lf, &logEntry) != EOF) {
-				if (logDumpCheckRecordForExport(count++, &logEntry)) {
-					logDumpStats(&logEntry);
-					exp_count++;
-				}
-				if (!logDumpProgress(count))
-					break;
+			// collect every plotted value along with its dumpYMin/dumpYMax extents, from the statistics
+			// cache if it has them, else from the log (adding them to the cache for next time)
+			logStatsLoad(&cache, statsFile, sbuf.st_size, sbuf.st_mtime);
+			if ((exp_count = logDumpPlotStats(&cache)) != 0) {
+				count = first = cache.numRecords;
 			}
+			else {
+				if (logDumpStatsCacheable())
+					logDumpStatsNeeded(&st, &cache);
+				else
+					logStatsInit(&st, cache.logSize, cache.logTime);
+				exp_count = logDumpScan(lf, &count, &st);
+				if (st.numValues)
+					logDumpStatsSave(&cache, &st, count, statsFile);
+				logStatsFree(&st);
+			}
+			logStatsFree(&cache);
 
 			// NOTE: everything below assumes that all logged columns (values) have the same number of samples (exp_count).
-			// We could do this per value instead (inside the next log reading loop) but at this point it's overkill.
-
-			xVals = (double *)calloc(exp_count, sizeof(double));
-			yVals = (double *)calloc(exp_count, sizeof(double));
-
-			// populate X graph values with zero through n samples
-			for (i = 0; i < exp_count; i++)
-				xVals[i] = (double)(i * OUTPUT_FREQ_DIVISOR + dumpRangeMin);
 
-			std::fill(dumpXMin, dumpXMin + dumpNum, *std::min_element(xVals, xVals + exp_count));
-			std::fill(dumpXMax, dumpXMax + dumpNum, *std::max_element(xVals, xVals + exp_count));
+			// X graph values are the export sample numbers
+			std::fill(dumpXMin, dumpXMin + dumpNum, (double)dumpRangeMin);
+			std::fill(dumpXMax, dumpXMax + dumpNum, (double)((exp_count ? exp_count - 1 : 0) * OUTPUT_FREQ_DIVISOR + dumpRangeMin));
 
 			if (!plotterInit(dumpNum, dumpYMin, dumpYMax, dumpXMin, dumpXMax))
 				exit(1);
 
 			for (i = 0; i < dumpNum; i++) {
-				rewind(lf);
-				count = exp_count = 0;
-				while (loggerReadEntry(lf, &logEntry) != EOF) {
-					if (logDumpCheckRecordForExport(count++, &logEntry))
-						yVals[exp_count++] = logDumpGetValue(&logEntry, dumpOrder[i]);
-
-					if (!logDumpProgress(count))
-						break;
-				}
-				plotterLine(exp_count, i, xVals, yVals, dumpHeaders[dumpOrder[i]]);
+				j = plotterSeriesPoints(dumpSeries[i]);
+				plotterLine(j, i, dumpSeries[i]->x, dumpSeries[i]->y, dumpHeaders[dumpOrder[i]]);
 			}
 
 			plotterEnd();
 
+			for (i = 0; i < dumpNum; i++)
+				plotterSeriesFree(dumpSeries[i]);
+			free(dumpSeries);
 			free(dumpYMin);
 			free(dumpYMax);
 			free(dumpXMin);
 			free(dumpXMax);
-			free(xVals);
-			free(yVals);
+		}
+		// flat text export across threads
+		else if (dumpThreads > 1 && !exportGPX && !exportKML && !exportMAV && !exportCol && !dumpFollow) {
+			exp_count = logDumpTextParallel(lf, &count);
 		}
 		// file export
 		else {
-			while (loggerReadEntry(lf, &logEntry) != EOF) {
+			while (logDumpNextRecord(lf)) {
 				if (logDumpCheckRecordForExport(count++, &logEntry)) {
 					logDumpText(&logEntry);
 					exp_count++;
@@ -1186,48 +1968,389 @@ int main(int argc, char **argv) {
 			}
 		}
 
+		writerFree(dumpWriter);
+
+		if (dumpCols) {
+			if (!colExportFinish(dumpCols)) {
+				fprintf(stderr, "logDump: error writing column export\n");
+				ret = 0;
+			}
+			dumpCols = NULL;
+		}
+
 		// finish up writing GPX/KML export
 		if (exportGPX) {
 			if (!gpsTrackAsWpts)
 				// close track log
-				printf(gpxTrkEnd);
+				fprintf(dumpOut, gpxTrkEnd);
 			// write waypoints, if any
-			if (strlen(gpxWaypoints))
-				printf(gpxWaypoints);
+			if (gpxWaypoints->written + gpxWaypoints->len)
+				writerCopy(gpxWaypoints, dumpOut);
 			// close gpx
-			printf(gpxFooter);
+			fprintf(dumpOut, gpxFooter);
 		}
 		else if (exportKML) {
 			if (!gpsTrackAsWpts) {
 				// close track log
-				printf(kmlModel, trackModelURL);
-				printf(kmlTrkEnd);
-				printf(kmlTrkFooter);
+				fprintf(dumpOut, kmlModel, trackModelURL);
+				fprintf(dumpOut, kmlTrkEnd);
+				fprintf(dumpOut, kmlTrkFooter);
 			}
-			printf(kmlFolderFooter);
+			fprintf(dumpOut, kmlFolderFooter);
 			// write waypoints, if any
-			if (strlen(gpxWaypoints)) {
-				printf(kmlFolderHeader, "Points", "Points");
-				printf(gpxWaypoints);
-				printf(kmlFolderFooter);
+			if (gpxWaypoints->written + gpxWaypoints->len) {
+				fprintf(dumpOut, kmlFolderHeader, "Points", "Points");
+				writerCopy(gpxWaypoints, dumpOut);
+				fprintf(dumpOut, kmlFolderFooter);
 			}
 			// close kml
-			printf(kmlFooter);
+			fprintf(dumpOut, kmlFooter);
 		}
 
 
-		fprintf(stderr, "\n\nlogDump: %d total records X %lu bytes = %4.1f MB\n", count, sizeof(logEntry), (float)count*sizeof(logEntry)/1024/1000);
-		fprintf(stderr, "logDump: %d mins %d seconds @ %dHz exported %d records\n", count/200/60, count/200 % 60, outputFreq, exp_count);
-		if (dumpTriggeredOnly)
-			fprintf(stderr, "logDump: only triggered records were exported\n");
-		if (dumpGpsTrack)
-			fprintf(stderr, "logDump: GPS accuracy filters were applied (h=%.1fm; v=%.1fm); starttime: %u\n", gpsTrackMinHAcc, gpsTrackMinVAcc, towStartTime);
-		if (gpxWptCnt)
-			fprintf(stderr, "logDump: %d waypoints exported to GPX\n", gpxWptCnt);
+		writerFree(gpxWaypoints);
+		if (wptFile)
+			fclose(wptFile);
+
+		f->count = count;
+		f->expCount = exp_count;
+
+		profilerCount(dumpProf, PROFILER_RECORDS, count - first);
+		profilerCount(dumpProf, PROFILER_EXPORTED, exp_count);
+		profilerCount(dumpProf, PROFILER_BYTES_IN, lf->pos - firstPos);
+		profilerCount(dumpProf, PROFILER_SKIPPED, lf->skipped);
+		profilerCount(dumpProf, PROFILER_RESYNCS, lf->resyncs);
+
+		if (!dumpQuiet) {
+			fprintf(stderr, "\n\nlogDump: %d total records X %lu bytes = %4.1f MB\n", count, sizeof(logEntry), (float)count*sizeof(logEntry)/1024/1000);
+			fprintf(stderr, "logDump: %d mins %d seconds @ %dHz exported %d records\n", count/200/60, count/200 % 60, outputFreq, exp_count);
+			if (dumpTriggeredOnly)
+				fprintf(stderr, "logDump: only triggered records were exported\n");
+			if (dumpGpsTrack)
+				fprintf(stderr, "logDump: GPS accuracy filters were applied (h=%.1fm; v=%.1fm); starttime: %u\n", gpsTrackMinHAcc, gpsTrackMinVAcc, towStartTime);
+			if (gpxWptCnt)
+				fprintf(stderr, "logDump: %d waypoints exported to GPX\n", gpxWptCnt);
+		}
+
+		loggerMapClose(lf);
 	}
 	else {
 		fprintf(stderr, "logDump: cannot open logfile\n");
+		ret = 0;
+	}
+
+	free(idxFile);
+	free(statsFile);
+	free(logPath);
+
+	return ret;
+}
+
+// file name extension for the export format
+const char *logDumpOutExt(void) {
+	if (exportGPX)
+		return "gpx";
+	if (exportKML)
+		return "kml";
+	if (exportCol)
+		return "aqlc";
+	if (exportMAV)
+		return "tlog";
+	if (valueSep == ',')
+		return "csv";
+	if (valueSep == '	')
+		return "tab";
+	return "txt";
+}
+
+bool logDumpNameLess(const char *a, const char *b) {
+	return strcmp(a, b) < 0;
+}
+
+bool logDumpIsDir(const char *name) {
+	struct stat sbuf;
+
+	return !stat(name, &sbuf) && S_ISDIR(sbuf.st_mode);
+}
+
+// add a log to a batch; a directory adds every *.log file in it (in name order)
+void logDumpAddLog(logDumpFile_t **files, int *numFiles, const char *name) {
+	DIR *dir;
+	struct dirent *ent;
+	char **names = NULL;
+	int numNames = 0;
+	size_t len;
+	int i;
+
+	if (logDumpIsDir(name)) {
+		if ((dir = opendir(name)) == NULL) {
+			fprintf(stderr, "logDump: cannot read directory '%s'\n", name);
+			return;
+		}
+		while ((ent = readdir(dir)) != NULL) {
+			len = strlen(ent->d_name);
+			if (len > 4 && !strcasecmp(ent->d_name + len - 4, ".log")) {
+				names = (char **)realloc(names, (numNames + 1) * sizeof(char *));
+				names[numNames] = (char *)malloc(strlen(name) + len + 2);
+				sprintf(names[numNames++], "%s/%s", name, ent->d_name);
+			}
+		}
+		closedir(dir);
+
+		std::sort(names, names + numNames, logDumpNameLess);
+		for (i = 0; i < numNames; i++) {
+			logDumpAddLog(files, numFiles, names[i]);
+			free(names[i]);
+		}
+		free(names);
+		return;
+	}
+
+	*files = (logDumpFile_t *)realloc(*files, (*numFiles + 1) * sizeof(logDumpFile_t));
+	memset(&(*files)[*numFiles], 0, sizeof(logDumpFile_t));
+	(*files)[*numFiles].logFile = strdup(name);
+	(*numFiles)++;
+}
+
+double logDumpTime(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// worker of a batch run, exports logs until there are none left
+void *logDumpBatchThread(void *arg) {
+	logDumpBatch_t *b = (logDumpBatch_t *)arg;
+	logDumpFile_t *f;
+	profiler_t prof;
+	FILE *out;
+	double t;
+	int n;
+
+	profilerInit(&prof, dumpProfile);
+	if (dumpStats)
+		dumpProf = &prof;
+
+	while (1) {
+		pthread_mutex_lock(&b->lock);
+		n = b->next++;
+		pthread_mutex_unlock(&b->lock);
+		if (n >= b->numFiles)
+			break;
+
+		f = &b->files[n];
+		t = logDumpTime();
+		logDumpReset();
+
+		if (dumpBuildIndex || dumpVerify) {
+			f->ok = logDumpFile(f, NULL);
+		}
+		else {
+			if ((out = fopen(f->outFile, "wb")) == NULL) {
+				fprintf(stderr, "logDump: cannot open output file '%s'\n", f->outFile);
+			}
+			else {
+				f->ok = logDumpFile(f, out);
+				if (fclose(out))
+					f->ok = 0;
+				if (!f->ok)
+					remove(f->outFile);
+			}
+		}
+
+		f->time = logDumpTime() - t;
+	}
+
+	if (dumpStats) {
+		pthread_mutex_lock(&b->lock);
+		profilerMerge(&dumpProfiler, &prof);
+		pthread_mutex_unlock(&b->lock);
+		dumpProf = NULL;
+	}
+
+	// drop this thread's copy of the log field list
+	loggerContextReset(loggerThreadContext());
+
+	return NULL;
+}
+
+bool logDumpOutLess(const logDumpFile_t *a, const logDumpFile_t *b) {
+	return strcmp(a->outFile, b->outFile) < 0;
+}
+
+// Name the export of each log dir/logname.ext.  Returns 0 if two logs of the same name (from
+// different directories) would be written to the same file.
+int logDumpBatchNames(logDumpFile_t *files, int numFiles) {
+	logDumpFile_t **sorted;
+	filespec_t spec;
+	char *name;
+	int ok = 1;
+	int i;
+
+	sorted = (logDumpFile_t **)malloc(numFiles * sizeof(logDumpFile_t *));
+
+	for (i = 0; i < numFiles; i++) {
+		name = strdup(files[i].logFile);
+		spec = extractFileName(name);
+		files[i].outFile = (char *)malloc(strlen(dumpOutDir) + 1 + strlen(spec.name) + 1 + strlen(logDumpOutExt()) + 1);
+		sprintf(files[i].outFile, "%s/%s.%s", dumpOutDir, spec.name, logDumpOutExt());
+		free(name);
+		sorted[i] = &files[i];
+	}
+
+	std::sort(sorted, sorted + numFiles, logDumpOutLess);
+	for (i = 1; i < numFiles; i++)
+		if (!strcmp(sorted[i-1]->outFile, sorted[i]->outFile)) {
+			fprintf(stderr, "logDump: '%s' and '%s' would both be exported to '%s'\n", sorted[i-1]->logFile, sorted[i]->logFile, sorted[i]->outFile);
+			ok = 0;
+		}
+
+	free(sorted);
+
+	return ok;
+}
+
+// Export every log of a batch, dumpThreads of them at a time, each one read in order by a single thread.
+// Prints a summary line for each log at the end; returns 0 if any of them failed.
+int logDumpBatch(logDumpFile_t *files, int numFiles) {
+	logDumpBatch_t b;
+	pthread_t *threads;
+	int *running;
+	uint32_t count = 0, exp_count = 0;
+	double t;
+	int numThreads, ok;
+	int i;
+
+	if (!dumpBuildIndex && !dumpVerify && !logDumpBatchNames(files, numFiles))
+		return 0;
+
+	numThreads = std::min(dumpThreads, numFiles);
+	// the logs are the unit of work, each one is exported by a single thread
+	dumpThreads = 1;
+
+	b.files = files;
+	b.numFiles = numFiles;
+	b.next = 0;
+	pthread_mutex_init(&b.lock, NULL);
+
+	threads = (pthread_t *)calloc(numThreads, sizeof(pthread_t));
+	running = (int *)calloc(numThreads, sizeof(int));
+
+	t = logDumpTime();
+	for (i = 1; i < numThreads; i++)
+		running[i] = !pthread_create(&threads[i], NULL, logDumpBatchThread, &b);
+	logDumpBatchThread(&b);
+	for (i = 1; i < numThreads; i++)
+		if (running[i])
+			pthread_join(threads[i], NULL);
+	t = logDumpTime() - t;
+
+	pthread_mutex_destroy(&b.lock);
+	free(threads);
+	free(running);
+
+	fprintf(stderr, "logDump:  records exported  errors  seconds  log\n");
+	ok = 1;
+	for (i = 0; i < numFiles; i++) {
+		fprintf(stderr, "logDump: %8u %8u %7d %8.3f  %s%s%s%s\n", files[i].count, files[i].expCount, files[i].errors, files[i].time,
+			files[i].logFile, files[i].outFile ? " -> " : "", files[i].outFile ? files[i].outFile : "", files[i].ok ? "" : " FAILED");
+		count += files[i].count;
+		exp_count += files[i].expCount;
+		ok &= files[i].ok;
+	}
+	fprintf(stderr, "logDump: %d logs, %u records read, %u exported in %.3f seconds using %d threads\n", numFiles, count, exp_count, t, numThreads);
+
+	return ok;
+}
+
+// --stats and --profile
+void logDumpReport(void) {
+	if (dumpStats)
+		profilerReport(stderr, &dumpProfiler, "logDump", dumpStats);
+}
+
+int main(int argc, char **argv) {
+	logDumpFile_t *files = NULL;
+	int numFiles = 0;
+	int i, j;
+
+	dumpNum = 0;
+
+	plotterOpts(argc, argv);
+	logDumpOpts(argc, argv);
+	argc -= optind;
+	argv += optind;
+
+	fprintf(stderr, "\n");
+	if (argc < 1) {
+		fprintf(stderr, "logDump: need log file argument. Type logDump --help for usage details.\n");
+		exit(1);
+	}
+	if (dumpNum < 1 && !dumpBuildIndex && !dumpVerify && !exportMAV) {
+		fprintf(stderr, "logDump: need at least one value to export. Type logDump --help for usage details.\n");
+		exit(1);
+	}
+
+	if (dumpThreads < 1)
+		dumpThreads = logDumpNumCPUs();
+
+	profilerInit(&dumpProfiler, dumpProfile);
+	if (dumpStats)
+		dumpProf = &dumpProfiler;
+
+	// determine output frequency
+	if (dumpGpsTrack && !usrSpecOutFreq) // use lower default setting for gps track log
+		outputFreq = gpsTrackFreq;
+
+	// set up field labels (combine from logger.h and logdump.h)
+	for (i=0; i < LOG_NUM_IDS; i++)
+		dumpHeaders[i] = loggerFieldLabels[i];
+	j = 0;
+	for (i++; i < NUM_FIELDS; i++)
+		dumpHeaders[i] = logDumpFieldLabels[j++];
+
+	if (dumpFollow && dumpPlot) {
+		fprintf(stderr, "logDump: --follow doesn't work with --plot.\n");
+		exit(1);
+	}
+	if (dumpSummary && (dumpPlot || dumpFollow || exportGPX || exportKML || exportCol || exportMAV)) {
+		fprintf(stderr, "logDump: --summary is text, it doesn't work with --plot, --follow or gpx, kml, col and mav exports.\n");
+		exit(1);
+	}
+
+	// one log to stdout
+	if (argc == 1 && !dumpOutDir && !logDumpIsDir(argv[0])) {
+		logDumpFile_t f;
+
+		memset(&f, 0, sizeof(f));
+		f.logFile = argv[0];
+
+		i = logDumpFile(&f, stdout);
+		logDumpReport();
+		exit(i ? 0 : 1);
+	}
+
+	// batch of logs, each to its own file
+	if (!dumpOutDir && !dumpBuildIndex && !dumpVerify) {
+		fprintf(stderr, "logDump: more than one log needs --out-dir. Type logDump --help for usage details.\n");
+		exit(1);
+	}
+	if (dumpPlot || dumpFollow) {
+		fprintf(stderr, "logDump: plots and --follow are for one log at a time.\n");
 		exit(1);
 	}
-	exit(0);
+
+	for (i = 0; i < argc; i++)
+		logDumpAddLog(&files, &numFiles, argv[i]);
+	if (numFiles < 1) {
+		fprintf(stderr, "logDump: no logs found.\n");
+		exit(1);
+	}
+
+	dumpQuiet = true;
+	i = logDumpBatch(files, numFiles);
+	logDumpReport();
+	exit(i ? 0 : 1);
 }
@@ -13,8 +13,10 @@ extern "C" {
 #endif
 
 #include "logger.h"
+#include "profiler.h"
 #include <stdint.h>
 #include <time.h>
+#include <pthread.h>
 
 #define P0                  	101325.0	// standard static pressure at sea level
 #define ADC_REF_VOLTAGE		3.3f
@@ -33,6 +35,9 @@ extern "C" {
 #define GPS_TRACK_MAX_TM_GAP	3000	// milliseconds w/out GPS position after which to start new track segment
 #define TRIG_ZERO_BUFFER		100		// pulse width ms +/- buffer for zero (center) position
 
+#define LOGDUMP_SLICE			4096	// records per slice of a parallel flat text export
+#define LOGDUMP_ROW_SIZE		(NUM_FIELDS * 32 + 2)	// longest possible flat text export row
+
 #define AQ_LOGGING_FREQUENCY	200		// assume this logging rate for AQ logs
 #define OUTPUT_FREQ_DIVISOR		(int)(AQ_LOGGING_FREQUENCY / outputFreq)	// divide 200Hz logging rate by this to set output frequency (eg 200/40=5Hz)
 
@@ -61,6 +66,15 @@ static bool includeHeaders = 0;				// include column headers in flat text export
 static bool dumpTriggeredOnly = 0;			// only export records with trigger indicator (see help)
 static bool exportGPX = 0;					// export GPX format
 static bool exportKML = 0;					// export KML format
+static bool exportCol = 0;					// export binary columns, see colExport.h
+static bool exportColDelta = 0;				// delta code whole number columns in binary exports
+static bool dumpBuildIndex = 0;				// only write the seek index of the log
+static bool dumpVerify = 0;					// only check the packets of the log and list its corrupt parts
+static bool dumpFollow = 0;					// keep exporting records as the log grows
+static int dumpFollowIdle = 0;				// stop following after this many seconds without new data, 0 for never
+static bool dumpSummary = 0;				// write min/max/mean/count of each value instead of exporting them
+static int dumpStats = 0;					// --stats/--profile report format, PROFILER_TEXT or PROFILER_JSON; 0 for none
+static bool dumpProfile = 0;				// time the stages as well, see profiler.h
 
 // GPX/KML export settings
 static const char trigWptName[30] = "trig"; // what to name waypoints made from triggered track points
@@ -115,8 +129,58 @@ typedef struct {
 	char time[31], name[30], wptstyle[20];
 } expFields_t;
 
-extern time_t towStartTime; // will hold date to add with GPS ToW to arrive at actual date/time
-extern FILE *outFP;
+// camera trigger detection, advanced once per record by logDumpTriggerUpdate()
+typedef struct {
+	unsigned activatedTime;						// LOG_LASTUPDATE when the trigger became active, 0 while inactive
+	unsigned lastActive;						// last trigger value reported
+	unsigned cnt;								// activations counted on the trigger channel
+	double event;								// trigger value of the current record, 0 for none
+} logDumpTrigger_t;
+
+// values carried from one exported record to the next
+typedef struct {
+	logDumpTrigger_t camTrig;
+	double homeLat, homeLon;
+	bool homeSet;
+	time_t towStartTime;						// same for the whole log, but held per thread
+} logDumpState_t;
+
+// Euler angles converted from the last quaternion seen, see logDumpAttitude()
+typedef struct {
+	float quat[4];
+	double rpy[3];								// roll, pitch, yaw in radians
+	bool valid;
+} logDumpAttitude_t;
+
+// one slice of a parallel flat text export, see logDumpTextParallel()
+typedef struct {
+	const loggerIndex_t *idx;
+	uint32_t base;								// record number of the first packet in idx
+	uint32_t first, last;						// records in slice
+	loggerRecord_t rec;							// record contents before the first one is read
+	logDumpState_t state;						// state before the first one
+	struct writerStruct *out;					// formatted rows
+	profiler_t prof;							// stage times of the slice, with --profile
+} logDumpSlice_t;
+
+// one log of a batch export, see logDumpBatch()
+typedef struct {
+	char *logFile;
+	char *outFile;								// dir/logname.ext, NULL for --build-index and --verify
+	uint32_t count, expCount;					// records read and exported
+	int errors;									// checksum errors
+	double time;								// seconds taken
+	int ok;
+} logDumpFile_t;
+
+typedef struct {
+	logDumpFile_t *files;
+	int numFiles;
+	int next;									// next log to hand to a worker
+	pthread_mutex_t lock;
+} logDumpBatch_t;
+
+extern __thread time_t towStartTime; // will hold date to add with GPS ToW to arrive at actual date/time
 
 extern double logDumpGetValue(loggerRecord_t *l, int field);
 
@@ -6,196 +6,206 @@
  */
 
 #include <string.h>
+#include <math.h>
 #include "logDump_mavlink.h"
-#include "logDump.h"
-#include "mavlink.h"
 
-mavlinkStruct_t mavlinkData;
-mavlink_system_t mavlink_system;
+__thread mavlinkStruct_t mavlinkData;
 
-void mavlinkInit(void) {
-	mavlinkData.wpCount = 0;
-	mavlinkData.wpCurrent = mavlinkData.wpCount + 1;
+// start a tlog of the records given to mavlinkDo() on out; GPS time of week counts from towStart
+void mavlinkInit(writerStruct_t *out, time_t towStart) {
+	memset(&mavlinkData, 0, sizeof(mavlinkData));
 
-	mavlink_system.sysid = 42;
-	mavlink_system.compid = MAV_COMP_ID_ALL;
-	mavlink_system.type = MAV_TYPE_QUADROTOR;
+	mavlinkData.out = out;
+	mavlinkData.tsBase = (uint64_t)towStart * 1000000;
+	mavlinkData.lastGpsUpdate = nan("");
+	mavlinkData.sysid = 42;
+	mavlinkData.compid = 0;
+}
 
-	mavlinkData.mode = MAV_MODE_FLAG_MANUAL_INPUT_ENABLED;
-	mavlinkData.nav_mode = MAV_STATE_STANDBY;
-	mavlinkData.status = MAV_STATE_ACTIVE;
-	mavlinkData.idlePercent = 999;
-	mavlinkData.packetDrops = 0;
+static inline void mavlinkPut16(uint8_t *p, uint16_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
 }
 
-void mavlinkWpReached(uint16_t seqId) {
-	//mavlink_msg_mission_item_reached_send(MAVLINK_COMM_0, seqId);
+static inline void mavlinkPut32(uint8_t *p, uint32_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
 }
 
-void mavlinkWpAnnounceCurrent(uint16_t seqId) {
-	//mavlink_msg_mission_current_send(MAVLINK_COMM_0, seqId);
+static inline void mavlinkPutFloat(uint8_t *p, float v) {
+	uint32_t u;
+
+	memcpy(&u, &v, sizeof(u));
+	mavlinkPut32(p, u);
 }
 
-void mavlogWritePacket(mavlink_message_t *msg, uint64_t ts) {
-	uint8_t buf[mavBufLen];
-
-//	printf("ts: %llu; len: %d; seq: %d; sysid: %d; compid: %d; magic: %d; msgid: %d; payload: %llu; chk: %lu\n",
-//			ts, msg->len, msg->seq, msg->sysid, msg->compid, msg->magic, msg->msgid, msg->payload64, msg->checksum);
-	memcpy(buf, (void*)&ts, sizeof(uint64_t));
-	//memcpy(buf+sizeof(uint64_t), (const mavlink_message_t *)msg, MAVLINK_NUM_NON_PAYLOAD_BYTES + msg->len);
-	int buflen = mavlink_msg_to_send_buffer(buf+sizeof(uint64_t), msg);
-	fwrite(buf, sizeof(uint8_t), sizeof(buf), outFP);
-	fflush(outFP);
-	memset(msg->payload64, 0x0, sizeof(msg->payload64));
+// X.25 CRC as MAVLink uses it
+static inline uint16_t mavlinkCrc(uint16_t crc, uint8_t c) {
+	uint8_t t = c ^ (uint8_t)crc;
+
+	t ^= t << 4;
+
+	return (crc >> 8) ^ (t << 8) ^ (t << 3) ^ (t >> 4);
 }
 
-void mavlinkDo(loggerRecord_t *l) {
-	// StatusType result;
-	mavlink_message_t msg;
-	uint16_t msgLen;
-	uint64_t ts = ((uint64_t)towStartTime*1000 + (uint64_t)logDumpGetValue(l, FLD_GPS_UTC_TIME)) * 1000;
-	double micros = logDumpGetValue(l, LOG_LASTUPDATE);
+// Frame the len payload bytes at p + MAVLINK_PAYLOAD: timestamp, header and checksum.
+// Returns where the next packet goes.
+static uint8_t *mavlinkPacket(uint8_t *p, uint64_t ts, uint8_t id, uint8_t len, uint8_t crcExtra) {
+	uint16_t crc = 0xFFFF;
+	int i;
 
-	//fprintf(stderr, "logDump: TIMESTAMP: %llu; START: %u; TOW: %lld\n", ts, towStartTime, (uint64_t)logDumpGetValue(l, GPS_UTC_TIME));
+	for (i = 0; i < 8; i++)
+		p[i] = ts >> (56 - 8*i);
 
-	mavlinkData.status = MAV_STATE_ACTIVE;
+	p[8] = MAVLINK_STX;
+	p[9] = len;
+	p[10] = mavlinkData.seq++;
+	p[11] = mavlinkData.sysid;
+	p[12] = mavlinkData.compid;
+	p[13] = id;
 
-	double modeChan = logDumpGetValue(l, LOG_RADIO_CHANNEL5);
-	if (modeChan < 250) 		// manual
-		mavlinkData.mode = MAV_MODE_FLAG_SAFETY_ARMED + MAV_MODE_FLAG_MANUAL_INPUT_ENABLED;
-	else if (modeChan > 250) 	// mission
-		mavlinkData.mode = MAV_MODE_FLAG_SAFETY_ARMED + MAV_MODE_FLAG_GUIDED_ENABLED;
-	else 						// pos/alt hold
-		mavlinkData.mode = MAV_MODE_FLAG_SAFETY_ARMED + MAV_MODE_FLAG_STABILIZE_ENABLED + MAV_MODE_FLAG_CUSTOM_MODE_ENABLED;
+	for (i = 9; i < MAVLINK_PAYLOAD + len; i++)
+		crc = mavlinkCrc(crc, p[i]);
+	crc = mavlinkCrc(crc, crcExtra);
+	mavlinkPut16(p + MAVLINK_PAYLOAD + len, crc);
 
-	// heartbeat
-	msgLen = mavlink_msg_heartbeat_pack(mavlink_system.sysid, mavlink_system.compid, &msg, mavlink_system.type,
-			MAV_AUTOPILOT_GENERIC_WAYPOINTS_ONLY, mavlinkData.mode,
-			mavlinkData.nav_mode, mavlinkData.status);
+	mavlinkData.packets++;
 
-	mavlogWritePacket(&msg, ts);
-/*
-	// status
-	double vIn = logDumpGetValue(l, VIN);
-	msgLen = mavlink_msg_sys_status_pack(mavlink_system.sysid, mavlink_system.compid, &msg, 0, 0, 0,
-			1000 - mavlinkData.idlePercent, vIn * 1000, -1,
-			(vIn - 9.8f) / 12.6f * 1000, 0,
-			mavlinkData.packetDrops, 0, 0, 0, 0);
-
-	mavlogWritePacket(&msg, ts);
-
-
-	// raw acc, rate, mag sensors
-	mavlink_msg_scaled_imu_pack(mavlink_system.sysid, mavlink_system.compid, &msg, micros,
-			logDumpGetValue(l, ACCX) * 1000.0f, logDumpGetValue(l, ACCY) * 1000.0f, logDumpGetValue(l, ACCZ) * 1000.0f,
-			logDumpGetValue(l, RATEX) * 1000.0f, logDumpGetValue(l, RATEY) * 1000.0f, logDumpGetValue(l, RATEZ) * 1000.0f,
-			logDumpGetValue(l, MAGX) * 1000.0f, logDumpGetValue(l, MAGY) * 1000.0f, logDumpGetValue(l, MAGZ) * 1000.0f);
-
-	mavlogWritePacket(&msg, ts);
-
-	// pressure and temp
-	mavlink_msg_scaled_pressure_pack(mavlink_system.sysid, mavlink_system.compid, &msg, micros,
-			logDumpGetValue(l, PRESSURE1) * 0.01f, 0.0f, logDumpGetValue(l, TEMP1) * 100);
-
-	mavlogWritePacket(&msg, ts);
-
-
-	// position
-	mavlink_msg_gps_raw_int_pack(mavlink_system.sysid, mavlink_system.compid, &msg, micros,
-			3, logDumpGetValue(l, LAT) * 1e7, logDumpGetValue(l, LON) * 1e7,
-			logDumpGetValue(l, GPS_ALT) * 1e3, logDumpGetValue(l, AUX_RATEY), logDumpGetValue(l, AUX_RATEZ),
-			logDumpGetValue(l, GPS_H_SPEED), 65535, 255);
-		//	    mavlink_msg_gps_raw_send(MAVLINK_COMM_0, micros, 3, gpsData.lat, gpsData.lon, gpsData.height, gpsData.hDOP, gpsData.vDOP, gpsData.speed, gpsData.heading);
-
-	mavlogWritePacket(&msg, ts);
-
-	// rc channels
-	mavlink_msg_rc_channels_raw_pack(mavlink_system.sysid, mavlink_system.compid, &msg, micros, 0,
-			logDumpGetValue(l, RADIO_CHANNEL1) + 1024, logDumpGetValue(l, RADIO_CHANNEL2) + 1024, logDumpGetValue(l, RADIO_CHANNEL3) + 1024,
-			logDumpGetValue(l, RADIO_CHANNEL4) + 1024, logDumpGetValue(l, RADIO_CHANNEL5) + 1024, logDumpGetValue(l, RADIO_CHANNEL6) + 1024,
-			logDumpGetValue(l, RADIO_CHANNEL7) + 1024, logDumpGetValue(l, RADIO_CHANNEL8) + 1024, logDumpGetValue(l, RADIO_QUALITY));
-
-	mavlogWritePacket(&msg, ts);
-
-	// motor outputs
-	mavlink_msg_servo_output_raw_pack(mavlink_system.sysid, mavlink_system.compid, &msg, micros, 0,
-			logDumpGetValue(l, MOTOR1), logDumpGetValue(l, MOTOR2),
-			logDumpGetValue(l, MOTOR2), logDumpGetValue(l, MOTOR4),
-			logDumpGetValue(l, MOTOR5), logDumpGetValue(l, MOTOR6),
-			logDumpGetValue(l, MOTOR7), logDumpGetValue(l, MOTOR8));
-
-	mavlogWritePacket(&msg, ts);
-
-	mavlink_msg_servo_output_raw_pack(mavlink_system.sysid, mavlink_system.compid, &msg, micros, 1,
-			logDumpGetValue(l, MOTOR9), logDumpGetValue(l, MOTOR10),
-			logDumpGetValue(l, MOTOR11), logDumpGetValue(l, MOTOR12),
-			logDumpGetValue(l, MOTOR13), logDumpGetValue(l, MOTOR14),
-			0, 0);
-
-	mavlogWritePacket(&msg, ts);
-	*/
-	/*
-	// rc channels
-	else if ((mavlinkData.streamInterval[MAV_DATA_STREAM_ALL]
-			|| mavlinkData.streamInterval[MAV_DATA_STREAM_RC_CHANNELS])
-			&& mavlinkData.streamNext[MAV_DATA_STREAM_RC_CHANNELS]
-					< micros) {
-		mavlink_msg_rc_channels_raw_send(MAVLINK_COMM_0, micros, 0,
-				RADIO_THROT + 1024, RADIO_ROLL + 1024, RADIO_PITCH + 1024,
-				RADIO_RUDD + 1024, RADIO_GEAR + 1024, RADIO_FLAPS + 1024,
-				RADIO_AUX2 + 1024, RADIO_AUX3 + 1024, RADIO_QUALITY);
-		mavlink_msg_rc_channels_scaled_send(MAVLINK_COMM_0, micros, 0,
-				(RADIO_THROT - 750) * 13, RADIO_ROLL * 13, RADIO_PITCH * 13,
-				RADIO_RUDD * 13, RADIO_GEAR * 13, RADIO_FLAPS * 13,
-				RADIO_AUX2 * 13, RADIO_AUX3 * 13, RADIO_QUALITY);
-		mavlinkData.streamNext[MAV_DATA_STREAM_RC_CHANNELS] = micros
-				+ mavlinkData.streamInterval[MAV_DATA_STREAM_RC_CHANNELS];
-	}
-	// raw controller
-	else if ((mavlinkData.streamInterval[MAV_DATA_STREAM_ALL]
-			|| mavlinkData.streamInterval[MAV_DATA_STREAM_RAW_CONTROLLER])
-			&& mavlinkData.streamNext[MAV_DATA_STREAM_RAW_CONTROLLER]
-					< micros) {
-		mavlink_msg_attitude_send(MAVLINK_COMM_0, micros,
-				AQ_ROLL * DEG_TO_RAD, AQ_PITCH * DEG_TO_RAD,
-				AQ_YAW * DEG_TO_RAD,
-				-(IMU_RATEX - UKF_GYO_BIAS_X) * DEG_TO_RAD,
-				(IMU_RATEY - UKF_GYO_BIAS_Y) * DEG_TO_RAD,
-				(IMU_RATEZ - UKF_GYO_BIAS_Z) * DEG_TO_RAD);
-		mavlink_msg_servo_output_raw_send(MAVLINK_COMM_0, micros, 0,
-				motorsData.value[0], motorsData.value[1],
-				motorsData.value[2], motorsData.value[3],
-				motorsData.value[4], motorsData.value[5],
-				motorsData.value[6], motorsData.value[7]);
-		mavlinkData.streamNext[MAV_DATA_STREAM_RAW_CONTROLLER] =
-				micros
-						+ mavlinkData.streamInterval[MAV_DATA_STREAM_RAW_CONTROLLER];
+	return p + MAVLINK_OVERHEAD + len;
+}
+
+// Append the packets of one record to the output, all packed in one go with the record's
+// timestamp.  rpy is its attitude as logDumpAttitude() has it.
+void mavlinkDo(loggerRecord_t *l, const double *rpy) {
+	uint8_t *s, *p, *m;
+	uint64_t ts = mavlinkData.tsBase + (uint64_t)l->data[LOG_GPS_ITOW] * 1000;
+	uint32_t ms = (uint32_t)(l->data[LOG_LASTUPDATE] / 1000);
+	double yaw, cog;
+	uint8_t mode;
+	int i;
+
+	s = p = (uint8_t *)writerReserve(mavlinkData.out, MAVLINK_RECORD_SIZE);
+
+	yaw = rpy[2] < 0 ? rpy[2] + 2*M_PI : rpy[2];
+
+	// heartbeat and battery state once a second
+	if (l->data[LOG_LASTUPDATE] >= mavlinkData.nextHeartbeat) {
+		if (l->data[LOG_RADIO_CHANNEL5] < -250)		// manual
+			mode = MAVLINK_MODE_FLAG_ARMED | MAVLINK_MODE_FLAG_MANUAL;
+		else if (l->data[LOG_RADIO_CHANNEL5] > 250)	// mission
+			mode = MAVLINK_MODE_FLAG_ARMED | MAVLINK_MODE_FLAG_GUIDED;
+		else									// pos/alt hold
+			mode = MAVLINK_MODE_FLAG_ARMED | MAVLINK_MODE_FLAG_STABILIZE | MAVLINK_MODE_FLAG_CUSTOM;
+
+		m = p + MAVLINK_PAYLOAD;
+		mavlinkPut32(m, 0);
+		m[4] = MAVLINK_TYPE_QUADROTOR;
+		m[5] = MAVLINK_AUTOPILOT_GENERIC_WP;
+		m[6] = mode;
+		m[7] = MAVLINK_STATE_ACTIVE;
+		m[8] = MAVLINK_VERSION;
+		p = mavlinkPacket(p, ts, MAVLINK_MSG_ID_HEARTBEAT, MAVLINK_MSG_ID_HEARTBEAT_LEN, MAVLINK_MSG_ID_HEARTBEAT_CRC);
+
+		m = p + MAVLINK_PAYLOAD;
+		memset(m, 0, MAVLINK_MSG_ID_SYS_STATUS_LEN);
+		mavlinkPut16(m + 14, (uint16_t)(l->data[LOG_ADC_VIN] * 1000));		// mV
+		mavlinkPut16(m + 16, (int16_t)(l->data[LOG_CURRENT_PDB] * 100));	// 10mA
+		m[30] = -1;														// battery remaining unknown
+		p = mavlinkPacket(p, ts, MAVLINK_MSG_ID_SYS_STATUS, MAVLINK_MSG_ID_SYS_STATUS_LEN, MAVLINK_MSG_ID_SYS_STATUS_CRC);
+
+		mavlinkData.nextHeartbeat = l->data[LOG_LASTUPDATE] + MAVLINK_HEARTBEAT_INTERVAL;
 	}
 
-	// send pending notices
-	msg = CoAcceptQueueMail(mavlinkData.notices, &result);
-	if (result == E_OK)
-		mavlink_msg_statustext_send(MAVLINK_COMM_0, 0, (const char *) msg);
-
-	// list all parameters
-	if (mavlinkData.currentParam < mavlinkData.numParams
-			&& mavlinkData.nextParam < micros) {
-		mavlink_msg_param_value_send(MAVLINK_COMM_0,
-				configParameterStrings[mavlinkData.currentParam],
-				p[mavlinkData.currentParam], MAVLINK_TYPE_FLOAT,
-				mavlinkData.numParams, mavlinkData.currentParam);
-		mavlinkData.currentParam++;
-		mavlinkData.nextParam = micros + MAVLINK_PARAM_INTERVAL;
-	} else if (mavlinkData.wpCurrent < mavlinkData.wpCount
-			&& mavlinkData.wpNext < micros) {
-		mavlink_msg_mission_request_send(MAVLINK_COMM_0,
-				mavlinkData.wpTargetSysId, mavlinkData.wpTargetCompId,
-				mavlinkData.wpCurrent);
-		mavlinkData.wpNext = micros + MAVLINK_WP_TIMEOUT;
-	} else if (mavlinkData.wpCurrent == mavlinkData.wpCount) {
-		mavlink_msg_mission_ack_send(MAVLINK_COMM_0,
-				mavlinkData.wpTargetSysId, mavlinkData.wpTargetCompId, 0);
-		mavlinkData.wpCurrent++;
+	// attitude, NED
+	m = p + MAVLINK_PAYLOAD;
+	mavlinkPut32(m, ms);
+	mavlinkPutFloat(m + 4, -rpy[0]);
+	mavlinkPutFloat(m + 8, -rpy[1]);
+	mavlinkPutFloat(m + 12, rpy[2]);
+	mavlinkPutFloat(m + 16, l->data[LOG_IMU_RATEX]);
+	mavlinkPutFloat(m + 20, l->data[LOG_IMU_RATEY]);
+	mavlinkPutFloat(m + 24, l->data[LOG_IMU_RATEZ]);
+	p = mavlinkPacket(p, ts, MAVLINK_MSG_ID_ATTITUDE, MAVLINK_MSG_ID_ATTITUDE_LEN, MAVLINK_MSG_ID_ATTITUDE_CRC);
+
+	// acc (mg), rate (mrad/s), mag (mgauss)
+	m = p + MAVLINK_PAYLOAD;
+	mavlinkPut32(m, ms);
+	for (i = 0; i < 3; i++) {
+		mavlinkPut16(m + 4 + 2*i, (int16_t)(l->data[LOG_IMU_ACCX+i] * (1000.0 / 9.80665)));
+		mavlinkPut16(m + 10 + 2*i, (int16_t)(l->data[LOG_IMU_RATEX+i] * 1000));
+		mavlinkPut16(m + 16 + 2*i, (int16_t)(l->data[LOG_IMU_MAGX+i] * 1000));
 	}
-	*/
+	p = mavlinkPacket(p, ts, MAVLINK_MSG_ID_SCALED_IMU, MAVLINK_MSG_ID_SCALED_IMU_LEN, MAVLINK_MSG_ID_SCALED_IMU_CRC);
+
+	// pressure (hPa) and temperature (cdegC)
+	m = p + MAVLINK_PAYLOAD;
+	mavlinkPut32(m, ms);
+	mavlinkPutFloat(m + 4, l->data[LOG_ADC_PRESSURE1] * 0.01f);
+	mavlinkPutFloat(m + 8, 0.0f);
+	mavlinkPut16(m + 12, (int16_t)(l->data[LOG_ADC_TEMP0] * 100));
+	p = mavlinkPacket(p, ts, MAVLINK_MSG_ID_SCALED_PRESSURE, MAVLINK_MSG_ID_SCALED_PRESSURE_LEN, MAVLINK_MSG_ID_SCALED_PRESSURE_CRC);
+
+	// GPS fix, when there is a new one
+	if (l->data[LOG_GPS_POS_UPDATE] != mavlinkData.lastGpsUpdate) {
+		cog = atan2(l->data[LOG_GPS_VELE], l->data[LOG_GPS_VELN]);
+		if (cog < 0)
+			cog += 2*M_PI;
+
+		m = p + MAVLINK_PAYLOAD;
+		for (i = 0; i < 8; i++)
+			m[i] = ts >> (8*i);
+		mavlinkPut32(m + 8, (int32_t)(l->data[LOG_GPS_LAT] * 1e7));
+		mavlinkPut32(m + 12, (int32_t)(l->data[LOG_GPS_LON] * 1e7));
+		mavlinkPut32(m + 16, (int32_t)(l->data[LOG_GPS_HEIGHT] * 1000));
+		mavlinkPut16(m + 20, (uint16_t)(l->data[LOG_GPS_HACC] * 100));
+		mavlinkPut16(m + 22, (uint16_t)(l->data[LOG_GPS_VACC] * 100));
+		mavlinkPut16(m + 24, (uint16_t)(sqrt(l->data[LOG_GPS_VELN]*l->data[LOG_GPS_VELN] + l->data[LOG_GPS_VELE]*l->data[LOG_GPS_VELE]) * 100));
+		mavlinkPut16(m + 26, (uint16_t)(cog * (18000.0 / M_PI)));
+		m[28] = l->data[LOG_GPS_HACC] < MAVLINK_GPS_FIX_HACC ? 3 : 1;
+		m[29] = 255;													// satellites unknown
+		p = mavlinkPacket(p, ts, MAVLINK_MSG_ID_GPS_RAW_INT, MAVLINK_MSG_ID_GPS_RAW_INT_LEN, MAVLINK_MSG_ID_GPS_RAW_INT_CRC);
+
+		mavlinkData.lastGpsUpdate = l->data[LOG_GPS_POS_UPDATE];
+	}
+
+	// position from the GPS, altitude and velocity from the UKF
+	m = p + MAVLINK_PAYLOAD;
+	mavlinkPut32(m, ms);
+	mavlinkPut32(m + 4, (int32_t)(l->data[LOG_GPS_LAT] * 1e7));
+	mavlinkPut32(m + 8, (int32_t)(l->data[LOG_GPS_LON] * 1e7));
+	mavlinkPut32(m + 12, (int32_t)(l->data[LOG_GPS_HEIGHT] * 1000));
+	mavlinkPut32(m + 16, (int32_t)(l->data[LOG_UKF_ALT] * 1000));
+	mavlinkPut16(m + 20, (int16_t)(l->data[LOG_UKF_VELN] * 100));
+	mavlinkPut16(m + 22, (int16_t)(l->data[LOG_UKF_VELE] * 100));
+	mavlinkPut16(m + 24, (int16_t)(l->data[LOG_UKF_VELD] * 100));
+	mavlinkPut16(m + 26, (uint16_t)(yaw * (18000.0 / M_PI)));
+	p = mavlinkPacket(p, ts, MAVLINK_MSG_ID_GLOBAL_POSITION_INT, MAVLINK_MSG_ID_GLOBAL_POSITION_INT_LEN, MAVLINK_MSG_ID_GLOBAL_POSITION_INT_CRC);
+
+	// rc channels 1-8
+	m = p + MAVLINK_PAYLOAD;
+	mavlinkPut32(m, ms);
+	for (i = 0; i < 8; i++)
+		mavlinkPut16(m + 4 + 2*i, (uint16_t)(l->data[LOG_RADIO_CHANNEL0+i] + 1024));
+	m[20] = 0;
+	m[21] = l->data[LOG_RADIO_QUALITY] > 254 ? 254 : (uint8_t)l->data[LOG_RADIO_QUALITY];
+	p = mavlinkPacket(p, ts, MAVLINK_MSG_ID_RC_CHANNELS_RAW, MAVLINK_MSG_ID_RC_CHANNELS_RAW_LEN, MAVLINK_MSG_ID_RC_CHANNELS_RAW_CRC);
+
+	// motor outputs, 1-8 on port 0 and 9-14 on port 1
+	m = p + MAVLINK_PAYLOAD;
+	mavlinkPut32(m, ms);
+	for (i = 0; i < 8; i++)
+		mavlinkPut16(m + 4 + 2*i, (uint16_t)l->data[LOG_MOT_MOTOR0+i]);
+	m[20] = 0;
+	p = mavlinkPacket(p, ts, MAVLINK_MSG_ID_SERVO_OUTPUT_RAW, MAVLINK_MSG_ID_SERVO_OUTPUT_RAW_LEN, MAVLINK_MSG_ID_SERVO_OUTPUT_RAW_CRC);
+
+	m = p + MAVLINK_PAYLOAD;
+	mavlinkPut32(m, ms);
+	for (i = 0; i < 8; i++)
+		mavlinkPut16(m + 4 + 2*i, i < 6 ? (uint16_t)l->data[LOG_MOT_MOTOR8+i] : 0);
+	m[20] = 1;
+	p = mavlinkPacket(p, ts, MAVLINK_MSG_ID_SERVO_OUTPUT_RAW, MAVLINK_MSG_ID_SERVO_OUTPUT_RAW_LEN, MAVLINK_MSG_ID_SERVO_OUTPUT_RAW_CRC);
+
+	mavlinkData.out->len += p - s;
 }
@@ -8,58 +8,83 @@
 #ifndef AQ_MAVLINK_GND_H_
 #define AQ_MAVLINK_GND_H_
 
-#ifdef __cplusplus
-extern "C" {
-#endif
-
+#include <stdint.h>
+#include <time.h>
 #include "logger.h"
-#include "../mavlink_types.h"
-
-#define MAVLINK_HEARTBEAT_INTERVAL	    1e6	    //  1Hz
-#define MAVLINK_PARAM_INTERVAL		    2e4	    // 50Hz
-#define MAVLINK_WP_TIMEOUT		    1e6	    // 1 second
-#define MAVLINK_NOTICE_DEPTH		    20
-#define MAVLINK_PARAMID_LEN		    16
-//#define MAVLINK_USE_CONVENIENCE_FUNCTIONS
-
-typedef struct {
-    unsigned long nextHeartbeat;
-    unsigned long nextParam;
-    unsigned int currentParam;
+#include "writer.h"
 
-    // TODO: pull actual count from header files
-//    unsigned long streamInterval[13];
-//    unsigned long streamNext[13];
+// MAVLink 1.0 telemetry log (.tlog), as QGroundControl and MAVProxy replay it: each packet
+// is preceded by its time as a big endian uint64_t of microseconds since 1970.  The packets
+// are packed here, so no MAVLink headers are needed to build this.
 
-    // this is a temporary implementation until we adopt mavlink completely
-    int numParams;
+#define MAVLINK_STX			    0xFE
+#define MAVLINK_HEADER_LEN		    6	    // STX, length, sequence, system, component, message id
+#define MAVLINK_PAYLOAD			    (8 + MAVLINK_HEADER_LEN)	// payload offset from the tlog timestamp
+#define MAVLINK_OVERHEAD		    (MAVLINK_PAYLOAD + 2)	// timestamp, header and checksum
+#define MAVLINK_RECORD_SIZE		    512	    // room for all the packets of one log record
 
-    uint16_t packetDrops;
-    uint16_t idlePercent;
-    uint8_t mode;
-    uint8_t nav_mode;
-    uint8_t status;
-    uint8_t wpTargetSysId;
-    uint8_t wpTargetCompId;
-    uint8_t wpCount;
-    uint8_t wpCurrent;
-    uint32_t wpNext;
-
-    unsigned long lastCounter;
+#define MAVLINK_HEARTBEAT_INTERVAL	    1e6	    //  1Hz
+#define MAVLINK_GPS_FIX_HACC		    10.0    // meters, worse than this is reported as no fix
+
+// id, payload length and CRC_EXTRA of each message written
+#define MAVLINK_MSG_ID_HEARTBEAT		0
+#define MAVLINK_MSG_ID_HEARTBEAT_LEN		9
+#define MAVLINK_MSG_ID_HEARTBEAT_CRC		50
+#define MAVLINK_MSG_ID_SYS_STATUS		1
+#define MAVLINK_MSG_ID_SYS_STATUS_LEN		31
+#define MAVLINK_MSG_ID_SYS_STATUS_CRC		124
+#define MAVLINK_MSG_ID_GPS_RAW_INT		24
+#define MAVLINK_MSG_ID_GPS_RAW_INT_LEN		30
+#define MAVLINK_MSG_ID_GPS_RAW_INT_CRC		24
+#define MAVLINK_MSG_ID_SCALED_IMU		26
+#define MAVLINK_MSG_ID_SCALED_IMU_LEN		22
+#define MAVLINK_MSG_ID_SCALED_IMU_CRC		170
+#define MAVLINK_MSG_ID_SCALED_PRESSURE		29
+#define MAVLINK_MSG_ID_SCALED_PRESSURE_LEN	14
+#define MAVLINK_MSG_ID_SCALED_PRESSURE_CRC	115
+#define MAVLINK_MSG_ID_ATTITUDE			30
+#define MAVLINK_MSG_ID_ATTITUDE_LEN		28
+#define MAVLINK_MSG_ID_ATTITUDE_CRC		39
+#define MAVLINK_MSG_ID_GLOBAL_POSITION_INT	33
+#define MAVLINK_MSG_ID_GLOBAL_POSITION_INT_LEN	28
+#define MAVLINK_MSG_ID_GLOBAL_POSITION_INT_CRC	104
+#define MAVLINK_MSG_ID_RC_CHANNELS_RAW		35
+#define MAVLINK_MSG_ID_RC_CHANNELS_RAW_LEN	22
+#define MAVLINK_MSG_ID_RC_CHANNELS_RAW_CRC	244
+#define MAVLINK_MSG_ID_SERVO_OUTPUT_RAW		36
+#define MAVLINK_MSG_ID_SERVO_OUTPUT_RAW_LEN	21
+#define MAVLINK_MSG_ID_SERVO_OUTPUT_RAW_CRC	222
+
+// the few enum values used, from common.xml
+#define MAVLINK_TYPE_QUADROTOR		    2
+#define MAVLINK_AUTOPILOT_GENERIC_WP	    1	    // MAV_AUTOPILOT_GENERIC_WAYPOINTS_ONLY
+#define MAVLINK_MODE_FLAG_CUSTOM	    0x01
+#define MAVLINK_MODE_FLAG_GUIDED	    0x08
+#define MAVLINK_MODE_FLAG_STABILIZE	    0x10
+#define MAVLINK_MODE_FLAG_MANUAL	    0x40
+#define MAVLINK_MODE_FLAG_ARMED		    0x80
+#define MAVLINK_STATE_ACTIVE		    4
+#define MAVLINK_VERSION			    3
 
+typedef struct {
+    writerStruct_t *out;
+    uint64_t tsBase;			    // microseconds from 1970 to the start of the GPS week
+    double nextHeartbeat;		    // LOG_LASTUPDATE of the next heartbeat and status
+    double lastGpsUpdate;		    // LOG_GPS_POS_UPDATE of the last GPS_RAW_INT
+    uint32_t packets;
+    uint8_t seq;
+    uint8_t sysid;
+    uint8_t compid;
 } mavlinkStruct_t;
 
-static const int mavBufLen = MAVLINK_MAX_PACKET_LEN + sizeof(uint64_t);
-
-extern mavlinkStruct_t mavlinkData;
-extern mavlink_system_t mavlink_system;
+#ifdef __cplusplus
+extern "C" {
+#endif
 
-extern void mavlinkInit(void);
-extern void mavlinkWpReached(uint16_t seqId);
-extern void mavlinkWpAnnounceCurrent(uint16_t seqId);
-extern void mavlinkDo(loggerRecord_t *l);
-//static inline void comm_send_ch(mavlink_channel_t chan, uint8_t ch) {}
+extern __thread mavlinkStruct_t mavlinkData;
 
+extern void mavlinkInit(writerStruct_t *out, time_t towStart);
+extern void mavlinkDo(loggerRecord_t *l, const double *rpy);
 
 #ifdef __cplusplus
 }
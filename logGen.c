@@ -0,0 +1,528 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#include "logGen.h"
+#include "logger.h"
+#include "quatosLog.h"
+#include "escLog.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#define LOGGEN_AQ_RATE			200					// AQ records a second
+#define LOGGEN_QUATOS_RATE		400
+#define LOGGEN_WAVES			8					// sine waves most values follow
+#define LOGGEN_GARBAGE			16					// most bytes of garbage put in front of a record
+
+static const char *logGenSchemaNames[] = {
+	"full",
+	"shuffled",
+	"short",
+	"random",
+	0
+};
+
+static const unsigned char logGenShortFields[] = {
+	LOG_LASTUPDATE,
+	LOG_GPS_ITOW, LOG_GPS_POS_UPDATE, LOG_GPS_LAT, LOG_GPS_LON, LOG_GPS_HEIGHT, LOG_GPS_HACC, LOG_GPS_VACC,
+	LOG_GPS_VEL_UPDATE, LOG_GPS_VELN, LOG_GPS_VELE, LOG_GPS_VELD,
+	LOG_ADC_VIN,
+	LOG_UKF_Q1, LOG_UKF_Q2, LOG_UKF_Q3, LOG_UKF_Q4, LOG_UKF_ALT,
+	LOG_MOT_MOTOR0, LOG_MOT_MOTOR1, LOG_MOT_MOTOR2, LOG_MOT_MOTOR3,
+	LOG_RADIO_CHANNEL0, LOG_RADIO_CHANNEL1, LOG_RADIO_CHANNEL2, LOG_RADIO_CHANNEL3,
+	LOG_RADIO_CHANNEL4, LOG_RADIO_CHANNEL5, LOG_RADIO_CHANNEL6, LOG_RADIO_CHANNEL7
+};
+
+// one moment of the made up flight: circles of 50m at 5m/s, climbing and sinking 10m, on a draining battery
+typedef struct {
+	double wave[LOGGEN_WAVES];
+	double lat, lon, alt;
+	double velN, velE, velD;
+	float quat[4];
+	double vin;
+} logGenFlight_t;
+
+void logGenDefaults(logGenOpts_t *o) {
+	memset(o, 0, sizeof(logGenOpts_t));
+	o->records = 100000;
+	o->schema = LOGGEN_SCHEMA_FULL;
+	o->numEscs = 4;
+	o->seed = 1;
+}
+
+int logGenSchemaByName(const char *name) {
+	int i;
+
+	for (i = 0; logGenSchemaNames[i]; i++)
+		if (!strcasecmp(name, logGenSchemaNames[i]))
+			return i;
+
+	return -1;
+}
+
+// xorshift, so a seed gives the same log on every platform
+static uint32_t logGenRand(uint32_t *s) {
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+
+	return *s;
+}
+
+static double logGenNoise(uint32_t *s) {
+	return logGenRand(s) / 4294967296.0 - 0.5;
+}
+
+// field type as a typical AQ firmware logs it
+unsigned char logGenFieldType(int fieldId) {
+	switch (fieldId) {
+		case LOG_LASTUPDATE:
+		case LOG_GPS_ITOW:
+		case LOG_GPS_POS_UPDATE:
+		case LOG_GPS_VEL_UPDATE:
+			return LOG_TYPE_U32;
+		case LOG_GPS_LAT:
+		case LOG_GPS_LON:
+			return LOG_TYPE_DOUBLE;
+		case LOG_ADC_MAG_SIGN:
+			return LOG_TYPE_S8;
+		case LOG_RADIO_QUALITY:
+		case LOG_RADIO_ERRORS:
+			return LOG_TYPE_U8;
+		case LOG_GMBL_TRIGGER:
+			return LOG_TYPE_S32;
+	}
+	if (fieldId >= LOG_MOT_MOTOR0 && fieldId <= LOG_MOT_MOTOR13)
+		return LOG_TYPE_U16;
+	if (fieldId >= LOG_RADIO_CHANNEL0 && fieldId <= LOG_RADIO_CHANNEL17)
+		return LOG_TYPE_S16;
+
+	return LOG_TYPE_FLOAT;
+}
+
+// Fill buf with the 'H' header field list of a schema (LOGGEN_SCHEMA_*), room for LOG_NUM_IDS fields.
+// Returns the number of fields.
+int logGenSchema(int schema, uint32_t *seed, char *buf) {
+	loggerFields_t *fields = (loggerFields_t *)buf;
+	int n = 0;
+	int i;
+
+	switch (schema) {
+		case LOGGEN_SCHEMA_SHUFFLED:
+			for (i = 0; i < LOG_NUM_IDS; i++)
+				fields[n++].fieldId = (i * 37) % LOG_NUM_IDS;
+			break;
+		case LOGGEN_SCHEMA_SHORT:
+			for (i = 0; i < (int)sizeof(logGenShortFields); i++)
+				fields[n++].fieldId = logGenShortFields[i];
+			break;
+		case LOGGEN_SCHEMA_RANDOM:
+			fields[n++].fieldId = LOG_LASTUPDATE;
+			for (i = 1; i < LOG_NUM_IDS; i++)
+				if (logGenRand(seed) & 0x100)
+					fields[n++].fieldId = i;
+			break;
+		default:
+			for (i = 0; i < LOG_NUM_IDS; i++)
+				fields[n++].fieldId = i;
+			break;
+	}
+
+	for (i = 0; i < n; i++)
+		fields[i].fieldType = logGenFieldType(fields[i].fieldId);
+
+	return n;
+}
+
+static void logGenFly(logGenFlight_t *f, double t, double progress) {
+	double a, n;
+	int i;
+
+	for (i = 0; i < LOGGEN_WAVES; i++)
+		f->wave[i] = sin(t * (i + 1) * 0.37 + i);
+
+	a = t / 10.0;
+	f->lat = 45.0 + 0.00045 * sin(a);
+	f->lon = -75.0 + 0.00064 * cos(a);
+	f->alt = 100.0 + 10.0 * sin(t / 20.0);
+	f->velN = 5.0 * cos(a);
+	f->velE = -5.0 * sin(a);
+	f->velD = -0.5 * cos(t / 20.0);
+
+	f->quat[0] = cos(a / 2.0);
+	f->quat[1] = 0.1 * sin(a / 2.0);
+	f->quat[2] = 0.2 * sin(a / 3.0);
+	f->quat[3] = sin(a / 2.0);
+	n = sqrt(f->quat[0]*f->quat[0] + f->quat[1]*f->quat[1] + f->quat[2]*f->quat[2] + f->quat[3]*f->quat[3]);
+	for (i = 0; i < 4; i++)
+		f->quat[i] /= n;
+
+	f->vin = 16.8 - 4.0 * (progress < 1.0 ? progress : 1.0);
+}
+
+// value of an AQ log field in record k
+static double logGenValue(const logGenFlight_t *f, int fieldId, uint64_t k, uint32_t *seed) {
+	int ch;
+
+	if (fieldId >= LOG_VOLTAGE0 && fieldId <= LOG_VOLTAGE14)
+		return fieldId - LOG_VOLTAGE0 == LOG_VOLT_VIN ? f->vin : 1.65 + 0.5 * f->wave[fieldId % LOGGEN_WAVES];
+	if (fieldId >= LOG_UKF_Q1 && fieldId <= LOG_UKF_Q4)
+		return f->quat[fieldId - LOG_UKF_Q1];
+	if (fieldId >= LOG_MOT_MOTOR0 && fieldId <= LOG_MOT_MOTOR13)
+		return k < 50 ? 0 : (int)(400 + 100 * f->wave[(fieldId - LOG_MOT_MOTOR0) % LOGGEN_WAVES]);
+	if (fieldId >= LOG_RADIO_CHANNEL0 && fieldId <= LOG_RADIO_CHANNEL17) {
+		ch = fieldId - LOG_RADIO_CHANNEL0;
+		if (ch == 3)		// a trigger channel
+			return (k / 400) % 3 ? -500 : 300;
+		if (ch == 6)		// a switch
+			return k > 1000 ? 300 : 0;
+		return (int)(700 * f->wave[ch % LOGGEN_WAVES]);
+	}
+
+	switch (fieldId) {
+		case LOG_LASTUPDATE:
+			return (uint32_t)(k * (1000000 / LOGGEN_AQ_RATE));
+		case LOG_GPS_ITOW:
+			return (uint32_t)(300000000 + k * (1000 / LOGGEN_AQ_RATE));
+		case LOG_GPS_POS_UPDATE:
+		case LOG_GPS_VEL_UPDATE:	// 5Hz fixes
+			return (uint32_t)(k / (LOGGEN_AQ_RATE / 5) * (LOGGEN_AQ_RATE / 5) * (1000000 / LOGGEN_AQ_RATE));
+		case LOG_GPS_LAT:
+			return f->lat;
+		case LOG_GPS_LON:
+			return f->lon;
+		case LOG_GPS_HEIGHT:
+		case LOG_UKF_ALT:
+		case LOG_UKF_PRES_ALT:
+			return f->alt;
+		case LOG_GPS_HACC:
+		case LOG_GPS_VACC:
+			return 1.0 + 0.5 * fabs(f->wave[0]);
+		case LOG_GPS_VELN:
+		case LOG_UKF_VELN:
+			return f->velN;
+		case LOG_GPS_VELE:
+		case LOG_UKF_VELE:
+			return f->velE;
+		case LOG_GPS_VELD:
+		case LOG_UKF_VELD:
+			return f->velD;
+		case LOG_ADC_VIN:
+			return f->vin;
+		case LOG_ADC_MAG_SIGN:
+			return 1;
+		case LOG_RADIO_QUALITY:
+			return 100 - (int)(k % 7);
+		case LOG_RADIO_ERRORS:
+			return k % 256;
+		case LOG_GMBL_TRIGGER:
+			return (int32_t)(k / 1200);
+	}
+
+	return f->wave[fieldId % LOGGEN_WAVES] * (fieldId % 10 + 1) + logGenNoise(seed) * 1e-3;
+}
+
+// store v at p as fieldType, returns its size
+static int logGenPack(char *p, int fieldType, double v) {
+	double d;
+	float f;
+	uint32_t u32;
+	int32_t s32;
+	uint16_t u16;
+	int16_t s16;
+	uint8_t u8;
+	int8_t s8;
+
+	switch (fieldType) {
+		case LOG_TYPE_DOUBLE:
+			d = v;
+			memcpy(p, &d, sizeof(d));
+			return sizeof(d);
+		case LOG_TYPE_U32:
+			u32 = (uint32_t)v;
+			memcpy(p, &u32, sizeof(u32));
+			return sizeof(u32);
+		case LOG_TYPE_S32:
+			s32 = (int32_t)v;
+			memcpy(p, &s32, sizeof(s32));
+			return sizeof(s32);
+		case LOG_TYPE_U16:
+			u16 = (uint16_t)v;
+			memcpy(p, &u16, sizeof(u16));
+			return sizeof(u16);
+		case LOG_TYPE_S16:
+			s16 = (int16_t)v;
+			memcpy(p, &s16, sizeof(s16));
+			return sizeof(s16);
+		case LOG_TYPE_U8:
+			u8 = (uint8_t)v;
+			memcpy(p, &u8, sizeof(u8));
+			return sizeof(u8);
+		case LOG_TYPE_S8:
+			s8 = (int8_t)v;
+			memcpy(p, &s8, sizeof(s8));
+			return sizeof(s8);
+		default:
+			f = v;
+			memcpy(p, &f, sizeof(f));
+			return sizeof(f);
+	}
+}
+
+static void logGenChecksum(const char *buf, int len, unsigned char *ckA, unsigned char *ckB) {
+	int i;
+
+	for (i = 0; i < len; i++) {
+		*ckA += buf[i];
+		*ckB += *ckA;
+	}
+}
+
+// 1 to 16 bytes, none of which is the avoid byte (the first byte of a sync)
+static void logGenGarbage(writerStruct_t *w, unsigned char avoid, uint32_t *seed) {
+	int n = 1 + logGenRand(seed) % LOGGEN_GARBAGE;
+	char *p = writerReserve(w, n);
+	int i;
+
+	for (i = 0; i < n; i++) {
+		p[i] = logGenRand(seed) >> 24;
+		if ((unsigned char)p[i] == avoid)
+			p[i] ^= 0x01;
+	}
+	w->len += n;
+}
+
+// which damage record k gets: 0 none, 1 garbage in front of it, 2 damaged in place
+static int logGenDamage(const logGenOpts_t *o, uint64_t k) {
+	if (!o->corruptEvery || k % o->corruptEvery != (uint64_t)o->corruptEvery - 1)
+		return 0;
+
+	return (k / o->corruptEvery) & 1 ? 2 : 1;
+}
+
+static int logGenMore(const logGenOpts_t *o, const logGenStats_t *s) {
+	return s->records < o->records && (!o->size || s->bytes < o->size);
+}
+
+static double logGenProgress(const logGenOpts_t *o, const logGenStats_t *s) {
+	return o->size ? (double)s->bytes / o->size : (double)s->records / o->records;
+}
+
+// an 'H' header, then 'M' (and 'L') records of the flight
+void logGenAq(writerStruct_t *w, const logGenOpts_t *o, logGenStats_t *s) {
+	char fields[LOG_NUM_IDS * sizeof(loggerFields_t)];
+	loggerFields_t *f = (loggerFields_t *)fields;
+	logGenFlight_t fl;
+	loggerRecord_t rec;
+	uint32_t seed = o->seed ? o->seed : 1;
+	unsigned char ckA, ckB;
+	int numFields = 0, packetSize = 0;
+	int damage, len;
+	uint64_t k;
+	char *p;
+	int i;
+
+	memset(s, 0, sizeof(logGenStats_t));
+
+	for (k = 0; logGenMore(o, s); k++) {
+		if (k == 0 || (o->headerEvery && k % o->headerEvery == 0)) {
+			numFields = logGenSchema(o->schema, &seed, fields);
+			for (i = 0, packetSize = 0; i < numFields; i++)
+				packetSize += loggerFieldSize(f[i].fieldType);
+
+			len = numFields * sizeof(loggerFields_t);
+			p = writerReserve(w, len + 6);
+			p[0] = 'A';
+			p[1] = 'q';
+			p[2] = 'H';
+			p[3] = numFields;
+			memcpy(p + 4, fields, len);
+			ckA = ckB = numFields;
+			logGenChecksum(p + 4, len, &ckA, &ckB);
+			p[len + 4] = ckA;
+			p[len + 5] = ckB;
+			w->len += len + 6;
+			s->bytes += len + 6;
+			s->headers++;
+		}
+
+		logGenFly(&fl, (double)k / LOGGEN_AQ_RATE, logGenProgress(o, s));
+
+		if ((damage = logGenDamage(o, k)) == 1) {
+			len = w->len;
+			logGenGarbage(w, 'A', &seed);
+			s->bytes += w->len - len;
+			s->garbled++;
+		}
+
+		if (o->lEvery && k % o->lEvery == (uint64_t)o->lEvery - 1) {
+			memset(&rec, 0, sizeof(rec));
+			for (i = 0; i < LOG_NUM_IDS; i++)
+				rec.data[i] = logGenValue(&fl, i, k, &seed);
+			for (i = 0; i < 4; i++)
+				rec.quat[i] = rec.data[LOG_UKF_Q1 + i];
+			for (i = 0; i < LOG_NUM_VOLTAGES; i++)
+				rec.voltages[i] = rec.data[LOG_VOLTAGE0 + i];
+			for (i = 0; i < LOG_NUM_MOTORS; i++)
+				rec.motors[i] = rec.data[LOG_MOT_MOTOR0 + i];
+			for (i = 0; i < LOG_NUM_RADIO_CHAN; i++)
+				rec.radioChannels[i] = rec.data[LOG_RADIO_CHANNEL0 + i];
+			ckA = ckB = 0;
+			logGenChecksum((const char *)&rec, sizeof(rec) - 2, &ckA, &ckB);
+			rec.ckA = ckA;
+			rec.ckB = ckB;
+
+			len = sizeof(rec);
+			p = writerReserve(w, len + 3);
+			memcpy(p + 3, &rec, len);
+			p[2] = 'L';
+		}
+		else {
+			p = writerReserve(w, packetSize + 5);
+			for (i = 0, len = 0; i < numFields; i++)
+				len += logGenPack(p + 3 + len, f[i].fieldType, logGenValue(&fl, f[i].fieldId, k, &seed));
+			ckA = ckB = 0;
+			logGenChecksum(p + 3, len, &ckA, &ckB);
+			p[len + 3] = ckA;
+			p[len + 4] = ckB;
+			len += 2;
+			p[2] = 'M';
+		}
+		p[0] = 'A';
+		p[1] = 'q';
+
+		if (damage == 2) {
+			p[3 + logGenRand(&seed) % (len - 2)] ^= 0x55;
+			s->damaged++;
+		}
+
+		w->len += len + 3;
+		s->bytes += len + 3;
+		s->records++;
+	}
+}
+
+// records of a sync and QUATOS_LOG_FIELDS floats
+void logGenQuatos(writerStruct_t *w, const logGenOpts_t *o, logGenStats_t *s) {
+	logGenFlight_t fl;
+	float v[QUATOS_LOG_FIELDS];
+	uint32_t sync = QUATOS_LOG_SYNC;
+	uint32_t seed = o->seed ? o->seed : 1;
+	int damage, len;
+	uint64_t k;
+	char *p;
+	int i;
+
+	memset(s, 0, sizeof(logGenStats_t));
+
+	for (k = 0; logGenMore(o, s); k++) {
+		logGenFly(&fl, (double)k / LOGGEN_QUATOS_RATE, logGenProgress(o, s));
+
+		for (i = 0; i < 4; i++) {
+			v[i] = fl.quat[i];							// QUAT_DES
+			v[7 + i] = fl.quat[i] + logGenNoise(&seed) * 1e-3;	// QUAT_ACT
+		}
+		for (i = 0; i < 3; i++) {
+			v[4 + i] = fl.wave[i];						// WCD
+			v[11 + i] = 0.5 * fl.wave[i + 3] + logGenNoise(&seed) * 1e-2;	// RATE_ACT
+			v[14 + i] = 0.5 * fl.wave[i + 3];			// RATE_DES
+			v[17 + i] = 0.02 + 0.001 * fl.wave[i];		// INERTIA_REQ
+		}
+		v[20] = 0.5;									// HOVER_THRUST
+		for (i = 0; i < 8; i++)
+			v[21 + i] = 0.5 + 0.2 * fl.wave[i];		// DCA
+
+		if ((damage = logGenDamage(o, k)) == 1) {
+			len = w->len;
+			logGenGarbage(w, 0xff, &seed);
+			s->bytes += w->len - len;
+			s->garbled++;
+		}
+
+		len = sizeof(sync) + sizeof(v);
+		p = writerReserve(w, len);
+		memcpy(p, &sync, sizeof(sync));
+		memcpy(p + sizeof(sync), v, sizeof(v));
+
+		// cut short, the reader finds the next record but loses this one
+		if (damage == 2) {
+			len -= 1 + logGenRand(&seed) % sizeof(v);
+			s->damaged++;
+		}
+
+		w->len += len;
+		s->bytes += len;
+		s->records++;
+	}
+}
+
+// records of o->numEscs ESCs in turn, each logging at LOGGEN_ESC_RATE
+void logGenEsc(writerStruct_t *w, const logGenOpts_t *o, logGenStats_t *s) {
+	logGenFlight_t fl;
+	uint32_t seed = o->seed ? o->seed : 1;
+	int numEscs = o->numEscs > 0 ? (o->numEscs < ESC_LOG_NUM_IDS ? o->numEscs : ESC_LOG_NUM_IDS) : 1;
+	uint64_t v, k;
+	uint32_t micros;
+	double wave;
+	int damage, len, id;
+	char *p;
+
+	memset(s, 0, sizeof(logGenStats_t));
+
+	for (k = 0; logGenMore(o, s); k++) {
+		id = k % numEscs;
+		if (id == 0)
+			logGenFly(&fl, (double)(k / numEscs) / LOGGEN_ESC_RATE, logGenProgress(o, s));
+		wave = fl.wave[id % LOGGEN_WAVES];
+
+		micros = (uint32_t)(k / numEscs * (1000000 / LOGGEN_ESC_RATE) + id * 37);
+		v = 3;											// running
+		v |= (uint64_t)(fl.vin * 100) << 3;
+		v |= (uint64_t)((5.0 + 3.0 * wave) * 100) << 15;
+		v |= (uint64_t)(5000 + 2000 * wave) << 29;
+		v |= (uint64_t)((40.0 + 20.0 * wave) * 255 / 100) << 44;
+		if (o->escV2)
+			v |= (uint64_t)(k / 100000 % 512) << 52;	// error count
+		else
+			v |= (uint64_t)((40.0 + wave + 32.0) * 4) << 52;
+
+		if ((damage = logGenDamage(o, k)) == 1) {
+			len = w->len;
+			logGenGarbage(w, ESC_LOG_SYNC, &seed);
+			s->bytes += w->len - len;
+			s->garbled++;
+		}
+
+		len = ESC_LOG_REC_SIZE;
+		p = writerReserve(w, len);
+		p[0] = ESC_LOG_SYNC;
+		p[1] = 0xc0 | id;
+		memcpy(p + 2, &micros, sizeof(micros));
+		memcpy(p + 6, &v, sizeof(v));
+
+		if (damage == 2) {
+			len -= 1 + logGenRand(&seed) % (ESC_LOG_REC_SIZE - 2);
+			s->damaged++;
+		}
+
+		w->len += len;
+		s->bytes += len;
+		s->records++;
+	}
+}
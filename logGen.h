@@ -0,0 +1,73 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#ifndef _logGen_h
+#define _logGen_h
+
+#include "writer.h"
+#include <stdint.h>
+
+// Synthetic logs for benchmarks: AQ logs, QUATOS logs and ESC32 logs of a made up flight, written through a
+// writer so they can go to a file or stay in memory.  Damaged records are either garbage put in front of the
+// sync (the reader skips it and keeps the record) or a flipped payload byte (the record fails its checksum).
+
+#define LOGGEN_SCHEMA_FULL		0					// every field in id order
+#define LOGGEN_SCHEMA_SHUFFLED	1					// every field in a scrambled order
+#define LOGGEN_SCHEMA_SHORT		2					// only what a track and attitude need
+#define LOGGEN_SCHEMA_RANDOM	3					// a random set of fields, a new one with each header
+
+#define LOGGEN_ESC_RATE			500					// ESC32 records a second, per ESC
+
+typedef struct {
+	uint64_t records;								// records to write
+	uint64_t size;									// or stop past this many bytes, 0 for no limit
+	int schema;										// LOGGEN_SCHEMA_*
+	int headerEvery;								// repeat the 'H' header every this many records, 0 for only at the start
+	int lEvery;										// write every n'th record as an 'L' record, 0 for none
+	int corruptEvery;								// damage every n'th record, 0 for none
+	int numEscs;									// ESCs in an ESC32 log
+	int escV2;										// ESC32v2 log, an error count in place of temp
+	uint32_t seed;									// of the garbage, damage, noise and random schemas
+} logGenOpts_t;
+
+// what was written
+typedef struct {
+	uint64_t records;								// records written, damaged ones included
+	uint64_t bytes;
+	uint64_t garbled;								// records with garbage in front of them
+	uint64_t damaged;								// records which fail their checksum (AQ only)
+	int headers;
+} logGenStats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void logGenDefaults(logGenOpts_t *o);
+extern int logGenSchemaByName(const char *name);
+extern unsigned char logGenFieldType(int fieldId);
+extern int logGenSchema(int schema, uint32_t *seed, char *fields);
+extern void logGenAq(writerStruct_t *w, const logGenOpts_t *o, logGenStats_t *s);
+extern void logGenQuatos(writerStruct_t *w, const logGenOpts_t *o, logGenStats_t *s);
+extern void logGenEsc(writerStruct_t *w, const logGenOpts_t *o, logGenStats_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
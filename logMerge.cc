@@ -0,0 +1,659 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#include "logger.h"
+#include "escLog.h"
+#include "quatosLog.h"
+#include "writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <string.h>
+#include <strings.h>
+
+// Streams AQ, ESC32 and QUATOS logs into one export in micros order.  Each source is read a batch at a
+// time and keeps a small window of rows sorted by time, which evens out records logged slightly out of
+// order; the next output row is the earliest head of all the windows.
+
+#define MERGE_MAX_SOURCES		16
+#define MERGE_WINDOW			64					// default rows held per source
+#define MERGE_ESC_COLS			8
+#define MERGE_QUATOS_RATE		400.0				// Hz, QUATOS records carry no time of their own
+
+enum mergeTypes {
+	MERGE_AQ,
+	MERGE_ESC,
+	MERGE_QUATOS
+};
+
+static const char *mergeTypeNames[] = {
+	"aq",
+	"esc",
+	"quatos"
+};
+
+static const char *mergeEscLabels[MERGE_ESC_COLS] = {
+	"id",
+	"state",
+	"vin",
+	"amps",
+	"rpm",
+	"duty",
+	"temp",
+	"dsrm-code"
+};
+
+typedef struct {
+	uint64_t micros;
+	uint32_t seq;									// order read, keeps rows of equal time in file order
+	double *vals;
+} mergeRow_t;
+
+typedef struct {
+	int type;
+	const char *fname;
+	char name[16];									// column heading prefix
+	int numCols;									// values in each of its rows
+	int64_t shift;									// micros added to every row
+	int escVersion;
+	double quatosRate;
+
+	loggerContext_t *ctx;
+	loggerRecord_t rec;
+	int fields[LOG_NUM_IDS];						// AQ fields exported
+	FILE *fp;
+	escLogReader_t *esc;
+	escLogBatch_t *escBatch;
+	int escPos;
+	int escCol[ESC_LOG_NUM_IDS];					// first as-of column of each ESC id, -1 if it has none
+	int numEscIds;
+	quatosLogReader_t *quatos;
+	double *quatosRows;
+	int quatosNum, quatosPos;
+
+	uint32_t lastRaw;								// for unwrapping 32 bit micros
+	uint64_t epoch;
+	int eof;
+
+	mergeRow_t *slots;								// window storage
+	double *pool;
+	mergeRow_t **free;
+	int numFree;
+	mergeRow_t **win;								// rows held, earliest first
+	int winLen;
+
+	double *last;									// latest values for an as-of join
+	unsigned char *have;
+	uint32_t rows;
+	uint32_t late;									// rows older than what was already exported
+} mergeSource_t;
+
+mergeSource_t mergeSources[MERGE_MAX_SOURCES];
+int mergeNumSources;
+int mergeWindow = MERGE_WINDOW;
+bool mergeAsOf;
+bool includeHeaders;
+char sep = ',';
+unsigned char mergeFieldMask[LOG_NUM_IDS];			// AQ fields asked for with -f, none for all logged ones
+bool mergeFieldsSet;
+
+void logMergeUsage(void) {
+	fprintf(stderr,
+"\n\
+Usage: logMerge [options] sources [ > outfile.ext ]\n\n\
+Sources (at least one is required, each may be repeated):\n\
+\n\
+ --aq (-a) file         AQ flight log, timed by its LASTUPDATE micros.\n\
+ --esc (-E) file        ESC32v3 log, timed by its micros.\n\
+ --esc-v2 (-V) file     ESC32v2 log.\n\
+ --quatos (-q) file     QUATOS log.  Its records have no time, so record n is at n / rate seconds.\n\
+\n\
+Source options, for the source given just before:\n\
+\n\
+ --shift (-s) micros    Add this to every time of the source, to line it up with the others.\n\
+ --rate (-r) Hz         QUATOS logging rate (default %g).\n\
+\n\
+Options:\n\
+\n\
+ --as-of (-j)           One row per record of the first source, each other source adding the\n\
+                          values of its latest record at or before it (per id for ESCs).\n\
+                          The default is a sparse export: one row per record of any source,\n\
+                          empty where a column belongs to another one.\n\
+ --fields (-f) list     Comma separated AQ fields to export, eg. IMU_RATEX,UKF_ALT\n\
+                          (default is all fields of the log's first header).\n\
+ --window (-w) rows     Rows kept per source to sort out records logged out of order (default %d).\n\
+ --exp-format (-e)      Export format. One of: csv (default), tab or txt.\n\
+ --col-headers (-c)     Include column headings row in the export.\n\
+\n\
+Examples:\n\
+   logMerge -c -a AQL-001.LOG -E ESC.LOG -q QUAT.LOG -s 1000000 >merged.csv\n\
+   logMerge -c -j -f IMU_RATEX,MOT_MOTOR0 -a AQL-001.LOG -E ESC.LOG >asof.csv\n",
+	MERGE_QUATOS_RATE, MERGE_WINDOW);
+}
+
+static void logMergeFields(const char *list) {
+	char name[64];
+	const char *p = list;
+	int len, i;
+
+	while (*p) {
+		len = strcspn(p, ",");
+		if (len >= (int)sizeof(name))
+			len = sizeof(name) - 1;
+		memcpy(name, p, len);
+		name[len] = 0;
+
+		// labels may carry units after the name
+		for (i = 0; i < LOG_NUM_IDS; i++)
+			if (strlen(name) == strcspn(loggerFieldLabels[i], " ") && !strncasecmp(name, loggerFieldLabels[i], strlen(name)))
+				break;
+		if (i == LOG_NUM_IDS) {
+			fprintf(stderr, "logMerge: unknown AQ field '%s', aborting...\n", name);
+			exit(1);
+		}
+		mergeFieldMask[i] = 1;
+		mergeFieldsSet = true;
+
+		p += strcspn(p, ",");
+		if (*p)
+			p++;
+	}
+}
+
+static void logMergeAddSource(int type, const char *fname, int escVersion) {
+	mergeSource_t *s;
+
+	if (mergeNumSources == MERGE_MAX_SOURCES) {
+		fprintf(stderr, "logMerge: too many sources, at most %d\n", MERGE_MAX_SOURCES);
+		exit(1);
+	}
+
+	s = &mergeSources[mergeNumSources++];
+	s->type = type;
+	s->fname = fname;
+	s->escVersion = escVersion;
+	s->quatosRate = MERGE_QUATOS_RATE;
+}
+
+static mergeSource_t *logMergeLastSource(const char *opt) {
+	if (!mergeNumSources) {
+		fprintf(stderr, "logMerge: %s must follow the source it is for\n", opt);
+		exit(1);
+	}
+
+	return &mergeSources[mergeNumSources - 1];
+}
+
+void logMergeOpts(int argc, char **argv) {
+	int ch;
+
+	static struct option longopts[] = {
+		{"help",			no_argument, 		NULL,		'h'},
+		{"aq",				required_argument,	NULL,		'a'},
+		{"esc",				required_argument,	NULL,		'E'},
+		{"esc-v2",			required_argument,	NULL,		'V'},
+		{"quatos",			required_argument,	NULL,		'q'},
+		{"shift",			required_argument,	NULL,		's'},
+		{"rate",			required_argument,	NULL,		'r'},
+		{"as-of",			no_argument,		NULL,		'j'},
+		{"fields",			required_argument,	NULL,		'f'},
+		{"window",			required_argument,	NULL,		'w'},
+		{"exp-format",		required_argument,	NULL,		'e'},
+		{"col-headers",		no_argument,		NULL,		'c'},
+		{NULL,				0,					NULL,		0}
+	};
+
+	while ((ch = getopt_long(argc, argv, "ha:E:V:q:s:r:jf:w:e:c", longopts, NULL)) != -1) {
+		switch (ch) {
+			case 'h':
+				logMergeUsage();
+				exit(0);
+				break;
+			case 'a':
+				logMergeAddSource(MERGE_AQ, optarg, 0);
+				break;
+			case 'E':
+				logMergeAddSource(MERGE_ESC, optarg, 3);
+				break;
+			case 'V':
+				logMergeAddSource(MERGE_ESC, optarg, 2);
+				break;
+			case 'q':
+				logMergeAddSource(MERGE_QUATOS, optarg, 0);
+				break;
+			case 's':
+				logMergeLastSource("--shift")->shift = strtoll(optarg, 0, 0);
+				break;
+			case 'r':
+				logMergeLastSource("--rate")->quatosRate = atof(optarg);
+				break;
+			case 'j':
+				mergeAsOf = true;
+				break;
+			case 'f':
+				logMergeFields(optarg);
+				break;
+			case 'w':
+				mergeWindow = atoi(optarg);
+				if (mergeWindow < 1)
+					mergeWindow = 1;
+				break;
+			case 'e':
+				if (strcmp(optarg, "csv") == 0)
+					sep = ',';
+				else if (strcmp(optarg, "tab") == 0)
+					sep = '	';
+				else if (strcmp(optarg, "txt") == 0)
+					sep = ' ';
+				break;
+			case 'c':
+				includeHeaders = true;
+				break;
+			default:
+				logMergeUsage();
+				exit(1);
+				break;
+		}
+	}
+}
+
+// 32 bit micros to a time which keeps counting past a wrap
+static uint64_t logMergeUnwrap(mergeSource_t *s, uint32_t raw) {
+	if (s->rows && raw < s->lastRaw && s->lastRaw - raw > 0x80000000U)
+		s->epoch += 0x100000000ULL;
+	s->lastRaw = raw;
+
+	return s->epoch + raw;
+}
+
+// Decode the next record of a source into row.  Returns 0 at the end of it.
+static int logMergeNext(mergeSource_t *s, mergeRow_t *row) {
+	escLogBatch_t *b;
+	double *v = row->vals;
+	int i;
+
+	switch (s->type) {
+		case MERGE_AQ:
+			if (loggerContextRead(s->ctx, &s->rec) == EOF)
+				return 0;
+			row->micros = logMergeUnwrap(s, (uint32_t)s->rec.data[LOG_LASTUPDATE]);
+			for (i = 0; i < s->numCols; i++)
+				v[i] = s->rec.data[s->fields[i]];
+			break;
+
+		case MERGE_ESC:
+			b = s->escBatch;
+			if (s->escPos == b->n) {
+				if (escLogRead(s->esc, b) == 0)
+					return 0;
+				s->escPos = 0;
+			}
+			i = s->escPos++;
+			row->micros = logMergeUnwrap(s, b->micros[i]);
+			v[0] = b->id[i];
+			v[1] = b->state[i];
+			v[2] = b->vin[i] / 100.0;
+			v[3] = b->amps[i] / 100.0;
+			v[4] = b->rpm[i];
+			v[5] = b->duty[i] / 255.0 * 100;
+			v[6] = s->escVersion == 2 ? b->temp[i] : b->temp[i] / 4.0 - 32.0;
+			v[7] = b->errCode[i];
+			break;
+
+		case MERGE_QUATOS:
+			if (s->quatosPos == s->quatosNum) {
+				if ((s->quatosNum = quatosLogRead(s->quatos, s->quatosRows, QUATOS_LOG_BATCH)) == 0)
+					return 0;
+				s->quatosPos = 0;
+			}
+			row->micros = (uint64_t)(s->rows * 1e6 / s->quatosRate);
+			memcpy(v, s->quatosRows + s->quatosPos++ * QUATOS_LOG_FIELDS, QUATOS_LOG_FIELDS * sizeof(double));
+			break;
+	}
+	row->micros += s->shift;
+	row->seq = s->rows++;
+
+	return 1;
+}
+
+static int logMergeBefore(const mergeRow_t *a, const mergeRow_t *b) {
+	return a->micros < b->micros || (a->micros == b->micros && a->seq < b->seq);
+}
+
+// top the window of a source up
+static void logMergeFill(mergeSource_t *s) {
+	mergeRow_t *row;
+	int i;
+
+	while (!s->eof && s->winLen < mergeWindow) {
+		row = s->free[--s->numFree];
+		if (!logMergeNext(s, row)) {
+			s->free[s->numFree++] = row;
+			s->eof = 1;
+			break;
+		}
+
+		// usually in order already, so look from the back
+		for (i = s->winLen; i > 0 && logMergeBefore(row, s->win[i-1]); i--)
+			s->win[i] = s->win[i-1];
+		s->win[i] = row;
+		s->winLen++;
+	}
+}
+
+static void logMergeOpen(mergeSource_t *s, int num) {
+	int n, i;
+
+	snprintf(s->name, sizeof(s->name), "%s", mergeTypeNames[s->type]);
+	for (i = n = 0; i < mergeNumSources; i++)
+		if (mergeSources[i].type == s->type)
+			n++;
+	// number them when there are more of a kind
+	if (n > 1) {
+		for (i = n = 0; i < num; i++)
+			if (mergeSources[i].type == s->type)
+				n++;
+		snprintf(s->name, sizeof(s->name), "%s%d", mergeTypeNames[s->type], n + 1);
+	}
+
+	fprintf(stderr, "logMerge: opening %s log: %s\n", mergeTypeNames[s->type], s->fname);
+
+	switch (s->type) {
+		case MERGE_AQ:
+			if ((s->ctx = loggerContextOpen(s->fname)) == NULL)
+				exit(1);
+			s->numCols = LOG_NUM_IDS;				// all of them until the fields are known
+			for (i = 0; i < LOG_NUM_IDS; i++)
+				s->fields[i] = i;
+			break;
+
+		case MERGE_ESC:
+		case MERGE_QUATOS:
+			if ((s->fp = fopen(s->fname, "rb")) == NULL) {
+				fprintf(stderr, "logMerge: cannot open file '%s', aborting...\n", s->fname);
+				exit(1);
+			}
+			if (s->type == MERGE_ESC) {
+				s->esc = escLogOpen(s->fp);
+				s->escBatch = (escLogBatch_t *)calloc(1, sizeof(escLogBatch_t));
+				s->numCols = MERGE_ESC_COLS;
+			}
+			else {
+				if (s->quatosRate <= 0.0) {
+					fprintf(stderr, "logMerge: bad QUATOS rate for '%s'\n", s->fname);
+					exit(1);
+				}
+				s->quatos = quatosLogOpen(s->fp, QUATOS_LOG_FIELDS);
+				s->quatosRows = (double *)malloc(QUATOS_LOG_BATCH * QUATOS_LOG_FIELDS * sizeof(double));
+				s->numCols = QUATOS_LOG_FIELDS;
+			}
+			break;
+	}
+
+	s->slots = (mergeRow_t *)calloc(mergeWindow, sizeof(mergeRow_t));
+	s->pool = (double *)calloc(mergeWindow * s->numCols, sizeof(double));
+	s->free = (mergeRow_t **)malloc(mergeWindow * sizeof(mergeRow_t *));
+	s->win = (mergeRow_t **)malloc(mergeWindow * sizeof(mergeRow_t *));
+	for (i = 0; i < mergeWindow; i++) {
+		s->slots[i].vals = s->pool + i * s->numCols;
+		s->free[i] = &s->slots[i];
+	}
+	s->numFree = mergeWindow;
+
+	logMergeFill(s);
+
+	// the AQ columns are the fields asked for, or else those of the first header, in field order
+	if (s->type == MERGE_AQ) {
+		loggerFields_t *f = s->ctx->fields;
+		unsigned char mask[LOG_NUM_IDS];
+		int j, k;
+
+		memcpy(mask, mergeFieldMask, sizeof(mask));
+		if (!mergeFieldsSet) {
+			if (f && s->ctx->numFields)
+				for (i = 0; i < s->ctx->numFields; i++)
+					mask[f[i].fieldId] = 1;
+			else
+				memset(mask, 1, sizeof(mask));
+		}
+
+		for (i = n = 0; i < LOG_NUM_IDS; i++)
+			if (mask[i])
+				s->fields[n++] = i;
+
+		// the rows read so far hold every field, pack them down
+		for (j = 0; j < s->winLen; j++) {
+			double *v = s->win[j]->vals;
+			for (k = 0; k < n; k++)
+				v[k] = v[s->fields[k]];
+		}
+		s->numCols = n;
+	}
+
+	// an as-of join has a column set for every ESC id of the first batch
+	if (s->type == MERGE_ESC) {
+		memset(s->escCol, -1, sizeof(s->escCol));
+		for (i = 0; i < s->escBatch->n; i++)
+			s->escCol[s->escBatch->id[i]] = 0;
+		for (i = 0; i < ESC_LOG_NUM_IDS; i++)
+			if (!s->escCol[i])
+				s->escCol[i] = s->numEscIds++ * (MERGE_ESC_COLS - 1);
+	}
+
+	n = mergeAsOf ? (s->type == MERGE_ESC ? s->numEscIds * (MERGE_ESC_COLS - 1) : s->numCols) : 0;
+	s->last = (double *)calloc(n + 1, sizeof(double));
+	s->have = (unsigned char *)calloc(n + 1, 1);
+}
+
+static void logMergeClose(mergeSource_t *s) {
+	if (s->ctx)
+		loggerContextClose(s->ctx);
+	if (s->esc)
+		escLogClose(s->esc);
+	if (s->quatos)
+		quatosLogClose(s->quatos);
+	if (s->fp)
+		fclose(s->fp);
+	free(s->escBatch);
+	free(s->quatosRows);
+	free(s->slots);
+	free(s->pool);
+	free(s->free);
+	free(s->win);
+	free(s->last);
+	free(s->have);
+}
+
+static void logMergeHeading(writerStruct_t *w, const char *name, const char *label, int id) {
+	char s[64];
+
+	if (id < 0)
+		snprintf(s, sizeof(s), "%s:%s", name, label);
+	else
+		snprintf(s, sizeof(s), "%s:%d:%s", name, id, label);
+
+	writerChar(w, sep);
+	writerString(w, s);
+}
+
+void logMergeHeaders(writerStruct_t *w) {
+	mergeSource_t *s;
+	int i, j, id;
+
+	writerString(w, "micros");
+	if (!mergeAsOf) {
+		writerChar(w, sep);
+		writerString(w, "source");
+	}
+
+	for (i = 0; i < mergeNumSources; i++) {
+		s = &mergeSources[i];
+
+		if (s->type == MERGE_ESC && mergeAsOf && i) {
+			for (id = 0; id < ESC_LOG_NUM_IDS; id++)
+				if (s->escCol[id] >= 0)
+					for (j = 1; j < MERGE_ESC_COLS; j++)
+						logMergeHeading(w, s->name, mergeEscLabels[j], id);
+			continue;
+		}
+
+		for (j = 0; j < s->numCols; j++) {
+			switch (s->type) {
+				case MERGE_AQ:
+					logMergeHeading(w, s->name, loggerFieldLabels[s->fields[j]], -1);
+					break;
+				case MERGE_ESC:
+					logMergeHeading(w, s->name, j == 6 && s->escVersion == 2 ? "errors" : mergeEscLabels[j], -1);
+					break;
+				case MERGE_QUATOS:
+					logMergeHeading(w, s->name, quatosLogFieldLabels[j], -1);
+					break;
+			}
+		}
+	}
+	writerChar(w, '\n');
+}
+
+static void logMergeValues(writerStruct_t *w, const double *v, const unsigned char *have, int n) {
+	int i;
+
+	for (i = 0; i < n; i++) {
+		writerChar(w, sep);
+		if (!have || have[i])
+			writerDouble(w, v[i]);
+	}
+}
+
+// a sparse row: the values of its source, nothing for the rest
+void logMergeSparse(writerStruct_t *w, int src, const mergeRow_t *row) {
+	int i, k;
+
+	writerDouble(w, (double)row->micros);
+	writerChar(w, sep);
+	writerString(w, mergeSources[src].name);
+
+	for (i = 0; i < mergeNumSources; i++) {
+		if (i == src)
+			logMergeValues(w, row->vals, NULL, mergeSources[i].numCols);
+		else
+			for (k = 0; k < mergeSources[i].numCols; k++)
+				writerChar(w, sep);
+	}
+	writerChar(w, '\n');
+}
+
+// remember the latest row of a source other than the first
+static void logMergeKeep(mergeSource_t *s, const mergeRow_t *row) {
+	int col;
+
+	if (s->type == MERGE_ESC) {
+		if ((col = s->escCol[(int)row->vals[0]]) >= 0) {
+			memcpy(s->last + col, row->vals + 1, (MERGE_ESC_COLS - 1) * sizeof(double));
+			memset(s->have + col, 1, MERGE_ESC_COLS - 1);
+		}
+	}
+	else {
+		memcpy(s->last, row->vals, s->numCols * sizeof(double));
+		memset(s->have, 1, s->numCols);
+	}
+}
+
+// a row of the first source along with the latest of all the others
+void logMergeAsOf(writerStruct_t *w, const mergeRow_t *row) {
+	mergeSource_t *s;
+	int i;
+
+	writerDouble(w, (double)row->micros);
+	logMergeValues(w, row->vals, NULL, mergeSources[0].numCols);
+
+	for (i = 1; i < mergeNumSources; i++) {
+		s = &mergeSources[i];
+		logMergeValues(w, s->last, s->have, s->type == MERGE_ESC ? s->numEscIds * (MERGE_ESC_COLS - 1) : s->numCols);
+	}
+	writerChar(w, '\n');
+}
+
+int main(int argc, char *argv[]) {
+	writerStruct_t *w;
+	mergeSource_t *s;
+	mergeRow_t *row;
+	uint64_t lastMicros = 0;
+	uint32_t count = 0;
+	int i, next;
+
+	logMergeOpts(argc, argv);
+
+	if (!mergeNumSources) {
+		fprintf(stderr, "logMerge: need at least one log.  Type logMerge --help for usage details.\n");
+		exit(1);
+	}
+
+	for (i = 0; i < mergeNumSources; i++)
+		logMergeOpen(&mergeSources[i], i);
+
+	w = writerInit(stdout, 0);
+
+	if (includeHeaders)
+		logMergeHeaders(w);
+
+	// with this few sources a scan of the window heads beats keeping a heap
+	while (1) {
+		next = -1;
+		for (i = 0; i < mergeNumSources; i++) {
+			s = &mergeSources[i];
+			if (s->winLen && (next < 0 || s->win[0]->micros < mergeSources[next].win[0]->micros ||
+					(mergeAsOf && !next && s->win[0]->micros == mergeSources[0].win[0]->micros)))	// "at or before" for an as-of join
+				next = i;
+		}
+		if (next < 0)
+			break;
+
+		s = &mergeSources[next];
+		row = s->win[0];
+		if (count && row->micros < lastMicros)
+			s->late++;
+		else
+			lastMicros = row->micros;
+
+		if (!mergeAsOf)
+			logMergeSparse(w, next, row);
+		else if (next)
+			logMergeKeep(s, row);
+		else
+			logMergeAsOf(w, row);
+		count++;
+
+		memmove(s->win, s->win + 1, --s->winLen * sizeof(mergeRow_t *));
+		s->free[s->numFree++] = row;
+		logMergeFill(s);
+	}
+
+	writerFree(w);
+
+	for (i = 0; i < mergeNumSources; i++) {
+		s = &mergeSources[i];
+		fprintf(stderr, "logMerge: %s: %u records", s->name, s->rows);
+		if (s->late)
+			fprintf(stderr, ", %u too far out of order for the window", s->late);
+		fprintf(stderr, "\n");
+		logMergeClose(s);
+	}
+
+	exit(0);
+}
@@ -0,0 +1,207 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#include "logStats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint64_t logSize;
+	int64_t logTime;
+	uint32_t numRecords;
+	uint32_t numValues;
+} logStatsFile_t;
+
+typedef struct {
+	int32_t id;
+	uint32_t numBlocks;
+} logStatsFileValue_t;
+
+static void logStatsEmpty(logStatsSummary_t *m) {
+	memset(m, 0, sizeof(logStatsSummary_t));
+	m->min = m->max = nan("");
+}
+
+static void logStatsSummaryAdd(logStatsSummary_t *m, uint32_t record, double val) {
+	if (!m->records++)
+		m->first = val;
+	m->last = val;
+
+	if (isnan(val))
+		return;
+
+	if (!m->count++) {
+		m->min = m->max = val;
+		m->minAt = m->maxAt = record;
+	}
+	else if (val < m->min) {
+		m->min = val;
+		m->minAt = record;
+	}
+	else if (val > m->max) {
+		m->max = val;
+		m->maxAt = record;
+	}
+	m->sum += val;
+}
+
+void logStatsInit(logStats_t *s, uint64_t logSize, int64_t logTime) {
+	memset(s, 0, sizeof(logStats_t));
+	s->logSize = logSize;
+	s->logTime = logTime;
+}
+
+logStatsValue_t *logStatsFind(const logStats_t *s, int id) {
+	int i;
+
+	for (i = 0; i < s->numValues; i++)
+		if (s->values[i].id == id)
+			return &s->values[i];
+
+	return NULL;
+}
+
+// new, empty value id; one already there is dropped
+logStatsValue_t *logStatsAdd(logStats_t *s, int id) {
+	logStatsValue_t *v;
+
+	if ((v = logStatsFind(s, id)) != NULL) {
+		free(v->blocks);
+	}
+	else {
+		s->values = (logStatsValue_t *)realloc(s->values, (s->numValues + 1) * sizeof(logStatsValue_t));
+		v = &s->values[s->numValues++];
+	}
+
+	memset(v, 0, sizeof(logStatsValue_t));
+	v->id = id;
+	logStatsEmpty(&v->total);
+
+	return v;
+}
+
+// add the value of a record, records must come in order
+void logStatsUpdate(logStatsValue_t *v, uint32_t record, double val) {
+	int n = record / LOG_STATS_BLOCK;
+
+	if (n >= v->numBlocks) {
+		if (n >= v->allocBlocks) {
+			v->allocBlocks = n < 1024 ? 1024 : n * 2;
+			v->blocks = (logStatsSummary_t *)realloc(v->blocks, v->allocBlocks * sizeof(logStatsSummary_t));
+		}
+		for (; v->numBlocks <= n; v->numBlocks++)
+			logStatsEmpty(&v->blocks[v->numBlocks]);
+	}
+
+	logStatsSummaryAdd(&v->total, record, val);
+	logStatsSummaryAdd(&v->blocks[n], record, val);
+}
+
+// returns 0 if there is no stats file, or it doesn't belong to the log as it is now
+int logStatsLoad(logStats_t *s, const char *fname, uint64_t logSize, int64_t logTime) {
+	logStatsFile_t f;
+	logStatsFileValue_t fv;
+	logStatsValue_t *v;
+	FILE *fp;
+	uint32_t i;
+	int ok;
+
+	logStatsInit(s, logSize, logTime);
+
+	if ((fp = fopen(fname, "rb")) == NULL)
+		return 0;
+
+	ok = fread(&f, sizeof(f), 1, fp) == 1 &&
+		!memcmp(f.magic, LOG_STATS_MAGIC, sizeof(f.magic)) && f.version == LOG_STATS_VERSION &&
+		f.logSize == logSize && f.logTime == logTime;
+
+	for (i = 0; ok && i < f.numValues; i++) {
+		ok = fread(&fv, sizeof(fv), 1, fp) == 1 && fv.numBlocks <= f.numRecords / LOG_STATS_BLOCK + 1;
+		if (ok) {
+			v = logStatsAdd(s, fv.id);
+			v->blocks = (logStatsSummary_t *)malloc((fv.numBlocks + 1) * sizeof(logStatsSummary_t));
+			v->numBlocks = v->allocBlocks = fv.numBlocks;
+			ok = v->blocks && fread(&v->total, sizeof(logStatsSummary_t), 1, fp) == 1 &&
+				fread(v->blocks, sizeof(logStatsSummary_t), fv.numBlocks, fp) == fv.numBlocks;
+		}
+	}
+
+	fclose(fp);
+
+	if (!ok) {
+		logStatsFree(s);
+		logStatsInit(s, logSize, logTime);
+		return 0;
+	}
+
+	s->numRecords = f.numRecords;
+
+	return 1;
+}
+
+int logStatsSave(const logStats_t *s, const char *fname) {
+	logStatsFile_t f;
+	logStatsFileValue_t fv;
+	const logStatsValue_t *v;
+	FILE *fp;
+	int ok;
+	int i;
+
+	if ((fp = fopen(fname, "wb")) == NULL)
+		return 0;
+
+	memset(&f, 0, sizeof(f));
+	memcpy(f.magic, LOG_STATS_MAGIC, sizeof(f.magic));
+	f.version = LOG_STATS_VERSION;
+	f.logSize = s->logSize;
+	f.logTime = s->logTime;
+	f.numRecords = s->numRecords;
+	f.numValues = s->numValues;
+
+	ok = fwrite(&f, sizeof(f), 1, fp) == 1;
+
+	for (i = 0; ok && i < s->numValues; i++) {
+		v = &s->values[i];
+		fv.id = v->id;
+		fv.numBlocks = v->numBlocks;
+		ok = fwrite(&fv, sizeof(fv), 1, fp) == 1 &&
+			fwrite(&v->total, sizeof(logStatsSummary_t), 1, fp) == 1 &&
+			(!v->numBlocks || fwrite(v->blocks, sizeof(logStatsSummary_t), v->numBlocks, fp) == (size_t)v->numBlocks);
+	}
+
+	if (fclose(fp) || !ok) {
+		remove(fname);
+		return 0;
+	}
+
+	return 1;
+}
+
+void logStatsFree(logStats_t *s) {
+	int i;
+
+	for (i = 0; i < s->numValues; i++)
+		free(s->values[i].blocks);
+	free(s->values);
+	s->values = NULL;
+	s->numValues = 0;
+}
@@ -0,0 +1,76 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#ifndef _logStats_h
+#define _logStats_h
+
+#include <stdint.h>
+
+// Summary statistics of the values of a log, kept in a file next to it so they needn't be worked out
+// again while the log stays the same.  Each value has a summary of all its records and one for every
+// LOG_STATS_BLOCK records, by record number; with enough blocks those are a plot of the value at
+// screen resolution.  Values are identified by whatever number the caller gives them.
+//
+// File layout, all little endian: logStatsFile_t, then for each value an int32_t id, a uint32_t
+// block count, its summary of everything and its block summaries.
+
+#define LOG_STATS_MAGIC			"AQLS"
+#define LOG_STATS_VERSION		1
+#define LOG_STATS_BLOCK			64					// records per block summary
+
+typedef struct {
+	uint32_t records;								// records added
+	uint32_t count;									// values which aren't NaN
+	uint32_t minAt, maxAt;							// record numbers of the first min and max
+	double min, max;								// NaN if count is 0
+	double sum;
+	double first, last;								// values of the first and last record
+} logStatsSummary_t;
+
+typedef struct {
+	int id;
+	logStatsSummary_t total;
+	logStatsSummary_t *blocks;						// block n holds records n * LOG_STATS_BLOCK and on
+	int numBlocks, allocBlocks;
+} logStatsValue_t;
+
+typedef struct {
+	uint64_t logSize;								// size and modification time of the log they belong to
+	int64_t logTime;
+	uint32_t numRecords;							// records which were read to get them
+	logStatsValue_t *values;
+	int numValues;
+} logStats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void logStatsInit(logStats_t *s, uint64_t logSize, int64_t logTime);
+extern logStatsValue_t *logStatsFind(const logStats_t *s, int id);
+extern logStatsValue_t *logStatsAdd(logStats_t *s, int id);
+extern void logStatsUpdate(logStatsValue_t *v, uint32_t record, double val);
+extern int logStatsLoad(logStats_t *s, const char *fname, uint64_t logSize, int64_t logTime);
+extern int logStatsSave(const logStats_t *s, const char *fname);
+extern void logStatsFree(logStats_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
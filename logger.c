@@ -17,141 +17,293 @@
 */
 
 #include "logger.h"
+#include "profiler.h"
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <time.h>
+#if defined (__WIN32__)
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <unistd.h>
+	#include <poll.h>
+#endif
+#if defined (__linux__)
+	#include <sys/inotify.h>
+#elif defined (__APPLE__) || defined (__FreeBSD__) || defined (__NetBSD__) || defined (__OpenBSD__)
+	#include <sys/event.h>
+	#define LOGGER_KQUEUE
+#endif
+#if defined (__SSE2__)
+	#include <emmintrin.h>
+#endif
 
-loggerFields_t *loggerFields;
-int loggerNumFields;
-int loggerPacketSize;
+static __thread loggerContext_t loggerThread;	// used by the calls which take no context
 
 void loggerChecksumError(const char *s) {
 	fprintf(stderr, "logger: checksum error in '%s' packet\n", s);
 }
 
-void loggerDecodePacket(char *buf, loggerRecord_t *r) {
-	int i;
-	unsigned char fieldId;
-
-	for (i = 0; i < loggerNumFields; i++) {
-		fieldId = loggerFields[i].fieldId;
-		// store some fields in arrays, for convenience
-		switch (fieldId) {
-			case LOG_VOLTAGE0:
-			case LOG_VOLTAGE1:
-			case LOG_VOLTAGE2:
-			case LOG_VOLTAGE3:
-			case LOG_VOLTAGE4:
-			case LOG_VOLTAGE5:
-			case LOG_VOLTAGE6:
-			case LOG_VOLTAGE7:
-			case LOG_VOLTAGE8:
-			case LOG_VOLTAGE9:
-			case LOG_VOLTAGE10:
-			case LOG_VOLTAGE11:
-			case LOG_VOLTAGE12:
-			case LOG_VOLTAGE13:
-			case LOG_VOLTAGE14:
-				r->voltages[fieldId-LOG_VOLTAGE0] = *(float *)buf;
-				break;
-			case LOG_UKF_Q1:
-			case LOG_UKF_Q2:
-			case LOG_UKF_Q3:
-			case LOG_UKF_Q4:
-				r->quat[fieldId-LOG_UKF_Q1] = *(float *)buf;
-				break;
-			case LOG_MOT_MOTOR0:
-			case LOG_MOT_MOTOR1:
-			case LOG_MOT_MOTOR2:
-			case LOG_MOT_MOTOR3:
-			case LOG_MOT_MOTOR4:
-			case LOG_MOT_MOTOR5:
-			case LOG_MOT_MOTOR6:
-			case LOG_MOT_MOTOR7:
-			case LOG_MOT_MOTOR8:
-			case LOG_MOT_MOTOR9:
-			case LOG_MOT_MOTOR10:
-			case LOG_MOT_MOTOR11:
-			case LOG_MOT_MOTOR12:
-			case LOG_MOT_MOTOR13:
-				r->motors[fieldId-LOG_MOT_MOTOR0] = *(uint16_t *)buf;
-				break;
-			case LOG_RADIO_CHANNEL0:
-			case LOG_RADIO_CHANNEL1:
-			case LOG_RADIO_CHANNEL2:
-			case LOG_RADIO_CHANNEL3:
-			case LOG_RADIO_CHANNEL4:
-			case LOG_RADIO_CHANNEL5:
-			case LOG_RADIO_CHANNEL6:
-			case LOG_RADIO_CHANNEL7:
-			case LOG_RADIO_CHANNEL8:
-			case LOG_RADIO_CHANNEL9:
-			case LOG_RADIO_CHANNEL10:
-			case LOG_RADIO_CHANNEL11:
-			case LOG_RADIO_CHANNEL12:
-			case LOG_RADIO_CHANNEL13:
-			case LOG_RADIO_CHANNEL14:
-			case LOG_RADIO_CHANNEL15:
-			case LOG_RADIO_CHANNEL16:
-			case LOG_RADIO_CHANNEL17:
-				r->radioChannels[fieldId-LOG_RADIO_CHANNEL0] = *(int16_t *)buf;
-				break;
+// Add len bytes to the running ckA/ckB sums of a packet.  Over 16 bytes b[0..15], ckA grows by their sum
+// and ckB by 16 * ckA plus the sum of (16 - i) * b[i], so SSE2 takes 16 bytes at a time; only the low
+// byte of each sum is kept, and 32 bit lanes wrap without changing it.
+void loggerChecksum(const char *buf, int len, unsigned char *ckA, unsigned char *ckB) {
+	unsigned char a = *ckA, b = *ckB;
+	int i = 0;
+
+#if defined (__SSE2__)
+	if (len >= 16) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i wLo = _mm_set_epi16(9, 10, 11, 12, 13, 14, 15, 16);
+		const __m128i wHi = _mm_set_epi16(1, 2, 3, 4, 5, 6, 7, 8);
+		__m128i vA = zero;							// byte sums, in lanes 0 and 2
+		__m128i vP = zero;							// sum of vA before each block
+		__m128i vW = zero;							// weighted byte sums
+		__m128i v;
+		uint32_t sa[4], sp[4], sw[4];
+
+		for (; i + 16 <= len; i += 16) {
+			v = _mm_loadu_si128((const __m128i *)(buf + i));
+			vP = _mm_add_epi32(vP, vA);
+			vA = _mm_add_epi32(vA, _mm_sad_epu8(v, zero));
+			vW = _mm_add_epi32(vW, _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), wLo));
+			vW = _mm_add_epi32(vW, _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), wHi));
 		}
 
-		switch (loggerFields[i].fieldType) {
-			case LOG_TYPE_DOUBLE:
-				r->data[fieldId] = *(double *)buf;
-				buf += 8;
-				break;
-			case LOG_TYPE_FLOAT:
-				r->data[fieldId] = *(float *)buf;
-				buf += 4;
-				break;
-			case LOG_TYPE_U32:
-				r->data[fieldId] = *(uint32_t *)buf;
-				buf += 4;
-				break;
-			case LOG_TYPE_S32:
-				r->data[fieldId] = *(int32_t *)buf;
-				buf += 4;
-				break;
-			case LOG_TYPE_U16:
-				r->data[fieldId] = *(uint16_t *)buf;
-				buf += 2;
-				break;
-			case LOG_TYPE_S16:
-				r->data[fieldId] = *(int16_t *)buf;
-				buf += 2;
-				break;
-			case LOG_TYPE_U8:
-				r->data[fieldId] = *(uint8_t *)buf;
-				buf += 1;
-				break;
-			case LOG_TYPE_S8:
-				r->data[fieldId] = *(int8_t *)buf;
-				buf += 1;
-				break;
+		_mm_storeu_si128((__m128i *)sa, vA);
+		_mm_storeu_si128((__m128i *)sp, vP);
+		_mm_storeu_si128((__m128i *)sw, vW);
+		b += i * a + 16 * (sp[0] + sp[2]) + sw[0] + sw[1] + sw[2] + sw[3];
+		a += sa[0] + sa[2];
+	}
+#endif
+	for (; i < len; i++) {
+		a += buf[i];
+		b += a;
+	}
+
+	*ckA = a;
+	*ckB = b;
+}
+
+// Packets are decoded by walking a plan which loggerPlanFields() compiles from each 'H' header:
+// consecutive fields of the same type form one run, decoded by a kernel specialized for that type,
+// and fields which are also kept in the convenience arrays get a second, per-array copy list.
+
+typedef void loggerDecodeKernel_t(const char *buf, loggerRecord_t *r, const unsigned char *ids, int n);
+
+typedef struct {
+	loggerDecodeKernel_t *kernel;
+	unsigned short offset;							// packet offset of first value
+	unsigned char ids;								// first field id, in loggerDecodePlan_t.ids[]
+	unsigned char n;								// number of values in run
+	unsigned char fieldType;
+} loggerDecodeRun_t;
+
+typedef struct {
+	unsigned short offset;							// packet offset of value
+	unsigned char index;							// array element
+} loggerDecodeCopy_t;
+
+typedef struct loggerDecodePlan {
+	loggerDecodeRun_t runs[256];
+	unsigned char ids[256];
+	loggerDecodeCopy_t voltages[256];
+	loggerDecodeCopy_t quat[256];
+	loggerDecodeCopy_t motors[256];
+	loggerDecodeCopy_t radioChannels[256];
+	int numRuns, numVoltages, numQuat, numMotors, numRadioChannels;
+} loggerDecodePlan_t;
+
+// field ids in any order
+#define LOGGER_DECODE_KERNEL(name, type) \
+	static void name(const char *buf, loggerRecord_t *r, const unsigned char *ids, int n) { \
+		type v; \
+		int i; \
+		for (i = 0; i < n; i++) { \
+			memcpy(&v, buf + i * sizeof(type), sizeof(type)); \
+			r->data[ids[i]] = v; \
+		} \
+	}
+
+// consecutive field ids, this is a straight convert & copy the compiler can vectorize
+#define LOGGER_DECODE_KERNEL_SEQ(name, type) \
+	static void name(const char *buf, loggerRecord_t *r, const unsigned char *ids, int n) { \
+		int first = ids[0]; \
+		type v; \
+		int i; \
+		for (i = 0; i < n; i++) { \
+			memcpy(&v, buf + i * sizeof(type), sizeof(type)); \
+			r->data[first + i] = v; \
+		} \
+	}
+
+LOGGER_DECODE_KERNEL(loggerDecodeDouble, double)
+LOGGER_DECODE_KERNEL(loggerDecodeFloat, float)
+LOGGER_DECODE_KERNEL(loggerDecodeU32, uint32_t)
+LOGGER_DECODE_KERNEL(loggerDecodeS32, int32_t)
+LOGGER_DECODE_KERNEL(loggerDecodeU16, uint16_t)
+LOGGER_DECODE_KERNEL(loggerDecodeS16, int16_t)
+LOGGER_DECODE_KERNEL(loggerDecodeU8, uint8_t)
+LOGGER_DECODE_KERNEL(loggerDecodeS8, int8_t)
+LOGGER_DECODE_KERNEL_SEQ(loggerDecodeSeqDouble, double)
+LOGGER_DECODE_KERNEL_SEQ(loggerDecodeSeqFloat, float)
+LOGGER_DECODE_KERNEL_SEQ(loggerDecodeSeqU32, uint32_t)
+LOGGER_DECODE_KERNEL_SEQ(loggerDecodeSeqS32, int32_t)
+LOGGER_DECODE_KERNEL_SEQ(loggerDecodeSeqU16, uint16_t)
+LOGGER_DECODE_KERNEL_SEQ(loggerDecodeSeqS16, int16_t)
+LOGGER_DECODE_KERNEL_SEQ(loggerDecodeSeqU8, uint8_t)
+LOGGER_DECODE_KERNEL_SEQ(loggerDecodeSeqS8, int8_t)
+
+// indexed by LOG_TYPE_*
+static loggerDecodeKernel_t *loggerDecodeKernels[] = {
+	loggerDecodeDouble, loggerDecodeFloat, loggerDecodeU32, loggerDecodeS32,
+	loggerDecodeU16, loggerDecodeS16, loggerDecodeU8, loggerDecodeS8
+};
+static loggerDecodeKernel_t *loggerDecodeSeqKernels[] = {
+	loggerDecodeSeqDouble, loggerDecodeSeqFloat, loggerDecodeSeqU32, loggerDecodeSeqS32,
+	loggerDecodeSeqU16, loggerDecodeSeqS16, loggerDecodeSeqU8, loggerDecodeSeqS8
+};
+
+static void loggerPlanCopy(loggerDecodeCopy_t *list, int *n, int offset, int index) {
+	list[*n].offset = offset;
+	list[*n].index = index;
+	(*n)++;
+}
+
+// compile the decode plan for the context's fields
+static void loggerPlanFields(loggerContext_t *c) {
+	loggerDecodePlan_t *p;
+	loggerDecodeRun_t *run = NULL;
+	unsigned char fieldId, fieldType;
+	int offset = 0;
+	int size;
+	int i, j;
+
+	if (c->plan == NULL)
+		c->plan = (loggerDecodePlan_t *)malloc(sizeof(loggerDecodePlan_t));
+	p = c->plan;
+
+	p->numRuns = p->numVoltages = p->numQuat = p->numMotors = p->numRadioChannels = 0;
+
+	for (i = 0, j = 0; i < c->numFields; i++) {
+		fieldId = c->fields[i].fieldId;
+		fieldType = c->fields[i].fieldType;
+		size = loggerFieldSize(fieldType);
+
+		// unknown types cannot be decoded (and take no space), unknown ids have nowhere to go
+		if (!size)
+			continue;
+		if (fieldId >= LOG_NUM_IDS) {
+			run = NULL;
+			offset += size;
+			continue;
+		}
+
+		if (fieldId >= LOG_VOLTAGE0 && fieldId <= LOG_VOLTAGE14)
+			loggerPlanCopy(p->voltages, &p->numVoltages, offset, fieldId - LOG_VOLTAGE0);
+		else if (fieldId >= LOG_UKF_Q1 && fieldId <= LOG_UKF_Q4)
+			loggerPlanCopy(p->quat, &p->numQuat, offset, fieldId - LOG_UKF_Q1);
+		else if (fieldId >= LOG_MOT_MOTOR0 && fieldId <= LOG_MOT_MOTOR13)
+			loggerPlanCopy(p->motors, &p->numMotors, offset, fieldId - LOG_MOT_MOTOR0);
+		else if (fieldId >= LOG_RADIO_CHANNEL0 && fieldId <= LOG_RADIO_CHANNEL17)
+			loggerPlanCopy(p->radioChannels, &p->numRadioChannels, offset, fieldId - LOG_RADIO_CHANNEL0);
+
+		// extend the current run or start a new one
+		if (run && run->fieldType == fieldType) {
+			run->n++;
+		}
+		else {
+			run = &p->runs[p->numRuns++];
+			run->offset = offset;
+			run->ids = j;
+			run->n = 1;
+			run->fieldType = fieldType;
 		}
+		p->ids[j++] = fieldId;
+		offset += size;
+	}
+
+	// pick the sequential kernel for runs of consecutive field ids
+	for (i = 0; i < p->numRuns; i++) {
+		run = &p->runs[i];
+
+		for (j = 1; j < run->n; j++)
+			if (p->ids[run->ids + j] != p->ids[run->ids] + j)
+				break;
+
+		run->kernel = (j == run->n) ? loggerDecodeSeqKernels[run->fieldType] : loggerDecodeKernels[run->fieldType];
 	}
 }
 
-int loggerReadEntryM(FILE *fp, loggerRecord_t *r) {
-	char buf[1024];
-	unsigned char ckA, ckB;
+void loggerContextDecode(const loggerContext_t *c, const char *buf, loggerRecord_t *r) {
+	const loggerDecodePlan_t *p = c->plan;
+	float f;
+	uint16_t u16;
+	int16_t s16;
 	int i;
 
-	if (loggerPacketSize > 0 && fread(buf, loggerPacketSize, 1, fp) == 1) {
-		// calc checksum
+	// no field list yet
+	if (p == NULL)
+		return;
+
+	for (i = 0; i < p->numRuns; i++)
+		p->runs[i].kernel(buf + p->runs[i].offset, r, p->ids + p->runs[i].ids, p->runs[i].n);
+
+	// store some fields in arrays, for convenience
+	for (i = 0; i < p->numVoltages; i++) {
+		memcpy(&f, buf + p->voltages[i].offset, sizeof(f));
+		r->voltages[p->voltages[i].index] = f;
+	}
+	for (i = 0; i < p->numQuat; i++) {
+		memcpy(&f, buf + p->quat[i].offset, sizeof(f));
+		r->quat[p->quat[i].index] = f;
+	}
+	for (i = 0; i < p->numMotors; i++) {
+		memcpy(&u16, buf + p->motors[i].offset, sizeof(u16));
+		r->motors[p->motors[i].index] = u16;
+	}
+	for (i = 0; i < p->numRadioChannels; i++) {
+		memcpy(&s16, buf + p->radioChannels[i].offset, sizeof(s16));
+		r->radioChannels[p->radioChannels[i].index] = s16;
+	}
+}
+
+void loggerDecodePacket(const char *buf, loggerRecord_t *r) {
+	loggerContextDecode(&loggerThread, buf, r);
+}
+
+// returns 1 if the two bytes read after a packet of len bytes (n read in all) are its checksum;
+// like reading them one at a time, a bad ckA is consumed but the following byte is not
+static int loggerStreamChecksum(FILE *fp, const char *buf, size_t len, size_t n, unsigned char ckA, unsigned char ckB) {
+	if (n > len && (unsigned char)buf[len] == ckA)
+		return n > len + 1 && (unsigned char)buf[len+1] == ckB;
+
+	if (n == len + 2)
+		ungetc((unsigned char)buf[len+1], fp);
+
+	return 0;
+}
+
+int loggerReadEntryM(loggerContext_t *c, FILE *fp, loggerRecord_t *r) {
+	char buf[LOGGER_MAX_FIELDS * 8 + 2];
+	unsigned char ckA, ckB;
+	size_t n;
+
+	// the packet and its checksum in one read
+	if (c->packetSize > 0 && (n = fread(buf, 1, c->packetSize + 2, fp)) >= (size_t)c->packetSize) {
 		ckA = ckB = 0;
-		for (i = 0; i < loggerPacketSize; i++) {
-			ckA += buf[i];
-			ckB += ckA;
-		}
+		loggerChecksum(buf, c->packetSize, &ckA, &ckB);
 
-		if (fgetc(fp) == ckA && fgetc(fp) == ckB) {
-			loggerDecodePacket(buf, r);
+		if (loggerStreamChecksum(fp, buf, c->packetSize, n, ckA, ckB)) {
+			loggerContextDecode(c, buf, r);
 
 			return 1;
 		}
@@ -162,48 +314,99 @@ int loggerReadEntryM(FILE *fp, loggerRecord_t *r) {
 	return 0;
 }
 
-int loggerReadEntryH(FILE *fp) {
-	char buf[1024];
+// size in bytes of one logged value of the given LOG_TYPE_*
+int loggerFieldSize(int fieldType) {
+	switch (fieldType) {
+		case LOG_TYPE_DOUBLE:
+			return 8;
+		case LOG_TYPE_FLOAT:
+		case LOG_TYPE_U32:
+		case LOG_TYPE_S32:
+			return 4;
+		case LOG_TYPE_U16:
+		case LOG_TYPE_S16:
+			return 2;
+		case LOG_TYPE_U8:
+		case LOG_TYPE_S8:
+			return 1;
+	}
+	return 0;
+}
+
+// install a new field list (schema) from an 'H' header packet
+void loggerContextSetFields(loggerContext_t *c, const char *buf, int numFields) {
+	int i;
+
+	c->fields = (loggerFields_t *)realloc(c->fields, (numFields + 1) * sizeof(loggerFields_t));
+	if (numFields)
+		memcpy(c->fields, buf, numFields * sizeof(loggerFields_t));
+	c->numFields = numFields;
+	c->headerValid = 0;
+
+	c->packetSize = 0;
+	for (i = 0; i < numFields; i++)
+		c->packetSize += loggerFieldSize(c->fields[i].fieldType);
+
+	loggerPlanFields(c);
+}
+
+void loggerSetFields(const char *buf, int numFields) {
+	loggerContextSetFields(&loggerThread, buf, numFields);
+}
+
+// make the field list of an 'H' header in the mapping (its numFields byte) the active one,
+// NULL for none; cheap if it already is
+void loggerContextUseHeader(loggerContext_t *c, const char *header) {
+	if (c->headerValid && header == c->header)
+		return;
+
+	if (header)
+		loggerContextSetFields(c, header + 1, (unsigned char)header[0]);
+	else
+		loggerContextSetFields(c, NULL, 0);
+
+	c->header = header;
+	c->headerValid = 1;
+}
+
+void loggerUseHeader(const char *header) {
+	loggerContextUseHeader(&loggerThread, header);
+}
+
+loggerContext_t *loggerThreadContext(void) {
+	return &loggerThread;
+}
+
+// drop the field list and free what the context holds, it can be used again after
+void loggerContextReset(loggerContext_t *c) {
+	free(c->fields);
+	free(c->plan);
+	c->fields = NULL;
+	c->plan = NULL;
+	c->numFields = 0;
+	c->packetSize = 0;
+	c->header = NULL;
+	c->headerValid = 0;
+}
+
+int loggerReadEntryH(loggerContext_t *c, FILE *fp) {
+	char buf[LOGGER_MAX_FIELDS * sizeof(loggerFields_t) + 2];
 	unsigned char ckA, ckB;
 	int numFields;
-	int i;
+	size_t len, n;
 
-	numFields = fgetc(fp);
+	if ((numFields = fgetc(fp)) == EOF)
+		return 0;
+	// an empty field list is not a packet, only its count byte is consumed
+	if ((len = numFields * sizeof(loggerFields_t)) == 0)
+		return 0;
 
-	if (fread(buf, numFields * sizeof(loggerFields_t), 1, fp) == 1) {
-		// calc checksum
+	if ((n = fread(buf, 1, len + 2, fp)) >= len) {
 		ckA = ckB = numFields;
-		for (i = 0; i < numFields * sizeof(loggerFields_t); i++) {
-			ckA += buf[i];
-			ckB += ckA;
-		}
-
-		if (fgetc(fp) == ckA && fgetc(fp) == ckB) {
-			loggerFields = (loggerFields_t *)realloc(loggerFields, numFields * sizeof(loggerFields_t));
-			memcpy(loggerFields, buf, numFields * sizeof(loggerFields_t));
-			loggerNumFields = numFields;
-
-			loggerPacketSize = 0;
-			for (i = 0; i < numFields; i++) {
-				switch (loggerFields[i].fieldType) {
-					case LOG_TYPE_DOUBLE:
-						loggerPacketSize += 8;
-						break;
-					case LOG_TYPE_FLOAT:
-					case LOG_TYPE_U32:
-					case LOG_TYPE_S32:
-						loggerPacketSize += 4;
-						break;
-					case LOG_TYPE_U16:
-					case LOG_TYPE_S16:
-						loggerPacketSize += 2;
-						break;
-					case LOG_TYPE_U8:
-					case LOG_TYPE_S8:
-						loggerPacketSize += 1;
-						break;
-				}
-			}
+		loggerChecksum(buf, len, &ckA, &ckB);
+
+		if (loggerStreamChecksum(fp, buf, len, n, ckA, ckB)) {
+			loggerContextSetFields(c, buf, numFields);
 
 			return 1;
 		}
@@ -217,18 +420,13 @@ int loggerReadEntryH(FILE *fp) {
 
 int loggerReadEntryL(FILE *fp, loggerRecord_t *r) {
 	char *buf = (char *)r;
-	char ckA, ckB;
-	int i;
+	unsigned char ckA, ckB;
 
 	if (fread(buf, sizeof(loggerRecord_t), 1, fp) == 1) {
-		// calc checksum
 		ckA = ckB = 0;
-		for (i = 0; i < sizeof(loggerRecord_t) - 2; i++) {
-			ckA += buf[i];
-			ckB += ckA;
-		}
+		loggerChecksum(buf, sizeof(loggerRecord_t) - 2, &ckA, &ckB);
 
-		if (r->ckA == ckA && r->ckB == ckB) {
+		if ((unsigned char)r->ckA == ckA && (unsigned char)r->ckB == ckB) {
 			return 1;
 		}
 		else {
@@ -239,7 +437,7 @@ int loggerReadEntryL(FILE *fp, loggerRecord_t *r) {
 	return 0;
 }
 
-int loggerReadEntry(FILE *fp, loggerRecord_t *r) {
+int loggerContextReadEntry(loggerContext_t *ctx, FILE *fp, loggerRecord_t *r) {
 	int c = 0;
 
 	loggerTop:
@@ -259,11 +457,11 @@ int loggerReadEntry(FILE *fp, loggerRecord_t *r) {
 				return 1;
 		}
 		else if (c == 'H') {
-			loggerReadEntryH(fp);
+			loggerReadEntryH(ctx, fp);
 			goto loggerTop;
 		}
 		else if (c == 'M') {
-			if (loggerReadEntryM(fp, r) == 0)
+			if (loggerReadEntryM(ctx, fp, r) == 0)
 				goto loggerTop;
 			else
 				return 1;
@@ -278,6 +476,1287 @@ int loggerReadEntry(FILE *fp, loggerRecord_t *r) {
 	return EOF;
 }
 
+int loggerReadEntry(FILE *fp, loggerRecord_t *r) {
+	return loggerContextReadEntry(&loggerThread, fp, r);
+}
+
+// memory-mapped reader, these follow the same resync rules as loggerReadEntry()
+
+loggerMap_t *loggerMapOpen(const char *fname) {
+	loggerMap_t *m;
+	struct stat st;
+
+	m = (loggerMap_t *)calloc(1, sizeof(loggerMap_t));
+
+#if defined (__WIN32__)
+	m->fd = open(fname, O_RDONLY | O_BINARY);
+#else
+	m->fd = open(fname, O_RDONLY);
+#endif
+	if (m->fd < 0 || fstat(m->fd, &st) < 0) {
+		fprintf(stderr, "logger: cannot open log file '%s'\n", fname);
+		if (m->fd >= 0)
+			close(m->fd);
+		free(m);
+		return NULL;
+	}
+
+	m->size = st.st_size;
+	m->fname = strdup(fname);
+	m->notify = -1;
+
+	if (m->size) {
+#if defined (__WIN32__)
+		// no mmap(), pull the whole file in instead
+		m->copy = 1;
+		m->base = (char *)malloc(m->size);
+		if (m->base && read(m->fd, (char *)m->base, m->size) != (int)m->size) {
+			free((char *)m->base);
+			m->base = NULL;
+		}
+#else
+		m->base = (char *)mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, m->fd, 0);
+		if (m->base == MAP_FAILED)
+			m->base = NULL;
+		else
+			madvise((void *)m->base, m->size, MADV_SEQUENTIAL);
+#endif
+		if (m->base == NULL) {
+			fprintf(stderr, "logger: cannot map log file '%s'\n", fname);
+			close(m->fd);
+			free(m->fname);
+			free(m);
+			return NULL;
+		}
+	}
+
+	return m;
+}
+
+void loggerMapClose(loggerMap_t *m) {
+	if (m) {
+		if (m->base) {
+#if !defined (__WIN32__)
+			if (!m->copy)
+				munmap((void *)m->base, m->size);
+			else
+#endif
+			free((char *)m->base);
+		}
+		if (m->notify >= 0)
+			close(m->notify);
+		close(m->fd);
+		free(m->fname);
+		free(m);
+	}
+}
+
+void loggerMapRewind(loggerMap_t *m) {
+	m->pos = 0;
+}
+
+// following a growing log
+
+#define LOGGER_FOLLOW_POLL		250					// ms between looks at a followed log without change notification
+
+// (re)start change notification on the log file m reads
+static void loggerMapWatch(loggerMap_t *m) {
+#if defined (LOGGER_KQUEUE)
+	struct kevent ev;
+#endif
+
+	if (m->notify >= 0)
+		close(m->notify);
+	m->notify = -1;
+
+#if defined (__linux__)
+	m->notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m->notify >= 0 && inotify_add_watch(m->notify, m->fname, IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE) < 0) {
+		close(m->notify);
+		m->notify = -1;
+	}
+#elif defined (LOGGER_KQUEUE)
+	m->notify = kqueue();
+	EV_SET(&ev, m->fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_DELETE | NOTE_LINK, 0, NULL);
+	if (m->notify >= 0 && kevent(m->notify, &ev, 1, NULL, 0, NULL) < 0) {
+		close(m->notify);
+		m->notify = -1;
+	}
+#endif
+}
+
+// Keep reading m as the log grows, see loggerMapWait().  The log is read into memory so it can be
+// rewritten on disk under the reader, and loggerMapNextPacket() stops in front of a packet
+// which is cut short instead of skipping it.
+void loggerMapFollow(loggerMap_t *m) {
+	char *copy;
+
+	m->follow = 1;
+
+	if (!m->copy) {
+		copy = (char *)malloc(m->size + 1);
+		if (m->size)
+			memcpy(copy, m->base, m->size);
+		if (m->header)
+			m->header = copy + (m->header - m->base);
+#if !defined (__WIN32__)
+		if (m->base)
+			munmap((void *)m->base, m->size);
+#endif
+		m->base = copy;
+		m->copy = 1;
+	}
+	m->checked = m->size;
+
+	loggerMapWatch(m);
+}
+
+// Read in whatever was added to a followed log; returns 1 if there was something, 0 if not, -1 if
+// the log can't be read.  A log which is replaced under its name (a rename) or cut short (to be
+// copied again) is checked against what was read of it: the same log carries on from where it was
+// once it has caught up, another one is read from its start and 2 is returned.
+static int loggerMapGrow(loggerMap_t *m) {
+	struct stat st, path;
+	char buf[64*1024];
+	size_t header, end;
+	char *base;
+	int fd, n;
+
+	if (stat(m->fname, &path) == 0 && fstat(m->fd, &st) == 0 && (path.st_ino != st.st_ino || path.st_dev != st.st_dev)) {
+#if defined (__WIN32__)
+		fd = open(m->fname, O_RDONLY | O_BINARY);
+#else
+		fd = open(m->fname, O_RDONLY);
+#endif
+		if (fd < 0)
+			return 0;
+		close(m->fd);
+		m->fd = fd;
+		m->checked = 0;
+		loggerMapWatch(m);
+	}
+
+	if (fstat(m->fd, &st) < 0)
+		return -1;
+	if ((size_t)st.st_size < m->checked)
+		m->checked = st.st_size;
+
+	if (m->checked < m->size) {
+		end = (size_t)st.st_size < m->size ? st.st_size : m->size;
+		if (lseek(m->fd, m->checked, SEEK_SET) < 0)
+			return -1;
+		while (m->checked < end && (n = read(m->fd, buf, end - m->checked < sizeof(buf) ? end - m->checked : sizeof(buf))) > 0) {
+			if (memcmp(buf, m->base + m->checked, n)) {
+				fprintf(stderr, "logger: '%s' is another log now, reading it from the start\n", m->fname);
+				m->size = m->pos = m->checked = 0;
+				m->header = NULL;
+				(m->ctx ? m->ctx : &loggerThread)->headerValid = 0;
+				return 2;
+			}
+			m->checked += n;
+		}
+		if (m->checked < m->size)
+			return 0;
+	}
+
+	if ((size_t)st.st_size == m->size)
+		return 0;
+
+	header = m->header ? m->header - m->base : 0;
+	if ((base = (char *)realloc((char *)m->base, st.st_size + 1)) == NULL)
+		return -1;
+	m->base = base;
+	if (m->header)
+		m->header = base + header;
+
+	if (lseek(m->fd, m->size, SEEK_SET) < 0)
+		return -1;
+	while (m->size < (size_t)st.st_size && (n = read(m->fd, base + m->size, st.st_size - m->size)) > 0)
+		m->size += n;
+	m->checked = m->size;
+
+	return 1;
+}
+
+// sleep until the log changes, or for ms milliseconds (-1 for as long as it takes);
+// returns 0 if a signal cut the sleep short
+static int loggerMapSleep(loggerMap_t *m, int ms) {
+#if defined (__linux__)
+	struct pollfd pfd;
+	char buf[4096];
+
+	if (m->notify >= 0) {
+		pfd.fd = m->notify;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, ms) < 0)
+			return errno != EINTR;
+		while (read(m->notify, buf, sizeof(buf)) > 0)
+			;
+		return 1;
+	}
+#elif defined (LOGGER_KQUEUE)
+	struct kevent ev;
+	struct timespec ts;
+
+	if (m->notify >= 0) {
+		ts.tv_sec = ms / 1000;
+		ts.tv_nsec = (ms % 1000) * 1000000;
+		if (kevent(m->notify, NULL, 0, &ev, 1, ms < 0 ? NULL : &ts) < 0)
+			return errno != EINTR;
+		return 1;
+	}
+#endif
+
+	// no change notification, look again every so often
+	if (ms < 0 || ms > LOGGER_FOLLOW_POLL)
+		ms = LOGGER_FOLLOW_POLL;
+#if defined (__WIN32__)
+	Sleep(ms);
+#else
+	if (usleep(ms * 1000) < 0)
+		return errno != EINTR;
+#endif
+	return 1;
+}
+
+// Wait for a followed log to grow and read in what was added.  Returns 1 once it has, 2 if it is
+// another log now (read from its start), 0 if it didn't grow within timeout seconds (0 waits for
+// ever) or a signal came in, -1 if it can't be read any more.  A log being copied again counts
+// as growing.
+int loggerMapWait(loggerMap_t *m, int timeout) {
+	time_t end = time(NULL) + timeout;
+	size_t checked = m->checked;
+	int ret, ms;
+
+	while ((ret = loggerMapGrow(m)) == 0) {
+		if (m->checked != checked) {
+			checked = m->checked;
+			end = time(NULL) + timeout;
+		}
+		ms = -1;
+		if (timeout) {
+			if ((ms = (end - time(NULL)) * 1000) <= 0)
+				return 0;
+		}
+		if (!loggerMapSleep(m, ms))
+			return 0;
+	}
+
+	return ret;
+}
+
+static loggerContext_t *loggerMapContext(const loggerMap_t *m) {
+	return m->ctx ? m->ctx : &loggerThread;
+}
+
+static void loggerMapError(loggerMap_t *m, const char *s) {
+	if (m->error)
+		m->error(m, s);
+	else
+		loggerChecksumError(s);
+}
+
+// bytes from up to to are not part of any valid packet
+static void loggerMapSkip(loggerMap_t *m, size_t from, size_t to) {
+	if (to > from) {
+		m->skipped += to - from;
+		if (m->skip)
+			m->skip(m, from, to);
+	}
+}
+
+// returns 1 and advances past the checksum if both checksum bytes match;
+// like the stdio reader, a bad ckA is consumed but the following byte is not
+static int loggerMapChecksum(loggerMap_t *m, unsigned char ckA, unsigned char ckB) {
+	if (m->pos < m->size && (unsigned char)m->base[m->pos++] == ckA)
+		if (m->pos < m->size && (unsigned char)m->base[m->pos++] == ckB)
+			return 1;
+
+	return 0;
+}
+
+// find the next valid 'M' or 'L' packet, parsing any 'H' headers along the way;
+// returns the packet type with *pkt pointing into the mapping (no copy), or EOF
+int loggerMapNextPacket(loggerMap_t *m, const char **pkt) {
+	loggerContext_t *ctx = loggerMapContext(m);
+	const char *p, *buf;
+	unsigned char ckA, ckB;
+	uint64_t skipped = m->skipped;
+	size_t sync;
+	int numFields;
+	int c;
+
+	while (m->pos < m->size) {
+		p = (const char *)memchr(m->base + m->pos, 'A', m->size - m->pos);
+		if (p == NULL)
+			break;
+		sync = p - m->base;
+		loggerMapSkip(m, m->pos, sync);
+
+		// the byte following a lone 'A' is consumed, same as loggerReadEntry()
+		m->pos = sync + 2;
+		if (m->pos > m->size || (m->pos == m->size && p[1] == 'q'))
+			goto loggerPartial;
+		if (p[1] != 'q') {
+			loggerMapSkip(m, sync, sync + 2);
+			continue;
+		}
+
+		c = (unsigned char)m->base[m->pos++];
+		buf = m->base + m->pos;
+
+		if (c == 'L') {
+			if (m->pos + sizeof(loggerRecord_t) > m->size)
+				goto loggerPartial;
+
+			m->pos += sizeof(loggerRecord_t);
+
+			profilerBegin(m->prof, PROFILER_CHECKSUM);
+			ckA = ckB = 0;
+			loggerChecksum(buf, sizeof(loggerRecord_t) - 2, &ckA, &ckB);
+			profilerEnd(m->prof);
+
+			if (((const loggerRecord_t *)buf)->ckA == (char)ckA && ((const loggerRecord_t *)buf)->ckB == (char)ckB) {
+				*pkt = buf;
+				goto loggerFound;
+			}
+
+			loggerMapSkip(m, sync, m->pos);
+			loggerMapError(m, "L");
+		}
+		else if (c == 'H') {
+			if (m->pos >= m->size)
+				goto loggerPartial;
+
+			numFields = (unsigned char)m->base[m->pos++];
+			buf++;
+
+			// an empty field list is skipped without reading a checksum
+			if (numFields == 0) {
+				loggerMapSkip(m, sync, m->pos);
+				continue;
+			}
+
+			if (m->pos + numFields * sizeof(loggerFields_t) + (m->follow ? 2 : 0) > m->size)
+				goto loggerPartial;
+
+			m->pos += numFields * sizeof(loggerFields_t);
+
+			profilerBegin(m->prof, PROFILER_CHECKSUM);
+			ckA = ckB = numFields;
+			loggerChecksum(buf, numFields * sizeof(loggerFields_t), &ckA, &ckB);
+			profilerEnd(m->prof);
+
+			if (loggerMapChecksum(m, ckA, ckB)) {
+				loggerContextSetFields(ctx, buf, numFields);
+				m->header = buf - 1;
+			}
+			else {
+				loggerMapSkip(m, sync, m->pos);
+				loggerMapError(m, "H");
+			}
+		}
+		else if (c == 'M' && ctx->packetSize > 0) {
+			if (m->pos + ctx->packetSize + (m->follow ? 2 : 0) > m->size)
+				goto loggerPartial;
+
+			m->pos += ctx->packetSize;
+
+			profilerBegin(m->prof, PROFILER_CHECKSUM);
+			ckA = ckB = 0;
+			loggerChecksum(buf, ctx->packetSize, &ckA, &ckB);
+			profilerEnd(m->prof);
+
+			if (loggerMapChecksum(m, ckA, ckB)) {
+				*pkt = buf;
+				goto loggerFound;
+			}
+
+			loggerMapSkip(m, sync, m->pos);
+			loggerMapError(m, "M");
+		}
+		else {
+			loggerMapSkip(m, sync, m->pos);
+		}
+	}
+
+	loggerMapSkip(m, m->pos, m->size);
+	m->pos = m->size;
+
+	return EOF;
+
+	loggerFound:
+
+	if (m->skipped != skipped)
+		m->resyncs++;
+
+	return buf[-1];
+
+	// a followed log is read from this packet on again once the rest of it is there, see loggerMapWait()
+	loggerPartial:
+
+	if (!m->follow)
+		loggerMapSkip(m, sync, m->size);
+	m->pos = m->follow ? sync : m->size;
+
+	return EOF;
+}
+
+// drop-in replacement for loggerReadEntry()
+int loggerMapReadEntry(loggerMap_t *m, loggerRecord_t *r) {
+	const char *pkt;
+	int type;
+
+	profilerBegin(m->prof, PROFILER_SCAN);
+	type = loggerMapNextPacket(m, &pkt);
+	profilerEnd(m->prof);
+
+	switch (type) {
+		case 'L':
+			memcpy(r, pkt, sizeof(loggerRecord_t));
+			return 1;
+		case 'M':
+			profilerBegin(m->prof, PROFILER_DECODE);
+			loggerContextDecode(loggerMapContext(m), pkt, r);
+			profilerEnd(m->prof);
+			return 1;
+	}
+
+	return EOF;
+}
+
+// open a log for reading with a context of its own; NULL if it cannot be opened
+loggerContext_t *loggerContextOpen(const char *fname) {
+	loggerContext_t *c;
+	loggerMap_t *m;
+
+	if ((m = loggerMapOpen(fname)) == NULL)
+		return NULL;
+
+	c = (loggerContext_t *)calloc(1, sizeof(loggerContext_t));
+	c->map = m;
+	m->ctx = c;
+
+	return c;
+}
+
+// next record of a log opened with loggerContextOpen(), or EOF
+int loggerContextRead(loggerContext_t *c, loggerRecord_t *r) {
+	return loggerMapReadEntry(c->map, r);
+}
+
+void loggerContextClose(loggerContext_t *c) {
+	if (c) {
+		loggerMapClose(c->map);
+		loggerContextReset(c);
+		free(c);
+	}
+}
+
+// parallel packet index
+
+#define LOGGER_INDEX_MIN_CHUNK	(1<<20)				// don't split a log into chunks smaller than this
+
+typedef struct {
+	loggerMap_t map;								// private read state over the shared mapping
+	loggerContext_t ctx;							// and field list
+	size_t start, end;								// packets whose sync starts in this range belong to the chunk
+	int resync;										// find the first packet at start instead of reading from map.pos
+	loggerIndex_t idx;
+	int allocPackets, allocErrors, allocRanges;
+	size_t firstPos;								// sync offset of the first packet read, map.size if none
+	const char *firstHeader;						// header in effect for it
+	size_t exitPos;									// sync offset of the first packet at or past end, map.size if none
+	const char *exitHeader;							// header in effect for it
+	uint64_t firstSkipped;							// map.skipped, map.resyncs and idx.numRanges at the first packet
+	uint32_t firstResyncs;
+	int firstRanges;
+} loggerChunk_t;
+
+// returns the type of a packet with a valid checksum starting at pos, 0 if there is none;
+// 'M' packets are checked against the active field list
+static int loggerMapPacketAt(const loggerMap_t *m, size_t pos) {
+	const char *buf;
+	unsigned char ckA, ckB;
+	int numFields;
+	int len;
+
+	if (pos + 3 > m->size || m->base[pos] != 'A' || m->base[pos+1] != 'q')
+		return 0;
+
+	buf = m->base + pos + 3;
+	ckA = ckB = 0;
+
+	switch (m->base[pos+2]) {
+		case 'L':
+			if (pos + 3 + sizeof(loggerRecord_t) > m->size)
+				return 0;
+			loggerChecksum(buf, sizeof(loggerRecord_t) - 2, &ckA, &ckB);
+			return (((const loggerRecord_t *)buf)->ckA == (char)ckA && ((const loggerRecord_t *)buf)->ckB == (char)ckB) ? 'L' : 0;
+
+		case 'H':
+			if (pos + 4 > m->size || (numFields = (unsigned char)*buf++) == 0)
+				return 0;
+			ckA = ckB = numFields;
+			len = numFields * sizeof(loggerFields_t);
+			break;
+
+		case 'M':
+			if ((len = loggerMapContext(m)->packetSize) <= 0)
+				return 0;
+			break;
+
+		default:
+			return 0;
+	}
+
+	if (buf + len + 2 > m->base + m->size)
+		return 0;
+
+	loggerChecksum(buf, len, &ckA, &ckB);
+
+	return ((unsigned char)buf[len] == ckA && (unsigned char)buf[len+1] == ckB) ? m->base[pos+2] : 0;
+}
+
+// first offset at or after pos where a valid packet starts, m->size if none
+static size_t loggerMapResync(const loggerMap_t *m, size_t pos) {
+	const char *p;
+
+	while (pos < m->size) {
+		p = (const char *)memchr(m->base + pos, 'A', m->size - pos);
+		if (p == NULL)
+			break;
+
+		pos = p - m->base;
+		if (loggerMapPacketAt(m, pos))
+			return pos;
+		pos++;
+	}
+
+	return m->size;
+}
+
+static int loggerSameHeader(const char *a, const char *b) {
+	if (a == b)
+		return 1;
+	if (a == NULL || b == NULL || a[0] != b[0])
+		return 0;
+
+	return !memcmp(a + 1, b + 1, (unsigned char)a[0] * sizeof(loggerFields_t));
+}
+
+static void loggerIndexAddError(loggerMap_t *m, const char *s) {
+	loggerChunk_t *c = (loggerChunk_t *)m->user;
+
+	if (c->idx.numErrors == c->allocErrors) {
+		c->allocErrors = c->allocErrors ? c->allocErrors * 2 : 64;
+		c->idx.errors = (loggerIndexError_t *)realloc(c->idx.errors, c->allocErrors * sizeof(loggerIndexError_t));
+	}
+	c->idx.errors[c->idx.numErrors].packet = c->idx.numPackets;
+	c->idx.errors[c->idx.numErrors].type = s[0];
+	c->idx.numErrors++;
+}
+
+// runs of skipped bytes are joined up with the one before if they meet
+static void loggerIndexAddRange(loggerChunk_t *c, size_t from, size_t to) {
+	loggerIndexRange_t *r;
+
+	if (c->idx.numRanges && c->idx.ranges[c->idx.numRanges-1].end == from) {
+		c->idx.ranges[c->idx.numRanges-1].end = to;
+		return;
+	}
+
+	if (c->idx.numRanges == c->allocRanges) {
+		c->allocRanges = c->allocRanges ? c->allocRanges * 2 : 64;
+		c->idx.ranges = (loggerIndexRange_t *)realloc(c->idx.ranges, c->allocRanges * sizeof(loggerIndexRange_t));
+	}
+	r = &c->idx.ranges[c->idx.numRanges++];
+	r->start = from;
+	r->end = to;
+}
+
+static void loggerIndexSkip(loggerMap_t *m, size_t from, size_t to) {
+	loggerIndexAddRange((loggerChunk_t *)m->user, from, to);
+}
+
+// read the packets of one chunk, plus a peek at the first packet of the next one
+static void *loggerIndexChunk(void *arg) {
+	loggerChunk_t *c = (loggerChunk_t *)arg;
+	loggerMap_t *m = &c->map;
+	loggerPacket_t *p;
+	const char *pkt;
+	size_t pos;
+	int type;
+
+	c->idx.numPackets = c->idx.numErrors = c->idx.numRanges = 0;
+	m->skipped = m->resyncs = 0;
+	c->firstHeader = NULL;
+	c->firstPos = m->size + 1;
+
+	loggerContextUseHeader(&c->ctx, m->header);
+	if (c->resync)
+		m->pos = loggerMapResync(m, c->start);
+
+	while ((type = loggerMapNextPacket(m, &pkt)) != EOF) {
+		pos = pkt - m->base - 3;
+
+		if (c->firstPos > m->size) {
+			c->firstPos = pos;
+			c->firstHeader = m->header;
+			c->firstSkipped = m->skipped;
+			c->firstResyncs = m->resyncs;
+			c->firstRanges = c->idx.numRanges;
+		}
+
+		if (pos >= c->end) {
+			c->exitPos = pos;
+			c->exitHeader = m->header;
+			return NULL;
+		}
+
+		if (c->idx.numPackets == c->allocPackets) {
+			c->allocPackets = c->allocPackets ? c->allocPackets * 2 : 16384;
+			c->idx.packets = (loggerPacket_t *)realloc(c->idx.packets, c->allocPackets * sizeof(loggerPacket_t));
+		}
+		p = &c->idx.packets[c->idx.numPackets++];
+		p->pkt = pkt;
+		p->header = m->header;
+		p->type = type;
+	}
+
+	if (c->firstPos > m->size) {
+		c->firstPos = m->size;
+		c->firstHeader = m->header;
+		c->firstSkipped = m->skipped;
+		c->firstResyncs = m->resyncs;
+		c->firstRanges = c->idx.numRanges;
+	}
+	c->exitPos = m->size;
+	c->exitHeader = m->header;
+
+	return NULL;
+}
+
+// Read the packet layout of a log from m->pos (and m->header) on using up to numThreads threads.
+// The rest of the file is split into byte ranges, each range is resynchronized on the first valid
+// packet in it and read using the field list in effect at m->pos, or that of the first 'H' header.  A range is kept
+// only if it picks up exactly where the reading of the preceding range left off, with the
+// same field list; otherwise it is read again from there.  So the result always matches
+// reading the file from start to end with loggerMapNextPacket(), quirks included, down to
+// the runs of bytes skipped along the way.  Returns the number of packets.
+int loggerMapIndex(loggerMap_t *m, loggerIndex_t *idx, int numThreads) {
+	loggerChunk_t *chunks;
+	pthread_t *threads;
+	int *running;
+	const char *first;
+	loggerMap_t scan;
+	size_t chunkSize;
+	int numChunks;
+	int np, ne, nr, skip;
+	int i, j;
+
+	numChunks = numThreads;
+	if (numChunks > (int)((m->size - m->pos) / LOGGER_INDEX_MIN_CHUNK))
+		numChunks = (m->size - m->pos) / LOGGER_INDEX_MIN_CHUNK;
+	if (numChunks < 1)
+		numChunks = 1;
+	chunkSize = (m->size - m->pos) / numChunks;
+
+	// the field list most of the file is going to be in
+	scan = *m;
+	first = m->header;
+	for (; first == NULL && (scan.pos = loggerMapResync(&scan, scan.pos)) < scan.size; scan.pos++)
+		if (scan.base[scan.pos+2] == 'H')
+			first = scan.base + scan.pos + 3;
+
+	chunks = (loggerChunk_t *)calloc(numChunks, sizeof(loggerChunk_t));
+	threads = (pthread_t *)calloc(numChunks, sizeof(pthread_t));
+	running = (int *)calloc(numChunks, sizeof(int));
+
+	for (i = 0; i < numChunks; i++) {
+		chunks[i].map = *m;
+		chunks[i].map.header = i ? first : m->header;
+		chunks[i].map.error = loggerIndexAddError;
+		chunks[i].map.skip = loggerIndexSkip;
+		chunks[i].map.user = &chunks[i];
+		chunks[i].map.ctx = &chunks[i].ctx;
+		chunks[i].map.prof = NULL;
+		chunks[i].start = m->pos + i * chunkSize;
+		chunks[i].end = (i == numChunks-1) ? m->size : m->pos + (i + 1) * chunkSize;
+		chunks[i].resync = (i > 0);
+	}
+
+	// the first chunk is read here, if a thread can't be started its chunk is too
+	for (i = 1; i < numChunks; i++)
+		if ((running[i] = !pthread_create(&threads[i], NULL, loggerIndexChunk, &chunks[i])) == 0)
+			loggerIndexChunk(&chunks[i]);
+	loggerIndexChunk(&chunks[0]);
+
+	for (i = 1; i < numChunks; i++)
+		if (running[i])
+			pthread_join(threads[i], NULL);
+
+	// check each chunk against where the previous one stopped, re-read it if it doesn't line up
+	for (i = 1; i < numChunks; i++) {
+		if (chunks[i].firstPos == chunks[i-1].exitPos &&
+				(chunks[i].firstPos == m->size || loggerSameHeader(chunks[i].firstHeader, chunks[i-1].exitHeader)))
+			continue;
+
+		chunks[i].map.pos = chunks[i-1].exitPos;
+		chunks[i].map.header = chunks[i-1].exitHeader;
+		chunks[i].resync = 0;
+		loggerIndexChunk(&chunks[i]);
+	}
+
+	// stitch together
+	np = ne = nr = 0;
+	for (i = 0; i < numChunks; i++) {
+		np += chunks[i].idx.numPackets;
+		ne += chunks[i].idx.numErrors;
+		nr += chunks[i].idx.numRanges;
+	}
+
+	idx->packets = (loggerPacket_t *)malloc((np + 1) * sizeof(loggerPacket_t));
+	idx->errors = (loggerIndexError_t *)malloc((ne + 1) * sizeof(loggerIndexError_t));
+	idx->ranges = (loggerIndexRange_t *)malloc((nr + 1) * sizeof(loggerIndexRange_t));
+	idx->numPackets = idx->numErrors = idx->numRanges = 0;
+
+	for (i = 0; i < numChunks; i++) {
+		if (chunks[i].idx.numPackets)
+			memcpy(idx->packets + idx->numPackets, chunks[i].idx.packets, chunks[i].idx.numPackets * sizeof(loggerPacket_t));
+
+		// errors and bytes skipped before a resynchronized chunk's first packet were already seen by the previous chunk
+		skip = (i > 0 && chunks[i].resync);
+		m->skipped += chunks[i].map.skipped - (skip ? chunks[i].firstSkipped : 0);
+		m->resyncs += chunks[i].map.resyncs - (skip ? chunks[i].firstResyncs : 0);
+		for (j = 0; j < chunks[i].idx.numErrors; j++) {
+			if (skip && chunks[i].idx.errors[j].packet == 0)
+				continue;
+			idx->errors[idx->numErrors] = chunks[i].idx.errors[j];
+			idx->errors[idx->numErrors].packet += idx->numPackets;
+			idx->numErrors++;
+		}
+		for (j = skip ? chunks[i].firstRanges : 0; j < chunks[i].idx.numRanges; j++) {
+			if (idx->numRanges && idx->ranges[idx->numRanges-1].end == chunks[i].idx.ranges[j].start)
+				idx->ranges[idx->numRanges-1].end = chunks[i].idx.ranges[j].end;
+			else
+				idx->ranges[idx->numRanges++] = chunks[i].idx.ranges[j];
+		}
+
+		idx->numPackets += chunks[i].idx.numPackets;
+
+		free(chunks[i].idx.packets);
+		free(chunks[i].idx.errors);
+		free(chunks[i].idx.ranges);
+		loggerContextReset(&chunks[i].ctx);
+	}
+
+	free(chunks);
+	free(threads);
+	free(running);
+
+	return idx->numPackets;
+}
+
+// decode packet n of an index
+int loggerContextIndexRecord(loggerContext_t *c, const loggerIndex_t *idx, int n, loggerRecord_t *r) {
+	const loggerPacket_t *p = &idx->packets[n];
+
+	if (p->type == 'L') {
+		memcpy(r, p->pkt, sizeof(loggerRecord_t));
+	}
+	else {
+		loggerContextUseHeader(c, p->header);
+		loggerContextDecode(c, p->pkt, r);
+	}
+
+	return 1;
+}
+
+int loggerIndexRecord(const loggerIndex_t *idx, int n, loggerRecord_t *r) {
+	return loggerContextIndexRecord(&loggerThread, idx, n, r);
+}
+
+void loggerIndexFree(loggerIndex_t *idx) {
+	free(idx->packets);
+	free(idx->errors);
+	free(idx->ranges);
+	idx->packets = NULL;
+	idx->errors = NULL;
+	idx->ranges = NULL;
+	idx->numPackets = idx->numErrors = idx->numRanges = 0;
+}
+
+// sidecar seek index
+
+#define LOGGER_SEEK_MAGIC		"AQLX"
+#define LOGGER_SEEK_VERSION		1
+
+// seek index file layout: this, then numEntries loggerSeekEntry_t
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint64_t logSize;								// size and modification time of the log it belongs to
+	int64_t logTime;
+	uint32_t numRecords;
+	uint32_t numEntries;
+} loggerSeekFile_t;
+
+static void loggerSeekNoError(loggerMap_t *m, const char *s) {
+}
+
+// mark the fields an 'H' header (its numFields byte) fills in
+static void loggerSeekFieldMask(const char *header, unsigned char *mask) {
+	const loggerFields_t *f;
+	int i;
+
+	memset(mask, 0, LOG_NUM_IDS);
+
+	if (header) {
+		f = (const loggerFields_t *)(header + 1);
+		for (i = 0; i < (unsigned char)header[0]; i++)
+			if (f[i].fieldId < LOG_NUM_IDS && loggerFieldSize(f[i].fieldType))
+				mask[f[i].fieldId] = 1;
+	}
+}
+
+// identifies the log an index file was built from
+static int loggerSeekStamp(const loggerMap_t *m, loggerSeekFile_t *f) {
+	struct stat st;
+
+	if (fstat(m->fd, &st) < 0)
+		return 0;
+
+	memset(f, 0, sizeof(loggerSeekFile_t));
+	memcpy(f->magic, LOGGER_SEEK_MAGIC, sizeof(f->magic));
+	f->version = LOGGER_SEEK_VERSION;
+	f->logSize = m->size;
+	f->logTime = st.st_mtime;
+
+	return 1;
+}
+
+// Read a whole log and note the records reading can be resumed from: the first one after each change
+// of field list, then one every interval records.  A record only qualifies if decoding it fills in every
+// field any earlier record did, so none of its values are carried over from before it.
+// Returns the number of entries; checksum errors are not reported.
+int loggerSeekBuild(loggerMap_t *m, loggerSeek_t *s, int interval) {
+	loggerMap_t scan;
+	unsigned char seen[LOG_NUM_IDS], fields[LOG_NUM_IDS];
+	const char *pkt, *header;
+	loggerSeekEntry_t *e;
+	uint32_t next, flags;
+	int alloc, type;
+	int clean, recheck;
+	int i;
+
+	memset(s, 0, sizeof(loggerSeek_t));
+	memset(seen, 0, sizeof(seen));
+	memset(fields, 0, sizeof(fields));
+
+	scan = *m;
+	scan.pos = 0;
+	scan.header = NULL;
+	scan.error = loggerSeekNoError;
+	loggerContextUseHeader(loggerMapContext(m), NULL);
+
+	header = NULL;
+	next = flags = 0;
+	alloc = 0;
+	clean = 1;
+	recheck = 0;
+
+	while ((type = loggerMapNextPacket(&scan, &pkt)) != EOF) {
+		if (scan.header != header) {
+			header = scan.header;
+			loggerSeekFieldMask(header, fields);
+			flags = LOGGER_SEEK_HEADER;
+			recheck = 1;
+		}
+
+		// an 'L' record is complete by itself, an 'M' one only covers the header's fields;
+		// the answer for 'M' records stays the same until the next header or 'L' record
+		if (type == 'L') {
+			memset(seen, 1, sizeof(seen));
+			clean = 1;
+			recheck = 1;
+		}
+		else if (recheck) {
+			clean = 1;
+			for (i = 0; i < LOG_NUM_IDS; i++) {
+				if (seen[i] && !fields[i])
+					clean = 0;
+				seen[i] |= fields[i];
+			}
+			recheck = 0;
+		}
+
+		if (clean && (flags || s->numRecords >= next)) {
+			if (s->numEntries == alloc) {
+				alloc = alloc ? alloc * 2 : 1024;
+				s->entries = (loggerSeekEntry_t *)realloc(s->entries, alloc * sizeof(loggerSeekEntry_t));
+			}
+			e = &s->entries[s->numEntries++];
+			e->record = s->numRecords;
+			e->flags = flags;
+			e->pos = pkt - scan.base - 3;
+			e->header = header ? (uint64_t)(header - scan.base) : LOGGER_SEEK_NO_HEADER;
+
+			next = s->numRecords + interval;
+			flags = 0;
+		}
+
+		s->numRecords++;
+	}
+
+	// back to the field list a log starts with
+	loggerContextUseHeader(loggerMapContext(m), NULL);
+
+	return s->numEntries;
+}
+
+// returns 0 if the index file could not be written
+int loggerSeekSave(const loggerMap_t *m, const loggerSeek_t *s, const char *fname) {
+	loggerSeekFile_t f;
+	FILE *fp;
+	int ok;
+
+	if (!loggerSeekStamp(m, &f) || (fp = fopen(fname, "wb")) == NULL)
+		return 0;
+
+	f.numRecords = s->numRecords;
+	f.numEntries = s->numEntries;
+
+	ok = fwrite(&f, sizeof(f), 1, fp) == 1 &&
+		(!s->numEntries || fwrite(s->entries, sizeof(loggerSeekEntry_t), s->numEntries, fp) == (size_t)s->numEntries);
+
+	if (fclose(fp) || !ok) {
+		remove(fname);
+		return 0;
+	}
+
+	return 1;
+}
+
+// returns 0 if there is no index file, or it doesn't belong to this log as it is now
+int loggerSeekLoad(const loggerMap_t *m, loggerSeek_t *s, const char *fname) {
+	loggerSeekFile_t f, stamp;
+	const loggerSeekEntry_t *e;
+	FILE *fp;
+	uint32_t i;
+	int ok;
+
+	memset(s, 0, sizeof(loggerSeek_t));
+
+	if (!loggerSeekStamp(m, &stamp) || (fp = fopen(fname, "rb")) == NULL)
+		return 0;
+
+	ok = fread(&f, sizeof(f), 1, fp) == 1 &&
+		!memcmp(f.magic, stamp.magic, sizeof(f.magic)) && f.version == stamp.version &&
+		f.logSize == stamp.logSize && f.logTime == stamp.logTime;
+
+	if (ok) {
+		s->entries = (loggerSeekEntry_t *)malloc((f.numEntries + 1) * sizeof(loggerSeekEntry_t));
+		ok = s->entries && fread(s->entries, sizeof(loggerSeekEntry_t), f.numEntries, fp) == f.numEntries;
+	}
+
+	// every entry has to point at a packet sync, and at an 'H' header if it has one
+	for (i = 0; ok && i < f.numEntries; i++) {
+		e = &s->entries[i];
+		ok = e->pos + 3 <= m->size && m->base[e->pos] == 'A' && m->base[e->pos+1] == 'q' &&
+			(e->header == LOGGER_SEEK_NO_HEADER || (e->header >= 3 && e->header < m->size && m->base[e->header-1] == 'H')) &&
+			(!i || e->record > e[-1].record);
+	}
+
+	fclose(fp);
+
+	if (!ok) {
+		loggerSeekFree(s);
+		return 0;
+	}
+
+	s->numEntries = f.numEntries;
+	s->numRecords = f.numRecords;
+
+	return 1;
+}
+
+// Resume reading m from the last entry at or before the given record and make its field list
+// the active one.  Returns the number of records before that entry; 0 if there is none, in which
+// case m is rewound to the start of the log.
+uint32_t loggerMapSeek(loggerMap_t *m, const loggerSeek_t *s, uint32_t record) {
+	const loggerSeekEntry_t *e;
+	int lo, hi, mid;
+
+	// first entry past record
+	lo = 0;
+	hi = s->numEntries;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (s->entries[mid].record <= record)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == 0) {
+		m->pos = 0;
+		m->header = NULL;
+		loggerContextUseHeader(loggerMapContext(m), NULL);
+		return 0;
+	}
+
+	e = &s->entries[lo-1];
+	m->pos = e->pos;
+	m->header = (e->header == LOGGER_SEEK_NO_HEADER) ? NULL : m->base + e->header;
+	loggerContextUseHeader(loggerMapContext(m), m->header);
+
+	return e->record;
+}
+
+void loggerSeekFree(loggerSeek_t *s) {
+	free(s->entries);
+	s->entries = NULL;
+	s->numEntries = 0;
+	s->numRecords = 0;
+}
+
+// column store
+
+double loggerColumnValue(const loggerColumns_t *c, int fieldId, int rec) {
+	const loggerColumn_t *col = &c->cols[fieldId];
+
+	if (col->data == NULL)
+		return 0.0;
+
+	switch (col->fieldType) {
+		case LOG_TYPE_DOUBLE:
+			return ((double *)col->data)[rec];
+		case LOG_TYPE_FLOAT:
+			return ((float *)col->data)[rec];
+		case LOG_TYPE_U32:
+			return ((uint32_t *)col->data)[rec];
+		case LOG_TYPE_S32:
+			return ((int32_t *)col->data)[rec];
+		case LOG_TYPE_U16:
+			return ((uint16_t *)col->data)[rec];
+		case LOG_TYPE_S16:
+			return ((int16_t *)col->data)[rec];
+		case LOG_TYPE_U8:
+			return ((uint8_t *)col->data)[rec];
+		case LOG_TYPE_S8:
+			return ((int8_t *)col->data)[rec];
+	}
+	return 0.0;
+}
+
+// convert one raw logged value to double
+static double loggerDecodeValue(const char *buf, int fieldType) {
+	double d;
+	float f;
+	uint32_t u32;
+	int32_t s32;
+	uint16_t u16;
+	int16_t s16;
+
+	switch (fieldType) {
+		case LOG_TYPE_DOUBLE:
+			memcpy(&d, buf, sizeof(d));
+			return d;
+		case LOG_TYPE_FLOAT:
+			memcpy(&f, buf, sizeof(f));
+			return f;
+		case LOG_TYPE_U32:
+			memcpy(&u32, buf, sizeof(u32));
+			return u32;
+		case LOG_TYPE_S32:
+			memcpy(&s32, buf, sizeof(s32));
+			return s32;
+		case LOG_TYPE_U16:
+			memcpy(&u16, buf, sizeof(u16));
+			return u16;
+		case LOG_TYPE_S16:
+			memcpy(&s16, buf, sizeof(s16));
+			return s16;
+		case LOG_TYPE_U8:
+			return *(uint8_t *)buf;
+		case LOG_TYPE_S8:
+			return *(int8_t *)buf;
+	}
+	return 0.0;
+}
+
+// fill the gap since the last stored value of a column, up to (not including) rec; fields which
+// are missing from the current schema keep their last value, as they do with a reused loggerRecord_t
+static void loggerColumnCarry(loggerColumn_t *col, int rec) {
+	int size = loggerFieldSize(col->fieldType);
+	char *d = (char *)col->data;
+
+	if (col->numVals == 0 && rec > 0) {
+		memset(d, 0, rec * size);
+	}
+	else {
+		for (; col->numVals < rec; col->numVals++)
+			memcpy(d + col->numVals * size, d + (col->numVals - 1) * size, size);
+	}
+	col->numVals = rec;
+}
+
+// convert an existing column to doubles; used if a field changes type between headers, or for 'L' records
+static void loggerColumnPromote(loggerColumns_t *c, int fieldId) {
+	loggerColumn_t *col = &c->cols[fieldId];
+	double *d;
+	int i;
+
+	d = (double *)malloc(c->allocRecs * sizeof(double));
+	for (i = 0; i < col->numVals; i++)
+		d[i] = loggerColumnValue(c, fieldId, i);
+
+	free(col->data);
+	col->data = d;
+	col->fieldType = LOG_TYPE_DOUBLE;
+}
+
+static loggerColumn_t *loggerColumnFor(loggerColumns_t *c, int fieldId, int fieldType, int rec) {
+	loggerColumn_t *col = &c->cols[fieldId];
+
+	if (col->data == NULL) {
+		col->fieldType = fieldType;
+		col->data = malloc(c->allocRecs * loggerFieldSize(fieldType));
+	}
+	else if (col->fieldType != fieldType && col->fieldType != LOG_TYPE_DOUBLE) {
+		loggerColumnPromote(c, fieldId);
+	}
+
+	loggerColumnCarry(col, rec);
+
+	return col;
+}
+
+static void loggerColumnsGrow(loggerColumns_t *c) {
+	int i;
+
+	c->allocRecs = c->allocRecs ? c->allocRecs * 2 : 16384;
+
+	for (i = 0; i < LOG_NUM_IDS; i++)
+		if (c->cols[i].data)
+			c->cols[i].data = realloc(c->cols[i].data, c->allocRecs * loggerFieldSize(c->cols[i].fieldType));
+}
+
+// store one 'M' packet as row c->numRecs, only fields selected in fieldMask are kept
+static void loggerColumnsAddM(loggerColumns_t *c, const loggerContext_t *ctx, const char *buf, const unsigned char *fieldMask) {
+	loggerColumn_t *col;
+	int fieldId, fieldType, size;
+	int i;
+
+	for (i = 0; i < ctx->numFields; i++) {
+		fieldId = ctx->fields[i].fieldId;
+		fieldType = ctx->fields[i].fieldType;
+		size = loggerFieldSize(fieldType);
+
+		if (fieldId < LOG_NUM_IDS && size && (!fieldMask || fieldMask[fieldId])) {
+			col = loggerColumnFor(c, fieldId, fieldType, c->numRecs);
+			if (col->fieldType == fieldType)
+				memcpy((char *)col->data + c->numRecs * size, buf, size);
+			else
+				((double *)col->data)[c->numRecs] = loggerDecodeValue(buf, fieldType);
+			col->numVals++;
+		}
+		buf += size;
+	}
+}
+
+// 'L' records carry every field as a double
+static void loggerColumnsAddL(loggerColumns_t *c, const loggerRecord_t *l, const unsigned char *fieldMask) {
+	loggerColumn_t *col;
+	double v;
+	int i;
+
+	for (i = 0; i < LOG_NUM_IDS; i++) {
+		if (!fieldMask || fieldMask[i]) {
+			col = loggerColumnFor(c, i, LOG_TYPE_DOUBLE, c->numRecs);
+			memcpy(&v, (const char *)l + offsetof(loggerRecord_t, data) + i * sizeof(double), sizeof(double));
+			((double *)col->data)[col->numVals++] = v;
+		}
+	}
+}
+
+// reads the rest of a mapped log into one contiguous column per logged field, in a single pass;
+// fieldMask (LOG_NUM_IDS long, may be NULL for all fields) selects which fields to keep
+int loggerColumnsLoad(loggerMap_t *m, loggerColumns_t *c, const unsigned char *fieldMask) {
+	const char *pkt;
+	int type;
+	int i;
+
+	memset(c, 0, sizeof(loggerColumns_t));
+
+	while ((type = loggerMapNextPacket(m, &pkt)) != EOF) {
+		if (c->numRecs == c->allocRecs)
+			loggerColumnsGrow(c);
+
+		if (type == 'M')
+			loggerColumnsAddM(c, loggerMapContext(m), pkt, fieldMask);
+		else
+			loggerColumnsAddL(c, (const loggerRecord_t *)pkt, fieldMask);
+
+		c->numRecs++;
+	}
+
+	for (i = 0; i < LOG_NUM_IDS; i++)
+		if (c->cols[i].data)
+			loggerColumnCarry(&c->cols[i], c->numRecs);
+
+	return c->numRecs;
+}
+
+// same as loggerColumnsLoad() for a log file name; returns -1 if the log cannot be opened
+int loggerColumnsRead(const char *fname, loggerColumns_t *c, const unsigned char *fieldMask) {
+	loggerMap_t *m;
+	int n;
+
+	if ((m = loggerMapOpen(fname)) == NULL)
+		return -1;
+
+	n = loggerColumnsLoad(m, c, fieldMask);
+	loggerMapClose(m);
+
+	return n;
+}
+
+// expand row rec into a loggerRecord_t, filling in only the fields which are stored
+void loggerColumnsRecord(const loggerColumns_t *c, int rec, loggerRecord_t *r) {
+	double v;
+	int i;
+
+	for (i = 0; i < LOG_NUM_IDS; i++) {
+		if (c->cols[i].data == NULL)
+			continue;
+
+		v = loggerColumnValue(c, i, rec);
+		r->data[i] = v;
+
+		if (i >= LOG_VOLTAGE0 && i <= LOG_VOLTAGE14)
+			r->voltages[i - LOG_VOLTAGE0] = v;
+		else if (i >= LOG_UKF_Q1 && i <= LOG_UKF_Q4)
+			r->quat[i - LOG_UKF_Q1] = v;
+		else if (i >= LOG_MOT_MOTOR0 && i <= LOG_MOT_MOTOR13)
+			r->motors[i - LOG_MOT_MOTOR0] = (int)v;
+		else if (i >= LOG_RADIO_CHANNEL0 && i <= LOG_RADIO_CHANNEL17)
+			r->radioChannels[i - LOG_RADIO_CHANNEL0] = (int)v;
+	}
+}
+
+void loggerColumnsFree(loggerColumns_t *c) {
+	int i;
+
+	for (i = 0; i < LOG_NUM_IDS; i++) {
+		free(c->cols[i].data);
+		c->cols[i].data = NULL;
+	}
+	c->numRecs = 0;
+	c->allocRecs = 0;
+}
+
 // allocates memory and reads an entire log
 int loggerReadLog(const char *fname, loggerRecord_t **l) {
 	loggerRecord_t buf;
@@ -296,8 +1775,7 @@ int loggerReadLog(const char *fname, loggerRecord_t **l) {
 		fprintf(stderr, "logger: cannot open log file '%s'\n", fname);
 	}
 	else {
-		loggerPacketSize = 0;
-		loggerNumFields = 0;
+		loggerContextSetFields(&loggerThread, NULL, 0);
 
 		// force header read
 		loggerReadEntry(fp, &buf);
@@ -320,8 +1798,8 @@ int loggerReadLog(const char *fname, loggerRecord_t **l) {
 }
 
 int loggerRecordSize(void) {
-	if (loggerPacketSize)
-		return loggerPacketSize + 2 + 3;
+	if (loggerThread.packetSize)
+		return loggerThread.packetSize + 2 + 3;
 	else
 		return (sizeof(loggerRecord_t));
 }
@@ -332,9 +1810,5 @@ void loggerFree(loggerRecord_t *l) {
 		l = NULL;
 	}
 
-	if (loggerFields) {
-		free(loggerFields);
-		loggerPacketSize = 0;
-		loggerNumFields = 0;
-	}
+	loggerContextReset(&loggerThread);
 }
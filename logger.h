@@ -24,6 +24,7 @@ extern "C" {
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
 
 enum log_fields {
 	LOG_LASTUPDATE = 0,
@@ -260,6 +261,8 @@ enum log_field_types {
 	LOG_TYPE_S8
 };
 
+#define LOGGER_MAX_FIELDS		255					// an 'H' header has a byte for the number of fields
+
 typedef struct {
 	unsigned char fieldId;
 	unsigned char fieldType;
@@ -300,9 +303,142 @@ typedef struct {
 
 } __attribute__((packed)) loggerRecord_t;
 
+// the field list (schema) packets are decoded with, along with its compiled decode plan;
+// each reader of a log needs its own, see loggerContextOpen()
+typedef struct loggerContext {
+	loggerFields_t *fields;
+	int numFields;
+	int packetSize;									// bytes in an 'M' packet, 0 until a header is read
+	const char *header;								// 'H' header the fields came from, see loggerContextUseHeader()
+	int headerValid;
+	struct loggerDecodePlan *plan;
+	struct loggerMap *map;							// log opened by loggerContextOpen(), if any
+} loggerContext_t;
+
+// read-only view of a whole log file, see loggerMapOpen()
+typedef struct loggerMap {
+	const char *base;								// start of mapped file
+	size_t size;									// mapped length in bytes
+	size_t pos;										// current read offset
+	int fd;
+	char *fname;
+	int copy;										// base is a malloc()ed copy of the file, not a mapping
+	int follow;										// the log is still growing, see loggerMapFollow()
+	int notify;										// descriptor loggerMapWait() sleeps on, -1 if none
+	size_t checked;									// bytes at the start of the followed file known to match base
+	const char *header;								// last 'H' header read (its numFields byte), NULL if none
+	void (*error)(struct loggerMap *m, const char *s); // checksum error handler, NULL to print it
+	void (*skip)(struct loggerMap *m, size_t from, size_t to); // called with each run of bytes skipped, NULL for none
+	void *user;										// for use by the error and skip handlers
+	loggerContext_t *ctx;							// field list state, NULL to use the calling thread's
+	uint64_t skipped;								// bytes read so far that were not part of a valid packet
+	uint32_t resyncs;								// valid packets found after skipping some
+	struct profiler *prof;							// stage times and counters, NULL for none
+} loggerMap_t;
+
+// one 'M' or 'L' packet found by loggerMapIndex()
+typedef struct {
+	const char *pkt;								// packet data in the mapping
+	const char *header;								// 'H' header in effect for an 'M' packet
+	int type;										// 'M' or 'L'
+} loggerPacket_t;
+
+typedef struct {
+	int packet;										// number of packets read before the error
+	char type;										// packet type which failed its checksum
+} loggerIndexError_t;
+
+// bytes of a log which are not part of any valid packet
+typedef struct {
+	uint64_t start, end;
+} loggerIndexRange_t;
+
+// every packet of a log in file order, along with the checksum errors met between them
+// and the runs of bytes skipped as corrupt
+typedef struct {
+	loggerPacket_t *packets;
+	int numPackets;
+	loggerIndexError_t *errors;
+	int numErrors;
+	loggerIndexRange_t *ranges;
+	int numRanges;
+} loggerIndex_t;
+
+#define LOGGER_SEEK_INTERVAL	1000				// records between seek index entries
+#define LOGGER_SEEK_HEADER		0x01				// entry flag: first record after a change of field list
+#define LOGGER_SEEK_NO_HEADER	0xffffffffffffffffULL
+
+// a record reading can be resumed from, see loggerSeekBuild()
+typedef struct {
+	uint32_t record;								// number of records before this one
+	uint32_t flags;									// LOGGER_SEEK_*
+	uint64_t pos;									// offset of its "Aq" sync
+	uint64_t header;								// offset of the numFields byte of the 'H' header in effect, LOGGER_SEEK_NO_HEADER if none
+} loggerSeekEntry_t;
+
+typedef struct {
+	loggerSeekEntry_t *entries;
+	int numEntries;
+	uint32_t numRecords;							// records in the whole log
+} loggerSeek_t;
+
+// one field of a log stored at its logged width, see loggerColumnsRead()
+typedef struct {
+	void *data;										// one value of fieldType per record, NULL if not stored
+	int numVals;									// number of values filled in so far
+	unsigned char fieldType;						// LOG_TYPE_*
+} loggerColumn_t;
+
+typedef struct {
+	loggerColumn_t cols[LOG_NUM_IDS];
+	int numRecs;
+	int allocRecs;
+} loggerColumns_t;
+
+extern loggerContext_t *loggerContextOpen(const char *fname);
+extern int loggerContextRead(loggerContext_t *c, loggerRecord_t *r);
+extern void loggerContextClose(loggerContext_t *c);
+extern void loggerContextReset(loggerContext_t *c);
+extern loggerContext_t *loggerThreadContext(void);
+extern void loggerContextSetFields(loggerContext_t *c, const char *buf, int numFields);
+extern void loggerContextUseHeader(loggerContext_t *c, const char *header);
+extern void loggerContextDecode(const loggerContext_t *c, const char *buf, loggerRecord_t *r);
+extern int loggerContextReadEntry(loggerContext_t *c, FILE *fp, loggerRecord_t *r);
+extern int loggerContextIndexRecord(loggerContext_t *c, const loggerIndex_t *idx, int n, loggerRecord_t *r);
+
+// calls without a context use the log's (loggerMap_t.ctx) or else the calling thread's own one,
+// so threads can decode different logs (or parts of one)
+extern void loggerChecksumError(const char *s);
+extern void loggerChecksum(const char *buf, int len, unsigned char *ckA, unsigned char *ckB);
 extern int loggerReadEntry(FILE *fp, loggerRecord_t *r);
 extern int loggerReadLog(const char *fname, loggerRecord_t **l);
 extern void loggerFree(loggerRecord_t *l);
+extern void loggerDecodePacket(const char *buf, loggerRecord_t *r);
+
+extern loggerMap_t *loggerMapOpen(const char *fname);
+extern int loggerMapNextPacket(loggerMap_t *m, const char **pkt);
+extern int loggerMapReadEntry(loggerMap_t *m, loggerRecord_t *r);
+extern void loggerMapRewind(loggerMap_t *m);
+extern void loggerMapClose(loggerMap_t *m);
+extern void loggerMapFollow(loggerMap_t *m);
+extern int loggerMapWait(loggerMap_t *m, int timeout);
+extern int loggerMapIndex(loggerMap_t *m, loggerIndex_t *idx, int numThreads);
+extern int loggerIndexRecord(const loggerIndex_t *idx, int n, loggerRecord_t *r);
+extern void loggerIndexFree(loggerIndex_t *idx);
+extern void loggerUseHeader(const char *header);
+extern int loggerSeekBuild(loggerMap_t *m, loggerSeek_t *s, int interval);
+extern int loggerSeekSave(const loggerMap_t *m, const loggerSeek_t *s, const char *fname);
+extern int loggerSeekLoad(const loggerMap_t *m, loggerSeek_t *s, const char *fname);
+extern uint32_t loggerMapSeek(loggerMap_t *m, const loggerSeek_t *s, uint32_t record);
+extern void loggerSeekFree(loggerSeek_t *s);
+
+extern int loggerFieldSize(int fieldType);
+extern void loggerSetFields(const char *buf, int numFields);
+extern int loggerColumnsLoad(loggerMap_t *m, loggerColumns_t *c, const unsigned char *fieldMask);
+extern int loggerColumnsRead(const char *fname, loggerColumns_t *c, const unsigned char *fieldMask);
+extern double loggerColumnValue(const loggerColumns_t *c, int fieldId, int rec);
+extern void loggerColumnsRecord(const loggerColumns_t *c, int rec, loggerRecord_t *r);
+extern void loggerColumnsFree(loggerColumns_t *c);
 
 #ifdef __cplusplus
 }
@@ -22,6 +22,7 @@
 
 #include "plotter.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <algorithm>
 #if defined (__WIN32__)
@@ -138,6 +139,14 @@ const char *plotValueLabels[100];
 			"-notrans",
 			"Do not adjust the transparency of overlapping lines."
 		},
+		{
+			"fullres",
+			NULL, NULL,
+			&plotFullRes,
+			PL_OPT_BOOL,
+			"-fullres",
+			"Plot every sample instead of the min/max of each pixel column (slow on long logs)."
+		},
 		{
 			"cmap0",
 			NULL, NULL,
@@ -411,3 +420,130 @@ void plotterEnd(void) {
 #endif
 }
 
+// canvas width in pixels, from -geometry or plotDefaultSize; 0 with -fullres, when series keep every sample
+int plotterWidth(void) {
+	int w = 0;
+
+	if (plotFullRes)
+		return 0;
+#ifdef HAS_PLPLOT
+	PLFLT xp, yp;
+	PLINT xleng, yleng, xoff, yoff;
+
+	plgpage(&xp, &yp, &xleng, &yleng, &xoff, &yoff);
+	w = xleng;
+#endif
+	if (w <= 0)
+		w = atoi(plotDefaultSize);
+
+	return w;
+}
+
+// A series keeps between one and two buckets per pixel column of the canvas.  Whenever that many
+// buckets are full, neighbouring pairs are merged and each bucket from then on takes twice as many
+// samples, so a series needs the same memory and plotting time however long the log is.
+plotterSeries_t *plotterSeriesInit(void) {
+	plotterSeries_t *s;
+
+	s = (plotterSeries_t *)calloc(1, sizeof(plotterSeries_t));
+	s->step = 1;
+	s->maxBuckets = plotterWidth() * 2;
+	if (s->maxBuckets)
+		s->buckets = (plotterBucket_t *)malloc(s->maxBuckets * sizeof(plotterBucket_t));
+
+	return s;
+}
+
+// add samples in b to those in a, which come first; ties keep the earlier sample
+static void plotterBucketMerge(plotterBucket_t *a, const plotterBucket_t *b) {
+	if (b->minY < a->minY || isnan(a->minY)) {
+		a->minX = b->minX;
+		a->minY = b->minY;
+	}
+	if (b->maxY > a->maxY || isnan(a->maxY)) {
+		a->maxX = b->maxX;
+		a->maxY = b->maxY;
+	}
+	a->lastX = b->lastX;
+	a->lastY = b->lastY;
+}
+
+static void plotterSeriesPoint(plotterSeries_t *s, double x, double y) {
+	if (s->numPoints == s->allocPoints) {
+		s->allocPoints = s->allocPoints ? s->allocPoints * 2 : 16384;
+		s->x = (double *)realloc(s->x, s->allocPoints * sizeof(double));
+		s->y = (double *)realloc(s->y, s->allocPoints * sizeof(double));
+	}
+	s->x[s->numPoints] = x;
+	s->y[s->numPoints] = y;
+	s->numPoints++;
+}
+
+void plotterSeriesAdd(plotterSeries_t *s, double x, double y) {
+	plotterBucket_t b = {x, y, x, y, x, y, x, y};
+	int i;
+
+	if (!s->maxBuckets) {
+		plotterSeriesPoint(s, x, y);
+		return;
+	}
+
+	if (s->numBuckets && s->count < s->step) {
+		plotterBucketMerge(&s->buckets[s->numBuckets-1], &b);
+		s->count++;
+		return;
+	}
+
+	if (s->numBuckets == s->maxBuckets) {
+		for (i = 0; i < s->numBuckets / 2; i++) {
+			s->buckets[i] = s->buckets[i*2];
+			plotterBucketMerge(&s->buckets[i], &s->buckets[i*2+1]);
+		}
+		s->numBuckets = i;
+		s->step *= 2;
+	}
+
+	s->buckets[s->numBuckets++] = b;
+	s->count = 1;
+}
+
+// fill in s->x and s->y with the points to plot, in order of samples; returns the number of points
+int plotterSeriesPoints(plotterSeries_t *s) {
+	plotterBucket_t *b;
+	double x[4], y[4];
+	int i, j;
+
+	if (!s->maxBuckets)
+		return s->numPoints;
+
+	s->numPoints = 0;
+	for (i = 0; i < s->numBuckets; i++) {
+		b = &s->buckets[i];
+		x[0] = b->firstX;
+		y[0] = b->firstY;
+		j = b->minX <= b->maxX;
+		x[2-j] = b->minX;
+		y[2-j] = b->minY;
+		x[1+j] = b->maxX;
+		y[1+j] = b->maxY;
+		x[3] = b->lastX;
+		y[3] = b->lastY;
+
+		// the same sample can be more than one of these
+		plotterSeriesPoint(s, x[0], y[0]);
+		for (j = 1; j < 4; j++)
+			if (x[j] != x[j-1] || y[j] != y[j-1])
+				plotterSeriesPoint(s, x[j], y[j]);
+	}
+
+	return s->numPoints;
+}
+
+void plotterSeriesFree(plotterSeries_t *s) {
+	if (s) {
+		free(s->buckets);
+		free(s->x);
+		free(s->y);
+		free(s);
+	}
+}
@@ -52,6 +52,16 @@ int main(int argc, char *argv[]) {
 
 	plotterEnd();  // must call to finish up
 }
+
+Long logs can be decimated to what fits on the canvas while they are read, keeping the first, last,
+minimum and maximum sample of each pixel column so peaks stay visible:
+
+	s = plotterSeriesInit();
+	for each sample
+		plotterSeriesAdd(s, x, y);
+	n = plotterSeriesPoints(s);
+	plotterLine(n, nval, s->x, s->y, label);
+	plotterSeriesFree(s);
 --------------
 */
 
@@ -71,6 +81,7 @@ extern "C" {
 static bool plotNoLegend = false;					// if true, do not draw a legend
 static bool plotWhiteBg = false;					// if true, use a white background and change color scheme to suit
 static bool plotNoAlpha = false;					// if true, do not adjust the transparency of overlapping lines
+static bool plotFullRes = false;					// if true, plot every sample instead of decimating series to the canvas width
 static int plotValsPerPage = 0;						// if not zero, limit number of items shown per graph
 static int plotMaxLegendValsOnTop = 3;				// if up to this many graph items, put legend on top as title (instead of on right side)
 static int plotStartColor = 2;						// color index of first color to use for plot
@@ -90,6 +101,24 @@ static char plotDefaultDevice[] = "aqt";
 static char plotDefaultDevice[] = "xwin";
 #endif
 
+// first, minimum, maximum and last sample of a run of series samples
+typedef struct {
+	double firstX, firstY;
+	double minX, minY;
+	double maxX, maxY;
+	double lastX, lastY;
+} plotterBucket_t;
+
+typedef struct {
+	int maxBuckets;									// merge pairs of buckets when this many are full, 0 to keep every sample
+	int step;										// samples per bucket
+	int count;										// samples in the last bucket
+	int numBuckets;
+	plotterBucket_t *buckets;
+	int numPoints, allocPoints;
+	double *x, *y;									// points to plot, set by plotterSeriesAdd() or plotterSeriesPoints()
+} plotterSeries_t;
+
 extern void plotterUsage(void);
 extern void plotterOpts(int &argc, char **argv);
 extern bool plotterInit(const int nValues, double *minYValues, double *maxYValues, double *minXValues, double *maxXValues);
@@ -97,6 +126,11 @@ extern void plotterNewPage(const int nvals, double ymin, double ymax, double xmi
 extern void plotterLine(const int nrec, const int nval, const double xVals[], const double yVals[], const char *label);
 extern void plotterEndPage();
 extern void plotterEnd();
+extern int plotterWidth(void);
+extern plotterSeries_t *plotterSeriesInit(void);
+extern void plotterSeriesAdd(plotterSeries_t *s, double x, double y);
+extern int plotterSeriesPoints(plotterSeries_t *s);
+extern void plotterSeriesFree(plotterSeries_t *s);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,167 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#include "profiler.h"
+#include <string.h>
+#include <time.h>
+#if !defined (__WIN32__)
+	#include <sys/time.h>
+	#include <sys/resource.h>
+#endif
+
+static const char *profilerStageNames[PROFILER_NUM_STAGES] = {
+	"scan",
+	"checksum",
+	"decode",
+	"filter",
+	"derive",
+	"fit",
+	"format",
+	"write"
+};
+
+static const char *profilerCounterNames[PROFILER_NUM_COUNTERS] = {
+	"records",
+	"exported",
+	"errorsM",
+	"errorsL",
+	"errorsH",
+	"resyncs",
+	"skipped",
+	"dropHAcc",
+	"dropVAcc",
+	"bytesIn",
+	"bytesOut"
+};
+
+static double profilerTime(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// process CPU seconds
+static void profilerCpu(double *user, double *sys) {
+#if defined (__WIN32__)
+	*user = (double)clock() / CLOCKS_PER_SEC;
+	*sys = 0.0;
+#else
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	*user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6;
+	*sys = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+#endif
+}
+
+// the start of the run, profilers merged into this one keep their own start
+void profilerInit(profiler_t *p, int timing) {
+	memset(p, 0, sizeof(profiler_t));
+	p->timing = timing;
+	p->startTime = profilerTime();
+	p->startTicks = profilerTicks();
+}
+
+void profilerMerge(profiler_t *dst, const profiler_t *src) {
+	int i;
+
+	for (i = 0; i < PROFILER_NUM_STAGES; i++) {
+		dst->ticks[i] += src->ticks[i];
+		dst->calls[i] += src->calls[i];
+	}
+	for (i = 0; i < PROFILER_NUM_COUNTERS; i++)
+		dst->counts[i] += src->counts[i];
+}
+
+// count a checksum error reported as "M", "L" or "H"
+void profilerChecksumError(profiler_t *p, const char *type) {
+	switch (type[0]) {
+		case 'M':
+			profilerCount(p, PROFILER_ERRORS_M, 1);
+			break;
+		case 'L':
+			profilerCount(p, PROFILER_ERRORS_L, 1);
+			break;
+		case 'H':
+			profilerCount(p, PROFILER_ERRORS_H, 1);
+			break;
+	}
+}
+
+// report format from an optional "text" or "json" option argument, 0 if it is neither
+int profilerFormat(const char *arg) {
+	if (!arg || !strcmp(arg, "text"))
+		return PROFILER_TEXT;
+	if (!strcmp(arg, "json"))
+		return PROFILER_JSON;
+
+	return 0;
+}
+
+// Print the stage times (if timed) and the counters collected since profilerInit(), as lines of
+// text prefixed with the tool name or as a single JSON object.  The tick rate is taken from the
+// time gone by, so the stage times need no calibration of their own.
+void profilerReport(FILE *fp, const profiler_t *p, const char *tool, int format) {
+	double wall, user, sys, tickSecs, s;
+	int i, n;
+
+	wall = profilerTime() - p->startTime;
+	tickSecs = (wall > 0.0 && profilerTicks() > p->startTicks) ? wall / (profilerTicks() - p->startTicks) : 0.0;
+	profilerCpu(&user, &sys);
+
+	if (format == PROFILER_JSON) {
+		fprintf(fp, "{\"tool\":\"%s\",\"wall\":%.6f,\"user\":%.6f,\"sys\":%.6f", tool, wall, user, sys);
+		if (p->timing) {
+			fprintf(fp, ",\"stages\":{");
+			for (i = n = 0; i < PROFILER_NUM_STAGES; i++)
+				if (p->calls[i])
+					fprintf(fp, "%s\"%s\":{\"seconds\":%.6f,\"calls\":%llu}", n++ ? "," : "", profilerStageNames[i],
+						p->ticks[i] * tickSecs, (unsigned long long)p->calls[i]);
+			fprintf(fp, "}");
+		}
+		for (i = 0; i < PROFILER_NUM_COUNTERS; i++)
+			fprintf(fp, ",\"%s\":%llu", profilerCounterNames[i], (unsigned long long)p->counts[i]);
+		fprintf(fp, "}\n");
+
+		return;
+	}
+
+	fprintf(fp, "%s: %.3f seconds, %.3f user, %.3f system\n", tool, wall, user, sys);
+	if (p->timing) {
+		fprintf(fp, "%s:   stage       seconds        calls   ns/call\n", tool);
+		for (i = 0; i < PROFILER_NUM_STAGES; i++) {
+			if (!p->calls[i])
+				continue;
+			s = p->ticks[i] * tickSecs;
+			fprintf(fp, "%s:   %-8s %10.3f %12llu %9.1f\n", tool, profilerStageNames[i], s,
+				(unsigned long long)p->calls[i], s * 1e9 / p->calls[i]);
+		}
+	}
+	fprintf(fp, "%s: %llu records read, %llu exported, %llu bytes in, %llu bytes out\n", tool,
+		(unsigned long long)p->counts[PROFILER_RECORDS], (unsigned long long)p->counts[PROFILER_EXPORTED],
+		(unsigned long long)p->counts[PROFILER_BYTES_IN], (unsigned long long)p->counts[PROFILER_BYTES_OUT]);
+	fprintf(fp, "%s: checksum errors M %llu, L %llu, H %llu; %llu resyncs, %llu bytes skipped\n", tool,
+		(unsigned long long)p->counts[PROFILER_ERRORS_M], (unsigned long long)p->counts[PROFILER_ERRORS_L],
+		(unsigned long long)p->counts[PROFILER_ERRORS_H], (unsigned long long)p->counts[PROFILER_RESYNCS],
+		(unsigned long long)p->counts[PROFILER_SKIPPED]);
+	if (p->counts[PROFILER_DROP_HACC] || p->counts[PROFILER_DROP_VACC])
+		fprintf(fp, "%s: dropped by the GPS accuracy filters: %llu HACC, %llu VACC\n", tool,
+			(unsigned long long)p->counts[PROFILER_DROP_HACC], (unsigned long long)p->counts[PROFILER_DROP_VACC]);
+}
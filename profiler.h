@@ -0,0 +1,141 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#ifndef _profiler_h
+#define _profiler_h
+
+#include <stdio.h>
+#include <stdint.h>
+#if defined (__x86_64__) || defined (__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// Stage times and counters for the --stats and --profile options of the log tools.  Each thread keeps
+// a profiler_t of its own, so nothing is shared while logs are read; they are added up with
+// profilerMerge() once the threads are done.  Stage times are exclusive, entering a stage from inside
+// another one stops the clock of the outer one until it is left again.  They are wall time of the
+// thread in the stage, kept in cycle counter ticks where there is one, and only when timing is on;
+// the counters are always kept.  Every call takes a NULL profiler, and then does nothing.
+
+enum profilerStages {
+	PROFILER_SCAN = 0,					// looking for packets and records, resynchronizing
+	PROFILER_CHECKSUM,
+	PROFILER_DECODE,
+	PROFILER_FILTER,					// choosing the records exported
+	PROFILER_DERIVE,					// calculated values: attitude, home position, ...
+	PROFILER_FIT,						// least squares
+	PROFILER_FORMAT,
+	PROFILER_WRITE,
+	PROFILER_NUM_STAGES
+};
+
+enum profilerCounters {
+	PROFILER_RECORDS = 0,				// records read
+	PROFILER_EXPORTED,
+	PROFILER_ERRORS_M,					// checksum errors by packet type
+	PROFILER_ERRORS_L,
+	PROFILER_ERRORS_H,
+	PROFILER_RESYNCS,
+	PROFILER_SKIPPED,					// bytes not part of any valid packet or record
+	PROFILER_DROP_HACC,					// records dropped by the GPS accuracy filters
+	PROFILER_DROP_VACC,
+	PROFILER_BYTES_IN,
+	PROFILER_BYTES_OUT,
+	PROFILER_NUM_COUNTERS
+};
+
+#define PROFILER_DEPTH		8			// stages nested deeper than this are not timed
+#define PROFILER_TEXT		1			// profilerReport() formats
+#define PROFILER_JSON		2
+
+typedef struct profiler {
+	uint64_t ticks[PROFILER_NUM_STAGES];
+	uint64_t calls[PROFILER_NUM_STAGES];
+	uint64_t counts[PROFILER_NUM_COUNTERS];
+	int timing;							// time the stages, not only count
+	int stack[PROFILER_DEPTH];			// stages entered
+	int depth;
+	uint64_t since;						// ticks when the innermost stage was entered or resumed
+	uint64_t startTicks;
+	double startTime;					// seconds, see profilerInit()
+} profiler_t;
+
+static inline uint64_t profilerTicks(void) {
+#if defined (__x86_64__) || defined (__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static inline void profilerBegin(profiler_t *p, int stage) {
+	uint64_t t;
+
+	if (!p || !p->timing)
+		return;
+
+	t = profilerTicks();
+	if (p->depth && p->depth <= PROFILER_DEPTH)
+		p->ticks[p->stack[p->depth-1]] += t - p->since;
+	if (p->depth < PROFILER_DEPTH)
+		p->stack[p->depth] = stage;
+	p->depth++;
+	p->calls[stage]++;
+	p->since = t;
+}
+
+// leave the stage entered last
+static inline void profilerEnd(profiler_t *p) {
+	uint64_t t;
+
+	if (!p || !p->timing || !p->depth)
+		return;
+
+	t = profilerTicks();
+	p->depth--;
+	if (p->depth < PROFILER_DEPTH)
+		p->ticks[p->stack[p->depth]] += t - p->since;
+	p->since = t;
+}
+
+static inline void profilerCount(profiler_t *p, int counter, uint64_t n) {
+	if (p)
+		p->counts[counter] += n;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void profilerInit(profiler_t *p, int timing);
+extern void profilerMerge(profiler_t *dst, const profiler_t *src);
+extern void profilerChecksumError(profiler_t *p, const char *type);
+extern int profilerFormat(const char *arg);
+extern void profilerReport(FILE *fp, const profiler_t *p, const char *tool, int format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
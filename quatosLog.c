@@ -0,0 +1,195 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#include "quatosLog.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// short names of the logged fields, in record order
+const char *quatosLogFieldLabels[QUATOS_LOG_FIELDS] = {
+	"QUAT_DES0",
+	"QUAT_DES1",
+	"QUAT_DES2",
+	"QUAT_DES3",
+	"WCD0",
+	"WCD1",
+	"WCD2",
+	"QUAT_ACT0",
+	"QUAT_ACT1",
+	"QUAT_ACT2",
+	"QUAT_ACT3",
+	"RATE_ACT0",
+	"RATE_ACT1",
+	"RATE_ACT2",
+	"RATE_DES0",
+	"RATE_DES1",
+	"RATE_DES2",
+	"INERTIA_REQ0",
+	"INERTIA_REQ1",
+	"INERTIA_REQ2",
+	"HOVER_THRUST",
+	"DCA0",
+	"DCA1",
+	"DCA2",
+	"DCA3",
+	"DCA4",
+	"DCA5",
+	"DCA6",
+	"DCA7"
+};
+
+quatosLogReader_t *quatosLogOpen(FILE *fp, int numFields) {
+	quatosLogReader_t *r;
+
+	r = (quatosLogReader_t *)calloc(1, sizeof(quatosLogReader_t));
+	r->fp = fp;
+	r->numFields = numFields;
+	r->recLen = sizeof(uint32_t) + numFields * sizeof(float);
+	r->buf = (unsigned char *)malloc(QUATOS_LOG_BUF_SIZE);
+	r->synced = 1;
+
+	return r;
+}
+
+void quatosLogClose(quatosLogReader_t *r) {
+	free(r->buf);
+	free(r);
+}
+
+// move what is left to the front of the buffer and read as much again as fits
+static void quatosLogFill(quatosLogReader_t *r) {
+	size_t want, n;
+
+	if (r->pos) {
+		memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+		r->len -= r->pos;
+		r->pos = 0;
+	}
+
+	want = QUATOS_LOG_BUF_SIZE - r->len;
+	n = fread(r->buf + r->len, 1, want, r->fp);
+	if (n < want)
+		r->eof = 1;
+	r->len += n;
+}
+
+static int quatosLogIsSync(const unsigned char *p) {
+	return p[0] == 0xff && p[1] == 0xff && p[2] == 0xff && p[3] == 0xff;
+}
+
+// first place from p on where four 0xff bytes start, NULL if there is none
+static const unsigned char *quatosLogFindSync(const unsigned char *p, const unsigned char *end) {
+#if defined (__SSE2__)
+	const __m128i ff = _mm_set1_epi8(-1);
+	__m128i a, b;
+	unsigned int m;
+
+	// a bit is set in m for every byte which starts a run of four
+	while (end - p >= 16 + 3) {
+		a = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), ff), _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 1)), ff));
+		b = _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 2)), ff), _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 3)), ff));
+		if ((m = _mm_movemask_epi8(_mm_and_si128(a, b))) != 0)
+			return p + __builtin_ctz(m);
+		p += 16;
+	}
+#endif
+	for (; end - p >= 4; p++)
+		if (quatosLogIsSync(p))
+			return p;
+
+	return NULL;
+}
+
+// fields of one record to doubles
+static void quatosLogConvert(const unsigned char *p, double *d, int n) {
+	float f;
+	int i = 0;
+
+#if defined (__SSE2__)
+	__m128 v;
+
+	for (; i + 4 <= n; i += 4) {
+		v = _mm_loadu_ps((const float *)(p + i * sizeof(float)));
+		_mm_storeu_pd(d + i, _mm_cvtps_pd(v));
+		_mm_storeu_pd(d + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+	}
+#endif
+	for (; i < n; i++) {
+		memcpy(&f, p + i * sizeof(float), sizeof(float));
+		d[i] = f;
+	}
+}
+
+// Read up to maxRows records into rows, numFields doubles each.  Returns the number read, 0 at the end of the log.
+int quatosLogRead(quatosLogReader_t *r, double *rows, int maxRows) {
+	const unsigned char *p, *q, *end;
+	int n = 0;
+
+	while (n < maxRows) {
+		// keep enough for a record and the sync of the one after it
+		if (r->len - r->pos < 2 * r->recLen + 4 && !r->eof)
+			quatosLogFill(r);
+
+		p = r->buf + r->pos;
+		end = r->buf + r->len;
+
+		if (end - p < r->recLen) {
+			if (end > p) {
+				if (r->synced && end - p >= 4 && quatosLogIsSync(p))
+					fprintf(stderr, "quatosLog: incomplete record at end of log after record # %u\n", r->records);
+				r->skipped += end - p;
+				r->pos = r->len;
+			}
+			if (!r->synced) {
+				fprintf(stderr, "quatosLog: sync lost after record # %u, %llu bytes skipped to end of log\n", r->records, (unsigned long long)(r->skipped - r->skippedBefore));
+				r->synced = 1;
+			}
+			break;
+		}
+
+		if (quatosLogIsSync(p) && (r->synced || end - p < r->recLen + 4 || quatosLogIsSync(p + r->recLen))) {
+			if (!r->synced) {
+				fprintf(stderr, "quatosLog: sync lost after record # %u, %llu bytes skipped\n", r->records, (unsigned long long)(r->skipped - r->skippedBefore));
+				r->synced = 1;
+			}
+
+			quatosLogConvert(p + sizeof(uint32_t), rows + n * r->numFields, r->numFields);
+			r->pos += r->recLen;
+			r->records++;
+			n++;
+			continue;
+		}
+
+		if (r->synced) {
+			r->synced = 0;
+			r->resyncs++;
+			r->skippedBefore = r->skipped;
+		}
+
+		// the last three bytes might be the start of a sync still to be read
+		if ((q = quatosLogFindSync(p + 1, end)) == NULL)
+			q = end - 3;
+		r->skipped += q - p;
+		r->pos = q - r->buf;
+	}
+
+	return n;
+}
@@ -0,0 +1,63 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#ifndef _quatosLog_h
+#define _quatosLog_h
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Quatos logs are records of a 4 byte 0xffffffff sync followed by numFields floats, in host byte order.
+// The reader takes the file in large blocks and hands back batches of records as rows of doubles.  When
+// a record doesn't start with a sync, it looks for the next one at any byte offset, and only takes it if
+// another sync follows one record later (or the log ends there).
+
+#define QUATOS_LOG_SYNC			0xffffffff
+#define QUATOS_LOG_BUF_SIZE		(256*1024)
+#define QUATOS_LOG_BATCH		1024				// rows a caller would usually ask for at once
+#define QUATOS_LOG_FIELDS		29					// fields logged by the QUATOS controller
+
+typedef struct {
+	FILE *fp;
+	int numFields;
+	int recLen;										// bytes in a record, sync included
+	unsigned char *buf;
+	int len, pos;									// bytes in buf, where the next record starts
+	int eof;
+	int synced;										// 0 after the last record was followed by something else
+	uint32_t records;								// read so far
+	uint32_t resyncs;								// times sync was lost
+	uint64_t skipped;								// bytes dropped getting it back
+	uint64_t skippedBefore;							// skipped when sync was last lost
+} quatosLogReader_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const char *quatosLogFieldLabels[QUATOS_LOG_FIELDS];
+
+extern quatosLogReader_t *quatosLogOpen(FILE *fp, int numFields);
+extern int quatosLogRead(quatosLogReader_t *r, double *rows, int maxRows);
+extern void quatosLogClose(quatosLogReader_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
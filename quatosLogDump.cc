@@ -1,5 +1,9 @@
 
 #include "plotter.h"
+#include "writer.h"
+#include "quatosLog.h"
+#include "attitude.h"
+#include "profiler.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -99,19 +103,27 @@ static bool dumpPlot = false;
 static bool includeHeaders = false;
 static uint32_t dumpRangeMin = 1;			// start export at this record number
 static uint32_t dumpRangeMax = 0;			// end export at this record number (zero for all)
+static int dumpStats = 0;					// --stats/--profile report format, 0 for none
+static bool dumpProfile = false;			// time the stages as well
 // runtime globals
-float logRowData[NUM_FIELDS];
+const double *logRowData;		// logged fields of the record being dumped
+int dumpRow;					// its row in the batch
+bool dumpAttitude;				// any of the Euler angles are wanted
+float dumpEuler[2][3][QUATOS_LOG_BATCH];	// roll, pitch, yaw of the desired and actual quaternions of the batch
 int dumpNum;
 int dumpOrder[NUM_FIELDS];
 double *dumpYMin, *dumpYMax;
 double *dumpXMin, *dumpXMax;
+plotterSeries_t **dumpSeries;	// plotted values
+writerStruct_t *dumpWriter;		// text export output
+profiler_t dumpProfiler;		// --stats
 
 void qLogDumpUsage(void) {
 	fprintf(stderr,
 "\n\
 Usage: quatosLogDump [options] [values] logfile [ > outfile.ext ]\n\n\
 Options Summary:\n\n\
-   [-e (txt|csv|tab)] [-c] [-p] [-m number] [-M number]\n\
+   [-e (txt|csv|tab)] [-c] [-p] [-m number] [-M number] [--stats[=json]] [--profile[=json]]\n\
    [--all] [--rates] [--quat] [--att] [--inertia] [--thrust] [--wcd] [--dca]\n\
 \n\
 Option Details:\n\
@@ -122,6 +134,9 @@ Option Details:\n\
                       (See plotting options, below. Use -h to get details.)\n\
  --range-min (-m)   Start export at this record number (default is 1).\n\
  --range-max (-M)   End export at this record number (zero means all records until end).\n\
+ --stats[=json]     At exit, print the records read and exported, times sync was lost\n\
+                      and bytes skipped to stderr, as text or a line of JSON.\n\
+ --profile[=json]   Same as --stats, plus the time spent reading, deriving and formatting.\n\
 \n\
 Values to export (at least one is required):\n\
 \n\
@@ -158,7 +173,9 @@ void qLogDumpOpts(int argc, char **argv) {
 		O_INERTIA,
 		O_THRUST,
 		O_WCD,
-		O_DCA
+		O_DCA,
+		O_STATS,
+		O_PROFILE
 	};
 
 	/* options descriptor */
@@ -178,6 +195,8 @@ void qLogDumpOpts(int argc, char **argv) {
 		{"thrust",			no_argument,		&longOpt,	O_THRUST},
 		{"wcd",				no_argument,		&longOpt,	O_WCD},
 		{"dca",				no_argument,		&longOpt,	O_DCA},
+		{"stats",			optional_argument,	&longOpt,	O_STATS},
+		{"profile",			optional_argument,	&longOpt,	O_PROFILE},
 		{NULL,				0,					NULL,		0}
 	};
 
@@ -257,6 +276,15 @@ void qLogDumpOpts(int argc, char **argv) {
 						for (i=0; i < LOG_NUM_DCA; i++)
 							dumpOrder[dumpNum++] = DCA_0 + i;
 						break;
+					case O_PROFILE:
+						dumpProfile = true;
+						// no break
+					case O_STATS:
+						if ((dumpStats = profilerFormat(optarg)) == 0) {
+							fprintf(stderr, "quatosLogDump: --stats and --profile take text or json, not '%s'\n", optarg);
+							exit(1);
+						}
+						break;
 				} // longopt switch
 				break;
 			default:
@@ -267,63 +295,43 @@ void qLogDumpOpts(int argc, char **argv) {
 
 }
 
-float *qLogDumpMakeQarray(const char *typ) {
-	static float q[4];
-	if (!strcmp(typ, "a")) {
-		q[0] = logRowData[QUAT_ACT_0];
-		q[1] = logRowData[QUAT_ACT_1];
-		q[2] = logRowData[QUAT_ACT_2];
-		q[3] = logRowData[QUAT_ACT_3];
-	} else {
-		q[0] = logRowData[QUAT_DES_0];
-		q[1] = logRowData[QUAT_DES_1];
-		q[2] = logRowData[QUAT_DES_2];
-		q[3] = logRowData[QUAT_DES_3];
-	}
-	return q;
-}
-
-void attitudeExtractEulerQuat(float *q, float *rpy) {
-	float q0, q1, q2, q3;
+// Euler angles of the desired and actual quaternions of a batch of rows
+void qLogDumpAttitude(const double *rows, int n) {
+	static float q[4][QUATOS_LOG_BATCH];
+	int base;
+	int i, j, k;
 
-	q0 = q[1];
-	q1 = q[2];
-	q2 = q[3];
-	q3 = q[0];
+	for (k = 0; k < 2; k++) {
+		base = k ? QUAT_ACT_0 : QUAT_DES_0;
+		for (j = 0; j < n; j++)
+			for (i = 0; i < 4; i++)
+				q[i][j] = rows[j * NUM_LOG_FIELDS + base + i];
 
-	rpy[2] = atan2((2.0f * (q0 * q1 + q3 * q2)), (q3*q3 - q2*q2 - q1*q1 + q0*q0));
-	rpy[1] = asin(-2.0f * (q0 * q2 - q1 * q3));
-	rpy[0] = atan((2.0f * (q1 * q2 + q0 * q3)) / (q3*q3 + q2*q2 - q1*q1 -q0*q0));
+		attitudeEulerQuatBatch(q[0], q[1], q[2], q[3], n, dumpEuler[k][0], dumpEuler[k][1], dumpEuler[k][2]);
+	}
 }
 
 double qLogDumpGetValue(int field) {
 	double val = nan("");
-	float rpy[3];
 
 	switch (field) {
 		case ROLL_DES:
-			attitudeExtractEulerQuat(qLogDumpMakeQarray("d"), rpy);
-			val = rpy[0];
+			val = dumpEuler[0][0][dumpRow];
 			break;
 		case PITCH_DES:
-			attitudeExtractEulerQuat(qLogDumpMakeQarray("d"), rpy);
-			val = rpy[1];
+			val = dumpEuler[0][1][dumpRow];
 			break;
 		case YAW_DES:
-			attitudeExtractEulerQuat(qLogDumpMakeQarray("d"), rpy);
-			val = rpy[2];
+			val = dumpEuler[0][2][dumpRow];
 			break;
 		case ROLL_ACT:
-			attitudeExtractEulerQuat(qLogDumpMakeQarray("a"), rpy);
-			val = rpy[0];
+			val = dumpEuler[1][0][dumpRow];
 			break;
 		case PITCH_ACT:
-			attitudeExtractEulerQuat(qLogDumpMakeQarray("a"), rpy);
-			val = rpy[1];
+			val = dumpEuler[1][1][dumpRow];
 			break;
 		case YAW_ACT:
-			attitudeExtractEulerQuat(qLogDumpMakeQarray("a"), rpy);
-			val = rpy[2];
+			val = dumpEuler[1][2][dumpRow];
 			break;
 		default:
 			val = (double)logRowData[field];
@@ -332,7 +340,8 @@ double qLogDumpGetValue(int field) {
 	return val;
 }
 
-void qLogDumpStats() {
+// update the extents of each plotted value and add it to its series
+void qLogDumpStats(double x) {
 	int i;
 	double val;
 
@@ -342,31 +351,32 @@ void qLogDumpStats() {
 			dumpYMax[i] = val;
 		if (val < dumpYMin[i])
 			dumpYMin[i] = val;
+		plotterSeriesAdd(dumpSeries[i], x, val);
 	}
 }
 
-void qLogDumpHeaders(void) {
+void qLogDumpHeaders(writerStruct_t *w) {
 	int i;
 
 	if (dumpNum) {
 		for (i = 0; i < dumpNum; i++) {
-			printf("%s", fieldLabels[dumpOrder[i]]);
+			writerString(w, fieldLabels[dumpOrder[i]]);
 			if (i < dumpNum - 1)
-				printf("%c", sep);
+				writerChar(w, sep);
 		}
-		printf("\n"); // end of header row
+		writerChar(w, '\n'); // end of header row
 	}
 }
 
-void qLogDumpText(void) {
+void qLogDumpText(writerStruct_t *w) {
 	int i;
 
 	for (i = 0; i < dumpNum; i++) {
-		printf("%.15G", qLogDumpGetValue(dumpOrder[i]));
+		writerDouble(w, qLogDumpGetValue(dumpOrder[i]));
 		if (i < dumpNum - 1)
-			printf("%c", sep);
+			writerChar(w, sep);
 	}
-	printf("\n"); // end of export row
+	writerChar(w, '\n'); // end of export row
 }
 
 bool qLogDumpProgress(const uint32_t count) {
@@ -380,9 +390,12 @@ bool qLogDumpProgress(const uint32_t count) {
 
 int main(int argc, char *argv[]) {
 	FILE *fp;
-	unsigned int sync = 0;
+	quatosLogReader_t *r;
+	profiler_t *prof;
+	double *rows;
 	uint32_t rec = 0;
 	uint32_t exp_count = 0;
+	int i, j, n;
 
 	plotterOpts(argc, argv);
 	qLogDumpOpts(argc, argv);
@@ -399,6 +412,9 @@ int main(int argc, char *argv[]) {
 		exit(1);
 	}
 
+	profilerInit(&dumpProfiler, dumpProfile);
+	prof = dumpStats ? &dumpProfiler : NULL;
+
 	fprintf(stderr, "quatosLogDump: opening logfile: %s\n", argv[0]);
 
 	fp = fopen(argv[0], "rb");
@@ -407,102 +423,116 @@ int main(int argc, char *argv[]) {
 		return 0;
 	}
 
-	// plot output
-	if (dumpPlot) {
-		double *xVals, *yVals;
-		int i, j;
+	for (i = 0; i < dumpNum; i++)
+		if (dumpOrder[i] > NUM_LOG_FIELDS)
+			dumpAttitude = true;
 
-		// need to get X & Y extents for all plotted values to initialize plotter
+	r = quatosLogOpen(fp, NUM_LOG_FIELDS);
+	rows = (double *)malloc(QUATOS_LOG_BATCH * NUM_LOG_FIELDS * sizeof(double));
 
+	if (dumpPlot) {
+		// need to get X & Y extents for all plotted values to initialize plotter
 		dumpYMin = (double *)calloc(dumpNum, sizeof(double));
 		dumpYMax = (double *)calloc(dumpNum, sizeof(double));
 		dumpXMin = (double *)calloc(dumpNum, sizeof(double));
 		dumpXMax = (double *)calloc(dumpNum, sizeof(double));
+		dumpSeries = (plotterSeries_t **)calloc(dumpNum, sizeof(plotterSeries_t *));
+		for (i = 0; i < dumpNum; i++)
+			dumpSeries[i] = plotterSeriesInit();
 		// initialize with bogus values
 		std::fill(dumpYMin, dumpYMin + dumpNum, +9999999.99);
 		std::fill(dumpYMax, dumpYMax + dumpNum, -9999999.99);
+	}
+	else {
+		dumpWriter = writerInit(stdout, 0);
+		dumpWriter->prof = prof;
+
+		if (includeHeaders)
+			qLogDumpHeaders(dumpWriter);
+	}
+
+	// one pass through the log, collecting plotted values and their extents or exporting them;
+	// the stages are timed a batch at a time, reading includes the sync checks and conversion
+	while (1) {
+		profilerBegin(prof, PROFILER_SCAN);
+		n = quatosLogRead(r, rows, QUATOS_LOG_BATCH);
+		profilerEnd(prof);
+		if (n <= 0)
+			break;
 
-		// read through entire log to update dumpYMin/dumpYMax extents for each value being exported
-		while (fread(&sync, sizeof(sync), 1, fp) == 1) {
-			if (sync == 0xffffffff) {
-				if (fread(logRowData, sizeof(float), NUM_LOG_FIELDS, fp) == NUM_LOG_FIELDS) {
-					if (rec++ >= dumpRangeMin) {
-						qLogDumpStats();
-						exp_count++;
-						if (!qLogDumpProgress(rec))
-							break;
-					}
-				} else
-					fprintf(stderr, "quatosLogDump: field count error record # %d\n", rec);
-			} else
-				fprintf(stderr, "quatosLogDump: sync error record # %d\n", rec);
+		if (dumpAttitude) {
+			profilerBegin(prof, PROFILER_DERIVE);
+			qLogDumpAttitude(rows, n);
+			profilerEnd(prof);
 		}
 
-		// NOTE: everything below assumes that all logged columns (values) have the same number of samples (rec).
-		// We could do this per value instead (inside the next log reading loop) but at this point it's overkill.
+		profilerBegin(prof, PROFILER_FORMAT);
+		for (j = 0; j < n; j++) {
+			logRowData = rows + j * NUM_LOG_FIELDS;
+			dumpRow = j;
+			if (rec++ >= dumpRangeMin) {
+				if (dumpPlot)
+					qLogDumpStats((double)(exp_count + dumpRangeMin));
+				else
+					qLogDumpText(dumpWriter);
+				exp_count++;
+			}
+			if (!qLogDumpProgress(rec))
+				break;
+		}
+		profilerEnd(prof);
+		if (j < n)
+			break;
+	}
 
-		xVals = (double *)calloc(exp_count, sizeof(double));
-		yVals = (double *)calloc(exp_count, sizeof(double));
+	if (r->resyncs)
+		fprintf(stderr, "\nquatosLogDump: lost sync %u times, %llu bytes skipped\n", r->resyncs, (unsigned long long)r->skipped);
 
-		// populate X graph values with zero through n samples
-		for (j = 0; j < exp_count; j++)
-			xVals[j] = (double)j + dumpRangeMin;
+	// plot output
+	if (dumpPlot) {
+		// NOTE: everything below assumes that all logged columns (values) have the same number of samples (rec).
 
-		std::fill(dumpXMin, dumpXMin + dumpNum, *std::min_element(xVals, xVals + exp_count));
-		std::fill(dumpXMax, dumpXMax + dumpNum, *std::max_element(xVals, xVals + exp_count));
+		// X graph values are the record numbers
+		std::fill(dumpXMin, dumpXMin + dumpNum, (double)dumpRangeMin);
+		std::fill(dumpXMax, dumpXMax + dumpNum, (double)((exp_count ? exp_count - 1 : 0) + dumpRangeMin));
 
 		if (!plotterInit(dumpNum, dumpYMin, dumpYMax, dumpXMin, dumpXMax))
 			exit(1);
 
 		for (i = 0; i < dumpNum; i++) {
-			rewind(fp);
-			rec = exp_count = 0;
-			while (fread(&sync, sizeof(sync), 1, fp) == 1) {
-				if (sync == 0xffffffff && fread(logRowData, sizeof(float), NUM_LOG_FIELDS, fp) == NUM_LOG_FIELDS) {
-					if (rec++ >= dumpRangeMin)
-						yVals[exp_count++] = qLogDumpGetValue(dumpOrder[i]);
-					if (!qLogDumpProgress(rec))
-						break;
-				}
-			}
-			plotterLine(exp_count, i, xVals, yVals, fieldLabels[dumpOrder[i]]);
+			n = plotterSeriesPoints(dumpSeries[i]);
+			plotterLine(n, i, dumpSeries[i]->x, dumpSeries[i]->y, fieldLabels[dumpOrder[i]]);
 		}
 
 		plotterEnd();
 
+		for (i = 0; i < dumpNum; i++)
+			plotterSeriesFree(dumpSeries[i]);
+		free(dumpSeries);
 		free(dumpYMin);
 		free(dumpYMax);
 		free(dumpXMin);
 		free(dumpXMax);
-		free(xVals);
-		free(yVals);
 	}
 	// file export
 	else {
-
-		if (includeHeaders)
-			qLogDumpHeaders();
-
-		while (fread(&sync, sizeof(sync), 1, fp) == 1) {
-			if (sync == 0xffffffff) {
-				if (fread(logRowData, sizeof(float), NUM_LOG_FIELDS, fp) == NUM_LOG_FIELDS) {
-					if (rec++ >= dumpRangeMin) {
-						qLogDumpText();
-						exp_count++;
-					}
-					if (!qLogDumpProgress(rec))
-						break;
-				}
-			}
-			else {
-				fprintf(stderr, "sync error record # %d\n", rec);
-			}
-		}
+		writerFree(dumpWriter);
 	}
 
+	profilerCount(prof, PROFILER_RECORDS, rec);
+	profilerCount(prof, PROFILER_EXPORTED, exp_count);
+	profilerCount(prof, PROFILER_RESYNCS, r->resyncs);
+	profilerCount(prof, PROFILER_SKIPPED, r->skipped);
+	profilerCount(prof, PROFILER_BYTES_IN, (uint64_t)r->records * r->recLen + r->skipped);
+
+	free(rows);
+	quatosLogClose(r);
 	fclose(fp);
 
 	fprintf(stderr, "\nquatosLogDump: %d records dumped\n", exp_count);
 
+	if (dumpStats)
+		profilerReport(stderr, prof, "quatosLogDump", dumpStats);
+
 	return 1;
 }
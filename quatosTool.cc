@@ -4,6 +4,8 @@
 #include <iostream>
 #include <math.h>
 #include <algorithm>  // std::min
+#include <pthread.h>
+#include <unistd.h>
 
 #define EIGEN_NO_DEBUG
 //#define EIGEN_DONT_VECTORIZE
@@ -18,6 +20,7 @@ using namespace Eigen;
 #define QUATOSTOOL_VERSION "150304.0"  // yymmdd.build
 
 #define MAX_DEPTH	16
+#define QUATOSTOOL_XML_BUF	(64*1024)	// bytes handed to expat at a time
 #define DEG_TO_RAD (M_PI / 180.0f)
 
 #define NUM_PORTS	16
@@ -89,15 +92,6 @@ const int configIds[] = {
 	0
 };
 
-typedef struct {
-	int elementIds[MAX_DEPTH];
-	int level;
-	int validCraft;
-	int n;
-	char value[256];
-	int valueLen;
-} parseContext_t;
-
 typedef struct {
 	int validCraft;
 	char craftId[256];
@@ -129,10 +123,35 @@ typedef struct {
 	Matrix3d J;
 } quatosData_t;
 
+typedef struct {
+	int elementIds[MAX_DEPTH];
+	int level;
+	int validCraft;
+	int n;
+	char value[256];
+	int valueLen;
+	quatosData_t *q;						// craft being read
+	int sweep;								// read every craft, not just the one asked for
+	quatosData_t **crafts;
+	int numCrafts;
+} parseContext_t;
+
+// a sweep over every craft of a file, see quatosToolSweep()
+typedef struct {
+	quatosData_t **crafts;
+	int numCrafts;
+	int next;
+	pthread_mutex_t lock;
+} quatosSweep_t;
+
 quatosData_t quatosData;
 int outputPID;
 int outputMIXfile;
 int outputDebug;
+int outputFile;							// -o given
+char *outputName;						// its file name, NULL for one named after the craft
+int sweepAll;
+int sweepThreads;						// crafts calculated at a time, 0 for one per CPU
 FILE *outFP;
 
 template<typename _Matrix_Type_>
@@ -160,11 +179,11 @@ void pseudoInverse(const _Matrix_Type_ &a, _Matrix_Type_ &result, double epsilon
 	array().inverse(), 0) ).asDiagonal() * svd.matrixU().adjoint();
 }
 
-int quatosToolFindPort(int port) {
+int quatosToolFindPort(quatosData_t *q, int port) {
 	int i;
 
-	for (i = 0; i < quatosData.ports.size(); i++)
-		if (quatosData.ports(i) == port)
+	for (i = 0; i < q->ports.size(); i++)
+		if (q->ports(i) == port)
 			return i;
 
 	return -1;
@@ -204,8 +223,8 @@ const XML_Char *quatosToolFindAttr(const XML_Char **atts, const char *name) {
 	return value;
 }
 
-void parse(XML_Parser parser, char c, int isFinal) {
-	if (XML_STATUS_OK == XML_Parse(parser, &c, isFinal ^ 1, isFinal))
+void parse(XML_Parser parser, const char *buf, int len, int isFinal) {
+	if (XML_STATUS_OK == XML_Parse(parser, buf, len, isFinal))
 		return;
 
 	fprintf(stderr, "quatosTool: parsing XML failed at line %lu, pos %lu: %s\n",
@@ -217,9 +236,11 @@ void parse(XML_Parser parser, char c, int isFinal) {
 }
 
 void resetCraft(parseContext_t *context) {
-	if (!quatosData.n) {
+	quatosData_t *q = context->q;
+
+	if (!q->n) {
 		int n = 0;
-		switch (quatosData.craftType) {
+		switch (q->craftType) {
 			case CONFIG_QUAD_PLUS:
 			case CONFIG_QUAD_X:
 				n = 4;
@@ -236,97 +257,108 @@ void resetCraft(parseContext_t *context) {
 				context->validCraft = 0;
 				break;
 		}
-		quatosData.n = n;
+		q->n = n;
 	}
 
-	quatosData.ports.setZero(1, quatosData.n);
-	quatosData.propDir.setZero(1, quatosData.n);
-	quatosData.massMots.setZero(quatosData.n);
-	quatosData.massEscs.setZero(quatosData.n);
-	quatosData.massArms.setZero(quatosData.n);
-	quatosData.frameX.resize(quatosData.n);
-	quatosData.frameY.resize(quatosData.n);
+	q->ports.setZero(1, q->n);
+	q->propDir.setZero(1, q->n);
+	q->massMots.setZero(q->n);
+	q->massEscs.setZero(q->n);
+	q->massArms.setZero(q->n);
+	q->frameX.resize(q->n);
+	q->frameY.resize(q->n);
 
-	quatosData.massEsc = DEFAULT_MASS_ESC;
-	quatosData.massMot = DEFAULT_MASS_MOTOR;
-	quatosData.massArm = DEFAULT_MASS_ARM;
-	quatosData.distEsc = DEFAULT_DIST_ESC;
-	quatosData.distMot = DEFAULT_DIST_MOTOR;
+	q->massEsc = DEFAULT_MASS_ESC;
+	q->massMot = DEFAULT_MASS_MOTOR;
+	q->massArm = DEFAULT_MASS_ARM;
+	q->distEsc = DEFAULT_DIST_ESC;
+	q->distMot = DEFAULT_DIST_MOTOR;
 
-	quatosData.validCraft = 1;
+	q->validCraft = 1;
 
 }
 
 void parseCube(parseContext_t *context, const XML_Char **atts) {
+	quatosData_t *q = context->q;
 	const XML_Char *att;
 	
-	quatosData.massObjects.conservativeResize(context->n+1);
-	quatosData.objectsDim.conservativeResize(context->n+1, 3);
-	quatosData.objectsOffset.conservativeResize(context->n+1, 3);
+	q->massObjects.conservativeResize(context->n+1);
+	q->objectsDim.conservativeResize(context->n+1, 3);
+	q->objectsOffset.conservativeResize(context->n+1, 3);
 
 	att = quatosToolFindAttr(atts, "dimx");
 	if (att)
-		quatosData.objectsDim(context->n, 0) = atof(att);
+		q->objectsDim(context->n, 0) = atof(att);
 	att = quatosToolFindAttr(atts, "dimy");
 	if (att)
-		quatosData.objectsDim(context->n, 1) = atof(att);
+		q->objectsDim(context->n, 1) = atof(att);
 	att = quatosToolFindAttr(atts, "dimz");
 	if (att)
-		quatosData.objectsDim(context->n, 2) = atof(att);
+		q->objectsDim(context->n, 2) = atof(att);
 
 	att = quatosToolFindAttr(atts, "offsetx");
 	if (att)
-		quatosData.objectsOffset(context->n, 0) = atof(att);
+		q->objectsOffset(context->n, 0) = atof(att);
 	att = quatosToolFindAttr(atts, "offsety");
 	if (att)
-		quatosData.objectsOffset(context->n, 1) = atof(att);
+		q->objectsOffset(context->n, 1) = atof(att);
 	att = quatosToolFindAttr(atts, "offsetz");
 	if (att)
-		quatosData.objectsOffset(context->n, 2) = atof(att);
+		q->objectsOffset(context->n, 2) = atof(att);
 }
 
 void parsePort(parseContext_t *context, const XML_Char **atts) {
+	quatosData_t *q = context->q;
 	const XML_Char *att;
 	
 	att = quatosToolFindAttr(atts, "rotation");
 	if (!att) {
-		fprintf(stderr, "quatosTool: craft '%s' missing rotation attribute\n", quatosData.craftId);
+		fprintf(stderr, "quatosTool: craft '%s' missing rotation attribute\n", q->craftId);
 	}
 	else {
-		quatosData.propDir(0, context->n) = atoi(att);
+		q->propDir(0, context->n) = atoi(att);
 	}
 }
 
 void parseCraft(parseContext_t *context, const XML_Char **atts) {
+	quatosData_t *q;
 	const XML_Char *att;
 
 	att = quatosToolFindAttr(atts, "id");
-	if (att && (!*quatosData.craftId || !strcmp(att, quatosData.craftId))) {
-		strncpy(quatosData.craftId, att, strlen(att));
+
+	// a sweep takes every craft, each one into its own data
+	if (att && context->sweep) {
+		context->crafts = (quatosData_t **)realloc(context->crafts, (context->numCrafts + 1) * sizeof(quatosData_t *));
+		context->q = context->crafts[context->numCrafts++] = new quatosData_t();
+	}
+	q = context->q;
+
+	if (att && (!*q->craftId || !strcmp(att, q->craftId))) {
+		strncpy(q->craftId, att, sizeof(q->craftId) - 1);
 
 		att = quatosToolFindAttr(atts, "config");
 		if (!att) {
-			fprintf(stderr, "quatosTool: craft '%s' missing config type\n", quatosData.craftId);
+			fprintf(stderr, "quatosTool: craft '%s' missing config type\n", q->craftId);
 		}
 		else {
-			quatosData.craftType = quatosToolConfigTypeByName(att);
-			if (quatosData.craftType < 0) {
-				fprintf(stderr, "quatosTool: craft '%s' invalid config type '%s'\n", quatosData.craftId, att);
+			q->craftType = quatosToolConfigTypeByName(att);
+			if (q->craftType < 0) {
+				fprintf(stderr, "quatosTool: craft '%s' invalid config type '%s'\n", q->craftId, att);
 			}
 			else {
-				if (quatosData.craftType == CONFIG_CUSTOM) {
+				if (q->craftType == CONFIG_CUSTOM) {
 					att = quatosToolFindAttr(atts, "motors");
 					if (!att || !atoi(att)) {
-						fprintf(stderr, "quatosTool: craft '%s' custom type has missing/incorrect motors attribute\n", quatosData.craftId);
+						fprintf(stderr, "quatosTool: craft '%s' custom type has missing/incorrect motors attribute\n", q->craftId);
 						exit(1);
 					}
-					quatosData.n = atoi(att);
+					q->n = atoi(att);
 				}
 				att = quatosToolFindAttr(atts, "configId");
 				if (att)
-					quatosData.configId = atoi(att);
+					q->configId = atoi(att);
 				else
-					quatosData.configId = configIds[quatosData.craftType];
+					q->configId = configIds[q->craftType];
 				context->validCraft = 1;
 				resetCraft(context);
 			}
@@ -335,20 +367,21 @@ void parseCraft(parseContext_t *context, const XML_Char **atts) {
 }
 
 void parseGeometryMotor(parseContext_t *context, const XML_Char **atts) {
+	quatosData_t *q = context->q;
 	const XML_Char *att;
 
 	att = quatosToolFindAttr(atts, "rotation");
 	if (!att) {
-		fprintf(stderr, "quatosTool: craft '%s' missing geometry->motor rotation attribute\n", quatosData.craftId);
+		fprintf(stderr, "quatosTool: craft '%s' missing geometry->motor rotation attribute\n", q->craftId);
 	}
 	else {
-		quatosData.propDir(0, context->n) = atoi(att);
+		q->propDir(0, context->n) = atoi(att);
 
 		att = quatosToolFindAttr(atts, "port");
 		if (!att || !atoi(att))
-			fprintf(stderr, "quatosTool: craft '%s' has missing/incorrect geometry->motor port attribute\n", quatosData.craftId);
+			fprintf(stderr, "quatosTool: craft '%s' has missing/incorrect geometry->motor port attribute\n", q->craftId);
 		else
-			quatosData.ports(0, context->n) = atoi(att);
+			q->ports(0, context->n) = atoi(att);
 	}
 }
 
@@ -410,14 +443,19 @@ void XMLCALL startElement(void *ctx, const XML_Char *name, const XML_Char **atts
 	context->valueLen = 0;
 }
 
+// element text may come in any number of pieces
 void XMLCALL parseChar(void *ctx, const XML_Char *str, int n) {
 	parseContext_t *context = (parseContext_t *)ctx;
 
-	context->value[context->valueLen++] = *str;
+	if (n > (int)sizeof(context->value) - 1 - context->valueLen)
+		n = sizeof(context->value) - 1 - context->valueLen;
+	memcpy(context->value + context->valueLen, str, n);
+	context->valueLen += n;
 }
 
 void XMLCALL endElement(void *ctx, const XML_Char *name __attribute__((__unused__)) ) {
 	parseContext_t *context = (parseContext_t *)ctx;
+	quatosData_t *q = context->q;
 
 	switch (context->elementIds[context->level]) {
 		case ELEMENT_QUATOS_CONFIGURATION:
@@ -429,7 +467,7 @@ void XMLCALL endElement(void *ctx, const XML_Char *name __attribute__((__unused_
 			break;
 		case ELEMENT_PORT:
 			if (context->validCraft) {
-				quatosData.ports(0, context->n) = atoi(context->value);
+				q->ports(0, context->n) = atoi(context->value);
 				context->n++;
 			}
 			break;
@@ -442,12 +480,12 @@ void XMLCALL endElement(void *ctx, const XML_Char *name __attribute__((__unused_
 		case ELEMENT_MOTOR:
 			if (context->validCraft) {
 				if (context->elementIds[context->level-1] == ELEMENT_MASS)
-					quatosData.massMot = atof(context->value);
+					q->massMot = atof(context->value);
 				else if (context->elementIds[context->level-1] == ELEMENT_DISTANCE)
-					quatosData.distMot = atof(context->value);
+					q->distMot = atof(context->value);
 				else if (context->elementIds[context->level-1] == ELEMENT_GEOMETRY) {
-					quatosData.frameX(context->n) = atof(std::strtok(context->value, ","));
-					quatosData.frameY(context->n) = atof(std::strtok(NULL, ","));
+					q->frameX(context->n) = atof(std::strtok(context->value, ","));
+					q->frameY(context->n) = atof(std::strtok(NULL, ","));
 					context->n++;
 				}
 			}
@@ -455,20 +493,20 @@ void XMLCALL endElement(void *ctx, const XML_Char *name __attribute__((__unused_
 		case ELEMENT_ARM:
 			if (context->validCraft) {
 				if (context->elementIds[context->level-1] == ELEMENT_MASS)
-					quatosData.massArm = atof(context->value);
+					q->massArm = atof(context->value);
 			}
 			break;
 		case ELEMENT_ESC:
 			if (context->validCraft) {
 				if (context->elementIds[context->level-1] == ELEMENT_MASS)
-					quatosData.massEsc = atof(context->value);
+					q->massEsc = atof(context->value);
 				else if (context->elementIds[context->level-1] == ELEMENT_DISTANCE)
-					quatosData.distEsc = atof(context->value);
+					q->distEsc = atof(context->value);
 			}
 			break;
 		case ELEMENT_CUBE:
 			if (context->validCraft) {
-				quatosData.massObjects(context->n) = atof(context->value);
+				q->massObjects(context->n) = atof(context->value);
 				context->n++;
 			}
 			break;
@@ -481,15 +519,17 @@ void quatosToolUsage(void) {
 	fprintf(stderr, "\nUsage:\n");
 	fprintf(stderr, "quatosTool [-h | --help] [-d | --debug] [-v | --version] [-c | --craft-id <craft_id>]\n");
 	fprintf(stderr, "           [-p | --pid]  [-m | --mix]   [-o | --output <output_file>]\n");
+	fprintf(stderr, "           [-a | --all]  [-j | --threads <num>]\n");
 	fprintf(stderr, "           <xml_file>\n\n");
 	fprintf(stderr, "   Default usage produces C-style #define code for inclusion or loading directly to AQ.\n");
 	fprintf(stderr, "   Using -m (.mix file) produces an INI-format file for use with QGC motor mix configurator.\n");
-	fprintf(stderr, "   Using -o without an argument will create an output file named <craft_id>.\n\n");
+	fprintf(stderr, "   Using -o without an argument will create an output file named <craft_id>.\n");
+	fprintf(stderr, "   Using -a reads every craft of the file in one go and calculates --threads of them at a time\n");
+	fprintf(stderr, "   (default one per CPU); with -o and no argument each craft goes to a file of its own.\n\n");
 }
 
 unsigned int quatosToolOptions(int argc, char **argv) {
 	int ch;
-	char fname[256]; // output file name
 
 	/* options descriptor */
 	static struct option longopts[] = {
@@ -500,13 +540,15 @@ unsigned int quatosToolOptions(int argc, char **argv) {
 			{ "mix",		no_argument,		NULL,	'm' },
 			{ "debug",		no_argument,		NULL,	'd' },
 			{ "version",	no_argument,		NULL,	'v' },
+			{ "all",		no_argument,		NULL,	'a' },
+			{ "threads",	required_argument,	NULL,	'j' },
 			{ NULL,			0,					NULL,	0 }
 	};
 
 	outFP = stdout;
 	outputDebug = 0;
 
-	while ((ch = getopt_long(argc, argv, "hpmdvo::c:", longopts, NULL)) != -1)
+	while ((ch = getopt_long(argc, argv, "hpmdvo::c:aj:", longopts, NULL)) != -1)
 		switch (ch) {
 		case 'h':
 			quatosToolUsage();
@@ -520,24 +562,15 @@ unsigned int quatosToolOptions(int argc, char **argv) {
 			//outputPID = 1;
 			break;
 		case 'o':
-			if (optarg == NULL && quatosData.craftId) {
-				strncpy(fname, quatosData.craftId, sizeof(fname));
-				if (outputMIXfile)
-					strcat(fname, ".mix");
-				else
-					strcat(fname, ".param");
-			} else if (optarg != NULL)
-				strcpy(fname, optarg);
-			else {
-				fprintf(stderr, "quatosTool: cannot determine output file name\n");
-				exit(0);
-			}
-
-			outFP = fopen(fname, "w");
-			if (outFP == NULL) {
-				fprintf(stderr, "quatosTool: cannot open output file '%s'\n", optarg);
-				exit(0);
-			}
+			// opened once the craft id is known, see quatosToolOpenOutput()
+			outputFile = 1;
+			outputName = optarg;
+			break;
+		case 'a':
+			sweepAll = 1;
+			break;
+		case 'j':
+			sweepThreads = atoi(optarg);
 			break;
 		case 'c':
 			strncpy(quatosData.craftId, optarg, sizeof(quatosData.craftId));
@@ -556,10 +589,13 @@ unsigned int quatosToolOptions(int argc, char **argv) {
 	return 1;
 }
 
-int quatosToolReadXML(FILE *fp) {
+// Read craft q from the XML file, or with crafts set every craft of it.  Returns the number of
+// crafts read into *crafts, -1 on failure.
+int quatosToolReadXML(FILE *fp, quatosData_t *q, quatosData_t ***crafts) {
 	XML_Parser parser;
 	parseContext_t context;
-	char c;
+	char buf[QUATOSTOOL_XML_BUF];
+	size_t n;
 
 	if (!(parser = XML_ParserCreate(NULL))) {
 		fprintf(stderr, "quatosTool: cannot create XML parser, aborting\n");
@@ -567,20 +603,26 @@ int quatosToolReadXML(FILE *fp) {
 	}
 
 	memset(&context, 0, sizeof(parseContext_t));
+	context.q = q;
+	context.sweep = crafts != NULL;
 	XML_SetUserData(parser, &context);
 
 	XML_SetStartElementHandler(parser, &startElement);
 	XML_SetDefaultHandler(parser, &parseChar);
 	XML_SetEndElementHandler(parser, &endElement);
 
-	while ((c = fgetc(fp)) != EOF)
-		parse(parser, c, 0);
-
-	parse(parser, c, 1);
+	// expat takes the file a block at a time, the last one marked final
+	do {
+		n = fread(buf, 1, sizeof(buf), fp);
+		parse(parser, buf, n, n < sizeof(buf));
+	} while (n == sizeof(buf));
 
 	XML_ParserFree(parser);
 
-	return 0;
+	if (crafts)
+		*crafts = context.crafts;
+
+	return context.numCrafts;
 }
 
 typedef struct {
@@ -601,7 +643,7 @@ void quatosToolJCalc(Matrix3d &J, double mass, double x, double y, double z) {
 }
 
 // only cuboid so far
-void quatosToolShapeCalc(Matrix3d &J, object_t *obj) {
+void quatosToolShapeCalc(quatosData_t *q, Matrix3d &J, object_t *obj) {
 	double sign[3];
 	double mass;
 	int x, y, z;
@@ -623,12 +665,12 @@ void quatosToolShapeCalc(Matrix3d &J, object_t *obj) {
 		for (j = 0; j < y; j++)
 			for (k = 0; k < z; k++)
 				quatosToolJCalc(J, mass,
-					obj->x - quatosData.offsetCG(0) - (obj->dimX/2.0 + (double)i/1000.0) * sign[0],
-					obj->y - quatosData.offsetCG(1) - (obj->dimY/2.0 + (double)j/1000.0) * sign[1],
-					obj->z - quatosData.offsetCG(2) - (obj->dimZ/2.0 + (double)k/1000.0) * sign[2]);
+					obj->x - q->offsetCG(0) - (obj->dimX/2.0 + (double)i/1000.0) * sign[0],
+					obj->y - q->offsetCG(1) - (obj->dimY/2.0 + (double)j/1000.0) * sign[1],
+					obj->z - q->offsetCG(2) - (obj->dimZ/2.0 + (double)k/1000.0) * sign[2]);
 }
 
-void quatosToolObjCalc() {
+void quatosToolObjCalc(quatosData_t *q) {
 	object_t objs[256];
 	int o;
 	int i;
@@ -636,230 +678,244 @@ void quatosToolObjCalc() {
 	memset(objs, 0, sizeof(objs));
 
 	o = 0;
-	for (i = 0; i < quatosData.n; i++) {
+	for (i = 0; i < q->n; i++) {
 		// Motor
-		objs[o].mass = quatosData.massMot;
-		objs[o].x = quatosData.frameX(i);
-		objs[o].y = quatosData.frameY(i);
-		if (quatosData.craftType != CONFIG_CUSTOM) {
-			objs[o].x *= quatosData.distMot;
-			objs[o].y *= quatosData.distMot;
+		objs[o].mass = q->massMot;
+		objs[o].x = q->frameX(i);
+		objs[o].y = q->frameY(i);
+		if (q->craftType != CONFIG_CUSTOM) {
+			objs[o].x *= q->distMot;
+			objs[o].y *= q->distMot;
 		}
 		objs[o].z = 0.0;
 		o++;
 
 		// ESC
-		objs[o].mass = quatosData.massEsc;
-		if (quatosData.craftType != CONFIG_CUSTOM) {
-			objs[o].x = quatosData.frameX(i) * quatosData.distEsc;
-			objs[o].y = quatosData.frameY(i) * quatosData.distEsc;
+		objs[o].mass = q->massEsc;
+		if (q->craftType != CONFIG_CUSTOM) {
+			objs[o].x = q->frameX(i) * q->distEsc;
+			objs[o].y = q->frameY(i) * q->distEsc;
 			objs[o].z = 0.0;
 		}
 		else {
-			double norm = sqrt(quatosData.frameX(i)*quatosData.frameX(i) + quatosData.frameY(i)*quatosData.frameY(i));
+			double norm = sqrt(q->frameX(i)*q->frameX(i) + q->frameY(i)*q->frameY(i));
 
-			objs[o].x = quatosData.frameX(i) / norm * quatosData.distEsc;
-			objs[o].y = quatosData.frameY(i) / norm * quatosData.distEsc;
+			objs[o].x = q->frameX(i) / norm * q->distEsc;
+			objs[o].y = q->frameY(i) / norm * q->distEsc;
 			objs[o].z = 0.0;
 		}
 		o++;
 
 		// ARM
-		objs[o].mass = quatosData.massArm;
-		objs[o].x = quatosData.frameX(i) / 2.0;
-		objs[o].y = quatosData.frameY(i) / 2.0;
-		if (quatosData.craftType != CONFIG_CUSTOM) {
-			objs[o].x *= quatosData.distMot;
-			objs[o].y *= quatosData.distMot;
+		objs[o].mass = q->massArm;
+		objs[o].x = q->frameX(i) / 2.0;
+		objs[o].y = q->frameY(i) / 2.0;
+		if (q->craftType != CONFIG_CUSTOM) {
+			objs[o].x *= q->distMot;
+			objs[o].y *= q->distMot;
 		}
 		objs[o].z = 0.0;
 		o++;
 	}
 
-	for (i = 0; i < quatosData.massObjects.size(); i++) {
-		objs[o].mass = quatosData.massObjects(i);
-		objs[o].x = quatosData.objectsOffset(i, 0);
-		objs[o].y = quatosData.objectsOffset(i, 1);
-		objs[o].z = quatosData.objectsOffset(i, 2);
+	for (i = 0; i < q->massObjects.size(); i++) {
+		objs[o].mass = q->massObjects(i);
+		objs[o].x = q->objectsOffset(i, 0);
+		objs[o].y = q->objectsOffset(i, 1);
+		objs[o].z = q->objectsOffset(i, 2);
 
-		objs[o].dimX = quatosData.objectsDim(i, 0);
-		objs[o].dimY = quatosData.objectsDim(i, 1);
-		objs[o].dimZ = quatosData.objectsDim(i, 2);
+		objs[o].dimX = q->objectsDim(i, 0);
+		objs[o].dimY = q->objectsDim(i, 1);
+		objs[o].dimZ = q->objectsDim(i, 2);
 		o++;
 	}
 
-	quatosData.totalMass = 0.0;
-	quatosData.offsetCG.setZero();
+	q->totalMass = 0.0;
+	q->offsetCG.setZero();
 	for (i = 0; i < o; i++) {
 		objs[i].mass /= 1000;			// g => Kg
-		quatosData.offsetCG(0) += objs[i].mass * objs[i].x;
-		quatosData.offsetCG(1) += objs[i].mass * objs[i].y;
-		quatosData.offsetCG(2) += objs[i].mass * objs[i].z;
+		q->offsetCG(0) += objs[i].mass * objs[i].x;
+		q->offsetCG(1) += objs[i].mass * objs[i].y;
+		q->offsetCG(2) += objs[i].mass * objs[i].z;
 
-		quatosData.totalMass += objs[i].mass;
+		q->totalMass += objs[i].mass;
 	}
-	quatosData.offsetCG /= quatosData.totalMass;
-	quatosData.objectsCount = o;
+	q->offsetCG /= q->totalMass;
+	q->objectsCount = o;
 
 	// calculate J matrix
-	quatosData.J.setZero();
+	q->J.setZero();
 	for (i = 0; i < o; i++) {
 		if (objs[i].dimX != 0.0 && objs[i].dimY != 0.0 && objs[i].dimZ != 0.0) {
 			//  dimensioned shapes
-			quatosToolShapeCalc(quatosData.J, &objs[i]);
+			quatosToolShapeCalc(q, q->J, &objs[i]);
 		}
 		else {
 			// point masses
-			quatosToolJCalc(quatosData.J, objs[i].mass, objs[i].x - quatosData.offsetCG(0), objs[i].y - quatosData.offsetCG(1), objs[i].z - quatosData.offsetCG(2));
+			quatosToolJCalc(q->J, objs[i].mass, objs[i].x - q->offsetCG(0), objs[i].y - q->offsetCG(1), objs[i].z - q->offsetCG(2));
 		}
 	}
 }
 
-void quatosToolCalc(void) {
+// The mixes are least-norm solutions of C H x = B, where C picks rows of H = [X; Y; propDir; 1].  So H is
+// factored just once: with H = U S V', pinv(C H) is V pinv(C U S), and C U S is only 4 columns wide.
+// The cut off for small singular values is the one pseudoInverse() would use on C H itself.
+void quatosToolMix(const JacobiSVD<MatrixXd> &svd, const MatrixXd &US, const MatrixXd &C, const MatrixXd &B, MatrixXd &result) {
+	MatrixXd A = C * US;
+	MatrixXd P;
+	double n = svd.matrixV().rows();
+
+	pseudoInverse(A, P, std::numeric_limits<double>::epsilon() * std::max<double>(C.rows(), n) / std::max(A.rows(), A.cols()));
+	result = svd.matrixV() * P * B;
+}
+
+void quatosToolCalc(quatosData_t *q) {
 //	VectorXd frameX, frameY;
-	MatrixXd A;
+	MatrixXd H, US;
+	MatrixXd C;
 	MatrixXd B;
 
-	quatosData.motorX.resize(1, quatosData.n);
-	quatosData.motorY.resize(1, quatosData.n);
+	q->motorX.resize(1, q->n);
+	q->motorY.resize(1, q->n);
 
-	//frameX.resize(quatosData.n);
-	//frameY.resize(quatosData.n);
+	//frameX.resize(q->n);
+	//frameY.resize(q->n);
 
 	// calculate x/y coordinates for each motor
-	switch (quatosData.craftType) {
+	switch (q->craftType) {
 		case CONFIG_QUAD_PLUS:
-			quatosData.frameX << 1.0, 0.0, -1.0, 0.0;
-			quatosData.frameY << 0.0, 1.0, 0.0, -1.0;
+			q->frameX << 1.0, 0.0, -1.0, 0.0;
+			q->frameY << 0.0, 1.0, 0.0, -1.0;
 			break;
 		case CONFIG_QUAD_X:
-			quatosData.frameX << sqrt(2.0)/2.0, sqrt(2.0)/2.0, -sqrt(2.0)/2.0, -sqrt(2.0)/2.0;
-			quatosData.frameY << -sqrt(2.0)/2.0, sqrt(2.0)/2.0, sqrt(2.0)/2.0, -sqrt(2.0)/2.0;
+			q->frameX << sqrt(2.0)/2.0, sqrt(2.0)/2.0, -sqrt(2.0)/2.0, -sqrt(2.0)/2.0;
+			q->frameY << -sqrt(2.0)/2.0, sqrt(2.0)/2.0, sqrt(2.0)/2.0, -sqrt(2.0)/2.0;
 			break;
 		case CONFIG_HEX_PLUS:
-			quatosData.frameX << 0.0,	sqrt(3.0)/2.0,	sqrt(3.0)/2.0,	0.0,	-sqrt(3.0)/2.0,	-sqrt(3.0)/2.0;
-			quatosData.frameY << 1.0,	0.5,		-0.5,		-1.0,	-0.5,		0.5;
-			quatosData.frameX << 1.0, 0.5, -0.5, -1, -0.5, 0.5;
-			quatosData.frameY << 0.0, sqrt(3)/2.0, sqrt(3.0)/2.0, 0.0, -sqrt(3.0)/2.0, -sqrt(3.0)/2.0;
+			q->frameX << 0.0,	sqrt(3.0)/2.0,	sqrt(3.0)/2.0,	0.0,	-sqrt(3.0)/2.0,	-sqrt(3.0)/2.0;
+			q->frameY << 1.0,	0.5,		-0.5,		-1.0,	-0.5,		0.5;
+			q->frameX << 1.0, 0.5, -0.5, -1, -0.5, 0.5;
+			q->frameY << 0.0, sqrt(3)/2.0, sqrt(3.0)/2.0, 0.0, -sqrt(3.0)/2.0, -sqrt(3.0)/2.0;
 			break;
 		case CONFIG_HEX_X:
-			quatosData.frameX << sqrt(3.0)/2.0,	sqrt(3.0)/2.0, 0.0, -sqrt(3.0)/2.0, -sqrt(3.0)/2.0,	0.0;
-			quatosData.frameY <<  -0.5,	0.5, 1.0, 0.5, -0.5, -1.0;
+			q->frameX << sqrt(3.0)/2.0,	sqrt(3.0)/2.0, 0.0, -sqrt(3.0)/2.0, -sqrt(3.0)/2.0,	0.0;
+			q->frameY <<  -0.5,	0.5, 1.0, 0.5, -0.5, -1.0;
 			break;
 		case CONFIG_OCTO_PLUS:
-			quatosData.frameY << 0,	cosf(315 *DEG_TO_RAD),	1,	cosf(45 *DEG_TO_RAD),	0,	cosf(135 *DEG_TO_RAD),	-1,	cosf(225 *DEG_TO_RAD);
-			quatosData.frameX << 1,	cosf(45 *DEG_TO_RAD),	0,	cosf(135 *DEG_TO_RAD),	-1,	cosf(225 *DEG_TO_RAD),	0,	cosf(315 *DEG_TO_RAD);
+			q->frameY << 0,	cosf(315 *DEG_TO_RAD),	1,	cosf(45 *DEG_TO_RAD),	0,	cosf(135 *DEG_TO_RAD),	-1,	cosf(225 *DEG_TO_RAD);
+			q->frameX << 1,	cosf(45 *DEG_TO_RAD),	0,	cosf(135 *DEG_TO_RAD),	-1,	cosf(225 *DEG_TO_RAD),	0,	cosf(315 *DEG_TO_RAD);
 			break;
 		case CONFIG_OCTO_X:
-			quatosData.frameY << cosf(247.5 *DEG_TO_RAD),	cosf(292.5 *DEG_TO_RAD),	cosf(337.5 *DEG_TO_RAD),	cosf(22.5 *DEG_TO_RAD),
+			q->frameY << cosf(247.5 *DEG_TO_RAD),	cosf(292.5 *DEG_TO_RAD),	cosf(337.5 *DEG_TO_RAD),	cosf(22.5 *DEG_TO_RAD),
 					     cosf(67.5 *DEG_TO_RAD),	cosf(112.5 *DEG_TO_RAD),	cosf(157.5 *DEG_TO_RAD),	cosf(202.5 *DEG_TO_RAD);
-			quatosData.frameX << cosf(337.5 *DEG_TO_RAD),	cosf(22.5 *DEG_TO_RAD),		cosf(67.5 *DEG_TO_RAD),		cosf(112.5 *DEG_TO_RAD),
+			q->frameX << cosf(337.5 *DEG_TO_RAD),	cosf(22.5 *DEG_TO_RAD),		cosf(67.5 *DEG_TO_RAD),		cosf(112.5 *DEG_TO_RAD),
 					     cosf(157.5 *DEG_TO_RAD),	cosf(202.5 *DEG_TO_RAD),	cosf(247.5 *DEG_TO_RAD),	cosf(292.5 *DEG_TO_RAD);
 			break;
 	}
 
 	// calc GG offset & J matrix
-	quatosToolObjCalc();
+	quatosToolObjCalc(q);
 
-	quatosData.motorX = quatosData.frameX.transpose();
-	quatosData.motorY = quatosData.frameY.transpose();
+	q->motorX = q->frameX.transpose();
+	q->motorY = q->frameY.transpose();
 
-	if (quatosData.craftType != CONFIG_CUSTOM) {
-		quatosData.motorX *= quatosData.distMot;
-		quatosData.motorY *= quatosData.distMot;
+	if (q->craftType != CONFIG_CUSTOM) {
+		q->motorX *= q->distMot;
+		q->motorY *= q->distMot;
 	}
 /*
-std::cout << "quatosData.motorX: " << quatosData.motorX << std::endl;
-std::cout << "quatosData.motorY: " << quatosData.motorY << std::endl;
+std::cout << "q->motorX: " << q->motorX << std::endl;
+std::cout << "q->motorY: " << q->motorY << std::endl;
 */
 
 	// adjust for CG offset
-	quatosData.motorX -= VectorXd::Ones(quatosData.n) * quatosData.offsetCG(0);
-	quatosData.motorY -= VectorXd::Ones(quatosData.n) * quatosData.offsetCG(1);
+	q->motorX -= VectorXd::Ones(q->n) * q->offsetCG(0);
+	q->motorY -= VectorXd::Ones(q->n) * q->offsetCG(1);
 
-	quatosData.propDir *= -1.0;								// our sense of rotation is counter intuitive
+	q->propDir *= -1.0;								// our sense of rotation is counter intuitive
 
-	A.resize(3, quatosData.n);
+	// H holds every row the mixes are made of
+	H.resize(4, q->n);
+	H <<	q->motorX,
+		q->motorY,
+		q->propDir,
+		MatrixXd::Ones(1, q->n);
+	JacobiSVD<MatrixXd> svd = H.jacobiSvd(ComputeThinU | ComputeThinV);
+	US = svd.matrixU() * svd.singularValues().asDiagonal();
+
+	C.resize(3, 4);
 	B.resize(3, 1);
 
 	// Roll
-	A <<	quatosData.motorX,
-		MatrixXd::Ones(1, quatosData.n),
-		-quatosData.motorY;
+	C <<	1, 0, 0, 0,		// X
+		0, 0, 0, 1,		// 1
+		0, -1, 0, 0;		// -Y
 	B <<	0,
 		0,
 		1;
 
-	pseudoInverse(A, quatosData.ROLL);
-	quatosData.ROLL *= B;
+	quatosToolMix(svd, US, C, B, q->ROLL);
 
 	// Pitch
-	A <<	-quatosData.motorY,
-		MatrixXd::Ones(1, quatosData.n),
-		quatosData.motorX;
+	C <<	0, -1, 0, 0,		// -Y
+		0, 0, 0, 1,		// 1
+		1, 0, 0, 0;		// X
 	B <<	0,
 		0,
 		1;
 
-	pseudoInverse(A, quatosData.PITCH);
-	quatosData.PITCH *= B;
+	quatosToolMix(svd, US, C, B, q->PITCH);
 
 	// Yaw
-	A <<	quatosData.motorX,
-		quatosData.motorY,
-		quatosData.propDir;
+	C <<	1, 0, 0, 0,		// X
+		0, 1, 0, 0,		// Y
+		0, 0, 1, 0;		// propDir
 	B <<	0,
 		0,
 		1;
 
-	pseudoInverse(A, quatosData.YAW);
-	quatosData.YAW *= B;
+	quatosToolMix(svd, US, C, B, q->YAW);
 
 	// Throttle
-	A.resize(4, quatosData.n);
+	C = MatrixXd::Identity(4, 4);
 	B.resize(4, 1);
 
-	A <<	quatosData.motorX,
-		quatosData.motorY,
-		quatosData.propDir,
-		MatrixXd::Ones(1, quatosData.n);
 	B <<	0,
 		0,
 		0,
-		quatosData.n;
+		q->n;
 
-	pseudoInverse(A, quatosData.THROT);
-	quatosData.THROT *= B;
+	quatosToolMix(svd, US, C, B, q->THROT);
 
 
 	// PD
-	quatosData.PD.resize(quatosData.n, 3);
-	quatosData.PD <<	quatosData.ROLL,
-			quatosData.PITCH,
-			quatosData.YAW,
+	q->PD.resize(q->n, 3);
+	q->PD <<	q->ROLL,
+			q->PITCH,
+			q->YAW,
 
 	// M
-	quatosData.M.resize(3, quatosData.n);
-	quatosData.M <<	-quatosData.motorY,
-			quatosData.motorX,
-			quatosData.propDir;
+	q->M.resize(3, q->n);
+	q->M <<	-q->motorY,
+			q->motorX,
+			q->propDir;
 
 	// Mt
-	quatosData.Mt.resize(quatosData.n, 4);
-	quatosData.Mt << quatosData.THROT, quatosData.PD * (quatosData.M*quatosData.PD).inverse();
+	q->Mt.resize(q->n, 4);
+	q->Mt << q->THROT, q->PD * (q->M*q->PD).inverse();
 
 	// PID
-	quatosData.PID.setZero(4, quatosData.n);
-	quatosData.PID <<	quatosData.Mt.col(0).transpose() / quatosData.Mt.col(0).cwiseAbs().maxCoeff(),
-			quatosData.Mt.col(1).transpose() / quatosData.Mt.col(1).cwiseAbs().maxCoeff(),
-			quatosData.Mt.col(2).transpose() / quatosData.Mt.col(2).cwiseAbs().maxCoeff(),
-			quatosData.Mt.col(3).transpose() / quatosData.Mt.col(3).cwiseAbs().maxCoeff();
-	quatosData.PID = quatosData.PID.transpose().eval() * 100.0;
+	q->PID.setZero(4, q->n);
+	q->PID <<	q->Mt.col(0).transpose() / q->Mt.col(0).cwiseAbs().maxCoeff(),
+			q->Mt.col(1).transpose() / q->Mt.col(1).cwiseAbs().maxCoeff(),
+			q->Mt.col(2).transpose() / q->Mt.col(2).cwiseAbs().maxCoeff(),
+			q->Mt.col(3).transpose() / q->Mt.col(3).cwiseAbs().maxCoeff();
+	q->PID = q->PID.transpose().eval() * 100.0;
 
 }
 
 template<typename _Matrix_Type_>
-void quatosToolMatrixOutput(const char *mtrxName, _Matrix_Type_ &mtrx) {
+void quatosToolMatrixOutput(quatosData_t *q, const char *mtrxName, _Matrix_Type_ &mtrx) {
 	int i, ii, j, maxIdx;
 	float val, t, p, r, y;
 
@@ -895,7 +951,7 @@ void quatosToolMatrixOutput(const char *mtrxName, _Matrix_Type_ &mtrx) {
 			}
 			for (i = 1; i <= NUM_PORTS; i++) {
 				val = 0.0f;
-				j = quatosToolFindPort(i);
+				j = quatosToolFindPort(q, i);
 				if (j >= 0) {
 					if (maxIdx == 4) // "M" or "PID"
 						val = mtrx(j, ii);
@@ -921,7 +977,7 @@ void quatosToolMatrixOutput(const char *mtrxName, _Matrix_Type_ &mtrx) {
 			p = 0.0;
 			r = 0.0;
 			y = 0.0;
-			j = quatosToolFindPort(i);
+			j = quatosToolFindPort(q, i);
 
 			// "Mt" and "PID" matrixes
 			if (strcmp(mtrxName, "M")) {
@@ -952,101 +1008,233 @@ void quatosToolMatrixOutput(const char *mtrxName, _Matrix_Type_ &mtrx) {
 	}
 }
 
-void quatosToolDbgCraftData(void) {
-	std::cerr << "quatosData.ports: " << quatosData.ports << std::endl;
-	std::cerr << "quatosData.propDir: " << quatosData.propDir << std::endl;
-	std::cerr << "quatosData.distMot: " << quatosData.distMot << std::endl;
-	std::cerr << "quatosData.distEsc: " << quatosData.distEsc << std::endl;
-	std::cerr << "quatosData.massMot: " << quatosData.massMot << std::endl;
-	std::cerr << "quatosData.massEsc: " << quatosData.massEsc << std::endl;
-	std::cerr << "quatosData.massArm: " << quatosData.massArm << std::endl;
-	std::cerr << "quatosData.massObjects: " << quatosData.massObjects << std::endl;
-	std::cerr << "quatosData.objectsDim: " << quatosData.objectsDim << std::endl;
-	std::cerr << "quatosData.objectsOffset: " << quatosData.objectsOffset << std::endl << std::endl;
+void quatosToolDbgCraftData(quatosData_t *q) {
+	std::cerr << "q->ports: " << q->ports << std::endl;
+	std::cerr << "q->propDir: " << q->propDir << std::endl;
+	std::cerr << "q->distMot: " << q->distMot << std::endl;
+	std::cerr << "q->distEsc: " << q->distEsc << std::endl;
+	std::cerr << "q->massMot: " << q->massMot << std::endl;
+	std::cerr << "q->massEsc: " << q->massEsc << std::endl;
+	std::cerr << "q->massArm: " << q->massArm << std::endl;
+	std::cerr << "q->massObjects: " << q->massObjects << std::endl;
+	std::cerr << "q->objectsDim: " << q->objectsDim << std::endl;
+	std::cerr << "q->objectsOffset: " << q->objectsOffset << std::endl << std::endl;
 }
 
-int main(int argc, char **argv) {
-	FILE *fp;
-	int i;
-	unsigned long portOrder = 0;
+// open the output file given with -o, or one named after craft q
+int quatosToolOpenOutput(quatosData_t *q) {
+	char craftName[sizeof(q->craftId) + sizeof(".param")]; // room for any craft id and extension
+	const char *fname = outputName; // output file name
 
-	memset(&quatosData, 0, sizeof(quatosData));
-
-	if (!quatosToolOptions(argc, argv)) {
-		fprintf(stderr, "Init failed, aborting\n");
-		return 0;
+	if (fname == NULL) {
+		sprintf(craftName, "%s%s", q->craftId, outputMIXfile ? ".mix" : ".param");
+		fname = craftName;
 	}
-	argc -= optind;
-	argv += optind;
 
-	if (argc < 1) {
-		fprintf(stderr, "quatosTool: requires xml file argument, aborting\n");
-		return -1;
-	}
-	if (!(fp = fopen(argv[0], "r"))) {
-		fprintf(stderr, "quatosTool: cannot open XML file '%s', aborting\n", argv[1]);
-		return -1;
-	}
-
-	if (quatosToolReadXML(fp) < 0)
-		return -1;
-
-	if (!quatosData.validCraft) {
-		fprintf(stderr, "quatosTool: craft is not valid, aborting\n");
-		return -1;
+	outFP = fopen(fname, "w");
+	if (outFP == NULL) {
+		fprintf(stderr, "quatosTool: cannot open output file '%s'\n", fname);
+		return 0;
 	}
 
-	if (outputDebug)
-		quatosToolDbgCraftData();
+	return 1;
+}
 
-	quatosToolCalc();
+void quatosToolOutput(quatosData_t *q) {
+	int i;
+	unsigned long portOrder = 0;
 
 	if (outputMIXfile) {
 		fprintf(outFP, "[META]\n");
-		fprintf(outFP, "ConfigId=%d\n", quatosData.configId);
+		fprintf(outFP, "ConfigId=%d\n", q->configId);
 		// output port ordering hint for GCS GUI
 		fprintf(outFP, "PortOrder=");
-		for (int i=0; i < quatosData.ports.size(); ++i)
-			fprintf(outFP, "%d,", (int)quatosData.ports(i));
+		for (int i=0; i < q->ports.size(); ++i)
+			fprintf(outFP, "%d,", (int)q->ports(i));
 		fprintf(outFP, "\n");
 	}
 	fprintf(outFP, "Tool_Version=%s\n", QUATOSTOOL_VERSION);
-	fprintf(outFP, "Craft=%s\n", quatosData.craftId);
-	fprintf(outFP, "Motors=%d\n", quatosData.n);
-	fprintf(outFP, "Mass=%f Kg (%d objects)\n", quatosData.totalMass, quatosData.objectsCount);
-	fprintf(outFP, "CG_Offset=%f, %f, %f\n", quatosData.offsetCG(0), quatosData.offsetCG(1), quatosData.offsetCG(2));
+	fprintf(outFP, "Craft=%s\n", q->craftId);
+	fprintf(outFP, "Motors=%d\n", q->n);
+	fprintf(outFP, "Mass=%f Kg (%d objects)\n", q->totalMass, q->objectsCount);
+	fprintf(outFP, "CG_Offset=%f, %f, %f\n", q->offsetCG(0), q->offsetCG(1), q->offsetCG(2));
 
 	if (outputPID) {
-		quatosToolMatrixOutput("PID", quatosData.PID);
+		quatosToolMatrixOutput(q, "PID", q->PID);
 	} else {
-		quatosToolMatrixOutput("Mt", quatosData.Mt);
-		quatosToolMatrixOutput("M", quatosData.M);
-		quatosToolMatrixOutput("J", quatosData.J);
+		quatosToolMatrixOutput(q, "Mt", q->Mt);
+		quatosToolMatrixOutput(q, "M", q->M);
+		quatosToolMatrixOutput(q, "J", q->J);
 	}
 
 	// output port ordering hint for GCS GUI
 	if (!outputMIXfile) {
 		// save port order (bit mask: first 8 bits are confgId, next 4 bits is first port used, next 4 is 2nd port used, etc., up to 32 bits (6 ports plus id))
-		i = std::min((int)5, (int)quatosData.ports.size()-1);
+		i = std::min((int)5, (int)q->ports.size()-1);
 		for (; i >= 0; --i)
-			portOrder |= static_cast<unsigned long>(quatosData.ports(i)) << (8 + (4 * i)); // save 8 bits for configId
+			portOrder |= static_cast<unsigned long>(q->ports(i)) << (8 + (4 * i)); // save 8 bits for configId
 
-		portOrder |= quatosData.configId;
+		portOrder |= q->configId;
 		float val = *(float *) &portOrder;
 		fprintf(outFP, "#define DEFAULT_MOT_FRAME\t%.20g\n", val);
 
 		// if more than 6 motors, need 2nd bitmask to store the other motor positions
 		// 2nd port order (bit mask: first 4 bits is 7th port used, next 4 is 8th port used, etc., up to 32 bits (8 ports))
-		if (quatosData.ports.size() > 6) {
+		if (q->ports.size() > 6) {
 			portOrder = 0;
-			i = std::min((int)7, (int)quatosData.ports.size()-7);
+			i = std::min((int)7, (int)q->ports.size()-7);
 			for (; i >= 0; --i)
-				portOrder |= static_cast<unsigned long>(quatosData.ports(i+6)) << (4 * i);
+				portOrder |= static_cast<unsigned long>(q->ports(i+6)) << (4 * i);
 
 			val = *(float *) &portOrder;
 			fprintf(outFP, "#define DEFAULT_MOT_FRAME_H\t%.20g\n", val);
 		}
 	}
+}
+
+// worker of a sweep, calculates crafts until there are none left
+void *quatosToolSweepThread(void *arg) {
+	quatosSweep_t *w = (quatosSweep_t *)arg;
+	int n;
+
+	while (1) {
+		pthread_mutex_lock(&w->lock);
+		n = w->next++;
+		pthread_mutex_unlock(&w->lock);
+		if (n >= w->numCrafts)
+			break;
+
+		if (w->crafts[n]->validCraft)
+			quatosToolCalc(w->crafts[n]);
+	}
+
+	return NULL;
+}
+
+// Calculate every craft read from the file, sweepThreads at a time, then output them in file order.
+// Returns the number which were not valid.
+int quatosToolSweep(quatosData_t **crafts, int numCrafts) {
+	quatosSweep_t w;
+	pthread_t *threads;
+	int *running;
+	int numThreads, invalid = 0;
+	int i;
+
+	numThreads = sweepThreads > 0 ? sweepThreads : sysconf(_SC_NPROCESSORS_ONLN);
+	numThreads = std::max(1, std::min(numThreads, numCrafts));
+
+	w.crafts = crafts;
+	w.numCrafts = numCrafts;
+	w.next = 0;
+	pthread_mutex_init(&w.lock, NULL);
+
+	threads = (pthread_t *)calloc(numThreads, sizeof(pthread_t));
+	running = (int *)calloc(numThreads, sizeof(int));
+
+	for (i = 1; i < numThreads; i++)
+		running[i] = !pthread_create(&threads[i], NULL, quatosToolSweepThread, &w);
+	quatosToolSweepThread(&w);
+	for (i = 1; i < numThreads; i++)
+		if (running[i])
+			pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&w.lock);
+	free(threads);
+	free(running);
+
+	for (i = 0; i < numCrafts; i++) {
+		if (!crafts[i]->validCraft) {
+			fprintf(stderr, "quatosTool: craft '%s' is not valid, skipped\n", crafts[i]->craftId);
+			invalid++;
+			continue;
+		}
+
+		if (outputDebug)
+			quatosToolDbgCraftData(crafts[i]);
+
+		// one file per craft, or else all of them one after another
+		if (outputFile && !outputName) {
+			if (!quatosToolOpenOutput(crafts[i])) {
+				invalid++;
+				continue;
+			}
+		}
+		else if (i)
+			fprintf(outFP, "\n");
+
+		quatosToolOutput(crafts[i]);
+
+		if (outputFile && !outputName) {
+			fclose(outFP);
+			outFP = stdout;
+		}
+	}
+
+	return invalid;
+}
+
+int main(int argc, char **argv) {
+	FILE *fp;
+	quatosData_t **crafts;
+	int numCrafts, invalid;
+	int i;
+
+	memset(&quatosData, 0, sizeof(quatosData));
+
+	if (!quatosToolOptions(argc, argv)) {
+		fprintf(stderr, "Init failed, aborting\n");
+		return 0;
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1) {
+		fprintf(stderr, "quatosTool: requires xml file argument, aborting\n");
+		return -1;
+	}
+	if (!(fp = fopen(argv[0], "r"))) {
+		fprintf(stderr, "quatosTool: cannot open XML file '%s', aborting\n", argv[0]);
+		return -1;
+	}
+
+	if (sweepAll) {
+		if ((numCrafts = quatosToolReadXML(fp, NULL, &crafts)) < 0)
+			return -1;
+		fclose(fp);
+
+		if (!numCrafts) {
+			fprintf(stderr, "quatosTool: no crafts in '%s', aborting\n", argv[0]);
+			return -1;
+		}
+		if (outputFile && outputName && !quatosToolOpenOutput(NULL))
+			return -1;
+
+		invalid = quatosToolSweep(crafts, numCrafts);
+
+		for (i = 0; i < numCrafts; i++)
+			delete crafts[i];
+		free(crafts);
+
+		return invalid ? -1 : 0;
+	}
+
+	if (quatosToolReadXML(fp, &quatosData, NULL) < 0)
+		return -1;
+
+	if (!quatosData.validCraft) {
+		fprintf(stderr, "quatosTool: craft is not valid, aborting\n");
+		return -1;
+	}
+
+	if (outputFile && !quatosToolOpenOutput(&quatosData))
+		return -1;
+
+	if (outputDebug)
+		quatosToolDbgCraftData(&quatosData);
+
+	quatosToolCalc(&quatosData);
+
+	quatosToolOutput(&quatosData);
 
 	return 0;
 }
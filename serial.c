@@ -28,6 +28,8 @@
 #include <stdlib.h>
 #include <sys/select.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 
 serialStruct_t *initSerial(const char *port, unsigned int baud, char ctsRts) {
 	serialStruct_t *s;
@@ -111,8 +113,10 @@ serialStruct_t *initSerial(const char *port, unsigned int baud, char ctsRts) {
 
 void serialFree(serialStruct_t *s) {
 	if (s) {
-		if (s->fd)
+		if (s->fd) {
+			serialDrain(s);
 			close(s->fd);
+		}
 		free (s);
 	}
 }
@@ -138,46 +142,163 @@ void serialEvenParity(serialStruct_t *s) {
 	tcsetattr(s->fd, TCSANOW, &options);      
 }
 
-void serialWriteChar(serialStruct_t *s, unsigned char c) {
-	char ret;
+// milliseconds on a clock which doesn't jump
+static long long serialMillis(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-	ret = write(s->fd, &c, 1);
+// write out the buffered output, returns 0 if the port failed
+int serialDrain(serialStruct_t *s) {
+	unsigned int n = 0;
+	ssize_t ret;
+	int ok;
+
+	while (n < s->outLen) {
+		ret = write(s->fd, s->outBuf + n, s->outLen - n);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+		n += ret;
+	}
+	ok = n == s->outLen;
+	s->outLen = 0;
+
+	return ok;
 }
 
 void serialWrite(serialStruct_t *s, char *str, unsigned int len) {
-	char ret;
+	unsigned int n;
+
+	while (len) {
+		if (s->outLen == OUTPUT_BUFFER_SIZE)
+			serialDrain(s);
+
+		n = OUTPUT_BUFFER_SIZE - s->outLen;
+		if (n > len)
+			n = len;
+		memcpy(s->outBuf + s->outLen, str, n);
+		s->outLen += n;
+		str += n;
+		len -= n;
+	}
+}
 
-	ret = write(s->fd, str, len);
+void serialWriteChar(serialStruct_t *s, unsigned char c) {
+	serialWrite(s, (char *)&c, 1);
 }
 
 void serialPrint(serialStruct_t *s, char *str) {
 	serialWrite(s, str, strlen(str));
 }
 
-unsigned char serialAvailable(serialStruct_t *s) {
+// Send the buffered output, wait up to timeout ms (-1 for ever) for input and read as much of it as
+// fits in one go.  Returns the number of bytes read, 0 on timeout (or with the buffer full), -1 if
+// the port failed.
+static int serialFill(serialStruct_t *s, int timeout) {
 	fd_set fdSet;
-	struct timeval timeout;
+	struct timeval tv;
+	unsigned int pos, n;
+	int ret;
+
+	serialDrain(s);
+
+	n = INPUT_BUFFER_SIZE - (s->inHead - s->inTail);
+	if (!n)
+		return 0;
+
+	// contiguous free space
+	pos = s->inHead & (INPUT_BUFFER_SIZE - 1);
+	if (n > INPUT_BUFFER_SIZE - pos)
+		n = INPUT_BUFFER_SIZE - pos;
 
 	FD_ZERO(&fdSet);
 	FD_SET(s->fd, &fdSet);
-	memset((char *)&timeout, 0, sizeof(timeout));
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = timeout % 1000 * 1000;
+
+	ret = select(s->fd+1, &fdSet, 0, 0, timeout < 0 ? NULL : &tv);
+	if (ret <= 0)
+		return (ret < 0 && errno != EINTR) ? -1 : 0;
 
-	if (select(s->fd+1, &fdSet, 0, 0, &timeout) == 1)
-		return 1;
-	else
+	ret = read(s->fd, s->inBuf + pos, n);
+	if (ret < 0 && (errno == EINTR || errno == EAGAIN))
 		return 0;
+	if (ret <= 0)
+		return -1;
+
+	s->inHead += ret;
+
+	return ret;
+}
+
+unsigned char serialAvailable(serialStruct_t *s) {
+	return s->inHead != s->inTail || serialFill(s, 0) > 0;
+}
+
+// wait up to timeout ms (-1 for ever) for input; returns 1 once there is some, 0 on timeout, -1 if the port failed
+int serialWait(serialStruct_t *s, int timeout) {
+	long long deadline = serialMillis() + timeout;
+	int ret;
+
+	while (s->inHead == s->inTail) {
+		if ((ret = serialFill(s, timeout)) < 0)
+			return -1;
+
+		if (!ret && timeout >= 0 && (timeout = deadline - serialMillis()) <= 0)
+			return s->inHead != s->inTail;
+	}
+
+	return 1;
+}
+
+// Read len bytes, waiting no longer than timeout ms in all (-1 for ever).  Returns the number of bytes
+// read, less than len if the time ran out or the port failed.
+int serialReadLen(serialStruct_t *s, void *buf, unsigned int len, int timeout) {
+	long long deadline = serialMillis() + timeout;
+	unsigned char *p = (unsigned char *)buf;
+	unsigned int n = 0, pos, k;
+	long long ms = -1;
+
+	while (n < len) {
+		if (s->inHead == s->inTail) {
+			if (timeout >= 0 && (ms = deadline - serialMillis()) < 0)
+				ms = 0;
+			if (serialWait(s, (int)ms) <= 0)
+				break;
+		}
+
+		pos = s->inTail & (INPUT_BUFFER_SIZE - 1);
+		k = s->inHead - s->inTail;
+		if (k > INPUT_BUFFER_SIZE - pos)
+			k = INPUT_BUFFER_SIZE - pos;
+		if (k > len - n)
+			k = len - n;
+
+		memcpy(p + n, s->inBuf + pos, k);
+		s->inTail += k;
+		n += k;
+	}
+
+	return n;
 }
 
+// discard any input
 void serialFlush(serialStruct_t *s) {
-	while (serialAvailable(s))
-		serialRead(s);
+	do
+		s->inTail = s->inHead;
+	while (serialFill(s, 0) > 0);
 }
 
+// blocking read of one byte
 unsigned char serialRead(serialStruct_t *s) {
-	char ret;
-	unsigned char c;
+	unsigned char c = 0;
 
-	ret = read(s->fd, &c, 1);
+	serialReadLen(s, &c, 1, -1);
 
 	return c;
 }
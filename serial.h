@@ -19,10 +19,17 @@
 #ifndef _serial_h
 #define _serial_h
 
-#define INPUT_BUFFER_SIZE	1024
+#define INPUT_BUFFER_SIZE	1024			// must be a power of 2
+#define OUTPUT_BUFFER_SIZE	1024
 
+// Input is read in bulk into a ring buffer, output is collected and written out in one go before anything
+// is read (or by serialDrain()), so request/response exchanges need nothing more than write then read.
 typedef struct {
 	int fd;
+	unsigned char inBuf[INPUT_BUFFER_SIZE];
+	unsigned int inHead, inTail;			// free running, inHead - inTail bytes are waiting
+	unsigned char outBuf[OUTPUT_BUFFER_SIZE];
+	unsigned int outLen;
 } serialStruct_t;
 
 #ifdef __cplusplus
@@ -36,6 +43,9 @@ extern void serialPrint(serialStruct_t *s, char *str);
 extern unsigned char serialAvailable(serialStruct_t *s);
 extern void serialFlush(serialStruct_t *s);
 extern unsigned char serialRead(serialStruct_t *s);
+extern int serialWait(serialStruct_t *s, int timeout);
+extern int serialReadLen(serialStruct_t *s, void *buf, unsigned int len, int timeout);
+extern int serialDrain(serialStruct_t *s);
 extern void serialEvenParity(serialStruct_t *s);
 extern void serialNoParity(serialStruct_t *s);
 extern void serialFree(serialStruct_t *s);
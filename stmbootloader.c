@@ -20,16 +20,20 @@
 #define _GNU_SOURCE
 #endif
 
-#include "serial.h"
+#include "stmbootloader.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <sys/time.h>
 
-#define STM_RETRIES_SHORT	1000
+#define STM_RETRIES_SHORT	1000		// ms to wait for an ACK
 #define STM_RETRIES_LONG	5000
-
-unsigned char getResults[11];
+#define STM_SETTLE		100		// ms of quiet after a failed block
+#define STM_MAX_ERRORS		50		// retries before a board is given up on
+#define STM_MAX_POKES		30		// tries to find the bootloader when not asking the user
 
 unsigned char stmHexToChar(const char *hex) {
 	char hex1, hex2;
@@ -48,196 +52,510 @@ unsigned char stmHexToChar(const char *hex) {
 
 unsigned char stmWaitAck(serialStruct_t *s, int retries) {
 	unsigned char c;
-	unsigned int i;
 
-	for (i = 0; i < retries; i++) {
-		if (serialAvailable(s)) {
-			c = serialRead(s);
-			if (c == 0x79) {
-//				putchar('+'); fflush(stdout);
-				return 1;
-			}
-			if (c == 0x1f) {
-				putchar('-'); fflush(stdout);
-				return 0;
-			}
-			else {
-				printf("?%02x?", c); fflush(stdout);
-				return 0;
-			}
-		}
-		usleep(1000);
+	if (serialReadLen(s, &c, 1, retries) != 1)
+		return 0;
+
+	if (c == 0x79) {
+//		putchar('+'); fflush(stdout);
+		return 1;
+	}
+	if (c == 0x1f) {
+		putchar('-'); fflush(stdout);
+		return 0;
 	}
+	else {
+		printf("?%02x?", c); fflush(stdout);
+		return 0;
+	}
+}
 
-	return 0;
+// send a command byte and its complement
+void stmCommand(serialStruct_t *s, unsigned char cmd) {
+	unsigned char c[2];
+
+	c[0] = cmd;
+	c[1] = 0xff ^ cmd;
+	serialWrite(s, (char *)c, 2);
 }
 
 unsigned char stmWriteString(serialStruct_t *s, const char *hex) {
+	unsigned char buf[128];
 	unsigned char c;
 	unsigned char ck;
 	unsigned char i;
 
 	ck = 0;
 	i = 0;
-	while (*hex) {
+	while (*hex && i < sizeof(buf) - 1) {
 		c = stmHexToChar(hex);
-		serialWrite(s, (char *)&c, 1);
+		buf[i++] = c;
 		ck ^= c;
 		hex += 2;
-		i++;
 	}
 	if (i == 1)
 		ck = 0xff ^ c;
 
-	// send checksum
-	serialWrite(s, (char *)&ck, 1);
+	// send with checksum
+	buf[i++] = ck;
+	serialWrite(s, (char *)buf, i);
 
 	return stmWaitAck(s, STM_RETRIES_LONG);
 }
 
 int stmWriteLen(serialStruct_t *s, char *data, int len, unsigned char ck) {
-	unsigned char c;
 	int i;
 
-	for (i = 0; i < len; i++) {
-		c = data[i];
-		ck ^= c;
-		serialWrite(s, (char *)&c, 1);
-	}
+	for (i = 0; i < len; i++)
+		ck ^= data[i];
+	serialWrite(s, data, len);
 	serialWrite(s, (char *)&ck, 1);
 
 	return stmWaitAck(s, STM_RETRIES_LONG);
 }
 
-void stmSendData(serialStruct_t *s, unsigned int addr, char *buf, int len) {
+// send a 32 bit address, MSB first
+int stmWriteAddr(serialStruct_t *s, unsigned int addr) {
+	unsigned char a[4];
+
+	a[0] = addr >> 24;
+	a[1] = addr >> 16;
+	a[2] = addr >> 8;
+	a[3] = addr;
+
+	return stmWriteLen(s, (char *)a, 4, 0);
+}
+
+// print a message, prefixed by the port when there are several boards
+void stmLog(stmPort_t *p, const char *fmt, ...) {
+	char buf[256];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	if (p->name)
+		printf("%s: %s", p->name, buf);
+	else
+		printf("%s", buf);
+	fflush(stdout);
+}
+
+// count a retry, returns 0 once there have been too many
+int stmRetry(stmPort_t *p) {
+	if (++p->errors <= STM_MAX_ERRORS)
+		return 1;
+
+	stmLog(p, "Too many errors, giving up\n");
+	return 0;
+}
+
+// send a command until it is ACKed
+int stmCommandAck(stmPort_t *p, unsigned char cmd) {
+	do {
+		stmCommand(p->s, cmd);
+		if (stmWaitAck(p->s, STM_RETRIES_LONG))
+			return 1;
+	} while (stmRetry(p));
+
+	return 0;
+}
+
+int stmSendData(stmPort_t *p, unsigned int addr, char *buf, int len) {
 	unsigned char c;
 	unsigned char ck;
-	unsigned char a[4];
 
-	printf("Writing address %x for %d bytes\n", addr, len);
+	stmLog(p, "Writing address %x for %d bytes\n", addr, len);
 
 	sendRetry:
 
-	do {
-		c = getResults[5];
-		serialWrite(s, (char *)&c, 1);
-		c = 0xff ^ c;
-		serialWrite(s, (char *)&c, 1);
-	} while (!stmWaitAck(s, STM_RETRIES_LONG));
+	if (!stmCommandAck(p, p->getResults[5]))
+		return 0;
 
 	// send address
-	// reverse byte order
-	a[0] = *(((unsigned char *)&addr)+3);
-	a[1] = *(((unsigned char *)&addr)+2);
-	a[2] = *(((unsigned char *)&addr)+1);
-	a[3] = *(((unsigned char *)&addr)+0);
-	if (!stmWriteLen(s, (char *)&a, 4, 0)) {
-		printf("Address error\n");
+	if (!stmWriteAddr(p->s, addr)) {
+		stmLog(p, "Address error\n");
+		if (!stmRetry(p))
+			return 0;
 		goto sendRetry;
 	}
 
 	// send len
 	ck = 0;
 	c = len - 1;
-	serialWrite(s, (char *)&c, 1);
+	serialWrite(p->s, (char *)&c, 1);
 	ck ^= c;
 
 	// send data
-	if (!stmWriteLen(s, buf, len, ck)) {
-		printf("Data error\n");
+	if (!stmWriteLen(p->s, buf, len, ck)) {
+		stmLog(p, "Data error\n");
+		if (!stmRetry(p))
+			return 0;
 		goto sendRetry;
 	}
+
+	return 1;
 }
 
-void stmWriteBuffer(serialStruct_t *s, char *msb, char *lsb, char *len, char *data) {
-	static unsigned char buf[256];
-	static unsigned int startAddr = 0;
-	static unsigned int length = 0;
-	unsigned int newAddr;
-	int offset;
-	int n;
-	int i;
+// Write a block, each step of the command going out in a single write once the bootloader has ACKed
+// the one before (it has no room to buffer ahead).  If anything goes wrong the line is left to settle
+// and the block goes again through stmSendData().
+int stmSendBlock(stmPort_t *p, unsigned int addr, unsigned char *data, int len) {
+	unsigned char buf[STM_BLOCK_SIZE + 2];
+	unsigned char ck;
+	unsigned char c;
+	int n, i;
+
+	stmCommand(p->s, p->getResults[5]);
+	if (!stmWaitAck(p->s, STM_RETRIES_LONG))
+		goto blockError;
+
+	// address and its checksum
+	buf[0] = addr >> 24;
+	buf[1] = addr >> 16;
+	buf[2] = addr >> 8;
+	buf[3] = addr;
+	buf[4] = buf[0] ^ buf[1] ^ buf[2] ^ buf[3];
+	serialWrite(p->s, (char *)buf, 5);
+	if (!stmWaitAck(p->s, STM_RETRIES_LONG))
+		goto blockError;
+
+	// length, data and checksum
+	buf[0] = len - 1;
+	ck = buf[0];
+	n = 1;
+	for (i = 0; i < len; i++) {
+		buf[n++] = data[i];
+		ck ^= data[i];
+	}
+	buf[n++] = ck;
+	serialWrite(p->s, (char *)buf, n);
+	if (stmWaitAck(p->s, STM_RETRIES_LONG))
+		return 1;
+
+	blockError:
+
+	stmLog(p, "%sBlock error at %x\n", p->name ? "" : "\n", addr);
+	if (!stmRetry(p))
+		return 0;
+	while (serialReadLen(p->s, &c, 1, STM_SETTLE) == 1)
+		;
+	serialFlush(p->s);
+
+	return stmSendData(p, addr, (char *)data, len);
+}
+
+// read len (1-256) bytes of memory, returns 0 on failure
+int stmReadData(stmPort_t *p, unsigned int addr, unsigned char *buf, int len) {
+	unsigned char c[2];
+
+	stmCommand(p->s, p->getResults[3]);
+	if (!stmWaitAck(p->s, STM_RETRIES_LONG))
+		return 0;
+
+	if (!stmWriteAddr(p->s, addr))
+		return 0;
+
+	c[0] = len - 1;
+	c[1] = 0xff ^ c[0];
+	serialWrite(p->s, (char *)c, 2);
+	if (!stmWaitAck(p->s, STM_RETRIES_LONG))
+		return 0;
 
-	// flush if called with 0 address
-	if (msb == 0  && lsb == 0 && startAddr) {
-		stmSendData(s, startAddr, (char *)buf, length);
-		startAddr = 0;
-		length = 0;
-		return;
+	return serialReadLen(p->s, buf, len, STM_RETRIES_LONG) == len;
+}
+
+unsigned int stmCrc32(unsigned int crc, const unsigned char *buf, int len) {
+	static unsigned int table[256];
+	unsigned int c;
+	int i, j;
+
+	if (!table[1]) {
+		for (i = 0; i < 256; i++) {
+			c = i;
+			for (j = 0; j < 8; j++)
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+	}
+
+	crc = ~crc;
+	for (i = 0; i < len; i++)
+		crc = table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+double stmSeconds(void) {
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// write every region of the image in blocks of up to STM_BLOCK_SIZE bytes
+int stmFlashImage(stmPort_t *p, stmImage_t *img) {
+	stmRegion_t *r;
+	unsigned int n, i;
+	double t;
+	int j;
+
+	p->total = 0;
+	for (j = 0; j < img->numRegions; j++)
+		p->total += img->regions[j].len;
+
+	t = stmSeconds();
+	p->done = 0;
+	for (j = 0; j < img->numRegions; j++) {
+		r = &img->regions[j];
+		for (i = 0; i < r->len; i += n) {
+			n = r->len - i;
+			if (n > STM_BLOCK_SIZE)
+				n = STM_BLOCK_SIZE;
+
+			if (!stmSendBlock(p, r->addr + i, r->data + i, n))
+				return 0;
+			p->done += n;
+
+			// with several boards the caller shows progress
+			if (!p->name) {
+				printf("\rWriting %08x  %3d%%", r->addr + i, p->done * 100 / p->total); fflush(stdout);
+			}
+		}
 	}
+	p->secs = stmSeconds() - t;
+
+	stmLog(p, "%sWrote %u bytes in %d region(s), %.1fs, %.1f KB/s\n", p->name ? "" : "\n", p->total, img->numRegions, p->secs, p->secs > 0 ? p->total / p->secs / 1024 : 0.0);
+
+	return 1;
+}
 
-	n = stmHexToChar(len);
+// read the image back and compare CRCs per region, returns the number which don't match
+int stmVerifyImage(stmPort_t *p, stmImage_t *img) {
+	unsigned char buf[STM_BLOCK_SIZE];
+	stmRegion_t *r;
+	unsigned int crc, n, i;
+	int bad = 0;
+	int j;
+
+	for (j = 0; j < img->numRegions; j++) {
+		r = &img->regions[j];
+		crc = 0;
+		for (i = 0; i < r->len; i += n) {
+			n = r->len - i;
+			if (n > STM_BLOCK_SIZE)
+				n = STM_BLOCK_SIZE;
+
+			if (!stmReadData(p, r->addr + i, buf, n)) {
+				stmLog(p, "Verify: read failed at %x\n", r->addr + i);
+				return img->numRegions - j;
+			}
+			crc = stmCrc32(crc, buf, n);
+		}
 
-	newAddr = stmHexToChar(&msb[0])<<24 | stmHexToChar(&msb[2])<<16 | stmHexToChar(&lsb[0])<<8 | stmHexToChar(&lsb[2]);
+		if (crc == r->crc) {
+			stmLog(p, "Verify: %08x-%08x CRC %08x OK\n", r->addr, r->addr + r->len - 1, crc);
+		}
+		else {
+			stmLog(p, "Verify: %08x-%08x CRC %08x, expected %08x\n", r->addr, r->addr + r->len - 1, crc, r->crc);
+			bad++;
+		}
+	}
 
-	// is this new data within our current block?
-	if (newAddr != (startAddr+length) || (newAddr+n) > (startAddr+256)) {
-		// flush
-		if (startAddr)
-			stmSendData(s, startAddr, (char *)buf, length);
+	return bad;
+}
 
-		// clear buffer
-		memset(buf, 0xff, 256);
+// add data at addr to the image, extending the last region if it follows on
+static void stmImageAdd(stmImage_t *img, unsigned int addr, const unsigned char *data, unsigned int len) {
+	stmRegion_t *r = img->numRegions ? &img->regions[img->numRegions - 1] : NULL;
+
+	if (!r || addr != r->addr + r->len) {
+		img->regions = (stmRegion_t *)realloc(img->regions, (img->numRegions + 1) * sizeof(stmRegion_t));
+		r = &img->regions[img->numRegions++];
+		r->addr = addr;
+		r->seq = img->numRegions - 1;
+		r->len = r->alloc = 0;
+		r->data = NULL;
+	}
 
-		startAddr = newAddr;
-		length = 0;
+	if (r->len + len > r->alloc) {
+		r->alloc = (r->len + len) * 2;
+		r->data = (unsigned char *)realloc(r->data, r->alloc);
 	}
 
-	offset = newAddr - startAddr;
+	memcpy(r->data + r->len, data, len);
+	r->len += len;
+}
+
+// by address, regions starting at the same address in the order they were added
+static int stmRegionCompare(const void *a, const void *b) {
+	const stmRegion_t *ra = (const stmRegion_t *)a;
+	const stmRegion_t *rb = (const stmRegion_t *)b;
 
-	for (i = 0; i < n; i++)
-		buf[offset+i] = stmHexToChar(&data[i*2]);
+	if (ra->addr != rb->addr)
+		return ra->addr < rb->addr ? -1 : 1;
 
-	length = offset + n;
+	return ra->seq - rb->seq;
 }
 
-// interpret Intel Hex file
-char *stmHexLoader(serialStruct_t *s, FILE *fp) {
-	char hexByteCount[3], hexAddressLSB[5], hexRecordType[3], hexData[128];
-	char addressMSB[5];
-	static char addressJump[9];
+// sort the regions and join those which overlap or lie less than STM_MAX_GAP apart, gaps are padded with 0xff
+static void stmImageCoalesce(stmImage_t *img) {
+	stmRegion_t *r, *q;
+	unsigned int end;
+	int i, n;
+
+	qsort(img->regions, img->numRegions, sizeof(stmRegion_t), stmRegionCompare);
+
+	n = 0;
+	for (i = 0; i < img->numRegions; i++) {
+		q = &img->regions[i];
+		r = n ? &img->regions[n - 1] : NULL;
+
+		if (r && q->addr <= r->addr + r->len + STM_MAX_GAP) {
+			end = q->addr + q->len;
+			if (end > r->addr + r->len) {
+				if (end - r->addr > r->alloc) {
+					r->alloc = end - r->addr;
+					r->data = (unsigned char *)realloc(r->data, r->alloc);
+				}
+				if (q->addr > r->addr + r->len)
+					memset(r->data + r->len, 0xff, q->addr - (r->addr + r->len));
+				r->len = end - r->addr;
+			}
+			// where they overlap the region starting higher wins, or the later one at the same address
+			memcpy(r->data + (q->addr - r->addr), q->data, q->len);
+			free(q->data);
+		}
+		else {
+			img->regions[n++] = *q;
+		}
+	}
+	img->numRegions = n;
+}
 
-	memset(addressJump, 0, sizeof(addressJump));
-	memset(addressMSB, 0, sizeof(addressMSB));
+// Read a whole Intel HEX file into img, returns 0 if it is malformed
+static int stmImageHex(stmImage_t *img, FILE *fp) {
+	char line[600];
+	unsigned char rec[256 + 5];
+	unsigned int base = 0;
+	unsigned char ck;
+	int lineNum = 0;
+	int len, n, i;
+
+	while (fgets(line, sizeof(line), fp)) {
+		lineNum++;
+
+		len = strlen(line);
+		while (len && isspace((unsigned char)line[len - 1]))
+			line[--len] = 0;
+		if (!len)
+			continue;
+
+		n = (len - 1) / 2;
+		if (line[0] != ':' || !(len & 1) || n < 5 || n > (int)sizeof(rec)) {
+			printf("Bad record on line %d\n", lineNum);
+			return 0;
+		}
 
-	while (fscanf(fp, ":%2s%4s%2s%s\n", hexByteCount, hexAddressLSB, hexRecordType, hexData) != EOF) {
-		unsigned int byteCount, addressLSB, recordType;
+		ck = 0;
+		for (i = 0; i < n; i++) {
+			if (!isxdigit((unsigned char)line[1 + i*2]) || !isxdigit((unsigned char)line[2 + i*2])) {
+				printf("Bad record on line %d\n", lineNum);
+				return 0;
+			}
+			rec[i] = stmHexToChar(&line[1 + i*2]);
+			ck += rec[i];
+		}
 
-		recordType = stmHexToChar(hexRecordType);
-		hexData[stmHexToChar(hexByteCount) * 2] = 0;	// terminate at CHKSUM
+		if (rec[0] + 5 != n || ck) {
+			printf("Checksum error on line %d\n", lineNum);
+			return 0;
+		}
 
-		switch (recordType) {
+		// the address records need their data bytes
+		if (((rec[3] == 0x02 || rec[3] == 0x04) && rec[0] < 2) || (rec[3] == 0x05 && rec[0] < 4)) {
+			printf("Bad record on line %d\n", lineNum);
+			return 0;
+		}
+
+		switch (rec[3]) {
 			case 0x00:
-				stmWriteBuffer(s, addressMSB, hexAddressLSB, hexByteCount, hexData);
+				stmImageAdd(img, base + (rec[1]<<8 | rec[2]), &rec[4], rec[0]);
 				break;
 			case 0x01:
 				// EOF
-				return addressJump;
+				return 1;
+			case 0x02:
+				// segment base address
+				base = (rec[4]<<8 | rec[5]) << 4;
 				break;
 			case 0x04:
 				// MSB of destination 32 bit address
-				strncpy(addressMSB, hexData, 4);
+				base = (rec[4]<<8 | rec[5]) << 16;
 				break;
 			case 0x05:
-				// flush
-				stmWriteBuffer(s, 0, 0, 0, 0);
 				// 32 bit address to run after load
-				strncpy(addressJump, hexData, 8);
+				img->jump = rec[4]<<24 | rec[5]<<16 | rec[6]<<8 | rec[7];
+				img->hasJump = 1;
 				break;
 		}
 	}
 
-	// flush
-	stmWriteBuffer(s, 0, 0, 0, 0);
+	return 1;
+}
 
-	return 0;
+// Read a firmware file into a sparse image of coalesced regions.  Raw binaries are placed at base.
+int stmImageLoad(stmImage_t *img, FILE *fp, int binary, unsigned int base) {
+	unsigned char buf[4096];
+	size_t n;
+	int i;
+
+	memset(img, 0, sizeof(stmImage_t));
+
+	if (binary) {
+		while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+			stmImageAdd(img, base, buf, n);
+			base += n;
+		}
+	}
+	else if (!stmImageHex(img, fp)) {
+		stmImageFree(img);
+		return 0;
+	}
+
+	stmImageCoalesce(img);
+
+	for (i = 0; i < img->numRegions; i++) {
+		img->regions[i].crc = stmCrc32(0, img->regions[i].data, img->regions[i].len);
+		printf("Region %08x-%08x, %u bytes\n", img->regions[i].addr, img->regions[i].addr + img->regions[i].len - 1, img->regions[i].len);
+	}
+
+	return img->numRegions > 0;
 }
 
-void stmLoader(serialStruct_t *s, FILE *fp, unsigned char overrideParity, unsigned char cont) {
+void stmImageFree(stmImage_t *img) {
+	int i;
+
+	for (i = 0; i < img->numRegions; i++)
+		free(img->regions[i].data);
+	free(img->regions);
+	memset(img, 0, sizeof(stmImage_t));
+}
+
+// Flash one board, returns 1 if it was written (and verified).  With p->name set the user isn't asked
+// to start the bootloader, that's done for all boards together.
+int stmLoader(stmPort_t *p, stmImage_t *img, unsigned char overrideParity, unsigned char cont, unsigned char verify) {
+	serialStruct_t *s = p->s;
 	char c;
-	unsigned char b1, b2, b3;
-	unsigned char i, n;
-	char *jumpAddress;
+	char id[64];
+	unsigned char b[2];
+	unsigned int i, n;
+	int pokes;
+
+	p->result = 0;
+	p->errors = 0;
 
 	// turn on parity generation
 	if (!overrideParity)
@@ -247,68 +565,80 @@ void stmLoader(serialStruct_t *s, FILE *fp, unsigned char overrideParity, unsign
 
 	// only if not continuing previous session
 	if (!cont) {
-		printf("Place STM in bootloader mode and press any key >");
-		getchar();
-		printf("\n");
+		if (!p->name) {
+			printf("Place STM in bootloader mode and press any key >");
+			getchar();
+			printf("\n");
+		}
 
 		serialFlush(s);
 
 		// poke the MCU
+		pokes = 0;
 		do {
-			printf("p"); fflush(stdout);
+			if (!p->name) {
+				printf("p"); fflush(stdout);
+			}
+			else if (++pokes > STM_MAX_POKES) {
+				stmLog(p, "No answer from the bootloader\n");
+				return 0;
+			}
 			c = 0x7f;
 			serialWrite(s, &c, 1);
 		} while (!stmWaitAck(s, STM_RETRIES_SHORT));
-		printf("STM bootloader alive...\n");
+		stmLog(p, "STM bootloader alive...\n");
 	}
 
 	// send GET command
-	do {
-		c = 0x00;
-		serialWrite(s, &c, 1);
-		c = 0xff;
-		serialWrite(s, &c, 1);
-	} while (!stmWaitAck(s, STM_RETRIES_LONG));
+	if (!stmCommandAck(p, 0x00))
+		return 0;
 
-	b1 = serialRead(s);	// number of bytes
-	b2 = serialRead(s);	// bootloader version
-	printf("STM Bootloader version: %d.%d\n", (b2 & 0xf0) >> 4, (b2 & 0x0f));
-
-	printf("Getting %d commands.\n", b1);
-	for (i = 0; i < b1; i++)
-		getResults[i] = serialRead(s);
+	if (serialReadLen(s, b, 2, STM_RETRIES_LONG) != 2) {	// number of bytes, bootloader version
+		stmLog(p, "No reply to GET\n");
+		return 0;
+	}
+	stmLog(p, "STM Bootloader version: %d.%d\n", (b[1] & 0xf0) >> 4, (b[1] & 0x0f));
+
+	stmLog(p, "Getting %d commands.\n", b[0]);
+	memset(p->getResults, 0, sizeof(p->getResults));
+	for (i = 0; i < b[0]; i++)
+		if (serialReadLen(s, i < sizeof(p->getResults) ? &p->getResults[i] : b, 1, STM_RETRIES_LONG) != 1) {
+			stmLog(p, "No reply to GET\n");
+			return 0;
+		}
 
 	stmWaitAck(s, STM_RETRIES_LONG);
-	printf("Commands received.\n");
+	stmLog(p, "Commands received.\n");
 
 	// send GET ID command
-	printf("Getting ID\n");
-	do {
-		c = getResults[2];
-		serialWrite(s, &c, 1);
-		c = 0xff ^ c;
-		serialWrite(s, &c, 1);
-	} while (!stmWaitAck(s, STM_RETRIES_LONG));
-
-	n = serialRead(s);
-	printf("STM Device ID: 0x");
-	for (i = 0; i <= n; i++)
-		printf("%02x", serialRead(s));
+	stmLog(p, "Getting ID\n");
+	if (!stmCommandAck(p, p->getResults[2]))
+		return 0;
+
+	*id = 0;
+	n = 0;
+	for (i = 0; i <= n + 1; i++) {
+		if (serialReadLen(s, b, 1, STM_RETRIES_LONG) != 1) {
+			stmLog(p, "No reply to GET ID\n");
+			return 0;
+		}
+		if (!i)
+			n = b[0];
+		else if (i < sizeof(id) / 2)
+			sprintf(id + (i-1)*2, "%02x", b[0]);
+	}
 	stmWaitAck(s, STM_RETRIES_LONG);
-	printf("\n");
+	stmLog(p, "STM Device ID: 0x%s\n", id);
 
 /*
 	// Enable ROP
-	printf("Sending enable ROP\n");
-	c = getResults[9];
-	serialWrite(s, &c, 1);
-	c = 0xff ^ c;
-	serialWrite(s, &c, 1);
+	stmLog(p, "Sending enable ROP\n");
+	stmCommand(s, p->getResults[9]);
 
 	if (!stmWaitAck(s, STM_RETRIES_LONG))
-		printf("ROP already active\n");
+		stmLog(p, "ROP already active\n");
 	else if (!stmWaitAck(s, STM_RETRIES_LONG))
-		printf("Enable ROP failed\n");
+		stmLog(p, "Enable ROP failed\n");
 	else
 		goto top;
 */
@@ -316,20 +646,16 @@ void stmLoader(serialStruct_t *s, FILE *fp, unsigned char overrideParity, unsign
 	flash_size:
 
 	// read Flash size
-	c = getResults[3];
-	serialWrite(s, &c, 1);
-	c = 0xff ^ c;
-	serialWrite(s, &c, 1);
+	stmCommand(s, p->getResults[3]);
 
 	// if read not allowed, unprotect (which also erases)
 	if (!stmWaitAck(s, STM_RETRIES_LONG)) {
-		printf("ROP unprotect\n");
+		stmLog(p, "ROP unprotect\n");
+		if (!stmRetry(p))
+			return 0;
 
 		// unprotect command
-		c = getResults[10];
-		serialWrite(s, &c, 1);
-		c = 0xff ^ c;
-		serialWrite(s, &c, 1);
+		stmCommand(s, p->getResults[10]);
 		stmWaitAck(s, STM_RETRIES_LONG);
 
 		// wait for results
@@ -337,66 +663,73 @@ void stmLoader(serialStruct_t *s, FILE *fp, unsigned char overrideParity, unsign
 			goto top;
 	}
 
-	// send address
-	if (!stmWriteString(s, "1FFFF7E0"))
-		goto flash_size;
-
-	// send # bytes (N-1 = 1)
-	if (!stmWriteString(s, "01"))
+	// send address, then # bytes (N-1 = 1)
+	if (!stmWriteString(s, "1FFFF7E0") || !stmWriteString(s, "01") || serialReadLen(s, b, 2, STM_RETRIES_LONG) != 2) {
+		if (!stmRetry(p))
+			return 0;
 		goto flash_size;
+	}
 
-	b1 = serialRead(s);
-	b2 = serialRead(s);
-	printf("STM Flash Size: %dKB\n", b2<<8 | b1);
+	stmLog(p, "STM Flash Size: %dKB\n", b[1]<<8 | b[0]);
 
 	// erase flash
 	erase_flash:
-	printf("Global flash erase [command 0x%x]...", getResults[6]); fflush(stdout);
-	do {
-		c = getResults[6];
-		serialWrite(s, &c, 1);
-		c = 0xff ^ c;
-		serialWrite(s, &c, 1);
-	} while (!stmWaitAck(s, STM_RETRIES_LONG));
+	stmLog(p, "Global flash erase [command 0x%x]...\n", p->getResults[6]);
+	if (!stmCommandAck(p, p->getResults[6]))
+		return 0;
 
 	// global erase
-	if (getResults[6] == 0x44) {
+	if (p->getResults[6] == 0x44) {
 		// mass erase
-		if (!stmWriteString(s, "FFFF"))
+		if (!stmWriteString(s, "FFFF")) {
+			if (!stmRetry(p))
+				return 0;
 			goto erase_flash;
+		}
 	}
 	else {
-		c = 0xff;
-		serialWrite(s, &c, 1);
-		c = 0x00;
-		serialWrite(s, &c, 1);
+		// erase all pages
+		stmCommand(s, 0xff);
 
-		if (!stmWaitAck(s, STM_RETRIES_LONG))
+		if (!stmWaitAck(s, STM_RETRIES_LONG)) {
+			if (!stmRetry(p))
+				return 0;
 			goto erase_flash;
+		}
 	}
 
-	printf("Done.\n");
-	
-	// upload hex file
-	printf("Flashing device...\n");
-	jumpAddress = stmHexLoader(s, fp);
-	if (jumpAddress) {
-		printf("\nFlash complete, restarting.\n");
+	stmLog(p, "Erase done.\n");
+
+	// upload image
+	stmLog(p, "Flashing device...\n");
+	if (!stmFlashImage(p, img))
+		return 0;
+
+	if (verify && stmVerifyImage(p, img)) {
+		stmLog(p, "Verify failed, not restarting.\n");
+		return 0;
+	}
+
+	if (img->hasJump) {
+		stmLog(p, "Flash complete, restarting.\n");
 
 		go:
 		// send GO command
-		do {
-			c = getResults[4];
-			serialWrite(s, &c, 1);
-			c = 0xff ^ c;
-			serialWrite(s, &c, 1);
-		} while (!stmWaitAck(s, STM_RETRIES_LONG));
+		if (!stmCommandAck(p, p->getResults[4]))
+			return 0;
 
 		// send address
-		if (!stmWriteString(s, jumpAddress))
+		if (!stmWriteAddr(s, img->jump)) {
+			if (!stmRetry(p))
+				return 0;
 			goto go;
+		}
 	}
 	else {
-		printf("\nFlash complete.\n");
+		stmLog(p, "Flash complete.\n");
 	}
+
+	p->result = 1;
+
+	return 1;
 }
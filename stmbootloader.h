@@ -22,6 +22,39 @@
 #include <stdio.h>
 #include "serial.h"
 
-extern void stmLoader(serialStruct_t *s, FILE *fp, unsigned char overrideParity, unsigned char cont);
+#define STM_BLOCK_SIZE		256		// largest write / read memory command
+#define STM_MAX_GAP		32		// regions closer than this are written as one
+
+typedef struct {
+	unsigned int addr;
+	unsigned int len, alloc;
+	unsigned char *data;
+	unsigned int crc;			// CRC32 of data
+	int seq;				// order the region was added in
+} stmRegion_t;
+
+// firmware as address ordered, non overlapping regions
+typedef struct {
+	stmRegion_t *regions;
+	int numRegions;
+	unsigned int jump;			// start address, if hasJump
+	unsigned char hasJump;
+} stmImage_t;
+
+// one bootloader session
+typedef struct {
+	serialStruct_t *s;
+	const char *name;			// set when flashing several boards, prefixes messages
+	unsigned char getResults[11];		// command codes from GET
+	int errors;				// retries so far
+	unsigned int done, total;		// bytes written
+	double secs;				// time taken to write
+	int result;				// 1 once flashed (and verified)
+} stmPort_t;
+
+extern int stmImageLoad(stmImage_t *img, FILE *fp, int binary, unsigned int base);
+extern void stmImageFree(stmImage_t *img);
+extern double stmSeconds(void);
+extern int stmLoader(stmPort_t *p, stmImage_t *img, unsigned char overrideParity, unsigned char cont, unsigned char verify);
 
 #endif
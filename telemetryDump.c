@@ -25,6 +25,7 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <time.h>
 
 static struct telemetryFieldStruct telemetryFields[] = {
 		{"Roll Angle", FLOAT_T},
@@ -84,13 +85,23 @@ static struct telemetryFieldStruct telemetryFields[] = {
 
 #define DEFAULT_PORT            "/dev/ttyUSB0"
 #define DEFAULT_BAUD            115200
+#define DEFAULT_FLUSH           100                     // ms
+
+#define TELEMETRY_BUF_SIZE      16384
+#define TELEMETRY_OUT_SIZE      (64*1024)
 
 char port[256];
 unsigned int baud;
-unsigned char parityA, parityB;
+int flushInterval;
+
+unsigned char telemetryBuf[TELEMETRY_BUF_SIZE];
+unsigned int telemetryLen;                              // bytes in telemetryBuf
+unsigned int telemetryFrameLen;                         // 'AqT', the fields and two checksum bytes
+char telemetryOut[TELEMETRY_OUT_SIZE];
 
 void telemetryDumpUsage(void) {
-	fprintf(stderr, "usage: telemetryDump <-h> <-p device_file> <-b baud_rate>\n");
+	fprintf(stderr, "usage: telemetryDump <-h> <-p device_file> <-b baud_rate> <-f flush_ms>\n");
+	fprintf(stderr, "       -f  how often buffered output is written out, in ms (default %d, 0 for every line)\n", DEFAULT_FLUSH);
 }
 
 int telemetryDumpInit(int argc, char **argv) {
@@ -98,12 +109,14 @@ int telemetryDumpInit(int argc, char **argv) {
 
 	strncpy(port, DEFAULT_PORT, sizeof(port));
 	baud = DEFAULT_BAUD;
+	flushInterval = DEFAULT_FLUSH;
 
 	/* options descriptor */
 	static struct option longopts[] = {
 		{ "help",       required_argument,      NULL,           'h' },
 		{ "port",       required_argument,      NULL,           'p' },
 		{ "baud",       required_argument,      NULL,           's' },
+		{ "flush",      required_argument,      NULL,           'f' },
 		{ NULL,         0,                      NULL,           0 }
 		};
 
@@ -119,6 +132,9 @@ int telemetryDumpInit(int argc, char **argv) {
 		case 'b':
 			baud = atoi(optarg);
 			break;
+		case 'f':
+			flushInterval = atoi(optarg);
+			break;
 		default:
 			telemetryDumpUsage();
 			return 0;
@@ -129,6 +145,37 @@ int telemetryDumpInit(int argc, char **argv) {
 	return 1;
 }
 
+// work out where each field sits in a frame
+void telemetryDumpLayout(void) {
+	int i = 0;
+
+	telemetryFrameLen = 3;
+	while (telemetryFields[i].fieldName) {
+		telemetryFields[i].fieldOffset = telemetryFrameLen;
+		switch (telemetryFields[i].fieldType) {
+			case DOUBLE_T:
+				telemetryFrameLen += sizeof(double);
+				break;
+			case FLOAT_T:
+				telemetryFrameLen += sizeof(float);
+				break;
+			case INT_T:
+				telemetryFrameLen += sizeof(int);
+				break;
+			case SHORT_T:
+				telemetryFrameLen += sizeof(short);
+				break;
+			case CHAR_T:
+				telemetryFrameLen += sizeof(char);
+				break;
+			case NO_T:
+				break;
+		}
+		i++;
+	}
+	telemetryFrameLen += 2;
+}
+
 void telemetryDumpHeaders(void) {
 	int i = 0;
 
@@ -140,107 +187,152 @@ void telemetryDumpHeaders(void) {
 		i++;
 	}
 	printf("\n");
+	fflush(stdout);
 }
 
 void telemetryDumpFail(serialStruct_t *s) {
-	fprintf(stderr, "telemetryDump: read 1 failed with errno = %d, aborting...\n", errno);
+	fprintf(stderr, "telemetryDump: read failed with errno = %d, aborting...\n", errno);
 	serialFree(s);
 	fflush(stdout);
 	exit(1);
 }
 
-unsigned char telemetryDumpRead(serialStruct_t *s) {
-	unsigned char c;
+long long telemetryDumpMillis(void) {
+	struct timespec ts;
 
-	if (read(s->fd, &c, 1) < 1)
-		telemetryDumpFail(s);
-	
-	return c;
-}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-void telemetryDumpChecksum(unsigned char c) {
-	parityA += c;
-	parityB += parityA;
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-int telemetryDumpGetFloat(serialStruct_t *s, float *v) {
-	unsigned int p = 0;
-	unsigned char *c = (unsigned char *)v;
+// returns 0 if the frame's checksum doesn't match
+int telemetryDumpChecksum(const unsigned char *f) {
+	unsigned char parityA = 0, parityB = 0;
 	unsigned int i;
 
-	for (i = 0; i < sizeof(float); i++) {
-		*c = telemetryDumpRead(s);
-		telemetryDumpChecksum(*c++);
+	for (i = 3; i < telemetryFrameLen - 2; i++) {
+		parityA += f[i];
+		parityB += parityA;
 	}
+
+	return f[i] == parityA && f[i+1] == parityB;
 }
 
-int telemetryDumpGetInt(serialStruct_t *s, int *v) {
-	unsigned int p = 0;
-	unsigned char *c = (unsigned char *)v;
-	unsigned int i;
+// format a frame as a line of the output, returns its length
+int telemetryDumpLine(const unsigned char *f, char *out, int size) {
+	const unsigned char *p;
+	double doubleVal;
+	float floatVal;
+	int intVal;
+	short shortVal;
+	int n = 0;
+	int i = 0;
+
+	while (telemetryFields[i].fieldName && n < size) {
+		if (i) {
+			out[n++] = ',';
+			out[n++] = ' ';
+		}
+
+		p = f + telemetryFields[i].fieldOffset;
+		switch (telemetryFields[i].fieldType) {
+			case DOUBLE_T:
+				memcpy(&doubleVal, p, sizeof(doubleVal));
+				n += snprintf(out + n, size - n, "%g", doubleVal);
+				break;
+			case FLOAT_T:
+				memcpy(&floatVal, p, sizeof(floatVal));
+				n += snprintf(out + n, size - n, "%g", floatVal);
+				break;
+			case INT_T:
+				memcpy(&intVal, p, sizeof(intVal));
+				n += snprintf(out + n, size - n, "%d", intVal);
+				break;
+			case SHORT_T:
+				memcpy(&shortVal, p, sizeof(shortVal));
+				n += snprintf(out + n, size - n, "%d", shortVal);
+				break;
+			case CHAR_T:
+				n += snprintf(out + n, size - n, "%d", (signed char)*p);
+				break;
+			case NO_T:
+				break;
+		}
+		i++;
+	}
+	out[n++] = '\n';
+
+	return n;
+}
+
+// Decode every complete frame in telemetryBuf and keep what is left for the next read.  A frame with
+// a bad checksum is skipped one byte at a time, so a real frame inside it is still found.
+void telemetryDumpFrames(void) {
+	unsigned char *p = telemetryBuf;
+	unsigned char *end = telemetryBuf + telemetryLen;
+	char line[2048];
 
-	for (i = 0; i < sizeof(int); i++) {
-		*c = telemetryDumpRead(s);
-		telemetryDumpChecksum(*c++);
+	while ((p = (unsigned char *)memchr(p, 'A', end - p)) != NULL) {
+		if (end - p < 3)
+			break;
+
+		if (p[1] != 'q' || p[2] != 'T') {
+			p++;
+			continue;
+		}
+
+		if ((unsigned int)(end - p) < telemetryFrameLen)
+			break;
+
+		if (!telemetryDumpChecksum(p)) {
+			fprintf(stderr, "telemetryDump: checksum error\n");
+			p++;
+			continue;
+		}
+
+		fwrite(line, 1, telemetryDumpLine(p, line, sizeof(line) - 1), stdout);
+		p += telemetryFrameLen;
+	}
+
+	if (p == NULL)
+		telemetryLen = 0;
+	else {
+		telemetryLen = end - p;
+		memmove(telemetryBuf, p, telemetryLen);
 	}
 }
 
 void telemetryDump(serialStruct_t *s) {
-	char outputBuf[2048];
-	char buf[64];
-	unsigned char c;
-	float floatVal;
-	int intVal;
-	int i, j;
+	long long lastFlush = telemetryDumpMillis();
+	int pending = 0;
+	int timeout;
+	int ret;
+
+	setvbuf(stdout, telemetryOut, _IOFBF, sizeof(telemetryOut));
 
 	while (1) {
-		start:
-
-		// look for 'Aq' to indicate new line
-		c = telemetryDumpRead(s);
-		if (c != 'A')
-			goto start;
-
-		c = telemetryDumpRead(s);
-		if (c != 'q')
-			goto start;
-
-		parityA = parityB = 0;
-
-		c = telemetryDumpRead(s);
-		if (c == 'T') {
-			*outputBuf = 0;
-			i = 0;
-			while (telemetryFields[i].fieldName) {
-				if (i)
-					strncat(outputBuf, ", ", sizeof(outputBuf));
-
-				if (telemetryFields[i].fieldType == FLOAT_T) {
-					telemetryDumpGetFloat(s, &floatVal);
-					snprintf(buf, sizeof(buf), "%g", floatVal);
-				}
-				else if (telemetryFields[i].fieldType == INT_T) {
-					telemetryDumpGetInt(s, &intVal);
-					snprintf(buf, sizeof(buf), "%d", intVal);
-				}
-				strcat(outputBuf, buf);
-				i++;
-			}
-
-			c = telemetryDumpRead(s);
-			if (parityA != c) {
-				fprintf(stderr, "telemetryDump: checksum error\n");
-				goto start;
-			}
-
-			c = telemetryDumpRead(s);
-			if (parityB != c) {
-				fprintf(stderr, "telemetryDump: checksum error\n");
-				goto start;
-			}
-
-			printf("%s\n", outputBuf);
+		// wait no longer than the next flush is due
+		timeout = -1;
+		if (pending && (timeout = lastFlush + flushInterval - telemetryDumpMillis()) < 0)
+			timeout = 0;
+
+		if ((ret = serialWait(s, timeout)) < 0)
+			telemetryDumpFail(s);
+
+		if (ret) {
+			// a frame longer than the buffer can never be completed, so drop it
+			if (telemetryLen == sizeof(telemetryBuf))
+				telemetryLen = 0;
+
+			telemetryLen += serialReadLen(s, telemetryBuf + telemetryLen, sizeof(telemetryBuf) - telemetryLen, 0);
+			telemetryDumpFrames();
+			pending = 1;
+		}
+
+		if (pending && telemetryDumpMillis() - lastFlush >= flushInterval) {
 			fflush(stdout);
+			lastFlush = telemetryDumpMillis();
+			pending = 0;
 		}
 	}
 }
@@ -259,6 +351,7 @@ int main(int argc, char **argv) {
 		return 0;
 	}
 
+	telemetryDumpLayout();
 	telemetryDumpHeaders();
 
 	telemetryDump(s);
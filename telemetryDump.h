@@ -31,6 +31,7 @@ enum telemetryTypes {
 struct telemetryFieldStruct {
 	const char *fieldName;
 	enum telemetryTypes fieldType;
+	int fieldOffset;					// in a frame, filled in by telemetryDumpLayout()
 };
 
 #endif
@@ -0,0 +1,316 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#include "writer.h"
+#include "profiler.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+// The number formatters produce exactly what printf() does for "%.15G", "%f" and "%d".
+// Digits are found by scaling the value with an exact power of ten in long double and rounding
+// that once; when the scaled value is too close to a rounding tie to be sure which way printf()
+// would go (or the value is out of range), snprintf() is used instead.
+
+#define WRITER_DIGITS		15			// %.15G precision
+#define WRITER_DECIMALS		6			// %f precision
+
+#if LDBL_MANT_DIG >= 64
+	#define WRITER_POW10_EXACT	27		// 5^27 < 2^64
+#else
+	#define WRITER_POW10_EXACT	22		// 5^22 < 2^53
+#endif
+
+static const long double writerPow10[] = {
+	1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L,
+	1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L,
+	1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L
+};
+
+writerStruct_t *writerInit(FILE *fp, size_t size) {
+	writerStruct_t *w;
+
+	w = (writerStruct_t *)calloc(1, sizeof(writerStruct_t));
+	w->fp = fp;
+	w->size = size ? size : WRITER_BUF_SIZE;
+	w->buf = (char *)malloc(w->size);
+
+	return w;
+}
+
+void writerFree(writerStruct_t *w) {
+	if (w) {
+		writerFlush(w);
+		free(w->buf);
+		free(w);
+	}
+}
+
+void writerFlush(writerStruct_t *w) {
+	if (w->fp && w->len) {
+		profilerBegin(w->prof, PROFILER_WRITE);
+		fwrite(w->buf, 1, w->len, w->fp);
+		profilerEnd(w->prof);
+		profilerCount(w->prof, PROFILER_BYTES_OUT, w->len);
+		w->written += w->len;
+		w->len = 0;
+	}
+}
+
+// copy everything written so far to fp, a writer with its own file must be able to read it back
+void writerCopy(writerStruct_t *w, FILE *fp) {
+	size_t n;
+
+	if (w->fp) {
+		writerFlush(w);
+		rewind(w->fp);
+		while ((n = fread(w->buf, 1, w->size, w->fp)) > 0)
+			fwrite(w->buf, 1, n, fp);
+	}
+	else {
+		fwrite(w->buf, 1, w->len, fp);
+	}
+}
+
+// returns room for at least n more bytes at the end of the buffer, the caller adds what it uses to len
+char *writerReserve(writerStruct_t *w, size_t n) {
+	if (w->len + n > w->size) {
+		writerFlush(w);
+
+		if (w->len + n > w->size) {
+			w->size = (w->len + n) * 2;
+			w->buf = (char *)realloc(w->buf, w->size);
+		}
+	}
+
+	return w->buf + w->len;
+}
+
+void writerWrite(writerStruct_t *w, const char *s, size_t len) {
+	memcpy(writerReserve(w, len), s, len);
+	w->len += len;
+}
+
+void writerString(writerStruct_t *w, const char *s) {
+	writerWrite(w, s, strlen(s));
+}
+
+void writerChar(writerStruct_t *w, char c) {
+	*writerReserve(w, 1) = c;
+	w->len++;
+}
+
+void writerInt(writerStruct_t *w, int v) {
+	w->len += writerFormatInt(writerReserve(w, WRITER_NUM_SIZE), v);
+}
+
+// "%.15G"
+void writerDouble(writerStruct_t *w, double v) {
+	w->len += writerFormatDouble(writerReserve(w, WRITER_NUM_SIZE), v);
+}
+
+// "%f"
+void writerFixed(writerStruct_t *w, double v) {
+	w->len += writerFormatFixed(writerReserve(w, WRITER_FIXED_SIZE), v);
+}
+
+// unsigned decimal digits of v, returns their count
+static int writerFormatU64(char *s, uint64_t v) {
+	char tmp[24];
+	int n = 0;
+	int i;
+
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	for (i = 0; i < n; i++)
+		s[i] = tmp[n-1-i];
+
+	return n;
+}
+
+// "%d"
+int writerFormatInt(char *s, int v) {
+	int n = 0;
+
+	if (v < 0)
+		s[n++] = '-';
+	n += writerFormatU64(s + n, v < 0 ? -(uint64_t)v : (uint64_t)v);
+	s[n] = 0;
+
+	return n;
+}
+
+// round v * 10^k (v >= 0) to an integer, returns 0 if the result can't be relied on
+static int writerRound(double v, int k, long double limit, uint64_t *r) {
+	long double m, frac;
+
+	if (k < 0 || k > WRITER_POW10_EXACT)
+		return 0;
+
+	m = v * writerPow10[k];
+	if (m >= limit)
+		return 0;
+
+	*r = (uint64_t)m;
+	frac = m - (long double)*r;
+
+	// one rounding in the product, so it is off by at most m * LDBL_EPSILON / 2
+	if (fabsl(frac - 0.5L) <= m * LDBL_EPSILON + LDBL_MIN)
+		return 0;
+
+	if (frac > 0.5L)
+		(*r)++;
+
+	return 1;
+}
+
+// WRITER_DIGITS significant digits of v (finite, > 0) in r, with the decimal exponent of the first one in exp
+static int writerDigits(double v, uint64_t *r, int *exp) {
+	long double m;
+	int e, k;
+	int i;
+
+	e = (int)floor(log10(v));
+
+	// log10() can be one off near powers of ten
+	for (i = 0; i < 3; i++) {
+		k = WRITER_DIGITS-1 - e;
+		if (k < 0 || k > WRITER_POW10_EXACT)
+			return 0;
+
+		m = v * writerPow10[k];
+		if (m < writerPow10[WRITER_DIGITS-1])
+			e--;
+		else if (m >= writerPow10[WRITER_DIGITS])
+			e++;
+		else
+			break;
+	}
+	if (i == 3 || !writerRound(v, k, writerPow10[WRITER_DIGITS], r))
+		return 0;
+
+	// rounded up to an extra digit
+	if (*r == (uint64_t)writerPow10[WRITER_DIGITS]) {
+		*r /= 10;
+		e++;
+	}
+	*exp = e;
+
+	return 1;
+}
+
+// "%.15G"
+int writerFormatDouble(char *s, double v) {
+	char digits[24];
+	double a = fabs(v);
+	uint64_t r;
+	int n = 0;
+	int e, nd, i;
+
+	if (!isfinite(v))
+		return snprintf(s, WRITER_NUM_SIZE, "%.15G", v);
+
+	if (signbit(v))
+		s[n++] = '-';
+
+	// whole numbers, the most common case in logs
+	if (a < 1e15 && a == floor(a)) {
+		n += writerFormatU64(s + n, (uint64_t)a);
+		s[n] = 0;
+		return n;
+	}
+
+	if (!writerDigits(a, &r, &e))
+		return snprintf(s, WRITER_NUM_SIZE, "%.15G", v);
+
+	// drop trailing zeros
+	writerFormatU64(digits, r);
+	for (nd = WRITER_DIGITS; nd > 1 && digits[nd-1] == '0'; nd--)
+		;
+
+	if (e < -4 || e >= WRITER_DIGITS) {
+		// d.dddE+dd
+		s[n++] = digits[0];
+		if (nd > 1) {
+			s[n++] = '.';
+			for (i = 1; i < nd; i++)
+				s[n++] = digits[i];
+		}
+		s[n++] = 'E';
+		s[n++] = e < 0 ? '-' : '+';
+		if (e < 0)
+			e = -e;
+		if (e < 10)
+			s[n++] = '0';
+		n += writerFormatU64(s + n, e);
+	}
+	else if (e < 0) {
+		// 0.000ddd
+		s[n++] = '0';
+		s[n++] = '.';
+		for (i = e; i < -1; i++)
+			s[n++] = '0';
+		for (i = 0; i < nd; i++)
+			s[n++] = digits[i];
+	}
+	else {
+		// ddd.ddd
+		for (i = 0; i <= e; i++)
+			s[n++] = digits[i];
+		if (nd > e + 1) {
+			s[n++] = '.';
+			for (; i < nd; i++)
+				s[n++] = digits[i];
+		}
+	}
+	s[n] = 0;
+
+	return n;
+}
+
+// "%f"
+int writerFormatFixed(char *s, double v) {
+	uint64_t r, scale;
+	int n = 0;
+	int i;
+
+	if (!isfinite(v) || !writerRound(fabs(v), WRITER_DECIMALS, 1e18L, &r))
+		return snprintf(s, WRITER_FIXED_SIZE, "%f", v);
+
+	if (signbit(v))
+		s[n++] = '-';
+
+	scale = (uint64_t)writerPow10[WRITER_DECIMALS];
+	n += writerFormatU64(s + n, r / scale);
+	s[n++] = '.';
+
+	r %= scale;
+	for (i = WRITER_DECIMALS-1; i >= 0; i--) {
+		s[n+i] = '0' + r % 10;
+		r /= 10;
+	}
+	n += WRITER_DECIMALS;
+	s[n] = 0;
+
+	return n;
+}
@@ -0,0 +1,63 @@
+/*
+    This file is part of AutoQuad.
+
+    AutoQuad is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    AutoQuad is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with AutoQuad.  If not, see <http://www.gnu.org/licenses/>.
+
+    Copyright © 2011-2014  Bill Nesbitt
+*/
+
+#ifndef _writer_h
+#define _writer_h
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define WRITER_BUF_SIZE		(1<<20)		// default output buffer size
+#define WRITER_NUM_SIZE		32			// room needed by one number formatted as "%.15G" or "%d"
+#define WRITER_FIXED_SIZE	320			// room needed by one number formatted as "%f"
+
+// buffered text output, written out with one fwrite() per full buffer
+typedef struct writerStruct {
+	FILE *fp;							// file to flush to, NULL to keep everything in memory
+	char *buf;
+	size_t len;							// bytes in buf
+	size_t size;						// allocated size of buf
+	size_t written;						// bytes already flushed to fp
+	struct profiler *prof;				// times the flushes, NULL for none
+} writerStruct_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern writerStruct_t *writerInit(FILE *fp, size_t size);
+extern void writerFree(writerStruct_t *w);
+extern void writerFlush(writerStruct_t *w);
+extern void writerCopy(writerStruct_t *w, FILE *fp);
+extern char *writerReserve(writerStruct_t *w, size_t n);
+extern void writerWrite(writerStruct_t *w, const char *s, size_t len);
+extern void writerString(writerStruct_t *w, const char *s);
+extern void writerChar(writerStruct_t *w, char c);
+extern void writerInt(writerStruct_t *w, int v);
+extern void writerDouble(writerStruct_t *w, double v);
+extern void writerFixed(writerStruct_t *w, double v);
+
+extern int writerFormatInt(char *s, int v);
+extern int writerFormatDouble(char *s, double v);
+extern int writerFormatFixed(char *s, double v);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif